@@ -0,0 +1,288 @@
+#pragma once
+
+/*
+    ###################################################################################
+    BenchmarkBaseline.h
+    Basic header-only storage of benchmark baseline values.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+/**
+* Named benchmark results saved into a text file, so later runs can be compared against them.
+*
+* Values are costs, i.e. lower is better (e.g. nanoseconds per operation).
+* A value regresses if it exceeds its baseline value by more than the tolerance ratio, e.g. with tolerance 0.25 a
+* measured value of 126 regresses against a baseline value of 100, unless the difference is within setMinDelta().
+*
+* File format is 1 entry per line: name, then value, separated by whitespace. Names cannot contain whitespace.
+* Empty lines and lines beginning with '#' are ignored, except "#reference <score>" storing the reference score, see
+* setReferenceScore().
+*/
+class BenchmarkBaseline
+{
+public:
+
+    enum class Result
+    {
+        New,        /**< There is no baseline value for the name yet. */
+        Ok,         /**< The value is within tolerance. */
+        Improved,   /**< The value is below the baseline value by more than the tolerance. */
+        Regressed   /**< The value is above the baseline value by more than the tolerance. */
+    };
+
+    static const char* getResultString(const Result& result)
+    {
+        switch (result)
+        {
+        case Result::New: return "NEW";
+        case Result::Ok: return "OK";
+        case Result::Improved: return "IMPROVED";
+        case Result::Regressed: return "REGRESSED";
+        default: return "";
+        }
+    }
+
+    /**
+    * @param filename  Path of the baseline file. Nothing is read until load() is invoked.
+    * @param tolerance Allowed relative deviation from the baseline values, must be non-negative.
+    */
+    BenchmarkBaseline(const std::string& filename, double tolerance = 0.25) :
+        m_sFilename(filename)
+    {
+        if (filename.empty())
+        {
+            throw std::runtime_error("BenchmarkBaseline ctor: filename cannot be empty!");
+        }
+        setTolerance(tolerance);
+    }
+
+    BenchmarkBaseline(const BenchmarkBaseline&) = default;
+    BenchmarkBaseline& operator=(const BenchmarkBaseline&) = default;
+    BenchmarkBaseline(BenchmarkBaseline&&) = default;
+    BenchmarkBaseline& operator=(BenchmarkBaseline&&) = default;
+
+    const std::string& getFilename() const
+    {
+        return m_sFilename;
+    }
+
+    double getTolerance() const
+    {
+        return m_tolerance;
+    }
+
+    void setTolerance(double tolerance)
+    {
+        if (!(tolerance >= 0.0))
+        {
+            throw std::runtime_error("BenchmarkBaseline::setTolerance(): tolerance must be non-negative!");
+        }
+        m_tolerance = tolerance;
+    }
+
+    double getMinDelta() const
+    {
+        return m_minDelta;
+    }
+
+    /**
+    * @param minDelta Deviations from the baseline value not larger than this absolute amount are within tolerance,
+    *                 so values close to the measurement resolution (e.g. 1 ns) don't flap. Must be non-negative.
+    */
+    void setMinDelta(double minDelta)
+    {
+        if (!(minDelta >= 0.0))
+        {
+            throw std::runtime_error("BenchmarkBaseline::setMinDelta(): minDelta must be non-negative!");
+        }
+        m_minDelta = minDelta;
+    }
+
+    /**
+    * Replaces the current values with the values read from the file.
+    * Throws std::runtime_error if the file exists but contains invalid line.
+    *
+    * @return False if the file does not exist or cannot be opened (values are cleared in this case too), true otherwise.
+    */
+    bool load()
+    {
+        m_values.clear();
+        m_referenceScore = 0.0;
+
+        std::ifstream f(m_sFilename);
+        if (!f)
+        {
+            return false;
+        }
+
+        std::string sLine;
+        int nLine = 0;
+        while (std::getline(f, sLine))
+        {
+            ++nLine;
+            std::istringstream ssLine(sLine);
+            std::string sName;
+            if (!(ssLine >> sName))
+            {
+                continue;
+            }
+            if (sName == "#reference")
+            {
+                if (!(ssLine >> m_referenceScore) || !(m_referenceScore >= 0.0))
+                {
+                    throw std::runtime_error(
+                        "BenchmarkBaseline::load(): invalid reference score in " + m_sFilename + " line " + std::to_string(nLine));
+                }
+                continue;
+            }
+            if (sName[0] == '#')
+            {
+                continue;
+            }
+
+            double value;
+            if (!(ssLine >> value))
+            {
+                throw std::runtime_error(
+                    "BenchmarkBaseline::load(): invalid value in " + m_sFilename + " line " + std::to_string(nLine));
+            }
+            m_values[sName] = value;
+        }
+        return true;
+    }
+
+    /**
+    * Writes all current values to the file, overwriting it.
+    * Throws std::runtime_error if the file cannot be written.
+    */
+    void save() const
+    {
+        std::ofstream f(m_sFilename, std::ios::trunc);
+        if (!f)
+        {
+            throw std::runtime_error("BenchmarkBaseline::save(): failed to open " + m_sFilename + " for writing!");
+        }
+
+        f << "# 455-355-7357-88 benchmark baseline: <name> <value>, lower value is better" << std::endl;
+        f.precision(10);
+        if (m_referenceScore > 0.0)
+        {
+            f << "#reference " << m_referenceScore << std::endl;
+        }
+        for (const auto& entry : m_values)
+        {
+            f << entry.first << " " << entry.second << std::endl;
+        }
+        if (!f)
+        {
+            throw std::runtime_error("BenchmarkBaseline::save(): failed to write " + m_sFilename);
+        }
+    }
+
+    bool contains(const std::string& name) const
+    {
+        return m_values.find(name) != m_values.end();
+    }
+
+    /**
+    * @return The baseline value of the given name, or 0 if there is no such value.
+    */
+    double get(const std::string& name) const
+    {
+        const auto it = m_values.find(name);
+        return it == m_values.end() ? 0.0 : it->second;
+    }
+
+    /**
+    * Sets the baseline value of the given name. Changes are not written to the file until save() is invoked.
+    */
+    void set(const std::string& name, double value)
+    {
+        if (name.empty() || (name.find_first_of(" \t\r\n") != std::string::npos) || (name[0] == '#'))
+        {
+            throw std::runtime_error("BenchmarkBaseline::set(): invalid name: \"" + name + "\"");
+        }
+        m_values[name] = value;
+    }
+
+    /**
+    * @return Reference workload score of the machine the values were measured on, 0 if unknown, see ReferenceWorkload.
+    */
+    double getReferenceScore() const
+    {
+        return m_referenceScore;
+    }
+
+    /**
+    * Sets the reference workload score of the machine the values were measured on, see ReferenceWorkload::getScore().
+    * Changes are not written to the file until save() is invoked.
+    */
+    void setReferenceScore(double referenceScore)
+    {
+        if (!(referenceScore >= 0.0))
+        {
+            throw std::runtime_error("BenchmarkBaseline::setReferenceScore(): score must be non-negative!");
+        }
+        m_referenceScore = referenceScore;
+    }
+
+    /**
+    * Scales a value measured on a machine with the given reference workload score to the machine of the baseline,
+    * so values measured on different machines can be compared to, and stored into, the same baseline.
+    *
+    * @return The scaled value, or the value unchanged if either reference score is unknown.
+    */
+    double normalize(double value, double referenceScore) const
+    {
+        return ((m_referenceScore > 0.0) && (referenceScore > 0.0)) ? value * m_referenceScore / referenceScore : value;
+    }
+
+    /**
+    * Compares the given value to the baseline value of the given name, according to the tolerance.
+    * Use normalize() first if the value may have been measured on a different machine than the baseline.
+    */
+    Result compare(const std::string& name, double value) const
+    {
+        const auto it = m_values.find(name);
+        if (it == m_values.end())
+        {
+            return Result::New;
+        }
+        if (std::abs(value - it->second) <= m_minDelta)
+        {
+            return Result::Ok;
+        }
+        if (value > it->second * (1.0 + m_tolerance))
+        {
+            return Result::Regressed;
+        }
+        if (value < it->second * (1.0 - m_tolerance))
+        {
+            return Result::Improved;
+        }
+        return Result::Ok;
+    }
+
+    const std::map<std::string, double>& getValues() const
+    {
+        return m_values;
+    }
+
+private:
+
+    std::string m_sFilename;
+    double m_tolerance = 0.25;
+    double m_minDelta = 0.0;                   /**< See setMinDelta(). */
+    double m_referenceScore = 0.0;             /**< See setReferenceScore(). */
+    std::map<std::string, double> m_values;    /**< Ordered, so the saved file is stable and diff-friendly. */
+};
@@ -0,0 +1,233 @@
+#pragma once
+
+/*
+    ###################################################################################
+    BenchmarkLabels.h
+    Basic header-only key/value label set of ScopeBenchmarker series.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <array>
+#include <cstddef>   // size_t
+#include <cstring>   // memcpy, strcmp, strlen
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "NameTable.h"
+
+/**
+* Small set of key/value labels describing the dimensions of a measurement, e.g. map=dust, players=16, so the same
+* scope measured with different parameters is stored as separate series of the same benchmarker name, and the series
+* can be aggregated by any of the labels, see ScopeBenchmarkerDataStore::aggregateByLabels().
+*
+* Keys and values are stored in the label set itself, so building a label set neither allocates nor takes a lock, and
+* only the series name built from the labels is interned into NameTable, see ScopeBenchmarkerDataStore::getSeriesHandle().
+* Labels are kept ordered by key, so the same labels given in different order describe the same series.
+*
+* Example:
+*
+*     ScopeBenchmarker<std::chrono::microseconds> bm("tick", BenchmarkLabels().add("map", mapName).add("players", nPlayers));
+*
+* The series is stored with name "tick{map=dust,players=16}".
+*/
+class BenchmarkLabels
+{
+public:
+
+    static constexpr size_t MaxLabels = 4;
+    static constexpr size_t MaxKeyLength = 31;
+    static constexpr size_t MaxValueLength = 31;
+
+    /**
+    * Maximum number of characters appended by appendTo(): braces, and key, '=', value and separator of each label.
+    */
+    static constexpr size_t MaxAppendedLength = MaxLabels * (MaxKeyLength + MaxValueLength + 2) + 2;
+
+    static_assert(NameBuilder::MaxLength >= NameBuilder::MaxBaseLength + MaxAppendedLength,
+        "NameBuilder must fit a base name with any valid label set, so labels accepted by add() never fail later!");
+
+    BenchmarkLabels() = default;
+
+    BenchmarkLabels(const BenchmarkLabels&) = default;
+    BenchmarkLabels& operator=(const BenchmarkLabels&) = default;
+    BenchmarkLabels(BenchmarkLabels&&) = default;
+    BenchmarkLabels& operator=(BenchmarkLabels&&) = default;
+
+    /**
+    * Adds a label, or replaces the value of the label with the same key.
+    * Throws std::runtime_error if key or value is empty, contains any of the characters ",={}" or is longer than
+    * MaxKeyLength or MaxValueLength, or if there would be more than MaxLabels labels.
+    */
+    BenchmarkLabels& add(const char* szKey, const char* szValue)
+    {
+        const size_t nKeyLength = strlen(szKey);
+        const size_t nValueLength = strlen(szValue);
+        validate(szKey, nKeyLength, MaxKeyLength, "key");
+        validate(szValue, nValueLength, MaxValueLength, "value");
+
+        size_t iLabel = 0;
+        int nCompare = 1;
+        while ((iLabel < m_nLabels) && ((nCompare = strcmp(m_labels[iLabel].m_szKey, szKey)) < 0))
+        {
+            iLabel++;
+        }
+
+        if ((iLabel == m_nLabels) || (nCompare != 0))
+        {
+            if (m_nLabels == MaxLabels)
+            {
+                throw std::runtime_error("BenchmarkLabels::add(): more than " + std::to_string(MaxLabels) + " labels!");
+            }
+            for (size_t i = m_nLabels; i > iLabel; i--)
+            {
+                m_labels[i] = m_labels[i - 1];
+            }
+            m_nLabels++;
+            memcpy(m_labels[iLabel].m_szKey, szKey, nKeyLength + 1);
+        }
+
+        memcpy(m_labels[iLabel].m_szValue, szValue, nValueLength + 1);
+        return *this;
+    }
+
+    BenchmarkLabels& add(const char* szKey, const std::string& sValue)
+    {
+        return add(szKey, sValue.c_str());
+    }
+
+    BenchmarkLabels& add(const char* szKey, int value)
+    {
+        return addInteger(szKey, value);
+    }
+
+    BenchmarkLabels& add(const char* szKey, unsigned int value)
+    {
+        return addInteger(szKey, value);
+    }
+
+    BenchmarkLabels& add(const char* szKey, long value)
+    {
+        return addInteger(szKey, value);
+    }
+
+    BenchmarkLabels& add(const char* szKey, unsigned long value)
+    {
+        return addInteger(szKey, value);
+    }
+
+    BenchmarkLabels& add(const char* szKey, long long value)
+    {
+        return addInteger(szKey, value);
+    }
+
+    BenchmarkLabels& add(const char* szKey, unsigned long long value)
+    {
+        return addInteger(szKey, value);
+    }
+
+    size_t size() const
+    {
+        return m_nLabels;
+    }
+
+    bool empty() const
+    {
+        return m_nLabels == 0;
+    }
+
+    /**
+    * Appends the labels in series name format, e.g. "{map=dust,players=16}", nothing if there are no labels.
+    */
+    void appendTo(NameBuilder& nameBuilder) const
+    {
+        if (m_nLabels == 0)
+        {
+            return;
+        }
+        nameBuilder << '{';
+        for (size_t i = 0; i < m_nLabels; i++)
+        {
+            if (i > 0)
+            {
+                nameBuilder << ',';
+            }
+            nameBuilder << m_labels[i].m_szKey << '=' << m_labels[i].m_szValue;
+        }
+        nameBuilder << '}';
+    }
+
+    /**
+    * @return The labels as key/value pairs ordered by key, as stored in ScopeBenchmarkerDataStore::BmData::m_labels.
+    */
+    std::vector<std::pair<std::string, std::string>> toVector() const
+    {
+        std::vector<std::pair<std::string, std::string>> labels;
+        for (size_t i = 0; i < m_nLabels; i++)
+        {
+            labels.emplace_back(m_labels[i].m_szKey, m_labels[i].m_szValue);
+        }
+        return labels;
+    }
+
+    /**
+    * @return The labels in series name format, e.g. "{map=dust,players=16}", empty string if there are no labels.
+    */
+    static std::string toString(const std::vector<std::pair<std::string, std::string>>& labels)
+    {
+        if (labels.empty())
+        {
+            return std::string();
+        }
+        std::string sLabels = "{";
+        for (const auto& label : labels)
+        {
+            sLabels += (sLabels.length() > 1 ? "," : "") + label.first + "=" + label.second;
+        }
+        return sLabels + "}";
+    }
+
+private:
+
+    struct Label
+    {
+        char m_szKey[MaxKeyLength + 1];
+        char m_szValue[MaxValueLength + 1];
+    };
+
+    std::array<Label, MaxLabels> m_labels;
+    size_t m_nLabels = 0;
+
+    template <typename T>
+    BenchmarkLabels& addInteger(const char* szKey, T value)
+    {
+        NameBuilder valueBuilder;
+        valueBuilder << value;
+        return add(szKey, valueBuilder.c_str());
+    }
+
+    static void validate(const char* szText, size_t nLength, size_t nMaxLength, const char* szWhat)
+    {
+        if (nLength == 0)
+        {
+            throw std::runtime_error(std::string("BenchmarkLabels::add(): ") + szWhat + " cannot be empty!");
+        }
+        if (nLength > nMaxLength)
+        {
+            throw std::runtime_error(std::string("BenchmarkLabels::add(): ") + szWhat + " is longer than " +
+                std::to_string(nMaxLength) + " characters: " + szText);
+        }
+        for (size_t i = 0; i < nLength; i++)
+        {
+            // not strcspn() as that is much slower for such short strings
+            if ((szText[i] == ',') || (szText[i] == '=') || (szText[i] == '{') || (szText[i] == '}'))
+            {
+                throw std::runtime_error(std::string("BenchmarkLabels::add(): ") + szWhat + " cannot contain any of \",={}\": " + szText);
+            }
+        }
+    }
+};
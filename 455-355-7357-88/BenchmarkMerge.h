@@ -0,0 +1,600 @@
+#pragma once
+
+/*
+    ###################################################################################
+    BenchmarkMerge.h
+    Basic header-only export and offline merge of ScopeBenchmarker results of many processes.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>     // std::abs
+#include <cstdlib>   // atof, strtoll, strtoull
+#include <fstream>
+#include <map>
+#include <memory>    // requires cpp11
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "LatencyHistogram.h"
+#include "ReferenceWorkload.h"
+#include "ScopeBenchmarker.h"
+
+/**
+* Merges benchmarker results exported by many processes (e.g. all server instances of a cluster) into fleet-wide
+* results, keeping a per-source breakdown, and detects sources whose results differ much from the others.
+*
+* Every process exports its ScopeBenchmarkerDataStore by exportDataStore(), then the files are merged by addFile().
+* Counters are merged exactly: totals and iterations are summed, min and max are taken over the sources and histograms
+* are merged bucket by bucket, so averages and percentiles of the merged results are the same as if all iterations
+* had been measured by a single process (no averaging of averages).
+* Merged results can be written in the same format, so merging can be done in multiple levels (e.g. cluster, fleet).
+*
+* File format is 1 line per benchmarker with tab-separated fields: name (including labels), denominator of the time
+* unit, iterations, total, min, max, budget exceeded count, histogram. Histogram is "-" if there is none, otherwise
+* "<min>:<max>:<bucket index>=<count>,..." listing only the non-empty buckets of LatencyHistogram.
+* Lines beginning with "#@" are host metadata of the source, with tab-separated key and value, see setHostMetadata().
+* Other empty lines and lines beginning with '#' are ignored, so older readers ignore host metadata too.
+*
+* Command line tool: BenchmarkMerge/BenchmarkMerge.cpp.
+*/
+class BenchmarkMerge
+{
+public:
+
+    /**
+    * Minimum number of sources measuring a benchmarker needed for detecting outlier sources of the benchmarker.
+    */
+    static constexpr size_t MinSourcesForOutliers = 3;
+
+    /**
+    * A source whose average duration of a benchmarker deviates much from the average durations of the other sources.
+    */
+    struct Outlier
+    {
+        std::string m_sName;     /**< Name of the benchmarker. */
+        std::string m_sSource;
+        double m_fAverage;       /**< Average duration measured by the source. */
+        double m_fMedian;        /**< Median of the average durations measured by all sources. */
+        double m_fScore;         /**< Robust z-score of m_fAverage, positive if slower than the median. */
+    };
+
+    /**
+    * Writes all benchmarkers of ScopeBenchmarkerDataStore in the format read by addResults().
+    * Should be invoked when no scope is being measured.
+    */
+    static void writeDataStore(std::ostream& os)
+    {
+        os << "# 455-355-7357-88 benchmark results" << std::endl;
+        for (const auto& metadata : getHostMetadata())
+        {
+            os << "#@" << metadata.first << '\t' << metadata.second << std::endl;
+        }
+        for (const auto& bmData : ScopeBenchmarkerDataStore::getAllData())
+        {
+            writeBmData(os, bmData.second);
+        }
+    }
+
+    /**
+    * @return False if the file could not be written, true otherwise.
+    */
+    static bool exportDataStore(const std::string& sFilename)
+    {
+        std::ofstream f(sFilename);
+        writeDataStore(f);
+        return static_cast<bool>(f);
+    }
+
+    /**
+    * Sets a host metadata entry written by writeDataStore() into every export of this process, e.g. the results of
+    * HostCharacterization, so results of different hosts can be interpreted when merged.
+    * Not thread-safe, should be invoked before exporting.
+    * Throws std::runtime_error if the key is empty, or the key or value contains tab or newline.
+    */
+    static void setHostMetadata(const std::string& sKey, const std::string& sValue)
+    {
+        if (sKey.empty() || (sKey.find_first_of("\t\r\n") != std::string::npos) || (sValue.find_first_of("\t\r\n") != std::string::npos))
+        {
+            throw std::runtime_error("BenchmarkMerge::setHostMetadata(): invalid key or value: " + sKey);
+        }
+        getHostMetadata()[sKey] = sValue;
+    }
+
+    /**
+    * @return Host metadata of this process set by setHostMetadata(), by key.
+    */
+    static std::map<std::string, std::string>& getHostMetadata()
+    {
+        static std::map<std::string, std::string> s_hostMetadata;
+        return s_hostMetadata;
+    }
+
+    BenchmarkMerge() = default;
+
+    BenchmarkMerge(const BenchmarkMerge&) = default;
+    BenchmarkMerge& operator=(const BenchmarkMerge&) = default;
+    BenchmarkMerge(BenchmarkMerge&&) = default;
+    BenchmarkMerge& operator=(BenchmarkMerge&&) = default;
+
+    /**
+    * Merges the results of the given file.
+    * Throws std::runtime_error if the file cannot be read or has invalid content.
+    *
+    * @param sSource Name of the source in the per-source breakdown, if empty then the file name is used.
+    */
+    void addFile(const std::string& sFilename, const std::string& sSource = "")
+    {
+        std::ifstream f(sFilename);
+        if (!f)
+        {
+            throw std::runtime_error("BenchmarkMerge::addFile(): cannot open " + sFilename);
+        }
+        addResults(sSource.empty() ? sFilename : sSource, f);
+    }
+
+    /**
+    * Merges the results read from the given stream.
+    * Results of the same benchmarker added multiple times with the same source are merged also in the breakdown.
+    * Throws std::runtime_error if the content is invalid, or the same benchmarker has different time units,
+    * lines before the invalid line stay merged.
+    */
+    void addResults(const std::string& sSource, std::istream& is)
+    {
+        if (sSource.empty())
+        {
+            throw std::runtime_error("BenchmarkMerge::addResults(): source cannot be empty!");
+        }
+
+        std::string sLine;
+        size_t iLine = 0;
+        while (std::getline(is, sLine))
+        {
+            iLine++;
+            if (!sLine.empty() && (sLine.back() == '\r'))
+            {
+                sLine.pop_back();
+            }
+            if ((sLine.length() > 2) && (sLine.compare(0, 2, "#@") == 0))
+            {
+                const size_t iTab = sLine.find('\t');
+                if (iTab != std::string::npos)
+                {
+                    m_hostMetadata[sSource][sLine.substr(2, iTab - 2)] = sLine.substr(iTab + 1);
+                }
+                continue;
+            }
+            if (sLine.empty() || (sLine[0] == '#'))
+            {
+                continue;
+            }
+
+            const ScopeBenchmarkerDataStore::BmData bmData = parseBmData(sLine, sSource + ":" + std::to_string(iLine));
+            Series& series = m_series[bmData.m_name];
+            if (series.m_merged.m_name.empty())
+            {
+                series.m_merged.m_name = bmData.m_name;
+                series.m_merged.m_baseName = bmData.m_baseName;
+                series.m_merged.m_labels = bmData.m_labels;
+            }
+            series.m_merged.merge(bmData);
+
+            ScopeBenchmarkerDataStore::BmData& bySource = series.m_bySource[sSource];
+            if (bySource.m_name.empty())
+            {
+                bySource.m_name = bmData.m_name;
+                bySource.m_baseName = bmData.m_baseName;
+                bySource.m_labels = bmData.m_labels;
+            }
+            bySource.merge(bmData);
+        }
+        m_sources.insert(sSource);
+    }
+
+    /**
+    * @return Number of different sources added so far.
+    */
+    size_t getSourceCount() const
+    {
+        return m_sources.size();
+    }
+
+    /**
+    * @return Host metadata of the given source, by key, empty if the source had none.
+    */
+    std::map<std::string, std::string> getSourceHostMetadata(const std::string& sSource) const
+    {
+        const auto it = m_hostMetadata.find(sSource);
+        return it == m_hostMetadata.end() ? std::map<std::string, std::string>() : it->second;
+    }
+
+    /**
+    * @return Merged results by benchmarker name.
+    */
+    std::map<std::string, ScopeBenchmarkerDataStore::BmData> getMerged() const
+    {
+        std::map<std::string, ScopeBenchmarkerDataStore::BmData> merged;
+        for (const auto& series : m_series)
+        {
+            merged.insert(std::make_pair(series.first, series.second.m_merged));
+        }
+        return merged;
+    }
+
+    /**
+    * @return Results of the given benchmarker by source, empty if there is no such benchmarker.
+    */
+    std::map<std::string, ScopeBenchmarkerDataStore::BmData> getBySource(const std::string& sName) const
+    {
+        const auto it = m_series.find(sName);
+        return it == m_series.end() ? std::map<std::string, ScopeBenchmarkerDataStore::BmData>() : it->second.m_bySource;
+    }
+
+    /**
+    * Detects sources whose average duration of a benchmarker is far from the median of the average durations of all
+    * sources, by the modified z-score using median absolute deviation (MAD), so a few outliers do not mask themselves
+    * by inflating the deviation, as they would with mean and standard deviation.
+    * Only benchmarkers measured by at least MinSourcesForOutliers sources are checked.
+    *
+    * @param fThreshold Minimum absolute score of an outlier, 3.5 is the usual choice.
+    * @return Outliers ordered by benchmarker name, then by descending absolute score.
+    */
+    std::vector<Outlier> findOutliers(double fThreshold = 3.5) const
+    {
+        std::vector<Outlier> outliers;
+        for (const auto& series : m_series)
+        {
+            std::vector<std::pair<std::string, double>> averages;
+            for (const auto& bySource : series.second.m_bySource)
+            {
+                if (bySource.second.m_iterations > 0)
+                {
+                    averages.push_back(std::make_pair(bySource.first, static_cast<double>(bySource.second.getAverageDuration())));
+                }
+            }
+            if (averages.size() < MinSourcesForOutliers)
+            {
+                continue;
+            }
+
+            std::vector<double> values;
+            for (const auto& average : averages)
+            {
+                values.push_back(average.second);
+            }
+            const double fMedian = getMedian(values);
+
+            std::vector<double> deviations;
+            double fDeviationSum = 0.0;
+            for (const double fValue : values)
+            {
+                deviations.push_back(std::abs(fValue - fMedian));
+                fDeviationSum += deviations.back();
+            }
+            // 1.4826 * MAD estimates the standard deviation for normal distribution; if more than half of the values
+            // are the same, MAD is 0 and the mean absolute deviation is used instead, scaled the same way
+            const double fMad = getMedian(deviations);
+            const double fScale = (fMad > 0.0) ? 1.4826 * fMad : 1.253314 * fDeviationSum / deviations.size();
+            if (fScale <= 0.0)
+            {
+                continue;
+            }
+
+            const size_t nOutliersBefore = outliers.size();
+            for (const auto& average : averages)
+            {
+                const double fScore = (average.second - fMedian) / fScale;
+                if (std::abs(fScore) > fThreshold)
+                {
+                    outliers.push_back(Outlier{ series.first, average.first, average.second, fMedian, fScore });
+                }
+            }
+            std::sort(outliers.begin() + nOutliersBefore, outliers.end(),
+                [](const Outlier& a, const Outlier& b) { return std::abs(a.m_fScore) > std::abs(b.m_fScore); });
+        }
+        return outliers;
+    }
+
+    /**
+    * @return Report lines: merged results of every benchmarker with its per-source breakdown, outlier sources marked,
+    *         followed by the list of outlier sources, and the host metadata of the sources having any.
+    */
+    std::vector<std::string> getReport(double fOutlierThreshold = 3.5) const
+    {
+        const std::vector<Outlier> outliers = findOutliers(fOutlierThreshold);
+        std::map<std::pair<std::string, std::string>, double> outlierScores;
+        std::map<std::string, size_t> outlierSources;
+        for (const auto& outlier : outliers)
+        {
+            outlierScores[std::make_pair(outlier.m_sName, outlier.m_sSource)] = outlier.m_fScore;
+            outlierSources[outlier.m_sSource]++;
+        }
+
+        std::vector<std::string> lines;
+        lines.push_back("Merged benchmark results of " + std::to_string(m_sources.size()) + " sources:");
+        for (const auto& series : m_series)
+        {
+            lines.push_back("  " + series.first + " Sources: " + std::to_string(series.second.m_bySource.size()) + ", " +
+                formatBmData(series.second.m_merged));
+            for (const auto& bySource : series.second.m_bySource)
+            {
+                const auto itOutlier = outlierScores.find(std::make_pair(series.first, bySource.first));
+                lines.push_back("    " + bySource.first + ": " + formatBmData(bySource.second) + formatNormalized(bySource.first, bySource.second) +
+                    (itOutlier == outlierScores.end() ? std::string() : ", OUTLIER (score " + formatNumber(itOutlier->second) + ")"));
+            }
+        }
+
+        if (outlierSources.empty())
+        {
+            lines.push_back("No outlier sources.");
+        }
+        else
+        {
+            lines.push_back("Outlier sources:");
+            for (const auto& outlierSource : outlierSources)
+            {
+                lines.push_back("  " + outlierSource.first + ": outlier in " + std::to_string(outlierSource.second) + " benchmarkers");
+            }
+        }
+
+        if (!m_hostMetadata.empty())
+        {
+            lines.push_back("Host metadata:");
+            for (const auto& hostMetadata : m_hostMetadata)
+            {
+                lines.push_back("  " + hostMetadata.first + ":");
+                for (const auto& metadata : hostMetadata.second)
+                {
+                    lines.push_back("    " + metadata.first + " = " + metadata.second);
+                }
+            }
+        }
+        return lines;
+    }
+
+    /**
+    * Writes the merged results in the format read by addResults().
+    * Host metadata is not written, since it describes the individual sources, not the merged results.
+    */
+    void writeMerged(std::ostream& os) const
+    {
+        os << "# 455-355-7357-88 benchmark results merged from " << m_sources.size() << " sources" << std::endl;
+        for (const auto& series : m_series)
+        {
+            writeBmData(os, series.second.m_merged);
+        }
+    }
+
+private:
+
+    struct Series
+    {
+        ScopeBenchmarkerDataStore::BmData m_merged;
+        std::map<std::string, ScopeBenchmarkerDataStore::BmData> m_bySource;
+    };
+
+    std::map<std::string, Series> m_series;     /**< By benchmarker name. */
+    std::set<std::string> m_sources;
+    std::map<std::string, std::map<std::string, std::string>> m_hostMetadata;   /**< By source, then by key. */
+
+    static void writeBmData(std::ostream& os, const ScopeBenchmarkerDataStore::BmData& bmData)
+    {
+        std::string sName = bmData.m_name;
+        std::replace(sName.begin(), sName.end(), '\t', ' ');
+        std::replace(sName.begin(), sName.end(), '\n', ' ');
+        os << sName
+            << '\t' << bmData.m_ratioDenominator
+            << '\t' << bmData.m_iterations
+            << '\t' << bmData.m_durationsTotal
+            << '\t' << bmData.m_durationsMin
+            << '\t' << bmData.m_durationsMax
+            << '\t' << bmData.m_budgetExceededCount
+            << '\t';
+        if (!bmData.m_pHistogram || (bmData.m_pHistogram->getCount() == 0))
+        {
+            os << '-' << std::endl;
+            return;
+        }
+
+        const LatencyHistogram& histogram = *bmData.m_pHistogram;
+        os << histogram.getMin() << ':' << histogram.getMax() << ':';
+        bool bFirst = true;
+        for (size_t i = 0; i < LatencyHistogram::BucketCount; i++)
+        {
+            const uint64_t nCount = histogram.getBucketValue(i);
+            if (nCount > 0)
+            {
+                os << (bFirst ? "" : ",") << i << '=' << nCount;
+                bFirst = false;
+            }
+        }
+        os << std::endl;
+    }
+
+    /**
+    * @param sLocation Source and line number, for error messages.
+    */
+    static ScopeBenchmarkerDataStore::BmData parseBmData(const std::string& sLine, const std::string& sLocation)
+    {
+        std::vector<std::string> fields;
+        std::stringstream ssLine(sLine);
+        std::string sField;
+        while (std::getline(ssLine, sField, '\t'))
+        {
+            fields.push_back(sField);
+        }
+        if ((fields.size() != 8) || fields[0].empty())
+        {
+            throw std::runtime_error("BenchmarkMerge: " + sLocation + ": expected 8 tab-separated fields!");
+        }
+
+        ScopeBenchmarkerDataStore::BmData bmData;
+        bmData.m_name = fields[0];
+        parseLabels(bmData);
+        bmData.m_ratioDenominator = static_cast<intmax_t>(parseInteger(fields[1], sLocation));
+        bmData.m_iterations = parseInteger(fields[2], sLocation);
+        bmData.m_durationsTotal = parseInteger(fields[3], sLocation);
+        bmData.m_durationsMin = parseInteger(fields[4], sLocation);
+        bmData.m_durationsMax = parseInteger(fields[5], sLocation);
+        bmData.m_budgetExceededCount = parseInteger(fields[6], sLocation);
+        if (fields[7] != "-")
+        {
+            bmData.m_pHistogram = parseHistogram(fields[7], sLocation);
+        }
+        return bmData;
+    }
+
+    /**
+    * Restores base name and labels from a series name like "tick{map=dust,players=16}", see BenchmarkLabels.
+    */
+    static void parseLabels(ScopeBenchmarkerDataStore::BmData& bmData)
+    {
+        const std::string& sName = bmData.m_name;
+        const size_t iOpen = sName.find('{');
+        if ((iOpen == std::string::npos) || (iOpen == 0) || (sName.back() != '}'))
+        {
+            return;
+        }
+
+        std::vector<std::pair<std::string, std::string>> labels;
+        std::stringstream ssLabels(sName.substr(iOpen + 1, sName.length() - iOpen - 2));
+        std::string sLabel;
+        while (std::getline(ssLabels, sLabel, ','))
+        {
+            const size_t iEquals = sLabel.find('=');
+            if (iEquals == std::string::npos)
+            {
+                return;  // not labels, just a name with braces
+            }
+            labels.push_back(std::make_pair(sLabel.substr(0, iEquals), sLabel.substr(iEquals + 1)));
+        }
+        bmData.m_baseName = sName.substr(0, iOpen);
+        bmData.m_labels = labels;
+    }
+
+    static std::shared_ptr<LatencyHistogram> parseHistogram(const std::string& sHistogram, const std::string& sLocation)
+    {
+        const size_t iColon1 = sHistogram.find(':');
+        const size_t iColon2 = (iColon1 == std::string::npos) ? std::string::npos : sHistogram.find(':', iColon1 + 1);
+        if (iColon2 == std::string::npos)
+        {
+            throw std::runtime_error("BenchmarkMerge: " + sLocation + ": invalid histogram!");
+        }
+        const uint64_t minValue = parseUnsigned(sHistogram.substr(0, iColon1), sLocation);
+        const uint64_t maxValue = parseUnsigned(sHistogram.substr(iColon1 + 1, iColon2 - iColon1 - 1), sLocation);
+
+        auto pHistogram = std::make_shared<LatencyHistogram>();
+        std::stringstream ssBuckets(sHistogram.substr(iColon2 + 1));
+        std::string sBucket;
+        while (std::getline(ssBuckets, sBucket, ','))
+        {
+            const size_t iEquals = sBucket.find('=');
+            if (iEquals == std::string::npos)
+            {
+                throw std::runtime_error("BenchmarkMerge: " + sLocation + ": invalid histogram bucket: " + sBucket);
+            }
+            const uint64_t iBucket = parseUnsigned(sBucket.substr(0, iEquals), sLocation);
+            if (iBucket >= LatencyHistogram::BucketCount)
+            {
+                throw std::runtime_error("BenchmarkMerge: " + sLocation + ": invalid histogram bucket index: " + sBucket);
+            }
+            // the recorded min and max are within the first and last non-empty buckets, other buckets are bounded by themselves
+            const size_t i = static_cast<size_t>(iBucket);
+            pHistogram->addToBucket(i, parseUnsigned(sBucket.substr(iEquals + 1), sLocation),
+                std::max(LatencyHistogram::getBucketLowerBound(i), minValue),
+                std::min(LatencyHistogram::getBucketUpperBound(i), maxValue));
+        }
+        return pHistogram;
+    }
+
+    static long long parseInteger(const std::string& sValue, const std::string& sLocation)
+    {
+        char* pEnd = nullptr;
+        errno = 0;
+        const long long value = strtoll(sValue.c_str(), &pEnd, 10);
+        if (sValue.empty() || (*pEnd != '\0') || (errno != 0))
+        {
+            throw std::runtime_error("BenchmarkMerge: " + sLocation + ": invalid integer: " + sValue);
+        }
+        return value;
+    }
+
+    static uint64_t parseUnsigned(const std::string& sValue, const std::string& sLocation)
+    {
+        char* pEnd = nullptr;
+        errno = 0;
+        const unsigned long long value = strtoull(sValue.c_str(), &pEnd, 10);
+        if (sValue.empty() || (sValue[0] == '-') || (*pEnd != '\0') || (errno != 0))
+        {
+            throw std::runtime_error("BenchmarkMerge: " + sLocation + ": invalid unsigned integer: " + sValue);
+        }
+        return static_cast<uint64_t>(value);
+    }
+
+    static double getMedian(std::vector<double> values)
+    {
+        std::sort(values.begin(), values.end());
+        const size_t n = values.size();
+        return (n % 2 == 1) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0;
+    }
+
+    static std::string formatNumber(double fValue)
+    {
+        std::stringstream ss;
+        ss << fValue;
+        return ss.str();
+    }
+
+    /**
+    * @return Average normalized by the "reference.score_ns" host metadata of the source, see ReferenceWorkload, flagged
+    *         if the reference was unstable, empty string if the source has no reference score.
+    */
+    std::string formatNormalized(const std::string& sSource, const ScopeBenchmarkerDataStore::BmData& bmData) const
+    {
+        const auto itHostMetadata = m_hostMetadata.find(sSource);
+        if ((itHostMetadata == m_hostMetadata.end()) || (bmData.m_iterations == 0))
+        {
+            return std::string();
+        }
+        const auto itScore = itHostMetadata->second.find("reference.score_ns");
+        const double fScoreNs = (itScore == itHostMetadata->second.end()) ? 0.0 : atof(itScore->second.c_str());
+        if (fScoreNs <= 0.0)
+        {
+            return std::string();
+        }
+        const auto itStable = itHostMetadata->second.find("reference.stable");
+        return ", Normalized Avg: " + formatNumber(ReferenceWorkload::normalize(bmData.getAverageDuration(), fScoreNs)) + " " +
+            bmData.getUnitString() + ((itStable != itHostMetadata->second.end()) && (itStable->second != "true") ? " (unstable reference)" : "");
+    }
+
+    static std::string formatBmData(const ScopeBenchmarkerDataStore::BmData& bmData)
+    {
+        std::string sLine = "Iterations: " + std::to_string(bmData.m_iterations);
+        if (bmData.m_iterations > 0)
+        {
+            sLine += ", Durations: Min/Max/Avg: " + std::to_string(bmData.m_durationsMin) + "/" + std::to_string(bmData.m_durationsMax) +
+                "/" + formatNumber(bmData.getAverageDuration()) + " " + bmData.getUnitString() +
+                ", Total: " + std::to_string(bmData.m_durationsTotal) + " " + bmData.getUnitString();
+        }
+        if (bmData.m_pHistogram && (bmData.m_pHistogram->getCount() > 0))
+        {
+            sLine += ", p50/p90/p99: " + std::to_string(bmData.m_pHistogram->getPercentile(50)) + "/" +
+                std::to_string(bmData.m_pHistogram->getPercentile(90)) + "/" +
+                std::to_string(bmData.m_pHistogram->getPercentile(99)) + " ns";
+        }
+        if (bmData.m_budgetExceededCount > 0)
+        {
+            sLine += ", Budget exceeded: " + std::to_string(bmData.m_budgetExceededCount);
+        }
+        return sLine;
+    }
+};
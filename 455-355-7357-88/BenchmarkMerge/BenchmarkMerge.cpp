@@ -0,0 +1,103 @@
+/*
+    ###############################################
+    BenchmarkMerge.cpp
+    Command line tool merging benchmarker results exported by many processes, see BenchmarkMerge.h.
+    Command line:
+     BenchmarkMerge [options] <results file>...
+     --output=<file>                   also write the merged results to the given file, in the same format as the inputs;
+     --outlier-threshold=N             minimum robust z-score of an outlier source, default 3.5.
+    Prints the merged results with per-source breakdown and the outlier sources. Every input file is a source.
+    Exit code is 0 on success, 1 on invalid command line or input.
+    Made by PR00F88
+    2024
+    ################################################
+*/
+
+#include <cstdlib>   // atof()
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "BenchmarkMerge.h"
+
+static void printUsage()
+{
+    std::cerr << "Usage: BenchmarkMerge [--output=<file>] [--outlier-threshold=N] <results file>..." << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    const std::string sOutputArg = "--output=";
+    const std::string sThresholdArg = "--outlier-threshold=";
+
+    std::string sOutputFile;
+    double fOutlierThreshold = 3.5;
+    std::vector<std::string> inputFiles;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string sArg = argv[i];
+        if (sArg.compare(0, sOutputArg.length(), sOutputArg) == 0)
+        {
+            sOutputFile = sArg.substr(sOutputArg.length());
+        }
+        else if (sArg.compare(0, sThresholdArg.length(), sThresholdArg) == 0)
+        {
+            fOutlierThreshold = atof(sArg.substr(sThresholdArg.length()).c_str());
+            if (fOutlierThreshold <= 0.0)
+            {
+                std::cerr << "Invalid outlier threshold: " << sArg << std::endl;
+                return 1;
+            }
+        }
+        else if ((sArg.length() > 2) && (sArg.compare(0, 2, "--") == 0))
+        {
+            std::cerr << "Unknown option: " << sArg << std::endl;
+            printUsage();
+            return 1;
+        }
+        else
+        {
+            inputFiles.push_back(sArg);
+        }
+    }
+
+    if (inputFiles.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    BenchmarkMerge merge;
+    try
+    {
+        for (const auto& sInputFile : inputFiles)
+        {
+            merge.addFile(sInputFile);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    for (const auto& sLine : merge.getReport(fOutlierThreshold))
+    {
+        std::cout << sLine << std::endl;
+    }
+
+    if (!sOutputFile.empty())
+    {
+        std::ofstream f(sOutputFile);
+        merge.writeMerged(f);
+        if (!f)
+        {
+            std::cerr << "Failed to write " << sOutputFile << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
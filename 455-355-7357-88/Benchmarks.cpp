@@ -0,0 +1,17 @@
+/*
+    ###################################################################################
+    Benchmarks.cpp
+    Optional single implementation file of Benchmark, to be used only if TEST_SEPARATE_COMPILATION is defined for the whole project.
+    In header-only mode (the default) this file compiles to nothing, so it is harmless to keep it in the project.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#ifdef TEST_SEPARATE_COMPILATION
+
+#include "Benchmarks.h"
+#include "BenchmarksImpl.h"
+
+#endif // TEST_SEPARATE_COMPILATION
@@ -10,9 +10,19 @@
     ###################################################################################
 */
 
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "Test.h"
 #include "ScopeBenchmarker.h"
 
+// only used by the implementation in BenchmarksImpl.h, so benchmark files do not need to include them
+class FrameProfiler;
+class NumaMatrix;
+class SamplingProfiler;
+
 /**
     This class should be the base of every benchmark tester class.
     It should be used in the following way:
@@ -41,6 +51,9 @@
       bool unitSubTest(void);
     - a unit-subtest should return true on pass and false on fail;
     - it is ok to use multiple assertions in a single subtest but using the optional message parameters of the assertion methods is highly recommended.
+
+    Every benchmark is automatically tagged with Test::TAG_BENCHMARK, so benchmarks can be excluded from quick test runs, see TestRunOptions.
+    Every benchmark also has the exclusive resource Test::RESOURCE_MACHINE, so Test::runTests() never runs it concurrently with other tests.
 */
 
 class Benchmark : public Test
@@ -53,62 +66,127 @@ public:
     */
     Benchmark(const std::string& testFile = "", const std::string& testName = "") :
         Test(testFile, testName)
-    {}
+    {
+        addTag(TAG_BENCHMARK);
+        addExclusiveResource(RESOURCE_MACHINE);
+    }
 
 protected:
 
     virtual void preSetUp() override
     {
+        measureReferenceWorkload();
+        m_nClockInstallCount = Clock::getInstallCount();
         initBenchmarkers();
+        bindNumaPlacement();
+        startSamplingProfiler();
     }
 
     virtual void postTearDown() override
     {
+        stopSamplingProfiler();
         printBenchmarkers();
+        m_pNumaBinding.reset();
+    }
+
+    /**
+        Runs a SamplingProfiler during each test and subtest, and adds its report to the info messages, so the
+        slowest functions within each scope benchmarker can be seen. Best to be invoked in the ctor or initialize().
+        Does nothing on platforms not supported by SamplingProfiler.
+        @param nFrequencyHz            Samples per second of process CPU time.
+        @param nTopFunctions           Number of functions listed per scope benchmarker.
+        @param sFoldedStacksFilePrefix If not empty, folded stacks are also written to <prefix><subtest name>.folded files.
+    */
+    void enableSamplingProfiler(unsigned int nFrequencyHz = 1000, size_t nTopFunctions = 5, const std::string& sFoldedStacksFilePrefix = "");
+
+    /**
+        Adds the report of the given frame profiler to the info messages, see FrameProfiler::getReport().
+        Useful at the end of a subtest running a frame loop, since postTearDown() prints only the aggregated scope benchmarkers.
+    */
+    void addFrameProfilerReport(const FrameProfiler& frameProfiler, size_t nWorstFrames = 5);
+
+    /**
+        Runs each test and subtest on the CPUs of the given NUMA node, with its memory allocated on the given NUMA node,
+        see NumaPlacement::ThreadBinding. Threads created by the test inherit the placement. Best to be invoked in the ctor or initialize().
+        Does nothing on single node machines and on platforms not supported by NumaPlacement.
+        Throws std::runtime_error if a node is not an online node.
+    */
+    void enableNumaPlacement(int cpuNode, int memoryNode);
+
+    /**
+        Adds the report of the given NUMA matrix to the info messages, see NumaMatrix::getReport().
+        Useful at the end of a subtest running its workload by NumaMatrix::run(), to see the cross-node penalty of the workload.
+    */
+    void addNumaMatrixReport(const NumaMatrix& numaMatrix);
+
+    /**
+        Prints the series of the given benchmarker name also aggregated by the given label keys after the scope benchmarkers
+        of each test and subtest, see ScopeBenchmarkerDataStore::aggregateByLabels(). Best to be invoked in the ctor or initialize().
+    */
+    void addBenchmarkerAggregation(const std::string& sBaseName, const std::vector<std::string>& groupByKeys)
+    {
+        m_aggregations.push_back(std::make_pair(sBaseName, groupByKeys));
+    }
+
+    /**
+        Writes the scope benchmarkers of each test and subtest also in CSV format with 1 column per label key, to
+        <prefix><subtest name>.csv files, see ScopeBenchmarkerDataStore::writeCsv(). Best to be invoked in the ctor or initialize().
+    */
+    void enableBenchmarkerCsv(const std::string& sCsvFilePrefix)
+    {
+        m_sCsvFilePrefix = sCsvFilePrefix;
     }
 
 private:
 
+    std::vector<std::pair<std::string, std::vector<std::string>>> m_aggregations;   /**< See addBenchmarkerAggregation(). */
+    std::string m_sCsvFilePrefix;                                                    /**< Empty unless enableBenchmarkerCsv() was invoked. */
+    std::shared_ptr<SamplingProfiler> m_pSamplingProfiler;   /**< Null unless enableSamplingProfiler() was invoked. */
+    unsigned int m_nSamplingFrequencyHz = 0;
+    size_t m_nSamplingTopFunctions = 0;
+    std::string m_sFoldedStacksFilePrefix;
+
+    int m_numaCpuNode = -1;                                  /**< -1 unless enableNumaPlacement() was invoked. */
+    int m_numaMemoryNode = -1;
+    std::shared_ptr<void> m_pNumaBinding;                    /**< NumaPlacement::ThreadBinding alive during each test and subtest. */
+    unsigned long long m_nClockInstallCount = 0;            /**< Clock::getInstallCount() before each test and subtest. */
+
+    void bindNumaPlacement();
+
+    void startSamplingProfiler();
+
+    /**
+        Must be invoked before printBenchmarkers() since the report takes the scope names from ScopeBenchmarkerDataStore.
+    */
+    void stopSamplingProfiler();
+
+    /**
+        Measures the ReferenceWorkload once per process, before the first test of the first benchmark, and stores its score as host metadata.
+    */
+    void measureReferenceWorkload();
+
     void initBenchmarkers()
     {
         ScopeBenchmarkerDataStore::clear(); // since ScopeBenchmarker works with static data, make sure previous tests did not leave something there
     }
 
-    void printBenchmarkers()
-    {
-        if (ScopeBenchmarkerDataStore::getAllData().empty())
-        {
-            return;
-        }
-
-        if (isSubTestRunning())
-        {
-            addToInfoMessages((std::string("  <").append(sTestFile + "::" + tSubTests[iCurrentSubTest].second).append("> Scope Benchmarkers:")).c_str());
-        }
-        else
-        {
-            addToInfoMessages((std::string("  <").append(sTestFile).append("> Scope Benchmarkers:")).c_str());
-        }
-
-        for (const auto& bmData : ScopeBenchmarkerDataStore::getAllData())
-        {
-            addToInfoMessages(
-                ("    " +
-                    bmData.second.m_name +
-                    " Iterations: " + std::to_string(bmData.second.m_iterations) +
-                    ", Durations: Min/Max/Avg: " +
-                    std::to_string(bmData.second.m_durationsMin) + "/" +
-                    std::to_string(bmData.second.m_durationsMax) + "/" +
-                    /* Test::toString() for getting rid of unneeded zeros after decimal point */
-                    toString(bmData.second.getAverageDuration()) +
-                    " " + bmData.second.getUnitString() +
-                    ", Total: " +
-                    std::to_string(bmData.second.m_durationsTotal) +
-                    " " + bmData.second.getUnitString()).c_str());
-        }
-        addToInfoMessages("");
-
-        ScopeBenchmarkerDataStore::clear(); // since ScopeBenchmarker works with static data, make sure we dont leave anything there
-    }
+    /**
+        Prints the slowest iterations kept for the given benchmarker, see ScopeBenchmarkerDataStore::setExemplarCapacity().
+    */
+    void printExemplars(const ScopeBenchmarkerDataStore::BmData& bmData);
+
+    void printBenchmarker(const ScopeBenchmarkerDataStore::BmData& bmData);
+
+    void printBenchmarkers();
 
 }; // class Benchmark
+
+
+/**
+    Benchmarks.h is header-only by default, like Test.h. With TEST_SEPARATE_COMPILATION, the functions using the profilers,
+    NumaPlacement and ReferenceWorkload are compiled only once in Benchmarks.cpp, which must be added to the project then,
+    and benchmark files include the headers of the profilers they use themselves.
+*/
+#ifndef TEST_SEPARATE_COMPILATION
+#include "BenchmarksImpl.h"
+#endif
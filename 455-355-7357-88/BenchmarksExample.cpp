@@ -1,8 +1,8 @@
 /*
     ###############################################
     BenchmarksExample.cpp
-    Example for Benchmark class.
-    You don't need this cpp file in your project, this is just an example for using my Benchmark class.
+    Example for Benchmark, UnitTest and DataDrivenTest classes.
+    You don't need this cpp file in your project, this is just an example for using my Benchmark, UnitTest and DataDrivenTest classes.
     Made by PR00F88
     2024
     ################################################
@@ -12,11 +12,26 @@
 #ifndef TEST_WITH_CCONSOLE
 #define TEST_WITH_CCONSOLE
 #endif
+#include "BenchmarkMerge.h"
 #include "Benchmarks.h"
+#include "DataDrivenTest.h"
+#include "FlightRecorder.h"
+#include "FlowTracker.h"
+#include "FunctionInstrumentation.h"
+#include "NameTable.h"
+#include "ReplayHarness.h"
+#include "UnitTest.h"
 
+#include <atomic>  // requires cpp11
 #include <cassert>
+#include <cstdio>  // std::remove()
+#include <fstream>
+#include <iterator>  // std::istreambuf_iterator
 #include <memory>  // for std::unique_ptr; requires cpp11
-#include <thread>  // for sleep_for(); requires cpp11
+#include <sstream>
+#include <stdexcept>
+#include <thread>  // requires cpp11
+#include <vector>
 
 #include "winproof88.h"  // part of PFL lib: https://github.com/proof88/PFL
 
@@ -25,6 +40,35 @@ static CConsole& getConsole()
     return CConsole::getConsoleInstance();
 }
 
+#if defined(FUNCTION_INSTRUMENTATION) && defined(__GNUC__)
+// Implemented by FunctionInstrumentation.cpp. The functions below invoke them by hand, as if this file was compiled
+// with -finstrument-functions, so don't compile this file with it. Link with -rdynamic so the functions have names.
+extern "C" void __cyg_profile_func_enter(void* pFn, void* pCallSite);
+extern "C" void __cyg_profile_func_exit(void* pFn, void* pCallSite);
+
+extern "C" void exampleInstrumentedInner()
+{
+    __cyg_profile_func_enter(reinterpret_cast<void*>(&exampleInstrumentedInner), nullptr);
+    Clock::sleep(std::chrono::milliseconds(2));
+    __cyg_profile_func_exit(reinterpret_cast<void*>(&exampleInstrumentedInner), nullptr);
+}
+
+extern "C" void exampleInstrumentedExcluded()
+{
+    __cyg_profile_func_enter(reinterpret_cast<void*>(&exampleInstrumentedExcluded), nullptr);
+    Clock::sleep(std::chrono::milliseconds(1));
+    __cyg_profile_func_exit(reinterpret_cast<void*>(&exampleInstrumentedExcluded), nullptr);
+}
+
+extern "C" void exampleInstrumentedOuter()
+{
+    __cyg_profile_func_enter(reinterpret_cast<void*>(&exampleInstrumentedOuter), nullptr);
+    exampleInstrumentedInner();
+    exampleInstrumentedExcluded();
+    __cyg_profile_func_exit(reinterpret_cast<void*>(&exampleInstrumentedOuter), nullptr);
+}
+#endif
+
 class ExampleBenchmarkTest :
     public Benchmark
 {
@@ -51,23 +95,86 @@ protected:
         // well, I just added only 1 subtest, which means I should rather implement the test by overriding testMethod(), but
         // let's treat this as an example on how to add subtest to a test class!
         addSubTest("test_scope_benchmarking", (PFNUNITSUBTEST)&ExampleBenchmarkTest::test_scope_benchmarking);
+        addSubTest("test_scope_benchmarking_real_clock", (PFNUNITSUBTEST)&ExampleBenchmarkTest::test_scope_benchmarking_real_clock);
+        addSubTest("test_flight_recorder", (PFNUNITSUBTEST)&ExampleBenchmarkTest::test_flight_recorder);
+        addSubTest("test_flow_tracker", (PFNUNITSUBTEST)&ExampleBenchmarkTest::test_flow_tracker);
+        addSubTest("test_replay_pacing", (PFNUNITSUBTEST)&ExampleBenchmarkTest::test_replay_pacing);
+#if defined(FUNCTION_INSTRUMENTATION) && defined(__GNUC__)
+        addSubTest("test_function_instrumentation", (PFNUNITSUBTEST)&ExampleBenchmarkTest::test_function_instrumentation);
+#endif
 
-        // sleep to avoid performance disturbance caused by Visual Studio background debug tools init after start debugging
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        // all series of sleep-outer are also printed merged into 1 line after the benchmarkers
+        addBenchmarkerAggregation("sleep-outer", {});
     }
 
 private:
 
+    VirtualClock m_clock;  // installed by the subtest so sleeping is instant and measured durations are exact
+
     bool test_scope_benchmarking()
     {
-        // We are testing different sleep times from bigger to smaller, because in general sleep precisity is bigger with bigger sleeps, and
-        // if we start this up in VS, its debug tools init might impact our measurements, so better do the smaller sleeps measurements later
-        // when the program has already been executing for a while!
+        // ScopeBenchmarker takes time from Clock::now(), and Clock::sleep() just advances the installed virtual clock,
+        // so this test does not really sleep and measured durations are deterministic, unlike with real sleeps!
+        ClockInstaller clockInstaller(m_clock);
+
         static constexpr auto sleepTimes = PFL::std_array_of<int>(
             100, 50, 30, 25, 20, 18, 15, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
 
         static constexpr int iterationsPerSleepTime = 20;
 
+        bool b = true;
+        for (const int& sleepFor : sleepTimes)
+        {
+            // names are built on the stack and interned once, ScopeBenchmarker then gets only an integer handle,
+            // so dynamic names cost no heap allocation after their first use
+            const NameTable::Handle scopeBmName = (NameBuilder() << "sleep-" << sleepFor).intern();
+            // alternatively, the sleep time can be a label of a single benchmarker name, stored as series "sleep-outer{ms=<sleepFor>}"
+            const BenchmarkLabels scopeOuterBmLabels = BenchmarkLabels().add("ms", sleepFor);
+            {
+                ScopeBenchmarker<std::chrono::milliseconds> scopeOuterBm("sleep-outer", scopeOuterBmLabels); // measurement of the whole loop starts here
+                for (int i = 0; i < iterationsPerSleepTime; i++)
+                {
+                    ScopeBenchmarker<std::chrono::milliseconds> scopeBm(scopeBmName); // scope duration measurement starts here
+                    Clock::sleep(std::chrono::milliseconds(sleepFor));
+                    // scope duration measurement ends here
+                }
+                // measurement of the whole loop ends here
+            }
+
+            // this is how we can access ScopeBenchmarker data after ScopeBenchmarker object is already out of scope
+            const auto& scopeBmData = ScopeBenchmarkerDataStore::getDataByNameHandle(scopeBmName);
+
+            b &= assertEquals(static_cast<long long>(sleepFor * iterationsPerSleepTime), scopeBmData.m_durationsTotal); // should be assertDurationsTotalEquals
+            b &= assertEquals(static_cast<long long>(sleepFor), scopeBmData.m_durationsMin);
+            b &= assertEquals(static_cast<long long>(sleepFor), scopeBmData.m_durationsMax);
+            b &= assertEquals(iterationsPerSleepTime, scopeBmData.m_iterations); // should be assertIterationCountEquals
+            b &= assertEquals(static_cast<float>(sleepFor), scopeBmData.getAverageDuration(), 0.001f); // should be assertDurationsAverageEquals
+
+            // virtual time does not pass by executing code, so there is no measurement overhead either
+            const auto& scopeOuterBmData = ScopeBenchmarkerDataStore::getDataByNameHandle(
+                ScopeBenchmarkerDataStore::getSeriesHandle("sleep-outer", scopeOuterBmLabels));
+            b &= assertEquals(scopeBmData.m_durationsTotal, scopeOuterBmData.m_durationsTotal);
+        }
+
+        // series can be aggregated by any of their labels, here all of them are merged
+        const auto sleepOuterAggregated = ScopeBenchmarkerDataStore::aggregateByLabels("sleep-outer", {});
+        b &= assertEquals(static_cast<size_t>(1), sleepOuterAggregated.size());
+        if (!sleepOuterAggregated.empty())
+        {
+            b &= assertEquals(static_cast<long long>(sleepTimes.size()), sleepOuterAggregated.begin()->second.m_iterations);
+        }
+
+        return b;
+    }
+
+    bool test_scope_benchmarking_real_clock()
+    {
+        // same as above but with real sleeps and plain string names, so the measurement overhead becomes visible;
+        // we are testing different sleep times from bigger to smaller, because in general sleep precisity is bigger with bigger sleeps
+        static constexpr auto sleepTimes = PFL::std_array_of<int>(20, 10, 5, 2, 1, 0);
+
+        static constexpr int iterationsPerSleepTime = 20;
+
         bool b = true;
         for (const int& sleepFor : sleepTimes)
         {
@@ -84,7 +191,6 @@ private:
                 // "scope duration measurement overhead" measurement ends here
             }
 
-            // this is how we can access ScopeBenchmarker data after ScopeBenchmarker object is already out of scope
             const auto& scopeBmData = ScopeBenchmarkerDataStore::getDataByName(scopeBmName);
 
             b &= assertBetween(sleepFor * iterationsPerSleepTime, 5000, scopeBmData.m_durationsTotal); // should be assertDurationsTotalBetween
@@ -103,10 +209,599 @@ private:
         return b;
     }
 
+    bool test_flight_recorder()
+    {
+        // a spike in 1 frame out of many triggers a dump of the events recorded before it; virtual time makes the spike deterministic
+        ClockInstaller clockInstaller(m_clock);
+
+        FlightRecorder flightRecorder("ExampleFlightRecorder", 1024);
+        flightRecorder.addScopeTrigger("physics", std::chrono::milliseconds(5));
+        flightRecorder.setDumpWindow(std::chrono::milliseconds(100));
+        flightRecorder.setRateLimit(std::chrono::seconds(60), 10);
+        flightRecorder.start();
+
+        for (int iFrame = 0; iFrame < 50; iFrame++)
+        {
+            ScopeBenchmarker<std::chrono::microseconds> frameBm("frame");
+            {
+                ScopeBenchmarker<std::chrono::microseconds> physicsBm("physics");
+                Clock::sleep(std::chrono::milliseconds((iFrame == 30) || (iFrame == 40) ? 8 : 2));
+            }
+            ScopeBenchmarker<std::chrono::microseconds> renderBm("render");
+            Clock::sleep(std::chrono::milliseconds(3));
+        }
+        flightRecorder.stop();
+        flightRecorder.waitForPendingDumps();
+
+        // the spike of frame 40 is within the rate limit interval of the dump of frame 30
+        bool b = assertEquals(1u, flightRecorder.getDumpCount(), "dumps");
+        b &= assertEquals(1ull, flightRecorder.getSuppressedTriggerCount(), "suppressed");
+        b &= assertTrue(flightRecorder.getErrorMessages().empty(), "errors");
+
+        const std::vector<std::string> writtenFiles = flightRecorder.getWrittenFiles();
+        b &= assertEquals(static_cast<size_t>(1), writtenFiles.size(), "files");
+        for (const auto& sFilename : writtenFiles)
+        {
+            std::ifstream f(sFilename);
+            const std::string sTrace((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+            b &= assertTrue(sTrace.find("TRIGGER: physics took 8000 us, threshold is 5000 us") != std::string::npos, "reason");
+            b &= assertTrue(sTrace.find("\"name\":\"render\"") != std::string::npos, "events");
+            f.close();
+            std::remove(sFilename.c_str());
+        }
+        return b;
+    }
+
+    bool test_flow_tracker()
+    {
+        // jobs are enqueued on this thread and processed on a worker thread, 1 in 10 jobs is slow to process
+        ClockInstaller clockInstaller(m_clock);
+
+        FlowTracker jobFlow("job");
+        const FlowTracker::StageHandle stageProcessed = jobFlow.addStage("processed");
+
+        const int nJobs = 100;
+        std::vector<FlowTracker::Flow> queue;
+        for (int iJob = 0; iJob < nJobs; iJob++)
+        {
+            queue.push_back(jobFlow.begin());
+            Clock::sleep(std::chrono::milliseconds(1));
+        }
+
+        // the worker starts after all jobs are enqueued, so only the worker moves the virtual time
+        std::thread worker([&]()
+            {
+                for (int iJob = 0; iJob < nJobs; iJob++)
+                {
+                    jobFlow.markStage(queue[iJob], "dequeued");
+                    Clock::sleep(std::chrono::milliseconds((iJob % 10 == 9) ? 10 : 1));
+                    jobFlow.end(queue[iJob], stageProcessed);
+                }
+            });
+        worker.join();
+
+        // percentiles are upper bounds of histogram buckets, clamped to the maximum
+        const LatencyHistogram& processed = jobFlow.getStageHistogram("processed");
+        bool b = assertEquals(static_cast<uint64_t>(nJobs), processed.getCount(), "processed count");
+        b &= assertEquals(static_cast<uint64_t>(1000000), processed.getMin(), "processed min");
+        b &= assertBetween(static_cast<uint64_t>(1000000), static_cast<uint64_t>(1070000), processed.getPercentile(50), "processed p50");
+        b &= assertEquals(static_cast<uint64_t>(10000000), processed.getPercentile(99), "processed p99");
+
+        const LatencyHistogram& endToEnd = jobFlow.getEndToEndHistogram();
+        b &= assertEquals(static_cast<uint64_t>(nJobs), endToEnd.getCount(), "end-to-end count");
+        b &= assertEquals(static_cast<uint64_t>(nJobs), jobFlow.getStageHistogram("dequeued").getCount(), "dequeued count");
+        b &= assertGequals(endToEnd.getMin(), processed.getMax(), "end-to-end min");
+        b &= assertFalse(queue.back().isOpen(), "flow closed");
+        return b;
+    }
+
+    bool test_replay_pacing()
+    {
+        static constexpr const char* TraceFilename = "ExampleReplay.trace";
+        ClockInstaller clockInstaller(m_clock);
+
+        // 20 events recorded 10 ms apart, every 5th event is a tick, the others are packets
+        {
+            ReplayTraceWriter writer(TraceFilename);
+            writer.setTypeName(1, "packet");
+            writer.setTypeName(2, "tick");
+            for (int iEvent = 0; iEvent < 20; iEvent++)
+            {
+                writer.record((iEvent % 5 == 4) ? 2 : 1, &iEvent, sizeof(iEvent));
+                Clock::sleep(std::chrono::milliseconds(10));
+            }
+            writer.flush();
+        }
+
+        bool b = true;
+        {
+            // processing a packet takes 1 ms, a tick takes 8 ms
+            ReplayHarness replay(TraceFilename, "replay");
+            int iExpectedEvent = 0;
+            const auto process = [&](const ReplayEvent& event)
+            {
+                b &= assertEquals(iExpectedEvent++, event.getAs<int>(0), "payload");
+                Clock::sleep(std::chrono::milliseconds((event.m_type == 2) ? 8 : 1));
+            };
+
+            // replayed twice as fast as recorded, events are due every 5 ms: an 8 ms tick delays the next packet by 3 ms
+            const ReplayHarness::Result paced = replay.run(process, ReplayHarness::Pacing::Original, 2.0);
+            b &= assertEquals(static_cast<size_t>(20), paced.m_nEvents, "paced events");
+            b &= assertTrue(paced.m_maxLag == std::chrono::milliseconds(3), "paced max lag");
+            b &= assertTrue(paced.m_duration == std::chrono::milliseconds(95 + 8), "paced duration");
+
+            const auto& lagBmData = ScopeBenchmarkerDataStore::getDataByName("replay.lag");
+            b &= assertEquals(20ll, lagBmData.m_iterations, "lag iterations");
+            b &= assertEquals(3ll * 3000000, lagBmData.m_durationsTotal, "lag total");
+
+            // without pacing, only the processing time counts
+            iExpectedEvent = 0;
+            const ReplayHarness::Result fast = replay.run(process);
+            b &= assertTrue(fast.m_duration == std::chrono::milliseconds(16 * 1 + 4 * 8), "fast duration");
+            b &= assertTrue(fast.m_maxLag == Clock::Duration::zero(), "fast max lag");
+
+            const auto& tickBmData = ScopeBenchmarkerDataStore::getDataByName("replay.tick");
+            b &= assertEquals(2ll * 4, tickBmData.m_iterations, "tick iterations");
+            b &= assertEquals(8000000ll, tickBmData.m_durationsMax, "tick max");
+        }
+
+        std::remove(TraceFilename);
+        return b;
+    }
+
+#if defined(FUNCTION_INSTRUMENTATION) && defined(__GNUC__)
+    bool test_function_instrumentation()
+    {
+        ClockInstaller clockInstaller(m_clock);
+
+        FunctionInstrumentation::reset();
+        FunctionInstrumentation::clearFilters();
+        FunctionInstrumentation::addExcludeFilter("Excluded");
+        FunctionInstrumentation::start();
+        for (int i = 0; i < 3; i++)
+        {
+            exampleInstrumentedOuter();
+        }
+        FunctionInstrumentation::stop();
+        FunctionInstrumentation::collect();
+        FunctionInstrumentation::clearFilters();
+
+        // durations are inclusive, in nanoseconds
+        const auto& outerBmData = ScopeBenchmarkerDataStore::getDataByName("exampleInstrumentedOuter");
+        bool b = assertEquals(3ll, outerBmData.m_iterations, "outer iterations");
+        b &= assertEquals(9000000ll, outerBmData.m_durationsTotal, "outer total");
+
+        const auto& innerBmData = ScopeBenchmarkerDataStore::getDataByName("exampleInstrumentedInner");
+        b &= assertEquals(3ll, innerBmData.m_iterations, "inner iterations");
+        b &= assertEquals(2000000ll, innerBmData.m_durationsMax, "inner max");
+
+        b &= assertEquals(0u, ScopeBenchmarkerDataStore::getAllData().count(PFL::calcHash("exampleInstrumentedExcluded")), "excluded");
+        b &= assertEquals(0ull, FunctionInstrumentation::getDroppedCallCount(), "dropped");
+        return b;
+    }
+#endif
+
 }; // class ExampleBenchmarkTest
 
 
-int WINAPI WinMain(_In_ HINSTANCE /*hInstance*/, _In_opt_ HINSTANCE /*hPrevInstance*/, _In_ LPSTR /*lpCmdLine*/, _In_ int /*nCmdShow*/)
+/**
+    Test run by ExampleUnitTest to show how tags select subtests, it records which of its subtests ran.
+*/
+class ExampleTaggedTest :
+    public UnitTest
+{
+public:
+
+    ExampleTaggedTest() : UnitTest(__FILE__, "ExampleTaggedTest")
+    {
+        addSubTest("test_fast", (PFNUNITSUBTEST)&ExampleTaggedTest::test_fast, { TAG_FAST });
+        addSubTest("test_slow", (PFNUNITSUBTEST)&ExampleTaggedTest::test_slow, { TAG_SLOW });
+        addSubTest("test_io", (PFNUNITSUBTEST)&ExampleTaggedTest::test_io, { TAG_IO, TAG_SLOW });
+        addSubTest("test_untagged", (PFNUNITSUBTEST)&ExampleTaggedTest::test_untagged);
+    }
+
+    ExampleTaggedTest(const ExampleTaggedTest&) = delete;
+    ExampleTaggedTest& operator=(const ExampleTaggedTest&) = delete;
+    ExampleTaggedTest(ExampleTaggedTest&&) = delete;
+    ExampleTaggedTest& operator=(ExampleTaggedTest&&) = delete;
+
+    std::vector<std::string> m_ranSubTests;
+
+private:
+
+    bool test_fast()
+    {
+        m_ranSubTests.push_back("test_fast");
+        return true;
+    }
+
+    bool test_slow()
+    {
+        m_ranSubTests.push_back("test_slow");
+        return true;
+    }
+
+    bool test_io()
+    {
+        m_ranSubTests.push_back("test_io");
+        return true;
+    }
+
+    bool test_untagged()
+    {
+        m_ranSubTests.push_back("test_untagged");
+        return true;
+    }
+
+}; // class ExampleTaggedTest
+
+
+/**
+    Test run concurrently by ExampleUnitTest to show how exclusive resources are respected, it counts the tests running
+    at the same time as itself.
+*/
+class ExampleResourceTest :
+    public UnitTest
+{
+public:
+
+    struct Counters
+    {
+        std::atomic<int> m_nRunning{ 0 };
+        std::atomic<int> m_nRunningWithResource{ 0 };
+        std::atomic<int> m_nMaxRunningWithResource{ 0 };
+    };
+
+    ExampleResourceTest(const std::string& sName, const std::string& sResource, Counters& counters) :
+        UnitTest(__FILE__, sName),
+        m_counters(counters)
+    {
+        if (!sResource.empty())
+        {
+            addExclusiveResource(sResource);
+        }
+    }
+
+    ExampleResourceTest(const ExampleResourceTest&) = delete;
+    ExampleResourceTest& operator=(const ExampleResourceTest&) = delete;
+    ExampleResourceTest(ExampleResourceTest&&) = delete;
+    ExampleResourceTest& operator=(ExampleResourceTest&&) = delete;
+
+    int m_nRunningAtStart = 0;   /**< Number of tests running when this test started, including itself. */
+
+protected:
+
+    virtual bool testMethod() override
+    {
+        m_nRunningAtStart = ++m_counters.m_nRunning;
+        const bool bHasResource = !getExclusiveResources().empty() && !hasExclusiveResource(RESOURCE_MACHINE);
+        if (bHasResource)
+        {
+            const int nRunningWithResource = ++m_counters.m_nRunningWithResource;
+            int nMax = m_counters.m_nMaxRunningWithResource.load();
+            while ((nRunningWithResource > nMax) && !m_counters.m_nMaxRunningWithResource.compare_exchange_weak(nMax, nRunningWithResource))
+            {
+            }
+        }
+
+        // real time, not Clock, since this test does not have RESOURCE_CLOCK
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        if (bHasResource)
+        {
+            --m_counters.m_nRunningWithResource;
+        }
+        --m_counters.m_nRunning;
+        return true;
+    }
+
+private:
+
+    Counters& m_counters;
+
+}; // class ExampleResourceTest
+
+
+class ExampleUnitTest :
+    public UnitTest
+{
+public:
+
+    ExampleUnitTest() : UnitTest(__FILE__)
+    {
+        addSubTest("test_name_table_concurrent_intern", (PFNUNITSUBTEST)&ExampleUnitTest::test_name_table_concurrent_intern, { TAG_FAST });
+        addSubTest("test_benchmark_merge", (PFNUNITSUBTEST)&ExampleUnitTest::test_benchmark_merge, { TAG_FAST });
+        addSubTest("test_assert_faster_by", (PFNUNITSUBTEST)&ExampleUnitTest::test_assert_faster_by, { TAG_SLOW });
+        addSubTest("test_run_options_select_by_tags", (PFNUNITSUBTEST)&ExampleUnitTest::test_run_options_select_by_tags, { TAG_FAST });
+        addSubTest("test_run_tests_concurrently", (PFNUNITSUBTEST)&ExampleUnitTest::test_run_tests_concurrently, { TAG_FAST });
+    }
+
+    ExampleUnitTest(const ExampleUnitTest&) = delete;
+    ExampleUnitTest& operator=(const ExampleUnitTest&) = delete;
+    ExampleUnitTest(ExampleUnitTest&&) = delete;
+    ExampleUnitTest& operator=(ExampleUnitTest&&) = delete;
+
+private:
+
+    bool test_name_table_concurrent_intern()
+    {
+        // all threads intern the same new names at the same time, each starting at a different name
+        const size_t nThreads = 4;
+        const size_t nNames = 200;
+        const size_t nSizeBefore = NameTable::size();
+
+        std::atomic<bool> bGo{ false };
+        std::vector<std::vector<NameTable::Handle>> handles(nThreads, std::vector<NameTable::Handle>(nNames));
+        std::vector<std::thread> threads;
+        for (size_t iThread = 0; iThread < nThreads; iThread++)
+        {
+            threads.emplace_back([&, iThread]()
+                {
+                    while (!bGo.load())
+                    {
+                        std::this_thread::yield();
+                    }
+                    for (size_t i = 0; i < nNames; i++)
+                    {
+                        const size_t iName = (i + iThread * nNames / nThreads) % nNames;
+                        NameBuilder name;
+                        name << "example-intern/" << static_cast<unsigned long long>(iName);
+                        handles[iThread][iName] = name.intern();
+                    }
+                });
+        }
+        bGo = true;
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        bool b = assertEquals(nSizeBefore + nNames, NameTable::size(), "size");
+        for (size_t iName = 0; iName < nNames; iName++)
+        {
+            const std::string sName = "example-intern/" + std::to_string(iName);
+            for (size_t iThread = 1; iThread < nThreads; iThread++)
+            {
+                b &= assertEquals(handles[0][iName], handles[iThread][iName], sName.c_str());
+            }
+            NameTable::Handle handle = 0;
+            b &= assertTrue(NameTable::findHandle(sName.c_str(), sName.length(), handle), sName.c_str());
+            b &= assertEquals(handles[0][iName], handle, sName.c_str());
+            b &= assertEquals(sName, NameTable::getName(handle), sName.c_str());
+            b &= assertEquals(PFL::calcHash(sName), NameTable::getNameHash(handle), sName.c_str());
+        }
+
+        NameTable::Handle handle = 0;
+        b &= assertFalse(NameTable::findHandle("example-intern/never", 20, handle), "not interned");
+        return b;
+    }
+
+    bool test_benchmark_merge()
+    {
+        // results of 5 servers in the export format: name, time unit denominator, iterations, total, min, max,
+        // budget exceeded count, histogram; server-4 is 5 times slower than the others
+        BenchmarkMerge merge;
+        for (int iServer = 0; iServer < 5; iServer++)
+        {
+            const long long nAvg = (iServer == 4) ? 5000 : 1000 + iServer * 10;
+            std::stringstream ss;
+            ss << "# 455-355-7357-88 benchmark results\n";
+            ss << "#@cpu\texample-cpu-" << iServer << "\n";
+            ss << "\n";
+            ss << "tick{map=dust}\t1000000\t100\t" << nAvg * 100 << "\t" << nAvg - 100 << "\t" << nAvg + 100 << "\t" << iServer << "\t-\n";
+            merge.addResults("server-" + std::to_string(iServer), ss);
+        }
+
+        // a histogram of 2 values of the same bucket
+        const std::size_t iBucket = LatencyHistogram::getBucketIndex(1500);
+        std::stringstream ssHistogram("flow\t1000000000\t2\t3000\t1500\t1500\t0\t1500:1500:" + std::to_string(iBucket) + "=2\n");
+        merge.addResults("server-0", ssHistogram);
+
+        bool b = assertEquals(static_cast<size_t>(5), merge.getSourceCount(), "sources");
+        b &= assertEquals(std::string("example-cpu-4"), merge.getSourceHostMetadata("server-4")["cpu"], "metadata");
+
+        // counters are merged exactly, not by averaging averages
+        const auto merged = merge.getMerged();
+        const auto& tick = merged.at("tick{map=dust}");
+        b &= assertEquals(std::string("tick"), tick.m_baseName, "base name");
+        b &= assertEquals(500ll, tick.m_iterations, "iterations");
+        b &= assertEquals((1000ll + 1010 + 1020 + 1030 + 5000) * 100, tick.m_durationsTotal, "total");
+        b &= assertEquals(900ll, tick.m_durationsMin, "min");
+        b &= assertEquals(5100ll, tick.m_durationsMax, "max");
+        b &= assertEquals(10ll, tick.m_budgetExceededCount, "budget exceeded");
+        b &= assertEquals(static_cast<size_t>(5), merge.getBySource("tick{map=dust}").size(), "breakdown");
+
+        const auto& flow = merged.at("flow");
+        b &= assertNotNull(flow.m_pHistogram.get(), "histogram");
+        if (flow.m_pHistogram)
+        {
+            b &= assertEquals(static_cast<uint64_t>(2), flow.m_pHistogram->getCount(), "histogram count");
+            b &= assertEquals(static_cast<uint64_t>(1500), flow.m_pHistogram->getPercentile(50), "histogram p50");
+        }
+
+        // the slow server is found by its robust z-score, "flow" has too few sources to be checked
+        const std::vector<BenchmarkMerge::Outlier> outliers = merge.findOutliers();
+        b &= assertEquals(static_cast<size_t>(1), outliers.size(), "outliers");
+        if (!outliers.empty())
+        {
+            b &= assertEquals(std::string("server-4"), outliers[0].m_sSource, "outlier source");
+            b &= assertEquals(std::string("tick{map=dust}"), outliers[0].m_sName, "outlier name");
+            b &= assertGreater(outliers[0].m_fScore, 3.5, "outlier score");
+        }
+
+        // invalid lines are reported with their source and line number
+        std::stringstream ssInvalid("# comment\ntick{map=dust}\t1000000\t100\n");
+        std::string sError;
+        try
+        {
+            merge.addResults("server-5", ssInvalid);
+        }
+        catch (const std::runtime_error& e)
+        {
+            sError = e.what();
+        }
+        b &= assertTrue(sError.find("server-5:2") != std::string::npos, "invalid line");
+        return b;
+    }
+
+    bool test_assert_faster_by()
+    {
+        // summing 64 values vs. summing 64 * 64 values: expected speedup is about 64, the asserted minimum leaves a large
+        // margin for noise, since the assertion measures real time
+        std::vector<int> values(64 * 64);
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            values[i] = static_cast<int>(i);
+        }
+        volatile int nSink = 0;  // so the sums are not optimized away
+
+        const auto sumFew = [&]()
+        {
+            int nSum = 0;
+            for (size_t i = 0; i < 64; i++)
+            {
+                nSum += values[i];
+            }
+            nSink = nSum;
+        };
+        const auto sumMany = [&]()
+        {
+            int nSum = 0;
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                nSum += values[i];
+            }
+            nSink = nSum;
+        };
+
+        return assertFasterBy(sumFew, sumMany, 4.0, "sum");
+    }
+
+    bool test_run_options_select_by_tags()
+    {
+        // same as passing "--tags=fast,io --exclude-tags=slow" on the command line of WinMain()
+        const TestRunOptions options = TestRunOptions::fromCommandLine("--tags=fast,io --exclude-tags=slow");
+        bool b = assertEquals(static_cast<size_t>(2), options.m_includeTags.size(), "include tags");
+
+        // test_io has an included tag but it is also slow, and test_untagged has no included tag
+        ExampleTaggedTest taggedTest;
+        b &= assertTrue(taggedTest.run(options), "run");
+        b &= assertFalse(taggedTest.isSkipped(), "not skipped");
+        b &= assertEquals(static_cast<size_t>(1), taggedTest.m_ranSubTests.size(), "ran subtests");
+        if (!taggedTest.m_ranSubTests.empty())
+        {
+            b &= assertEquals(std::string("test_fast"), taggedTest.m_ranSubTests[0], "ran subtest");
+        }
+        b &= assertEquals(1, taggedTest.getPassedSubTestCount(), "passed subtests");
+        b &= assertEquals(3, taggedTest.getSkippedSubTestCount(), "skipped subtests");
+
+        // nothing selected: the whole test is skipped, and runTests() does not count it
+        ExampleTaggedTest skippedTest;
+        b &= assertTrue(skippedTest.run(TestRunOptions::fromCommandLine("--tags=gpu")), "run skipped");
+        b &= assertTrue(skippedTest.isSkipped(), "skipped");
+        b &= assertTrue(skippedTest.m_ranSubTests.empty(), "nothing ran");
+
+        // no options: everything runs
+        ExampleTaggedTest fullTest;
+        b &= assertTrue(fullTest.run(), "run all");
+        b &= assertEquals(static_cast<size_t>(4), fullTest.m_ranSubTests.size(), "ran all");
+        return b;
+    }
+
+    bool test_run_tests_concurrently()
+    {
+        // same as passing "--jobs=4" on the command line of WinMain(): up to 4 tests run at the same time, except that
+        // the tests using the same port never overlap, and the test having RESOURCE_MACHINE runs alone
+        ExampleResourceTest::Counters counters;
+        std::vector<std::unique_ptr<Test>> tests;
+        tests.push_back(std::unique_ptr<Test>(new ExampleResourceTest("port-1", "example port 7777", counters)));
+        tests.push_back(std::unique_ptr<Test>(new ExampleResourceTest("free-1", "", counters)));
+        tests.push_back(std::unique_ptr<Test>(new ExampleResourceTest("port-2", "example port 7777", counters)));
+        tests.push_back(std::unique_ptr<Test>(new ExampleResourceTest("free-2", "", counters)));
+        tests.push_back(std::unique_ptr<Test>(new ExampleResourceTest("machine", RESOURCE_MACHINE, counters)));
+        tests.push_back(std::unique_ptr<Test>(new ExampleResourceTest("free-3", "", counters)));
+
+        Test::runTests(tests, getConsole(), "Running Example Concurrent Tests ...", TestRunOptions::fromCommandLine("--jobs=4"));
+
+        bool b = true;
+        for (const auto& pTest : tests)
+        {
+            b &= assertTrue(pTest->isPassed(), pTest->getName().c_str());
+        }
+        b &= assertEquals(1, counters.m_nMaxRunningWithResource.load(), "port users overlapped");
+        b &= assertEquals(1, static_cast<ExampleResourceTest&>(*tests[4]).m_nRunningAtStart, "machine test not alone");
+        b &= assertEquals(0, counters.m_nRunning.load(), "still running");
+        return b;
+    }
+
+}; // class ExampleUnitTest
+
+
+class ExampleDataDrivenTest :
+    public DataDrivenTest
+{
+public:
+
+    ExampleDataDrivenTest() : DataDrivenTest(__FILE__, "")
+    {
+        addTag(TAG_IO);
+        addSubTest("test_csv_row_numbers", (PFNUNITSUBTEST)&ExampleDataDrivenTest::test_csv_row_numbers);
+    }
+
+    ExampleDataDrivenTest(const ExampleDataDrivenTest&) = delete;
+    ExampleDataDrivenTest& operator=(const ExampleDataDrivenTest&) = delete;
+    ExampleDataDrivenTest(ExampleDataDrivenTest&&) = delete;
+    ExampleDataDrivenTest& operator=(ExampleDataDrivenTest&&) = delete;
+
+protected:
+
+    virtual bool setUp() override
+    {
+        // a table of a few MiB is split into many chunks, processed by multiple threads; each row holds its own line number
+        // and there is an empty line in the middle, so row numbers can be checked in every chunk
+        std::ofstream f(CsvFilename, std::ios::trunc);
+        f << "line,value\n";
+        size_t nLine = 2;
+        for (size_t i = 0; i < 200000; i++, nLine++)
+        {
+            if (i == 100000)
+            {
+                f << "\n";
+                nLine++;
+            }
+            f << nLine << "," << i * 2 << "\n";
+        }
+        return assertTrue(static_cast<bool>(f), "csv write");
+    }
+
+    virtual void tearDown() override
+    {
+        std::remove(CsvFilename);
+    }
+
+private:
+
+    static constexpr const char* const CsvFilename = "ExampleDataDrivenTest.csv";
+
+    bool test_csv_row_numbers()
+    {
+        const CsvDataTable table(CsvFilename);
+        const size_t iValueColumn = table.getColumnIndex("value");
+        bool b = assertLess(static_cast<size_t>(1), table.split(4).size(), "chunks");
+        b &= runDataCases(table, [](const DataRow& row) {
+            // row numbers are line numbers within the file also in the chunks after the first one
+            return static_cast<size_t>(row.getFieldAsLongLong(0)) == row.getRowNumber();
+        });
+        b &= runDataCases(table, [iValueColumn](const DataRow& row) {
+            return row.getFieldAsLongLong(iValueColumn) % 2 == 0;
+        });
+        return b;
+    }
+
+}; // class ExampleDataDrivenTest
+
+
+int WINAPI WinMain(_In_ HINSTANCE /*hInstance*/, _In_opt_ HINSTANCE /*hPrevInstance*/, _In_ LPSTR lpCmdLine, _In_ int /*nCmdShow*/)
 {
     constexpr const char* const CON_TITLE = "Example benchmark test";
 
@@ -125,8 +820,11 @@ int WINAPI WinMain(_In_ HINSTANCE /*hInstance*/, _In_opt_ HINSTANCE /*hPrevInsta
 
     std::vector<std::unique_ptr<Test>> tests;
     tests.push_back(std::unique_ptr<Test>(new ExampleBenchmarkTest));
+    tests.push_back(std::unique_ptr<Test>(new ExampleUnitTest));
+    tests.push_back(std::unique_ptr<Test>(new ExampleDataDrivenTest));
 
-    Test::runTests(tests, getConsole(), "Running Performance Tests ...");
+    // e.g. "--exclude-tags=benchmark,slow" runs only the quick unit tests, see TestRunOptions::fromCommandLine()
+    Test::runTests(tests, getConsole(), "Running Performance Tests ...", TestRunOptions::fromCommandLine(lpCmdLine));
     system("pause");
 
     getConsole().Deinitialize();
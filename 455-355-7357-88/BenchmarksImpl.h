@@ -0,0 +1,260 @@
+#pragma once
+
+/*
+    ###################################################################################
+    BenchmarksImpl.h
+    Implementation of the functions of Benchmark using the profilers, NumaPlacement and ReferenceWorkload.
+    Included by Benchmarks.h in header-only mode, or compiled once in Benchmarks.cpp if TEST_SEPARATE_COMPILATION is defined.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "Benchmarks.h"
+#include "BenchmarkMerge.h"
+#include "FrameProfiler.h"
+#include "NumaPlacement.h"
+#include "ReferenceWorkload.h"
+#include "SamplingProfiler.h"
+
+#ifndef TEST_INLINE
+#ifdef TEST_SEPARATE_COMPILATION
+#define TEST_INLINE
+#else
+#define TEST_INLINE inline
+#endif
+#endif
+
+TEST_INLINE void Benchmark::enableSamplingProfiler(unsigned int nFrequencyHz, size_t nTopFunctions, const std::string& sFoldedStacksFilePrefix)
+{
+    if (!m_pSamplingProfiler)
+    {
+        m_pSamplingProfiler = std::make_shared<SamplingProfiler>();
+    }
+    m_nSamplingFrequencyHz = nFrequencyHz;
+    m_nSamplingTopFunctions = nTopFunctions;
+    m_sFoldedStacksFilePrefix = sFoldedStacksFilePrefix;
+}
+
+TEST_INLINE void Benchmark::addFrameProfilerReport(const FrameProfiler& frameProfiler, size_t nWorstFrames)
+{
+    for (const auto& sLine : frameProfiler.getReport(nWorstFrames))
+    {
+        addToInfoMessages(sLine.c_str());
+    }
+    addToInfoMessages("");
+}
+
+TEST_INLINE void Benchmark::enableNumaPlacement(int cpuNode, int memoryNode)
+{
+    const std::vector<int> nodes = NumaPlacement::getNodes();
+    for (const int node : { cpuNode, memoryNode })
+    {
+        if (std::find(nodes.begin(), nodes.end(), node) == nodes.end())
+        {
+            throw std::runtime_error("Benchmark::enableNumaPlacement(): node " + std::to_string(node) + " is not online!");
+        }
+    }
+    m_numaCpuNode = cpuNode;
+    m_numaMemoryNode = memoryNode;
+}
+
+TEST_INLINE void Benchmark::addNumaMatrixReport(const NumaMatrix& numaMatrix)
+{
+    for (const auto& sLine : numaMatrix.getReport())
+    {
+        addToInfoMessages(sLine.c_str());
+    }
+    addToInfoMessages("");
+}
+
+TEST_INLINE void Benchmark::bindNumaPlacement()
+{
+    if ((m_numaCpuNode < 0) || (NumaPlacement::getNodeCount() < 2))
+    {
+        return;
+    }
+
+    const auto pBinding = std::make_shared<NumaPlacement::ThreadBinding>(m_numaCpuNode, m_numaMemoryNode);
+    m_pNumaBinding = pBinding;
+    const int actualMemoryNode = NumaPlacement::probeAllocationNode();
+    addToInfoMessages(("  NUMA Placement: CPU node " + std::to_string(m_numaCpuNode) +
+        (pBinding->isCpuBound() ? "" : " (binding failed)") +
+        ", Memory node " + std::to_string(m_numaMemoryNode) +
+        (pBinding->isMemoryBound() ? "" : " (binding failed)") +
+        ", Allocations landed on node " + (actualMemoryNode < 0 ? std::string("?") : std::to_string(actualMemoryNode))).c_str());
+}
+
+TEST_INLINE void Benchmark::startSamplingProfiler()
+{
+    if (m_pSamplingProfiler)
+    {
+        m_pSamplingProfiler->clear();
+        m_pSamplingProfiler->start(m_nSamplingFrequencyHz);
+    }
+}
+
+TEST_INLINE void Benchmark::stopSamplingProfiler()
+{
+    if (!m_pSamplingProfiler || !m_pSamplingProfiler->isRunning())
+    {
+        return;
+    }
+
+    m_pSamplingProfiler->stop();
+    for (const auto& sLine : m_pSamplingProfiler->getReport(m_nSamplingTopFunctions))
+    {
+        addToInfoMessages(("  " + sLine).c_str());
+    }
+
+    if (!m_sFoldedStacksFilePrefix.empty())
+    {
+        const std::string sFilename = m_sFoldedStacksFilePrefix + (isSubTestRunning() ? tSubTests[iCurrentSubTest].second : getName()) + ".folded";
+        if (!m_pSamplingProfiler->writeFoldedStacks(sFilename))
+        {
+            addToInfoMessages(("  Sampling Profiler: failed to write " + sFilename).c_str());
+        }
+    }
+}
+
+TEST_INLINE void Benchmark::measureReferenceWorkload()
+{
+    if (!ReferenceWorkload::measure())
+    {
+        return;
+    }
+
+    const ReferenceWorkload::Score& score = ReferenceWorkload::getScore();
+    BenchmarkMerge::setHostMetadata("reference.score_ns", std::to_string(score.m_fNs));
+    BenchmarkMerge::setHostMetadata("reference.spread", std::to_string(score.m_fSpread));
+    BenchmarkMerge::setHostMetadata("reference.stable", score.isStable() ? "true" : "false");
+    addToInfoMessages(("  Reference Workload: " + toString(score.m_fNs / 1000000.0) + " ms, Spread: " +
+        toString(score.m_fSpread * 100.0) + "%" + (score.isStable() ? "" : ", UNSTABLE: normalized results are unreliable!")).c_str());
+}
+
+TEST_INLINE void Benchmark::printExemplars(const ScopeBenchmarkerDataStore::BmData& bmData)
+{
+    const auto& allData = ScopeBenchmarkerDataStore::getAllData();
+    for (size_t i = 0; i < bmData.m_exemplars.size(); i++)
+    {
+        const auto& exemplar = bmData.m_exemplars[i];
+        std::stringstream ssThreadId;
+        ssThreadId << exemplar.m_threadId;
+        std::string sExemplar = "      Slowest #" + std::to_string(i + 1) + ": " +
+            std::to_string(bmData.toDurationCount(exemplar.m_duration)) + " " + bmData.getUnitString() +
+            ", Start: " + std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(exemplar.m_timeStart.time_since_epoch()).count()) + " us" +
+            ", Thread: " + ssThreadId.str();
+        if (exemplar.m_bTagged)
+        {
+            sExemplar += ", Tag: " + std::to_string(exemplar.m_tag);
+        }
+        if (!exemplar.m_children.empty())
+        {
+            sExemplar += ", Children:";
+            for (const auto& child : exemplar.m_children)
+            {
+                const auto it = allData.find(child.first);
+                sExemplar += std::string(" ") + (child.first == 0 ? "(other)" : (it == allData.end() ? "?" : it->second.m_name.c_str())) +
+                    " " + std::to_string(bmData.toDurationCount(child.second)) + " " + bmData.getUnitString();
+            }
+        }
+        addToInfoMessages(sExemplar.c_str());
+    }
+}
+
+TEST_INLINE void Benchmark::printBenchmarker(const ScopeBenchmarkerDataStore::BmData& bmData)
+{
+    const std::string sBudget = (bmData.m_budget > Clock::Duration::zero()) ?
+        ", Budget: " + std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(bmData.m_budget).count()) +
+        " us, Exceeded: " + std::to_string(bmData.m_budgetExceededCount) :
+        std::string();
+    const std::string sPercentiles = (bmData.m_pHistogram && (bmData.m_pHistogram->getCount() > 0)) ?
+        ", p50/p90/p99: " + std::to_string(bmData.m_pHistogram->getPercentile(50)) + "/" +
+        std::to_string(bmData.m_pHistogram->getPercentile(90)) + "/" +
+        std::to_string(bmData.m_pHistogram->getPercentile(99)) + " ns" :
+        std::string();
+    // durations measured in virtual time cannot be normalized by the real-time score of the reference workload
+    const bool bVirtualTime = (Clock::getInstalled() != nullptr) || (Clock::getInstallCount() != m_nClockInstallCount);
+    const std::string sNormalized = (!bVirtualTime && (ReferenceWorkload::getScore().m_fNs > 0.0)) ?
+        ", Normalized Avg: " + toString(static_cast<float>(ReferenceWorkload::normalize(bmData.getAverageDuration()))) + " " +
+        bmData.getUnitString() + (ReferenceWorkload::getScore().isStable() ? "" : " (unstable reference)") :
+        std::string();
+    addToInfoMessages(
+        ("    " +
+            bmData.m_name +
+            " Iterations: " + std::to_string(bmData.m_iterations) +
+            ", Durations: Min/Max/Avg: " +
+            std::to_string(bmData.m_durationsMin) + "/" +
+            std::to_string(bmData.m_durationsMax) + "/" +
+            /* Test::toString() for getting rid of unneeded zeros after decimal point */
+            toString(bmData.getAverageDuration()) +
+            " " + bmData.getUnitString() +
+            sNormalized +
+            ", Total: " +
+            std::to_string(bmData.m_durationsTotal) +
+            " " + bmData.getUnitString() +
+            sPercentiles +
+            sBudget).c_str());
+}
+
+TEST_INLINE void Benchmark::printBenchmarkers()
+{
+    if (ScopeBenchmarkerDataStore::getAllData().empty())
+    {
+        return;
+    }
+
+    if (isSubTestRunning())
+    {
+        addToInfoMessages((std::string("  <").append(sTestFile + "::" + tSubTests[iCurrentSubTest].second).append("> Scope Benchmarkers:")).c_str());
+    }
+    else
+    {
+        addToInfoMessages((std::string("  <").append(sTestFile).append("> Scope Benchmarkers:")).c_str());
+    }
+
+    for (const auto& bmData : ScopeBenchmarkerDataStore::getAllData())
+    {
+        printBenchmarker(bmData.second);
+        printExemplars(bmData.second);
+    }
+
+    for (const auto& aggregation : m_aggregations)
+    {
+        const auto groups = ScopeBenchmarkerDataStore::aggregateByLabels(aggregation.first, aggregation.second);
+        if (groups.empty())
+        {
+            continue;
+        }
+        std::string sKeys;
+        for (const auto& sKey : aggregation.second)
+        {
+            sKeys += (sKeys.empty() ? "" : ",") + sKey;
+        }
+        addToInfoMessages(("  " + aggregation.first + " aggregated by {" + sKeys + "}:").c_str());
+        for (const auto& group : groups)
+        {
+            printBenchmarker(group.second);
+        }
+    }
+    addToInfoMessages("");
+
+    if (!m_sCsvFilePrefix.empty())
+    {
+        const std::string sFilename = m_sCsvFilePrefix + (isSubTestRunning() ? tSubTests[iCurrentSubTest].second : getName()) + ".csv";
+        std::ofstream f(sFilename);
+        ScopeBenchmarkerDataStore::writeCsv(f);
+        if (!f)
+        {
+            addToInfoMessages(("  Failed to write " + sFilename).c_str());
+        }
+    }
+
+    ScopeBenchmarkerDataStore::clear(); // since ScopeBenchmarker works with static data, make sure we dont leave anything there
+}
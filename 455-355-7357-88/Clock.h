@@ -0,0 +1,287 @@
+#pragma once
+
+/*
+    ###################################################################################
+    Clock.h
+    Basic header-only clock abstraction with replaceable global clock.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <atomic>    // requires cpp11
+#include <chrono>    // steady_clock, etc.; requires cpp11
+#include <thread>    // for sleep_for(); requires cpp11
+
+#include "ExclusiveResources.h"
+
+/**
+* Clock interface shared by the framework (e.g. ScopeBenchmarker) and the code under test.
+*
+* Time-dependent code should use the static Clock::now() and Clock::sleep() functions instead of directly using
+* std::chrono::steady_clock and std::this_thread, so tests can install a VirtualClock: with a virtual clock
+* installed, sleeping and waiting for timeouts return immediately after advancing the virtual time, so time-based
+* test suites run in milliseconds and their results are deterministic.
+*
+* If no clock is installed, the static functions fall back to std::chrono::steady_clock and std::this_thread
+* directly, without virtual call.
+*/
+class Clock
+{
+public:
+
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    typedef std::chrono::steady_clock::duration Duration;
+
+    /**
+    * @return Current time according to the installed clock, or according to std::chrono::steady_clock if no clock is installed.
+    */
+    static TimePoint now()
+    {
+        const Clock* const pClock = getInstalledPtr().load(std::memory_order_acquire);
+        return pClock ? pClock->getNow() : std::chrono::steady_clock::now();
+    }
+
+    /**
+    * Blocks the current thread for the given duration according to the installed clock.
+    */
+    template <typename Rep, typename Period>
+    static void sleep(const std::chrono::duration<Rep, Period>& duration)
+    {
+        Clock* const pClock = getInstalledPtr().load(std::memory_order_acquire);
+        if (pClock)
+        {
+            pClock->sleepFor(std::chrono::duration_cast<Duration>(duration));
+        }
+        else
+        {
+            std::this_thread::sleep_for(duration);
+        }
+    }
+
+    /**
+    * Blocks the current thread until the given time point according to the installed clock.
+    */
+    static void sleepUntil(const TimePoint& timePoint)
+    {
+        const TimePoint timeNow = now();
+        if (timePoint > timeNow)
+        {
+            sleep(timePoint - timeNow);
+        }
+    }
+
+    /**
+    * Polls the given predicate until it returns true or the timeout elapses according to the installed clock.
+    *
+    * @param pred         Callable with signature: bool pred().
+    * @param timeout      Maximum time to wait.
+    * @param pollInterval Time to sleep between 2 evaluations of the predicate.
+    * @return The last value returned by the predicate.
+    */
+    template <typename Pred>
+    static bool waitUntil(Pred pred, const Duration& timeout, const Duration& pollInterval = std::chrono::milliseconds(1))
+    {
+        const TimePoint timeDeadline = now() + timeout;
+        while (!pred())
+        {
+            if (now() >= timeDeadline)
+            {
+                return pred();
+            }
+            sleep(pollInterval);
+        }
+        return true;
+    }
+
+    /**
+    * Replaces the global clock.
+    * The caller keeps ownership of the clock object, which must outlive its installation.
+    * Installing clock while other threads are using Clock functions is safe, however a thread might still be
+    * sleeping according to the previously installed clock.
+    * Tests run concurrently by Test::runTests() must have exclusive resource ExclusiveResources::CLOCK to install a
+    * clock, otherwise std::runtime_error is thrown, since the installed clock is shared by all tests.
+    *
+    * @param pClock The clock to be installed. Pass nullptr to restore the default std::chrono::steady_clock behavior.
+    */
+    static void install(Clock* pClock)
+    {
+        ExclusiveResources::require(ExclusiveResources::CLOCK, "Clock::install()");
+        store(pClock);
+    }
+
+    /**
+    * @return The currently installed clock, or nullptr if no clock is installed.
+    */
+    static Clock* getInstalled()
+    {
+        return getInstalledPtr().load(std::memory_order_acquire);
+    }
+
+    /**
+    * @return Number of times a clock was installed so far, for telling whether durations measured since an earlier
+    *         call might be virtual even if no clock is installed anymore.
+    */
+    static unsigned long long getInstallCount()
+    {
+        return getInstallCountRef().load(std::memory_order_relaxed);
+    }
+
+    virtual ~Clock() = default;
+
+    /**
+    * @return Current time according to this clock.
+    */
+    virtual TimePoint getNow() const = 0;
+
+    /**
+    * Blocks the current thread for the given duration according to this clock.
+    */
+    virtual void sleepFor(const Duration& duration) = 0;
+
+private:
+
+    friend class ClockInstaller;
+
+    /**
+    * Installs the given clock without checking ExclusiveResources, so it never throws.
+    * Used by ClockInstaller's dtor to restore a clock it already had the right to replace.
+    */
+    static void store(Clock* pClock) noexcept
+    {
+        getInstalledPtr().store(pClock, std::memory_order_release);
+        if (pClock)
+        {
+            getInstallCountRef().fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static std::atomic<Clock*>& getInstalledPtr()
+    {
+        static std::atomic<Clock*> s_pInstalledClock(nullptr);
+        return s_pInstalledClock;
+    }
+
+    static std::atomic<unsigned long long>& getInstallCountRef()
+    {
+        static std::atomic<unsigned long long> s_nInstallCount(0);
+        return s_nInstallCount;
+    }
+};
+
+
+/**
+* Real clock based on std::chrono::steady_clock.
+* Not needed to be installed since Clock functions behave the same when no clock is installed, however it can be handy
+* for code receiving a Clock reference.
+*/
+class SteadyClock : public Clock
+{
+public:
+
+    virtual TimePoint getNow() const override
+    {
+        return std::chrono::steady_clock::now();
+    }
+
+    virtual void sleepFor(const Duration& duration) override
+    {
+        std::this_thread::sleep_for(duration);
+    }
+};
+
+
+/**
+* Virtual clock for tests: time passes only when explicitly advanced, or when someone sleeps.
+* Sleeping advances the time by the sleep duration and returns immediately.
+* Thread-safe: the current time is kept in an atomic offset.
+*/
+class VirtualClock : public Clock
+{
+public:
+
+    /**
+    * @param timeStart Initial time of the clock. By default it is the current time of std::chrono::steady_clock.
+    */
+    VirtualClock(const TimePoint& timeStart = std::chrono::steady_clock::now()) :
+        m_timeStart(timeStart),
+        m_elapsedTicks(0)
+    {}
+
+    VirtualClock(const VirtualClock&) = delete;
+    VirtualClock& operator=(const VirtualClock&) = delete;
+    VirtualClock(VirtualClock&&) = delete;
+    VirtualClock& operator=(VirtualClock&&) = delete;
+
+    virtual TimePoint getNow() const override
+    {
+        return m_timeStart + Duration(m_elapsedTicks.load(std::memory_order_acquire));
+    }
+
+    virtual void sleepFor(const Duration& duration) override
+    {
+        advance(duration);
+    }
+
+    /**
+    * Moves the time forward by the given duration. Negative durations are ignored since the clock is steady.
+    */
+    template <typename Rep, typename Period>
+    void advance(const std::chrono::duration<Rep, Period>& duration)
+    {
+        const Duration::rep ticks = std::chrono::duration_cast<Duration>(duration).count();
+        if (ticks > 0)
+        {
+            m_elapsedTicks.fetch_add(ticks, std::memory_order_acq_rel);
+        }
+    }
+
+    /**
+    * @return Time elapsed since construction of the clock.
+    */
+    Duration getElapsed() const
+    {
+        return Duration(m_elapsedTicks.load(std::memory_order_acquire));
+    }
+
+private:
+
+    const TimePoint m_timeStart;
+    std::atomic<Duration::rep> m_elapsedTicks;
+};
+
+
+/**
+* Installs the given clock for the lifetime of this object, then restores the previously installed clock.
+* Convenient in setUp() / tearDown() or simply in a subtest:
+*
+*     VirtualClock clock;
+*     ClockInstaller clockInstaller(clock);
+*     ...
+*/
+class ClockInstaller
+{
+public:
+
+    ClockInstaller(Clock& clock) :
+        m_pPrevClock(Clock::getInstalled())
+    {
+        Clock::install(&clock);
+    }
+
+    ~ClockInstaller()
+    {
+        // install() might throw, but the ctor already checked that this thread may install a clock
+        Clock::store(m_pPrevClock);
+    }
+
+    ClockInstaller(const ClockInstaller&) = delete;
+    ClockInstaller& operator=(const ClockInstaller&) = delete;
+    ClockInstaller(ClockInstaller&&) = delete;
+    ClockInstaller& operator=(ClockInstaller&&) = delete;
+
+private:
+
+    Clock* const m_pPrevClock;
+};
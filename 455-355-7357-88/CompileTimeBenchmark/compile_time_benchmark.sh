@@ -0,0 +1,93 @@
+#!/bin/sh
+
+#   ###################################################################################
+#   compile_time_benchmark.sh
+#   Compile-time benchmark of Test.h: header-only mode vs. TEST_SEPARATE_COMPILATION mode.
+#   Generates N test files, each containing a UnitTest with assertions of common types,
+#   then compiles them in both modes and prints the total compile times.
+#   Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+#   Made by PR00F88
+#   2024
+#   ###################################################################################
+#
+#   Usage: compile_time_benchmark.sh [number of test files, default 50]
+#   Environment: CXX (default: g++), CXXFLAGS (default: -std=c++14 -O0 -w)
+
+N=${1:-50}
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--std=c++14 -O0 -w}
+FRAMEWORK_DIR=$(cd "$(dirname "$0")/.." && pwd)
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+i=0
+while [ "$i" -lt "$N" ]; do
+    cat > "$WORK_DIR/test_$i.cpp" <<CPP
+#include "UnitTest.h"
+
+class GeneratedTest$i : public UnitTest
+{
+public:
+    GeneratedTest$i() : UnitTest(__FILE__)
+    {
+        addSubTest("test_ints", (PFNUNITSUBTEST)&GeneratedTest$i::test_ints);
+        addSubTest("test_floats", (PFNUNITSUBTEST)&GeneratedTest$i::test_floats);
+        addSubTest("test_strings", (PFNUNITSUBTEST)&GeneratedTest$i::test_strings);
+    }
+
+private:
+    bool test_ints()
+    {
+        const int a = $i;
+        const long long b = $i;
+        const unsigned int c = $i;
+        return (assertEquals(a, a, "int") & assertNotEquals(a, a + 1) & assertLess(a, a + 1) &
+            assertGequals(b, b) & assertBetween(b - 1, b + 1, b) & assertGreater(c + 1, c) &
+            assertLequals(c, c) & assertTrue(a == $i)) != 0;
+    }
+
+    bool test_floats()
+    {
+        const float f = $i.5f;
+        const double d = $i.25;
+        return (assertEquals(f, f, 0.001f) & assertEquals(d, d) & assertLess(d, d + 1.0) &
+            assertBetween(f - 1.f, f + 1.f, f, 0.001f) & assertGreater(f + 1.f, f)) != 0;
+    }
+
+    bool test_strings()
+    {
+        const std::string s = "test_$i";
+        return (assertEquals(s, std::string("test_$i")) & assertNotEquals(s, std::string("x")) &
+            assertLess(std::string("a"), s)) != 0;
+    }
+};
+
+void createGeneratedTest$i(std::vector<std::unique_ptr<Test>>& tests)
+{
+    tests.push_back(std::unique_ptr<Test>(new GeneratedTest$i));
+}
+CPP
+    i=$((i + 1))
+done
+
+# prints elapsed wall-clock seconds of compiling all generated files with the given extra flags
+compile_all()
+{
+    START=$(date +%s.%N)
+    for f in "$WORK_DIR"/test_*.cpp; do
+        $CXX $CXXFLAGS "$@" -I"$FRAMEWORK_DIR" -c "$f" -o "$f.o" || exit 1
+    done
+    END=$(date +%s.%N)
+    awk "BEGIN { printf \"%.2f\", $END - $START }"
+}
+
+echo "Compiling $N test files with: $CXX $CXXFLAGS"
+HEADER_ONLY=$(compile_all)
+echo "Header-only mode:                      ${HEADER_ONLY} s"
+
+START=$(date +%s.%N)
+$CXX $CXXFLAGS -DTEST_SEPARATE_COMPILATION -I"$FRAMEWORK_DIR" -c "$FRAMEWORK_DIR/Test.cpp" -o "$WORK_DIR/Test.o" || exit 1
+END=$(date +%s.%N)
+TEST_CPP=$(awk "BEGIN { printf \"%.2f\", $END - $START }")
+SEPARATE=$(compile_all -DTEST_SEPARATE_COMPILATION)
+echo "TEST_SEPARATE_COMPILATION mode:        ${SEPARATE} s (+ ${TEST_CPP} s for Test.cpp once)"
@@ -0,0 +1,772 @@
+#pragma once
+
+/*
+    ###################################################################################
+    DataDrivenTest.h
+    Basic header-only data-driven Unit Test class streaming test cases from files.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>  // std::min(), std::sort()
+#include <atomic>     // requires cpp11
+#include <cstdlib>    // strtoll(), strtod()
+#include <cstring>    // memchr(), memcpy()
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>     // requires cpp11
+#include <vector>
+
+#include "MappedFile.h"
+#include "UnitTest.h"
+
+/**
+* A single row (test case) of a DataTable.
+* Nothing is parsed until explicitly asked: the row just points into the memory-mapped file.
+* CSV fields are split at the first call to any field accessor function.
+*/
+class DataRow
+{
+public:
+
+    /**
+    * @return 1-based number of the row within the file.
+    *         For CSV files this is the line number (header line included), so it can be looked up directly in a text editor.
+    *         For binary files this is the 1-based index of the record.
+    */
+    std::size_t getRowNumber() const
+    {
+        return m_rowNumber;
+    }
+
+    /**
+    * @return Pointer to the raw bytes of the row. For CSV rows the line ending is not included.
+    */
+    const char* getData() const
+    {
+        return m_pData;
+    }
+
+    /**
+    * @return Number of raw bytes of the row.
+    */
+    std::size_t getSize() const
+    {
+        return m_size;
+    }
+
+    /**
+    * @return Copy of the raw bytes of the row as string, convenient for logging CSV rows.
+    */
+    std::string getRaw() const
+    {
+        return std::string(m_pData, m_size);
+    }
+
+    /**
+    * Binary record accessor.
+    * Throws std::out_of_range if the requested value does not fit into the record.
+    *
+    * @param offset Byte offset of the value within the record.
+    * @return       Value of type T copied from the given offset of the record, in the byte order of the file.
+    */
+    template <typename T>
+    T getAs(std::size_t offset) const
+    {
+        if (offset + sizeof(T) > m_size)
+        {
+            throw std::out_of_range("DataRow::getAs(): offset out of record bounds!");
+        }
+        T value;
+        // memcpy since there is no guarantee about alignment of values within records
+        std::memcpy(&value, m_pData + offset, sizeof(T));
+        return value;
+    }
+
+    /**
+    * @return Number of fields in the CSV row.
+    */
+    std::size_t getFieldCount() const
+    {
+        splitFields();
+        return m_fields.size();
+    }
+
+    /**
+    * Throws std::out_of_range if the row has less fields.
+    * Surrounding double quotes are removed, and double-double quotes inside quoted fields are unescaped.
+    *
+    * @param index 0-based index of the field.
+    * @return      Value of the field as string.
+    */
+    std::string getField(std::size_t index) const
+    {
+        splitFields();
+        if (index >= m_fields.size())
+        {
+            throw std::out_of_range("DataRow::getField(): index out of range at row " + std::to_string(m_rowNumber) + "!");
+        }
+
+        const char* const pBegin = m_pData + m_fields[index].first;
+        const std::size_t len = m_fields[index].second;
+        if ((len < 2) || (*pBegin != '"') || (pBegin[len - 1] != '"'))
+        {
+            return std::string(pBegin, len);
+        }
+
+        std::string sUnquoted;
+        sUnquoted.reserve(len - 2);
+        for (std::size_t i = 1; i < len - 1; ++i)
+        {
+            sUnquoted.push_back(pBegin[i]);
+            if ((pBegin[i] == '"') && (pBegin[i + 1] == '"'))
+            {
+                ++i;
+            }
+        }
+        return sUnquoted;
+    }
+
+    /**
+    * Throws std::out_of_range if the row has less fields, or std::invalid_argument if the field is not a valid integer.
+    */
+    long long getFieldAsLongLong(std::size_t index) const
+    {
+        const std::string sField = getField(index);
+        char* pEnd = nullptr;
+        const long long value = strtoll(sField.c_str(), &pEnd, 10);
+        if (sField.empty() || (*pEnd != '\0'))
+        {
+            throw std::invalid_argument("DataRow::getFieldAsLongLong(): invalid integer \"" + sField + "\" at row " + std::to_string(m_rowNumber) + "!");
+        }
+        return value;
+    }
+
+    /**
+    * Throws std::out_of_range if the row has less fields, or std::invalid_argument if the field is not a valid number.
+    */
+    double getFieldAsDouble(std::size_t index) const
+    {
+        const std::string sField = getField(index);
+        char* pEnd = nullptr;
+        const double value = strtod(sField.c_str(), &pEnd);
+        if (sField.empty() || (*pEnd != '\0'))
+        {
+            throw std::invalid_argument("DataRow::getFieldAsDouble(): invalid number \"" + sField + "\" at row " + std::to_string(m_rowNumber) + "!");
+        }
+        return value;
+    }
+
+private:
+
+    friend class CsvDataTable;
+    friend class BinaryDataTable;
+    friend class DataDrivenTest;
+
+    std::size_t m_rowNumber = 0;
+    const char* m_pData = nullptr;
+    std::size_t m_size = 0;
+    char m_cSeparator = ',';
+    mutable bool m_bFieldsSplit = false;
+    mutable std::vector<std::pair<std::size_t, std::size_t>> m_fields;  /**< Offset and length of fields, filled by splitFields(). */
+
+    /**
+    * Rows are reused by the worker threads, so field vector capacity is also reused and we don't allocate for every row.
+    */
+    void set(std::size_t rowNumber, const char* pData, std::size_t size)
+    {
+        m_rowNumber = rowNumber;
+        m_pData = pData;
+        m_size = size;
+        m_bFieldsSplit = false;
+    }
+
+    void splitFields() const
+    {
+        if (m_bFieldsSplit)
+        {
+            return;
+        }
+        m_bFieldsSplit = true;
+        m_fields.clear();
+
+        bool bInQuotes = false;
+        std::size_t iFieldStart = 0;
+        for (std::size_t i = 0; i < m_size; ++i)
+        {
+            if (m_pData[i] == '"')
+            {
+                bInQuotes = !bInQuotes;
+            }
+            else if ((m_pData[i] == m_cSeparator) && !bInQuotes)
+            {
+                m_fields.emplace_back(iFieldStart, i - iFieldStart);
+                iFieldStart = i + 1;
+            }
+        }
+        m_fields.emplace_back(iFieldStart, m_size - iFieldStart);
+    }
+}; // class DataRow
+
+
+/**
+* Contiguous part of a DataTable, processed by a single worker thread at a time.
+*/
+struct DataChunk
+{
+    const char* m_pBegin = nullptr;
+    const char* m_pEnd = nullptr;
+    std::size_t m_firstRowNumber = 0;  /**< 1-based row number of the first row of the chunk within the file.
+                                            0 if unknown in advance (custom tables), in that case DataRow::getRowNumber() is
+                                            relative to the chunk, and only the failed rows reported by DataDrivenTest are
+                                            made absolute after all chunks are processed. */
+};
+
+
+/**
+* Base class for memory-mapped test case tables.
+* Tables only know how to split themselves into chunks and how to iterate over rows of a chunk, test execution is done by DataDrivenTest.
+*/
+class DataTable
+{
+public:
+
+    virtual ~DataTable() = default;
+
+    DataTable(const DataTable&) = delete;
+    DataTable& operator=(const DataTable&) = delete;
+    DataTable(DataTable&&) = delete;
+    DataTable& operator=(DataTable&&) = delete;
+
+    const std::string& getFilename() const
+    {
+        return m_sFilename;
+    }
+
+    /**
+    * @param  nChunksHint Preferred number of chunks. The actual number of chunks might be less, e.g. for small tables.
+    * @return Non-overlapping chunks covering all rows of the table.
+    */
+    virtual std::vector<DataChunk> split(std::size_t nChunksHint) const = 0;
+
+    /**
+    * Reads the next row of the given chunk.
+    *
+    * @param pCursor       Position in the chunk, advanced past the read row.
+    * @param chunk         The chunk being read.
+    * @param row           Filled with the read row, its row number is relative to the beginning of the chunk if chunk's first row number is unknown (0).
+    * @param iRowInChunk   0-based position of the read row within the chunk, counting also skipped rows (e.g. empty lines), advanced past the read row.
+    * @return True if a row has been read, false if no more rows in the chunk.
+    */
+    virtual bool nextRow(const char*& pCursor, const DataChunk& chunk, DataRow& row, std::size_t& iRowInChunk) const = 0;
+
+    /**
+    * @return Field separator character to be used by rows read from this table.
+    */
+    virtual char getSeparator() const
+    {
+        return ',';
+    }
+
+protected:
+
+    static std::size_t getMinChunkBytes()
+    {
+        return 64 * 1024;  // avoid scheduling overhead of too small chunks
+    }
+
+    DataTable(const std::string& filename) :
+        m_sFilename(filename),
+        m_file(filename)
+    {}
+
+    std::string m_sFilename;
+    MappedFile m_file;
+}; // class DataTable
+
+
+/**
+* Text table with one test case per line, fields separated by a separator character.
+* Fields can be double-quoted, however quoted fields cannot contain line breaks since the table is split into chunks at line breaks
+* without parsing the whole file in advance.
+* Both LF and CRLF line endings are accepted, empty lines are skipped.
+*/
+class CsvDataTable : public DataTable
+{
+public:
+
+    /**
+    * @param filename    Path to the CSV file.
+    * @param bHasHeader  If true, the 1st line is treated as header containing column names, and not as a test case.
+    * @param cSeparator  Field separator character.
+    */
+    CsvDataTable(const std::string& filename, bool bHasHeader = true, char cSeparator = ',') :
+        DataTable(filename),
+        m_cSeparator(cSeparator)
+    {
+        m_pRowsBegin = m_file.getData();
+        const char* const pFileEnd = m_file.getData() + m_file.getSize();
+        if (!bHasHeader || (m_file.getSize() == 0))
+        {
+            return;
+        }
+
+        const char* pLineEnd = static_cast<const char*>(std::memchr(m_pRowsBegin, '\n', m_file.getSize()));
+        if (pLineEnd == nullptr)
+        {
+            pLineEnd = pFileEnd;
+        }
+        DataRow headerRow;
+        headerRow.m_cSeparator = m_cSeparator;
+        headerRow.set(1, m_pRowsBegin, trimmedLineLength(m_pRowsBegin, pLineEnd));
+        for (std::size_t i = 0; i < headerRow.getFieldCount(); ++i)
+        {
+            m_vHeader.push_back(headerRow.getField(i));
+        }
+        m_pRowsBegin = (pLineEnd == pFileEnd) ? pFileEnd : pLineEnd + 1;
+        m_nHeaderLines = 1;
+    }
+
+    /**
+    * @return Column names read from the header line, empty if there is no header.
+    */
+    const std::vector<std::string>& getHeader() const
+    {
+        return m_vHeader;
+    }
+
+    /**
+    * Throws std::out_of_range if there is no such column in the header.
+    *
+    * @return 0-based index of the column with the given name, to be used with DataRow::getField().
+    */
+    std::size_t getColumnIndex(const std::string& columnName) const
+    {
+        const auto it = std::find(m_vHeader.begin(), m_vHeader.end(), columnName);
+        if (it == m_vHeader.end())
+        {
+            throw std::out_of_range("CsvDataTable::getColumnIndex(): no such column: " + columnName);
+        }
+        return static_cast<std::size_t>(it - m_vHeader.begin());
+    }
+
+    virtual std::vector<DataChunk> split(std::size_t nChunksHint) const override
+    {
+        std::vector<DataChunk> chunks;
+        const char* const pFileEnd = m_file.getData() + m_file.getSize();
+        if (m_pRowsBegin == pFileEnd)
+        {
+            return chunks;
+        }
+
+        const std::size_t nBytes = static_cast<std::size_t>(pFileEnd - m_pRowsBegin);
+        const std::size_t nChunkBytes = std::max<std::size_t>(getMinChunkBytes(), nBytes / std::max<std::size_t>(1, nChunksHint));
+        const char* pChunkBegin = m_pRowsBegin;
+        std::size_t firstRowNumber = m_nHeaderLines + 1;
+        while (pChunkBegin < pFileEnd)
+        {
+            DataChunk chunk;
+            chunk.m_pBegin = pChunkBegin;
+            if (static_cast<std::size_t>(pFileEnd - pChunkBegin) <= nChunkBytes)
+            {
+                chunk.m_pEnd = pFileEnd;
+            }
+            else
+            {
+                // chunks shall end at line boundaries
+                const char* const pNominalEnd = pChunkBegin + nChunkBytes;
+                const char* const pLineEnd = static_cast<const char*>(std::memchr(pNominalEnd, '\n', static_cast<std::size_t>(pFileEnd - pNominalEnd)));
+                chunk.m_pEnd = (pLineEnd == nullptr) ? pFileEnd : pLineEnd + 1;
+            }
+            chunk.m_firstRowNumber = firstRowNumber;
+            chunks.push_back(chunk);
+            // counting lines by memchr() is much faster than parsing them, so row numbers are absolute from the beginning
+            firstRowNumber += countLines(chunk.m_pBegin, chunk.m_pEnd);
+            pChunkBegin = chunk.m_pEnd;
+        }
+        return chunks;
+    }
+
+    virtual bool nextRow(const char*& pCursor, const DataChunk& chunk, DataRow& row, std::size_t& iRowInChunk) const override
+    {
+        while (pCursor < chunk.m_pEnd)
+        {
+            const char* pLineEnd = static_cast<const char*>(std::memchr(pCursor, '\n', static_cast<std::size_t>(chunk.m_pEnd - pCursor)));
+            if (pLineEnd == nullptr)
+            {
+                pLineEnd = chunk.m_pEnd;
+            }
+            const char* const pLineBegin = pCursor;
+            const std::size_t iLine = iRowInChunk;
+            pCursor = (pLineEnd == chunk.m_pEnd) ? chunk.m_pEnd : pLineEnd + 1;
+            ++iRowInChunk;
+
+            const std::size_t len = trimmedLineLength(pLineBegin, pLineEnd);
+            if (len == 0)
+            {
+                continue;
+            }
+            row.m_cSeparator = m_cSeparator;
+            row.set(chunk.m_firstRowNumber + iLine, pLineBegin, len);
+            return true;
+        }
+        return false;
+    }
+
+    virtual char getSeparator() const override
+    {
+        return m_cSeparator;
+    }
+
+private:
+
+    char m_cSeparator;
+    const char* m_pRowsBegin = nullptr;     /**< First byte after the header line. */
+    std::size_t m_nHeaderLines = 0;
+    std::vector<std::string> m_vHeader;
+
+    /**
+    * @return Number of line breaks between the given pointers.
+    */
+    static std::size_t countLines(const char* pBegin, const char* pEnd)
+    {
+        std::size_t nLines = 0;
+        for (const char* p = pBegin;
+            (p < pEnd) && ((p = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(pEnd - p)))) != nullptr);
+            ++p)
+        {
+            ++nLines;
+        }
+        return nLines;
+    }
+
+    static std::size_t trimmedLineLength(const char* pLineBegin, const char* pLineEnd)
+    {
+        std::size_t len = static_cast<std::size_t>(pLineEnd - pLineBegin);
+        if ((len > 0) && (pLineBegin[len - 1] == '\r'))
+        {
+            --len;
+        }
+        return len;
+    }
+}; // class CsvDataTable
+
+
+/**
+* Binary table with fixed-size records, optionally preceded by a fixed-size file header.
+* Throws std::runtime_error if the file size minus the header size is not a multiple of the record size.
+*/
+class BinaryDataTable : public DataTable
+{
+public:
+
+    /**
+    * @param filename    Path to the binary file.
+    * @param recordSize  Size of a single record (test case) in bytes.
+    * @param headerSize  Number of bytes to be skipped at the beginning of the file.
+    */
+    BinaryDataTable(const std::string& filename, std::size_t recordSize, std::size_t headerSize = 0) :
+        DataTable(filename),
+        m_recordSize(recordSize),
+        m_headerSize(headerSize)
+    {
+        if (m_recordSize == 0)
+        {
+            throw std::runtime_error("BinaryDataTable ctor: recordSize cannot be 0!");
+        }
+        if ((m_file.getSize() < m_headerSize) || (((m_file.getSize() - m_headerSize) % m_recordSize) != 0))
+        {
+            throw std::runtime_error("BinaryDataTable ctor: size of " + filename + " is not header size + multiple of record size!");
+        }
+    }
+
+    /**
+    * @return Number of records in the table.
+    */
+    std::size_t getRecordCount() const
+    {
+        return (m_file.getSize() - m_headerSize) / m_recordSize;
+    }
+
+    /**
+    * @return Pointer to the file header, or nullptr if header size is 0.
+    */
+    const char* getHeader() const
+    {
+        return (m_headerSize == 0) ? nullptr : m_file.getData();
+    }
+
+    virtual std::vector<DataChunk> split(std::size_t nChunksHint) const override
+    {
+        std::vector<DataChunk> chunks;
+        const std::size_t nRecords = getRecordCount();
+        if (nRecords == 0)
+        {
+            return chunks;
+        }
+
+        const std::size_t nChunkRecords = std::max<std::size_t>(
+            std::max<std::size_t>(1, getMinChunkBytes() / m_recordSize),
+            (nRecords + nChunksHint - 1) / std::max<std::size_t>(1, nChunksHint));
+        const char* const pRecords = m_file.getData() + m_headerSize;
+        for (std::size_t iFirst = 0; iFirst < nRecords; iFirst += nChunkRecords)
+        {
+            DataChunk chunk;
+            chunk.m_pBegin = pRecords + iFirst * m_recordSize;
+            chunk.m_pEnd = pRecords + std::min(nRecords, iFirst + nChunkRecords) * m_recordSize;
+            chunk.m_firstRowNumber = iFirst + 1;
+            chunks.push_back(chunk);
+        }
+        return chunks;
+    }
+
+    virtual bool nextRow(const char*& pCursor, const DataChunk& chunk, DataRow& row, std::size_t& iRowInChunk) const override
+    {
+        if (pCursor >= chunk.m_pEnd)
+        {
+            return false;
+        }
+        row.set(chunk.m_firstRowNumber + iRowInChunk, pCursor, m_recordSize);
+        pCursor += m_recordSize;
+        ++iRowInChunk;
+        return true;
+    }
+
+private:
+
+    std::size_t m_recordSize;
+    std::size_t m_headerSize;
+}; // class BinaryDataTable
+
+
+/**
+    Unit test class supporting data-driven subtests: the same test case function is executed for every row of a DataTable.
+    Instead of loading millions of input/expected pairs into vectors in initialize(), the table file is memory-mapped,
+    rows are parsed lazily by the test case function, and chunks of the table are processed by multiple threads in parallel.
+
+    Example:
+
+        class ParserRegressionTest :
+            public DataDrivenTest
+        {
+        public:
+
+            ParserRegressionTest() :
+                DataDrivenTest( __FILE__ )
+            {
+                addSubTest("test_parser_corpus", (PFNUNITSUBTEST) &ParserRegressionTest::test_parser_corpus);
+            }
+
+        private:
+
+            bool test_parser_corpus()
+            {
+                const CsvDataTable table("corpus.csv");
+                return runDataCases(table, (PFNDATACASE) &ParserRegressionTest::parserCase);
+            }
+
+            bool parserCase(const DataRow& row)
+            {
+                return parse(row.getField(0)) == row.getFieldAsLongLong(1);
+            }
+        };
+
+    Since test case functions might be invoked in parallel, they shall not modify the state of the test object, including
+    the invocation of the assertXXX() functions! Just return true on pass and false on fail, runDataCases() will collect the
+    numbers of the failing rows and add them to the error messages.
+    If a test case function throws, the row is treated as failed and the first exception message is also reported.
+    Use setDataCaseThreadCount(1) if the test case function is not thread-safe; in that case assertXXX() functions can be used too.
+*/
+class DataDrivenTest : public UnitTest
+{
+public:
+
+    /**
+        @param testFile The file where the test is defined.
+        @param testName The name of the test. If empty, itt will be "Unnamed Test".
+    */
+    DataDrivenTest(const std::string& testFile = "", const std::string& testName = "") :
+        UnitTest(testFile, testName)
+    {}
+
+    /**
+        @param nThreads Number of threads executing test cases. 0 means the number of hardware threads.
+    */
+    void setDataCaseThreadCount(std::size_t nThreads)
+    {
+        m_nDataCaseThreads = nThreads;
+    }
+
+    /**
+        @param nRows Maximum number of failing row numbers listed in the error messages by a single runDataCases() call.
+    */
+    void setMaxReportedFailedRows(std::size_t nRows)
+    {
+        m_nMaxReportedFailedRows = nRows;
+    }
+
+protected:
+    typedef bool (Test::* PFNDATACASE) (const DataRow&);  /**< Type for a data-driven test case function pointer. */
+
+    /**
+        Executes the given test case function for every row of the given table.
+
+        @param table    The table containing the test cases.
+        @param caseFunc Member function of the derived test class, returning true on pass and false on fail.
+        @return True if the test case function passed for every row, false otherwise.
+    */
+    bool runDataCases(const DataTable& table, PFNDATACASE caseFunc)
+    {
+        return runDataCases(table, [this, caseFunc](const DataRow& row) { return (this->*caseFunc)(row); });
+    }
+
+    /**
+        Same as above but with arbitrary callable having the signature: bool caseFunc(const DataRow& row).
+    */
+    template <typename CaseFunc>
+    bool runDataCases(const DataTable& table, CaseFunc caseFunc)
+    {
+        const std::size_t nThreads = (m_nDataCaseThreads == 0) ?
+            std::max<unsigned>(1, std::thread::hardware_concurrency()) :
+            m_nDataCaseThreads;
+        // more chunks than threads, so threads finishing early can take over remaining work
+        std::vector<DataChunk> chunks = table.split(nThreads * 4);
+        std::vector<ChunkResult> results(chunks.size());
+        std::atomic<std::size_t> iNextChunk(0);
+
+        const auto worker = [&]()
+        {
+            DataRow row;
+            row.m_cSeparator = table.getSeparator();
+            for (std::size_t iChunk = iNextChunk++; iChunk < chunks.size(); iChunk = iNextChunk++)
+            {
+                const DataChunk& chunk = chunks[iChunk];
+                ChunkResult& result = results[iChunk];
+                const char* pCursor = chunk.m_pBegin;
+                while (table.nextRow(pCursor, chunk, row, result.m_nRowsInChunk))
+                {
+                    ++result.m_nCases;
+                    bool bPassed = false;
+                    try
+                    {
+                        bPassed = caseFunc(static_cast<const DataRow&>(row));
+                    }
+                    catch (const std::exception& e)
+                    {
+                        if (result.m_sFirstException.empty())
+                        {
+                            result.m_sFirstException = e.what();
+                            result.m_iFirstExceptionRow = result.m_nRowsInChunk - 1;
+                        }
+                    }
+                    catch (...)
+                    {
+                        if (result.m_sFirstException.empty())
+                        {
+                            result.m_sFirstException = "unknown exception";
+                            result.m_iFirstExceptionRow = result.m_nRowsInChunk - 1;
+                        }
+                    }
+
+                    if (!bPassed)
+                    {
+                        ++result.m_nFailedCases;
+                        // within a chunk rows come in increasing order, so the first few failures are the smallest row numbers of the chunk
+                        if (result.m_vFailedRowsInChunk.size() < m_nMaxReportedFailedRows)
+                        {
+                            result.m_vFailedRowsInChunk.push_back(result.m_nRowsInChunk - 1);
+                        }
+                    }
+                }
+            }
+        };
+
+        if ((nThreads == 1) || (chunks.size() <= 1))
+        {
+            worker();
+        }
+        else
+        {
+            std::vector<std::thread> threads;
+            for (std::size_t i = 0; i < std::min(nThreads, chunks.size()); ++i)
+            {
+                threads.emplace_back(worker);
+            }
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        // now that we know how many rows each chunk has, row numbers can be made absolute
+        std::size_t nCases = 0;
+        std::size_t nFailedCases = 0;
+        std::vector<std::size_t> vFailedRows;
+        std::string sFirstException;
+        std::size_t iFirstExceptionRow = 0;
+        std::size_t nextChunkFirstRowNumber = chunks.empty() ? 0 : chunks.front().m_firstRowNumber;
+        for (std::size_t i = 0; i < chunks.size(); ++i)
+        {
+            const std::size_t firstRowNumber = (chunks[i].m_firstRowNumber == 0) ? nextChunkFirstRowNumber : chunks[i].m_firstRowNumber;
+            nextChunkFirstRowNumber = firstRowNumber + results[i].m_nRowsInChunk;
+
+            nCases += results[i].m_nCases;
+            nFailedCases += results[i].m_nFailedCases;
+            for (const auto& iRow : results[i].m_vFailedRowsInChunk)
+            {
+                vFailedRows.push_back(firstRowNumber + iRow);
+            }
+            if (sFirstException.empty() && !results[i].m_sFirstException.empty())
+            {
+                sFirstException = results[i].m_sFirstException;
+                iFirstExceptionRow = firstRowNumber + results[i].m_iFirstExceptionRow;
+            }
+        }
+
+        if (nFailedCases == 0)
+        {
+            return true;
+        }
+
+        std::sort(vFailedRows.begin(), vFailedRows.end());
+        std::string sFailedRows;
+        for (std::size_t i = 0; i < std::min(vFailedRows.size(), m_nMaxReportedFailedRows); ++i)
+        {
+            sFailedRows.append(i == 0 ? "" : ", ").append(std::to_string(vFailedRows[i]));
+        }
+        if (nFailedCases > m_nMaxReportedFailedRows)
+        {
+            sFailedRows.append(", ...");
+        }
+
+        addToErrorMessages(
+            (std::string("  <").append(table.getFilename()).append("> failed rows: ").append(std::to_string(nFailedCases)).append(" / ").append(
+                std::to_string(nCases)).append(", row numbers: ").append(sFailedRows)).c_str());
+        if (!sFirstException.empty())
+        {
+            addToErrorMessages(
+                (std::string("  <").append(table.getFilename()).append("> row ").append(std::to_string(iFirstExceptionRow)).append(
+                    " threw: ").append(sFirstException)).c_str());
+        }
+        return false;
+    } // runDataCases()
+
+private:
+
+    struct ChunkResult
+    {
+        std::size_t m_nRowsInChunk = 0;                     /**< Also counts skipped rows, needed for calculating absolute row numbers. */
+        std::size_t m_nCases = 0;
+        std::size_t m_nFailedCases = 0;
+        std::vector<std::size_t> m_vFailedRowsInChunk;      /**< 0-based row positions relative to the beginning of the chunk. */
+        std::string m_sFirstException;
+        std::size_t m_iFirstExceptionRow = 0;
+    };
+
+    std::size_t m_nDataCaseThreads = 0;
+    std::size_t m_nMaxReportedFailedRows = 20;
+
+}; // class DataDrivenTest
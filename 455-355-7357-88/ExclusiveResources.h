@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+    ###################################################################################
+    ExclusiveResources.h
+    Basic header-only tracking of exclusive resources held by the test running in the current thread.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>  // std::find()
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+* Names of the predefined exclusive resources of tests, see Test::addExclusiveResource(), and checking them in code
+* touching process-wide state.
+*
+* When Test::runTests() runs tests concurrently, each test thread publishes the exclusive resources of its test here,
+* and process-wide state of the framework (installed Clock, ScopeBenchmarkerDataStore) calls require() before
+* changing it, so a test forgetting to declare the resource fails with a clear error instead of corrupting other tests.
+* Threads not started by Test::runTests() (e.g. sequential runs, threads started by the tests) are not checked.
+*/
+class ExclusiveResources
+{
+public:
+
+    static constexpr const char* const MACHINE = "machine";             /**< Runs alone, implies all other resources. */
+    static constexpr const char* const CLOCK = "clock";                 /**< Installing a Clock, e.g. by ClockInstaller. */
+    static constexpr const char* const BENCHMARKERS = "benchmarkers";   /**< Using ScopeBenchmarker or ScopeBenchmarkerDataStore. */
+
+    /**
+    * Sets the exclusive resources held by the current thread, nullptr stops checking them in the current thread.
+    * The caller keeps ownership of the vector, which must outlive the setting.
+    */
+    static void setHeldByThread(const std::vector<std::string>* pResources)
+    {
+        const std::string sMachine = MACHINE;   // not passing MACHINE by reference, that would need its definition in C++14
+        Held& held = getHeldRef();
+        held.m_pResources = pResources;
+        held.m_bMachine = pResources && (std::find(pResources->begin(), pResources->end(), sMachine) != pResources->end());
+        held.m_szLastGranted = nullptr;
+    }
+
+    /**
+    * Throws std::runtime_error if the current thread is checked and does not hold the given resource nor MACHINE.
+    * The resources are searched only at the first require() of the same resource name pointer in the thread, e.g.
+    * BENCHMARKERS, later calls only compare the pointer.
+    *
+    * @param szResource Name of the required resource.
+    * @param szUser     Name of the function requiring it, for the error message.
+    */
+    static void require(const char* szResource, const char* szUser)
+    {
+        Held& held = getHeldRef();
+        if (!held.m_pResources || held.m_bMachine || (szResource == held.m_szLastGranted))
+        {
+            return;
+        }
+        if (std::find(held.m_pResources->begin(), held.m_pResources->end(), szResource) != held.m_pResources->end())
+        {
+            held.m_szLastGranted = szResource;
+            return;
+        }
+        throw std::runtime_error(std::string(szUser) + ": the test must have exclusive resource \"" + szResource +
+            "\" to run concurrently with other tests, see Test::addExclusiveResource()!");
+    }
+
+private:
+
+    struct Held
+    {
+        const std::vector<std::string>* m_pResources;   /**< Null if the thread is not checked. */
+        bool m_bMachine;                                /**< m_pResources contains MACHINE. */
+        const char* m_szLastGranted;                    /**< Last resource name found in m_pResources by require(). */
+    };
+
+    static Held& getHeldRef()
+    {
+        // zero-initialized since it has thread storage duration
+        static thread_local Held s_held;
+        return s_held;
+    }
+};
@@ -0,0 +1,752 @@
+#pragma once
+
+/*
+    ###################################################################################
+    FlightRecorder.h
+    Basic header-only always-on recorder of recent ScopeBenchmarker events.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>
+#include <atomic>              // requires cpp11
+#include <chrono>              // requires cpp11
+#include <condition_variable>  // requires cpp11
+#include <cstddef>             // ptrdiff_t
+#include <cstdint>             // uint64_t
+#include <cstdio>              // snprintf
+#include <fstream>
+#include <map>
+#include <memory>              // requires cpp11
+#include <mutex>               // requires cpp11
+#include <stdexcept>
+#include <string>
+#include <thread>              // requires cpp11
+#include <utility>
+#include <vector>
+
+#include "PFL.h"  // for PFL::StringHash
+
+#include "Clock.h"
+#include "ScopeBenchmarker.h"
+
+/**
+* Flight recorder for catching rare spikes, e.g. the one happening once an hour in production.
+*
+* While recording, every scope entered and left by any ScopeBenchmarker is saved as an event into a fixed-size
+* per-thread ring buffer, so only the most recent events are kept and memory usage does not grow.
+* The buffer of an exited thread is reused by the next new thread, so thread churn doesn't grow memory usage either.
+* When a trigger rule fires, the ring buffers are frozen and a background thread is woken up, which copies the events
+* of the last few seconds (the dump window), lets recording continue, then writes the copied events to a trace file.
+*
+* Trigger rules:
+*  - a given scope takes longer than its threshold, see addScopeTrigger();
+*  - a frame takes longer than the frame budget, see setFrameBudget() and checkFrameDuration();
+*  - manual trigger, see trigger().
+*
+* Triggers are rate-limited: after a dump, further triggers are suppressed for the minimum dump interval, and there is
+* a maximum number of dumps, so a spike storm doesn't thrash the disk.
+*
+* Trace files are in the Chrome Trace Event JSON format, so they can be opened by chrome://tracing or
+* https://ui.perfetto.dev. File name is <prefix>_<dump index>.json.
+* Stages of the same FlowTracker flow are linked by flow arrows in the trace, also across threads.
+*
+* Recording an event costs a relaxed atomic load, a thread-local lookup, writing the event and a release store.
+* A firing trigger costs only locking a mutex and waking up the background thread on the triggering thread, scope
+* names are resolved and the reason is formatted by the background thread.
+* Only 1 FlightRecorder should be recording at the same time, since each of them records every scope.
+* Trigger rules, dump window and rate limit should be configured before start().
+*
+* Example:
+*
+*     FlightRecorder flightRecorder("spike");
+*     flightRecorder.addScopeTrigger("physics", std::chrono::milliseconds(5));
+*     flightRecorder.setFrameBudget(std::chrono::microseconds(16667));
+*     flightRecorder.start();
+*     while (running)
+*     {
+*         frameProfiler.markFrameBoundary();
+*         flightRecorder.checkFrameDuration(frameProfiler.getLastFrameDuration());
+*         ...
+*     }
+*/
+class FlightRecorder : public ScopeBenchmarkerListener
+{
+public:
+
+    enum class EventType : unsigned char
+    {
+        Enter,
+        Exit,
+        FlowBegin,
+        FlowStage,
+        FlowEnd
+    };
+
+    struct Event
+    {
+        Clock::Duration::rep m_timeTicks;      /**< Clock::TimePoint::time_since_epoch().count() */
+        PFL::StringHash m_nameHash;
+        unsigned long long m_flowId;           /**< Only for flow events, see FlowTracker. */
+        EventType m_type;
+    };
+
+    /**
+    * @param sTraceFilePrefix Path and beginning of the file name of the trace files.
+    * @param nEventsPerThread Capacity of the per-thread ring buffers, rounded up to power of 2.
+    */
+    FlightRecorder(const std::string& sTraceFilePrefix = "flight_recorder", size_t nEventsPerThread = 65536) :
+        m_sTraceFilePrefix(sTraceFilePrefix),
+        m_id(getNextId()),
+        m_writerThread()
+    {
+        if (sTraceFilePrefix.empty())
+        {
+            throw std::runtime_error("FlightRecorder ctor: sTraceFilePrefix cannot be empty!");
+        }
+        if (nEventsPerThread < 2)
+        {
+            throw std::runtime_error("FlightRecorder ctor: nEventsPerThread must be at least 2!");
+        }
+
+        m_nEventsPerThread = 1;
+        while (m_nEventsPerThread < nEventsPerThread)
+        {
+            m_nEventsPerThread <<= 1;
+        }
+
+        m_writerThread = std::thread(&FlightRecorder::writeDumps, this);
+    }
+
+    virtual ~FlightRecorder()
+    {
+        stop();  // waits for the threads still notifying this recorder
+        {
+            std::lock_guard<std::mutex> lock(m_dumpsMutex);
+            m_bShutdown = true;
+        }
+        m_dumpsCv.notify_all();
+        m_writerThread.join();
+    }
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+    FlightRecorder(FlightRecorder&&) = delete;
+    FlightRecorder& operator=(FlightRecorder&&) = delete;
+
+    /**
+    * Starts recording the events of all ScopeBenchmarkers.
+    * Throws std::runtime_error if the recorder cannot be added as listener to ScopeBenchmarkerDataStore.
+    */
+    void start()
+    {
+        if (m_bRecording)
+        {
+            return;
+        }
+        if (!ScopeBenchmarkerDataStore::addListener(this))
+        {
+            throw std::runtime_error("FlightRecorder::start(): too many ScopeBenchmarker listeners!");
+        }
+        m_bRecording = true;
+    }
+
+    /**
+    * Stops recording, after waiting for the other threads still recording an event or triggering.
+    * Already recorded events are kept, and pending dumps are still written.
+    */
+    void stop()
+    {
+        if (!m_bRecording)
+        {
+            return;
+        }
+        ScopeBenchmarkerDataStore::removeListener(this);
+        m_bRecording = false;
+    }
+
+    bool isRecording() const
+    {
+        return m_bRecording;
+    }
+
+    /**
+    * Adds a trigger rule: if the scope of the given ScopeBenchmarker name takes longer than the threshold, a dump is triggered.
+    * Trigger rules cannot be changed while recording.
+    */
+    void addScopeTrigger(const std::string& sScopeName, const Clock::Duration& threshold)
+    {
+        if (m_bRecording)
+        {
+            throw std::runtime_error("FlightRecorder::addScopeTrigger(): cannot add trigger while recording!");
+        }
+        m_scopeTriggers.push_back(ScopeTrigger{ PFL::calcHash(sScopeName), threshold, sScopeName });
+    }
+
+    /**
+    * @param budget Frames longer than this trigger a dump in checkFrameDuration(). 0 disables the frame budget trigger.
+    */
+    void setFrameBudget(const Clock::Duration& budget)
+    {
+        m_frameBudget = budget;
+    }
+
+    /**
+    * Triggers a dump if the given frame duration exceeds the frame budget.
+    * Convenient to be called with FrameProfiler::getLastFrameDuration() right after FrameProfiler::markFrameBoundary().
+    *
+    * @return True if a dump was triggered, false otherwise.
+    */
+    bool checkFrameDuration(const Clock::Duration& frameDuration)
+    {
+        if ((m_frameBudget <= Clock::Duration::zero()) || (frameDuration <= m_frameBudget))
+        {
+            return false;
+        }
+        return tryTrigger(Clock::now(), [this, &frameDuration](TriggerRequest& request) {
+            request.m_kind = TriggerKind::Frame;
+            request.m_duration = frameDuration;
+            request.m_threshold = m_frameBudget;
+        });
+    }
+
+    /**
+    * Manually triggers a dump, subject to rate limiting.
+    *
+    * @return True if a dump was triggered, false otherwise.
+    */
+    bool trigger(const std::string& sReason)
+    {
+        return tryTrigger(Clock::now(), [&sReason](TriggerRequest& request) {
+            request.m_kind = TriggerKind::Manual;
+            request.m_sReason = sReason;
+        });
+    }
+
+    /**
+    * @param window Only events of this last period before the trigger are dumped.
+    */
+    void setDumpWindow(const Clock::Duration& window)
+    {
+        m_dumpWindow = window;
+    }
+
+    /**
+    * @param minInterval Triggers within this period after the previous dump are suppressed.
+    * @param nMaxDumps   Triggers are suppressed after this many dumps.
+    */
+    void setRateLimit(const Clock::Duration& minInterval, unsigned int nMaxDumps)
+    {
+        m_minDumpInterval = minInterval;
+        m_nMaxDumps = nMaxDumps;
+    }
+
+    /**
+    * @return Number of triggered dumps, including the ones still being written.
+    */
+    unsigned int getDumpCount() const
+    {
+        return m_nDumps;
+    }
+
+    /**
+    * @return Number of triggers suppressed by rate limiting or by another dump being frozen at the same time.
+    */
+    unsigned long long getSuppressedTriggerCount() const
+    {
+        return m_nSuppressedTriggers;
+    }
+
+    /**
+    * Blocks until all triggered dumps are written to file.
+    */
+    void waitForPendingDumps()
+    {
+        std::unique_lock<std::mutex> lock(m_dumpsMutex);
+        m_dumpsWrittenCv.wait(lock, [this]() { return !m_bTriggerPending && !m_bWritingDump; });
+    }
+
+    /**
+    * @return Names of the written trace files, in order of writing.
+    */
+    std::vector<std::string> getWrittenFiles() const
+    {
+        std::lock_guard<std::mutex> lock(m_dumpsMutex);
+        return m_writtenFiles;
+    }
+
+    /**
+    * @return Errors happened during writing trace files.
+    */
+    std::vector<std::string> getErrorMessages() const
+    {
+        std::lock_guard<std::mutex> lock(m_dumpsMutex);
+        return m_errorMessages;
+    }
+
+    virtual void onScopeEnter(const PFL::StringHash& nameHash, const Clock::TimePoint& timeStart) override
+    {
+        record(nameHash, EventType::Enter, timeStart);
+    }
+
+    virtual void onScopeExit(const PFL::StringHash& nameHash, const Clock::TimePoint& timeStart, const Clock::TimePoint& timeEnd) override
+    {
+        record(nameHash, EventType::Exit, timeEnd);
+
+        for (size_t i = 0; i < m_scopeTriggers.size(); i++)
+        {
+            const ScopeTrigger& scopeTrigger = m_scopeTriggers[i];
+            if ((scopeTrigger.m_nameHash == nameHash) && (timeEnd - timeStart > scopeTrigger.m_threshold))
+            {
+                tryTrigger(timeEnd, [i, &scopeTrigger, &timeStart, &timeEnd](TriggerRequest& request) {
+                    request.m_kind = TriggerKind::Scope;
+                    request.m_iScopeTrigger = i;
+                    request.m_duration = timeEnd - timeStart;
+                    request.m_threshold = scopeTrigger.m_threshold;
+                });
+            }
+        }
+    }
+
+    virtual void onFlowEvent(
+        const PFL::StringHash& nameHash, unsigned long long flowId, FlowEventType type, const Clock::TimePoint& time) override
+    {
+        switch (type)
+        {
+        case FlowEventType::Begin: record(nameHash, EventType::FlowBegin, time, flowId); break;
+        case FlowEventType::Stage: record(nameHash, EventType::FlowStage, time, flowId); break;
+        case FlowEventType::End: record(nameHash, EventType::FlowEnd, time, flowId); break;
+        }
+    }
+
+private:
+
+    struct ScopeTrigger
+    {
+        PFL::StringHash m_nameHash;
+        Clock::Duration m_threshold;
+        std::string m_sName;
+    };
+
+    struct ThreadBuffer
+    {
+        std::thread::id m_threadId;
+        unsigned int m_threadIndex;                 /**< Used as tid in the trace files. */
+        std::vector<Event> m_events;                /**< Ring buffer, power of 2 size. */
+        std::atomic<uint64_t> m_nWritten{ 0 };      /**< Index of the next event to be written, never wraps. */
+        std::atomic<bool> m_bInUse{ true };         /**< Cleared when the thread exits or records to another recorder, see CachedBuffer. */
+    };
+
+    /**
+    * Thread-local reference to the buffer of the thread in the recorder it records to.
+    * Shares ownership of the buffer, so the buffer stays valid for the thread even after the recorder is destroyed.
+    */
+    struct CachedBuffer
+    {
+        unsigned long long m_recorderId = 0;
+        std::shared_ptr<ThreadBuffer> m_pBuffer;
+
+        ~CachedBuffer()
+        {
+            release();
+        }
+
+        void release()
+        {
+            if (m_pBuffer)
+            {
+                m_pBuffer->m_bInUse.store(false, std::memory_order_release);
+                m_pBuffer.reset();
+            }
+            m_recorderId = 0;
+        }
+    };
+
+    enum class TriggerKind : unsigned char
+    {
+        Scope,
+        Frame,
+        Manual
+    };
+
+    /**
+    * Filled by the triggering thread, the reason is formatted from it only by the background thread.
+    */
+    struct TriggerRequest
+    {
+        TriggerKind m_kind;
+        unsigned int m_dumpIndex;
+        Clock::TimePoint m_timeTrigger;
+        size_t m_iScopeTrigger;                     /**< Index into m_scopeTriggers, only for TriggerKind::Scope. */
+        Clock::Duration m_duration;                 /**< Duration of the scope or frame, not for TriggerKind::Manual. */
+        Clock::Duration m_threshold;                /**< Threshold of the scope or frame budget, not for TriggerKind::Manual. */
+        std::string m_sReason;                      /**< Only for TriggerKind::Manual. */
+    };
+
+    struct PendingDump
+    {
+        unsigned int m_dumpIndex;
+        std::string m_sReason;
+        Clock::TimePoint m_timeTrigger;
+        std::vector<std::pair<unsigned int, std::vector<Event>>> m_events;   /**< Thread index and its events. */
+        std::map<PFL::StringHash, std::string> m_names;
+    };
+
+    const std::string m_sTraceFilePrefix;
+    const unsigned long long m_id;                  /**< Distinguishes recorders for the thread-local buffer cache. */
+    size_t m_nEventsPerThread;
+    std::atomic<bool> m_bRecording{ false };
+
+    std::vector<ScopeTrigger> m_scopeTriggers;
+    Clock::Duration m_frameBudget = Clock::Duration::zero();
+    Clock::Duration m_dumpWindow = std::chrono::seconds(5);
+    Clock::Duration m_minDumpInterval = std::chrono::seconds(60);
+    unsigned int m_nMaxDumps = 10;
+
+    std::mutex m_buffersMutex;                      /**< Guards m_buffers, taken only by new threads and by the background thread. */
+    std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+    unsigned int m_nThreads = 0;                    /**< Number of threads recorded so far, also reusing a buffer. */
+
+    std::atomic<bool> m_bFrozen{ false };           /**< Recording is paused until the background thread copies the events. Also guards the fields below. */
+    std::atomic<unsigned int> m_nDumps{ 0 };
+    std::atomic<unsigned long long> m_nSuppressedTriggers{ 0 };
+    Clock::TimePoint m_timeLastDump;
+    TriggerRequest m_trigger;
+
+    mutable std::mutex m_dumpsMutex;                /**< Guards the fields below. */
+    std::condition_variable m_dumpsCv;
+    std::condition_variable m_dumpsWrittenCv;
+    bool m_bTriggerPending = false;                 /**< m_trigger is waiting for the background thread. */
+    bool m_bWritingDump = false;
+    bool m_bShutdown = false;
+    std::vector<std::string> m_writtenFiles;
+    std::vector<std::string> m_errorMessages;
+    std::thread m_writerThread;                     /**< Copies and writes the triggered dumps, see writeDumps(). */
+
+    static unsigned long long getNextId()
+    {
+        static std::atomic<unsigned long long> s_nextId(1);
+        return s_nextId++;
+    }
+
+    static std::string formatUs(const Clock::Duration& duration)
+    {
+        return std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+    }
+
+    void record(const PFL::StringHash& nameHash, const EventType& type, const Clock::TimePoint& time, unsigned long long flowId = 0)
+    {
+        if (m_bFrozen.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        ThreadBuffer& buffer = getThreadBuffer();
+        const uint64_t nWritten = buffer.m_nWritten.load(std::memory_order_relaxed);
+        Event& event = buffer.m_events[static_cast<size_t>(nWritten & (m_nEventsPerThread - 1))];
+        event.m_timeTicks = time.time_since_epoch().count();
+        event.m_nameHash = nameHash;
+        event.m_flowId = flowId;
+        event.m_type = type;
+        buffer.m_nWritten.store(nWritten + 1, std::memory_order_release);
+    }
+
+    ThreadBuffer& getThreadBuffer()
+    {
+        static thread_local CachedBuffer s_cachedBuffer;
+
+        if (s_cachedBuffer.m_recorderId == m_id)
+        {
+            return *s_cachedBuffer.m_pBuffer;
+        }
+        s_cachedBuffer.release();
+
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        const std::thread::id threadId = std::this_thread::get_id();
+        std::shared_ptr<ThreadBuffer> pBuffer;
+        std::shared_ptr<ThreadBuffer> pUnusedBuffer;
+        for (const auto& buffer : m_buffers)
+        {
+            if (buffer->m_bInUse.load(std::memory_order_acquire))
+            {
+                continue;
+            }
+            if (buffer->m_threadId == threadId)
+            {
+                // this thread recorded to another recorder in the meantime, its events are kept
+                pBuffer = buffer;
+                break;
+            }
+            if (!pUnusedBuffer)
+            {
+                pUnusedBuffer = buffer;
+            }
+        }
+        if (!pBuffer && pUnusedBuffer)
+        {
+            // the events of the exited thread are dropped, since they would be attributed to this thread
+            pBuffer = pUnusedBuffer;
+            pBuffer->m_threadId = threadId;
+            pBuffer->m_threadIndex = ++m_nThreads;
+            pBuffer->m_nWritten.store(0, std::memory_order_relaxed);
+        }
+        if (!pBuffer)
+        {
+            m_buffers.push_back(std::make_shared<ThreadBuffer>());
+            pBuffer = m_buffers.back();
+            pBuffer->m_threadId = threadId;
+            pBuffer->m_threadIndex = ++m_nThreads;
+            pBuffer->m_events.resize(m_nEventsPerThread);
+        }
+        pBuffer->m_bInUse.store(true, std::memory_order_relaxed);
+
+        s_cachedBuffer.m_recorderId = m_id;
+        s_cachedBuffer.m_pBuffer = pBuffer;
+        return *pBuffer;
+    }
+
+    /**
+    * Freezes the ring buffers and hands the trigger over to the background thread, unless rate limited.
+    *
+    * @param fillTrigger Callable with signature: void fillTrigger(TriggerRequest& request), invoked only if the dump
+    *                    is not rate limited, filling the kind of trigger and the fields needed for its reason.
+    */
+    template <typename FillFunc>
+    bool tryTrigger(const Clock::TimePoint& timeTrigger, FillFunc fillTrigger)
+    {
+        bool bExpected = false;
+        if (!m_bRecording || !m_bFrozen.compare_exchange_strong(bExpected, true, std::memory_order_acquire))
+        {
+            ++m_nSuppressedTriggers;
+            return false;
+        }
+
+        if ((m_nDumps >= m_nMaxDumps) || ((m_nDumps > 0) && (timeTrigger - m_timeLastDump < m_minDumpInterval)))
+        {
+            m_bFrozen.store(false, std::memory_order_release);
+            ++m_nSuppressedTriggers;
+            return false;
+        }
+
+        m_trigger.m_dumpIndex = m_nDumps;
+        m_trigger.m_timeTrigger = timeTrigger;
+        fillTrigger(m_trigger);
+        m_timeLastDump = timeTrigger;
+        ++m_nDumps;
+
+        // stays frozen until the background thread copies the events, see collectDump()
+        {
+            std::lock_guard<std::mutex> lock(m_dumpsMutex);
+            m_bTriggerPending = true;
+        }
+        m_dumpsCv.notify_one();
+        return true;
+    }
+
+    std::string formatReason(const TriggerRequest& request) const
+    {
+        switch (request.m_kind)
+        {
+        case TriggerKind::Scope:
+            return m_scopeTriggers[request.m_iScopeTrigger].m_sName + " took " + formatUs(request.m_duration) +
+                " us, threshold is " + formatUs(request.m_threshold) + " us";
+        case TriggerKind::Frame:
+            return "frame took " + formatUs(request.m_duration) + " us, budget is " + formatUs(request.m_threshold) + " us";
+        default:
+            return request.m_sReason;
+        }
+    }
+
+    /**
+    * Copies the events of the dump window of the pending trigger, then lets recording continue.
+    * Invoked by the background thread while the ring buffers are frozen.
+    */
+    PendingDump collectDump()
+    {
+        PendingDump dump;
+        dump.m_dumpIndex = m_trigger.m_dumpIndex;
+        dump.m_sReason = formatReason(m_trigger);
+        dump.m_timeTrigger = m_trigger.m_timeTrigger;
+        m_trigger.m_sReason.clear();
+        const Clock::Duration::rep timeWindowStartTicks = (dump.m_timeTrigger - m_dumpWindow).time_since_epoch().count();
+        {
+            std::lock_guard<std::mutex> lock(m_buffersMutex);
+            for (const auto& buffer : m_buffers)
+            {
+                dump.m_events.push_back(std::make_pair(buffer->m_threadIndex, copyEvents(*buffer, timeWindowStartTicks)));
+            }
+        }
+        m_bFrozen.store(false, std::memory_order_release);
+
+        for (const auto& threadEvents : dump.m_events)
+        {
+            for (const auto& event : threadEvents.second)
+            {
+                if (dump.m_names.find(event.m_nameHash) == dump.m_names.end())
+                {
+                    const std::string sName = ScopeBenchmarkerDataStore::getNameByHash(event.m_nameHash);
+                    dump.m_names[event.m_nameHash] = sName.empty() ? "scope#" + std::to_string(event.m_nameHash) : sName;
+                }
+            }
+        }
+        return dump;
+    }
+
+    /**
+    * Copies the events not older than the given time from the ring buffer.
+    * A writer thread might be in the middle of writing 1 event even though the buffers are frozen, so the slot being
+    * overwritten is skipped, and the events overwritten during copying are dropped.
+    */
+    std::vector<Event> copyEvents(const ThreadBuffer& buffer, const Clock::Duration::rep& timeWindowStartTicks) const
+    {
+        const uint64_t nCapacity = m_nEventsPerThread;
+        const uint64_t nEnd = buffer.m_nWritten.load(std::memory_order_acquire);
+        const uint64_t nBegin = (nEnd >= nCapacity) ? nEnd - nCapacity + 1 : 0;
+
+        std::vector<Event> events;
+        events.reserve(static_cast<size_t>(nEnd - nBegin));
+        for (uint64_t i = nBegin; i < nEnd; i++)
+        {
+            events.push_back(buffer.m_events[static_cast<size_t>(i & (nCapacity - 1))]);
+        }
+
+        const uint64_t nEndAfterCopy = buffer.m_nWritten.load(std::memory_order_acquire);
+        const uint64_t nValidBegin = (nEndAfterCopy >= nCapacity) ? nEndAfterCopy - nCapacity + 1 : 0;
+        if (nValidBegin > nBegin)
+        {
+            events.erase(events.begin(), events.begin() + static_cast<ptrdiff_t>(std::min(nValidBegin - nBegin, static_cast<uint64_t>(events.size()))));
+        }
+
+        size_t iFirstInWindow = 0;
+        while ((iFirstInWindow < events.size()) && (events[iFirstInWindow].m_timeTicks < timeWindowStartTicks))
+        {
+            ++iFirstInWindow;
+        }
+        events.erase(events.begin(), events.begin() + static_cast<ptrdiff_t>(iFirstInWindow));
+        return events;
+    }
+
+    /**
+    * Writer thread function: copies and writes the triggered dumps to file until shutdown.
+    */
+    void writeDumps()
+    {
+        std::unique_lock<std::mutex> lock(m_dumpsMutex);
+        while (true)
+        {
+            m_dumpsCv.wait(lock, [this]() { return m_bShutdown || m_bTriggerPending; });
+            if (!m_bTriggerPending)
+            {
+                return;  // shutdown
+            }
+
+            m_bTriggerPending = false;
+            m_bWritingDump = true;
+            lock.unlock();
+
+            const PendingDump dump = collectDump();
+            const std::string sFilename = m_sTraceFilePrefix + "_" + std::to_string(dump.m_dumpIndex) + ".json";
+            const bool bWritten = writeTraceFile(sFilename, dump);
+
+            lock.lock();
+            if (bWritten)
+            {
+                m_writtenFiles.push_back(sFilename);
+            }
+            else
+            {
+                m_errorMessages.push_back("FlightRecorder: failed to write " + sFilename);
+            }
+            m_bWritingDump = false;
+            m_dumpsWrittenCv.notify_all();
+        }
+    }
+
+    static std::string escapeJson(const std::string& s)
+    {
+        std::string sEscaped;
+        for (const char c : s)
+        {
+            if ((c == '"') || (c == '\\'))
+            {
+                sEscaped += '\\';
+                sEscaped += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char szBuf[8];
+                snprintf(szBuf, sizeof(szBuf), "\\u%04x", static_cast<unsigned int>(c));
+                sEscaped += szBuf;
+            }
+            else
+            {
+                sEscaped += c;
+            }
+        }
+        return sEscaped;
+    }
+
+    /**
+    * Writes the dump in Chrome Trace Event format. Timestamps are in microseconds relative to the dump window start.
+    * Flow events are written as zero-length slices with a flow event (start, step, finish) bound to them, since flow
+    * arrows are drawn between slices.
+    */
+    static bool writeTraceFile(const std::string& sFilename, const PendingDump& dump)
+    {
+        std::ofstream f(sFilename, std::ios::trunc);
+        if (!f)
+        {
+            return false;
+        }
+
+        const Clock::Duration::rep timeTriggerTicks = dump.m_timeTrigger.time_since_epoch().count();
+        Clock::Duration::rep timeBaseTicks = timeTriggerTicks;
+        for (const auto& threadEvents : dump.m_events)
+        {
+            if (!threadEvents.second.empty() && (threadEvents.second.front().m_timeTicks < timeBaseTicks))
+            {
+                timeBaseTicks = threadEvents.second.front().m_timeTicks;
+            }
+        }
+        const auto toUs = [timeBaseTicks](const Clock::Duration::rep& ticks)
+        {
+            return std::chrono::duration<double, std::micro>(Clock::Duration(ticks - timeBaseTicks)).count();
+        };
+
+        f.precision(3);
+        f << std::fixed;
+        f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+        f << "{\"name\":\"TRIGGER: " << escapeJson(dump.m_sReason) << "\",\"ph\":\"i\",\"s\":\"g\",\"ts\":"
+            << toUs(timeTriggerTicks) << ",\"pid\":1,\"tid\":0}";
+        for (const auto& threadEvents : dump.m_events)
+        {
+            for (const auto& event : threadEvents.second)
+            {
+                const std::string sName = escapeJson(dump.m_names.at(event.m_nameHash));
+                if ((event.m_type == EventType::Enter) || (event.m_type == EventType::Exit))
+                {
+                    f << "," << std::endl << "{\"name\":\"" << sName
+                        << "\",\"ph\":\"" << (event.m_type == EventType::Enter ? "B" : "E")
+                        << "\",\"ts\":" << toUs(event.m_timeTicks)
+                        << ",\"pid\":1,\"tid\":" << threadEvents.first << "}";
+                    continue;
+                }
+
+                const char* const szFlowPhase =
+                    (event.m_type == EventType::FlowBegin) ? "s" : ((event.m_type == EventType::FlowStage) ? "t" : "f");
+                f << "," << std::endl << "{\"name\":\"" << sName << "\",\"cat\":\"flow\",\"ph\":\"X\",\"dur\":0"
+                    << ",\"ts\":" << toUs(event.m_timeTicks)
+                    << ",\"pid\":1,\"tid\":" << threadEvents.first
+                    << ",\"args\":{\"flow\":" << event.m_flowId << "}}";
+                f << "," << std::endl << "{\"name\":\"flow\",\"cat\":\"flow\",\"ph\":\"" << szFlowPhase
+                    << "\",\"bp\":\"e\",\"id\":" << event.m_flowId
+                    << ",\"ts\":" << toUs(event.m_timeTicks)
+                    << ",\"pid\":1,\"tid\":" << threadEvents.first << "}";
+            }
+        }
+        f << std::endl << "]}" << std::endl;
+        return static_cast<bool>(f);
+    }
+};
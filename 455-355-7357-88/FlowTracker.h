@@ -0,0 +1,331 @@
+#pragma once
+
+/*
+    ###################################################################################
+    FlowTracker.h
+    Basic header-only tracker of items flowing through threads, e.g. jobs in a pipeline.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <atomic>    // requires cpp11
+#include <chrono>    // requires cpp11
+#include <cstdint>   // uint64_t
+#include <map>
+#include <memory>    // requires cpp11
+#include <mutex>     // requires cpp11
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "PFL.h"  // for PFL::StringHash
+
+#include "Clock.h"
+#include "LatencyHistogram.h"
+#include "ScopeBenchmarker.h"
+
+/**
+* Tracks latency of items passing through a producer -> queue -> worker -> completion pipeline, where the item is
+* handed over between threads, so ScopeBenchmarker cannot show the time spent waiting in queues.
+*
+* A Flow is begun when the item is created or enqueued, and it travels with the item: it is a small value to be stored
+* in the item. Any thread can mark the flow reaching a stage (e.g. dequeued, processed), and finally end it.
+* Every stage records the time elapsed since the previous stage (or since the beginning) into the BmData named
+* "<flow name>.<stage name>", and ending the flow also records the end-to-end latency into the BmData named
+* "<flow name>". Durations are in nanoseconds, and besides the min/max/avg of BmData, each of them also has a
+* LatencyHistogram (BmData::m_pHistogram) for percentiles.
+*
+* Flow events are also reported to the listeners of ScopeBenchmarkerDataStore, so a FlightRecorder links the stages
+* of the same flow in its trace files even if they happened on different threads.
+*
+* Time is taken by Clock::now(), so flows are measured in virtual time when a VirtualClock is installed.
+* Marking stages is thread-safe without serializing the marking threads: the BmData of a stage is looked up once and
+* cached until ScopeBenchmarkerDataStore::clear(), and durations are recorded by a ConcurrentRecorder. Only finding a
+* stage by its name takes the mutex of the tracker: pass the StageHandle returned by addStage() to avoid that too.
+* A Flow itself is not thread-safe: it should be owned by 1 thread at a time, as the item carrying it.
+*
+* Example:
+*
+*     FlowTracker jobFlow("job");
+*     // producer thread
+*     job.m_flow = jobFlow.begin();
+*     queue.push(job);
+*     // worker thread
+*     Job job = queue.pop();
+*     jobFlow.markStage(job.m_flow, "dequeued");   // queueing delay, or pass the handle returned by addStage("dequeued")
+*     process(job);
+*     jobFlow.end(job.m_flow, "processed");        // processing time and end-to-end latency
+*/
+class FlowTracker : public ScopeBenchmarkerDataStore
+{
+    struct Stage;
+
+public:
+
+    /**
+    * State of 1 tracked item, to be stored in the item.
+    */
+    class Flow
+    {
+    public:
+
+        Flow() = default;
+
+        Flow(const Flow&) = default;
+        Flow& operator=(const Flow&) = default;
+        Flow(Flow&&) = default;
+        Flow& operator=(Flow&&) = default;
+
+        /**
+        * @return Unique id of the flow, 0 if the flow is not begun or already ended.
+        */
+        unsigned long long getId() const
+        {
+            return m_id;
+        }
+
+        bool isOpen() const
+        {
+            return m_id != 0;
+        }
+
+        const Clock::TimePoint& getTimeBegin() const
+        {
+            return m_timeBegin;
+        }
+
+    private:
+
+        friend class FlowTracker;
+
+        unsigned long long m_id = 0;
+        Clock::TimePoint m_timeBegin;
+        Clock::TimePoint m_timeLastStage;   /**< Time of the previous stage, or m_timeBegin if there was no stage yet. */
+    };
+
+    /**
+    * Refers to a stage of a FlowTracker, valid for the lifetime of the tracker, see addStage().
+    */
+    class StageHandle
+    {
+    public:
+
+        StageHandle() = default;
+
+    private:
+
+        friend class FlowTracker;
+
+        explicit StageHandle(Stage* pStage) :
+            m_pStage(pStage)
+        {}
+
+        Stage* m_pStage = nullptr;
+    };
+
+    /**
+    * @param sFlowName Name of the BmData of end-to-end latency, and prefix of the names of the BmData of the stages.
+    */
+    FlowTracker(const std::string& sFlowName) :
+        m_sFlowName(sFlowName)
+    {
+        if (sFlowName.empty())
+        {
+            throw std::runtime_error("FlowTracker ctor: sFlowName cannot be empty!");
+        }
+        m_endToEnd.m_sBmDataName = sFlowName;
+        m_endToEnd.m_nameHash = PFL::calcHash(sFlowName);
+        m_endToEnd.m_pHistogram = std::make_shared<LatencyHistogram>();
+        getBmData(m_endToEnd);
+    }
+
+    virtual ~FlowTracker() = default;
+
+    FlowTracker(const FlowTracker&) = delete;
+    FlowTracker& operator=(const FlowTracker&) = delete;
+    FlowTracker(FlowTracker&&) = delete;
+    FlowTracker& operator=(FlowTracker&&) = delete;
+
+    const std::string& getFlowName() const
+    {
+        return m_sFlowName;
+    }
+
+    /**
+    * Creates the BmData of the given stage in advance, so marking the stage later does not insert into
+    * ScopeBenchmarkerDataStore.
+    *
+    * @return Handle of the stage, for marking the stage without looking it up by name.
+    */
+    StageHandle addStage(const std::string& sStageName)
+    {
+        Stage& stage = findStage(sStageName);
+        getBmData(stage);
+        getBmData(m_endToEnd);
+        return StageHandle(&stage);
+    }
+
+    /**
+    * Begins a new flow, e.g. when the item is enqueued.
+    */
+    Flow begin()
+    {
+        Flow flow;
+        flow.m_id = getNextId();
+        flow.m_timeBegin = Clock::now();
+        flow.m_timeLastStage = flow.m_timeBegin;
+        notifyFlowEvent(m_endToEnd.m_nameHash, flow.m_id, ScopeBenchmarkerListener::FlowEventType::Begin, flow.m_timeBegin);
+        return flow;
+    }
+
+    /**
+    * Records the time elapsed since the previous stage of the flow, into the BmData of the given stage.
+    * Can be invoked on any thread.
+    */
+    void markStage(Flow& flow, const std::string& sStageName)
+    {
+        markStage(flow, StageHandle(&findStage(sStageName)));
+    }
+
+    void markStage(Flow& flow, const StageHandle& stageHandle)
+    {
+        Stage& stage = getStage(flow, stageHandle, "FlowTracker::markStage()");
+        const Clock::TimePoint timeStage = Clock::now();
+        recordDuration(stage, timeStage - flow.m_timeLastStage);
+        flow.m_timeLastStage = timeStage;
+        notifyFlowEvent(stage.m_nameHash, flow.m_id, ScopeBenchmarkerListener::FlowEventType::Stage, timeStage);
+    }
+
+    /**
+    * Records the last stage same as markStage(), also records the end-to-end latency of the flow, then closes the flow.
+    * Can be invoked on any thread.
+    */
+    void end(Flow& flow, const std::string& sStageName = "end")
+    {
+        end(flow, StageHandle(&findStage(sStageName)));
+    }
+
+    void end(Flow& flow, const StageHandle& stageHandle)
+    {
+        Stage& stage = getStage(flow, stageHandle, "FlowTracker::end()");
+        const Clock::TimePoint timeEnd = Clock::now();
+        recordDuration(stage, timeEnd - flow.m_timeLastStage);
+        recordDuration(m_endToEnd, timeEnd - flow.m_timeBegin);
+        notifyFlowEvent(stage.m_nameHash, flow.m_id, ScopeBenchmarkerListener::FlowEventType::End, timeEnd);
+        flow.m_id = 0;
+    }
+
+    /**
+    * @return Distribution of the end-to-end latencies in nanoseconds.
+    */
+    const LatencyHistogram& getEndToEndHistogram() const
+    {
+        return *m_endToEnd.m_pHistogram;
+    }
+
+    /**
+    * @return Distribution of the latencies of the given stage in nanoseconds.
+    *         Throws std::runtime_error if the stage has not been added or marked yet.
+    */
+    const LatencyHistogram& getStageHistogram(const std::string& sStageName) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = m_stages.find(sStageName);
+        if (it == m_stages.end())
+        {
+            throw std::runtime_error("FlowTracker::getStageHistogram(): no such stage: " + sStageName);
+        }
+        return *(it->second->m_pHistogram);
+    }
+
+private:
+
+    struct Stage
+    {
+        std::string m_sBmDataName;                          /**< "<flow name>.<stage name>" */
+        PFL::StringHash m_nameHash = 0;
+        std::shared_ptr<LatencyHistogram> m_pHistogram;     /**< Shared with BmData::m_pHistogram. */
+        ConcurrentRecorder m_recorder;
+        std::atomic<BmData*> m_pBmData{ nullptr };          /**< Valid if m_bmDataGeneration is the current generation. */
+        std::atomic<unsigned long long> m_bmDataGeneration{ ~0ull };
+    };
+
+    const std::string m_sFlowName;
+    Stage m_endToEnd;                                       /**< Not a real stage, records the end-to-end latency. */
+
+    mutable std::mutex m_mutex;                             /**< Guards m_stages and looking up the BmData of the stages. */
+    std::map<std::string, std::unique_ptr<Stage>> m_stages; /**< Key is the stage name. */
+
+    static unsigned long long getNextId()
+    {
+        // ids are unique across trackers so trace viewers don't mix flows of different trackers
+        static std::atomic<unsigned long long> s_nextId(1);
+        return s_nextId++;
+    }
+
+    Stage& findStage(const std::string& sStageName)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_stages.find(sStageName);
+        if (it == m_stages.end())
+        {
+            if (sStageName.empty())
+            {
+                throw std::runtime_error("FlowTracker: stage name cannot be empty!");
+            }
+            std::unique_ptr<Stage> pStage(new Stage());
+            pStage->m_sBmDataName = m_sFlowName + "." + sStageName;
+            pStage->m_nameHash = PFL::calcHash(pStage->m_sBmDataName);
+            pStage->m_pHistogram = std::make_shared<LatencyHistogram>();
+            it = m_stages.insert(std::make_pair(sStageName, std::move(pStage))).first;
+        }
+        return *it->second;
+    }
+
+    static Stage& getStage(const Flow& flow, const StageHandle& stageHandle, const char* szFunction)
+    {
+        if (!flow.isOpen())
+        {
+            throw std::runtime_error(std::string(szFunction) + ": flow is not open!");
+        }
+        if (!stageHandle.m_pStage)
+        {
+            throw std::runtime_error(std::string(szFunction) + ": invalid stage handle!");
+        }
+        return *stageHandle.m_pStage;
+    }
+
+    /**
+    * @return The BmData of the given stage, looked up only if the data store was cleared since the last lookup.
+    */
+    BmData& getBmData(Stage& stage)
+    {
+        const unsigned long long generation = getGeneration();
+        if (stage.m_bmDataGeneration.load(std::memory_order_acquire) == generation)
+        {
+            return *stage.m_pBmData.load(std::memory_order_relaxed);
+        }
+
+        // the histogram is attached under the mutex, so the recording threads only read it
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (stage.m_bmDataGeneration.load(std::memory_order_relaxed) != generation)
+        {
+            BmData& bmData = findOrCreate(stage.m_nameHash, stage.m_sBmDataName);
+            if (bmData.m_pHistogram != stage.m_pHistogram)
+            {
+                bmData.m_ratioDenominator = std::chrono::nanoseconds::period::den;
+                bmData.m_pHistogram = stage.m_pHistogram;
+            }
+            stage.m_pBmData.store(&bmData, std::memory_order_relaxed);
+            stage.m_bmDataGeneration.store(generation, std::memory_order_release);
+        }
+        return *stage.m_pBmData.load(std::memory_order_relaxed);
+    }
+
+    void recordDuration(Stage& stage, const Clock::Duration& duration)
+    {
+        stage.m_recorder.record(getBmData(stage), std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+};
@@ -0,0 +1,482 @@
+#pragma once
+
+/*
+    ###################################################################################
+    FrameProfiler.h
+    Basic header-only per-frame profiler built on top of ScopeBenchmarker.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>
+#include <chrono>    // requires cpp11
+#include <cstddef>   // std::size_t
+#include <cstdint>   // intmax_t
+#include <iomanip>   // std::setprecision
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "PFL.h"  // for PFL::StringHash
+
+#include "Clock.h"
+#include "ScopeBenchmarker.h"
+
+/**
+* Per-frame view of the ScopeBenchmarkers running inside a frame loop.
+*
+* Aggregated ScopeBenchmarker data of a whole run hides which frames were bad. Call markFrameBoundary() once per frame
+* (e.g. at the beginning of the frame loop) and FrameProfiler will:
+*  - snapshot how much each scope benchmarker's total duration and iteration count grew since the previous boundary,
+*    and keep these per-scope frame totals for the last N frames in a ring;
+*  - put the frame duration into a frame-time histogram, and count the frames exceeding the frame time budgets
+*    (by default 1/60 s and 1/30 s, i.e. the 16.6 ms and 33.3 ms of 60 and 30 FPS);
+*  - produce a report listing the histogram with the budget lines and the worst frames with their per-scope breakdown.
+*
+* Frame time is taken by Clock::now(), same as ScopeBenchmarker, so it also works with a VirtualClock installed.
+* Per-scope durations are in the DurationType units of the corresponding ScopeBenchmarker.
+*
+* Each boundary iterates over all stored benchmarkers, so the cost of markFrameBoundary() is linear in the number of
+* scope benchmarkers. Like ScopeBenchmarkerDataStore, this class is not thread-safe: use it from the frame loop thread.
+*
+* Example:
+*
+*     FrameProfiler frameProfiler;
+*     while (running)
+*     {
+*         frameProfiler.markFrameBoundary();
+*         {
+*             ScopeBenchmarker<std::chrono::microseconds> bm("physics");
+*             ...
+*         }
+*         ...
+*     }
+*     for (const auto& sLine : frameProfiler.getReport()) { ... }
+*/
+class FrameProfiler
+{
+public:
+
+    /**
+    * How much a scope benchmarker's data grew during a frame.
+    */
+    struct ScopeInFrame
+    {
+        PFL::StringHash m_nameHash;         /**< Key to ScopeBenchmarkerDataStore::getAllData() and getScopeName(). */
+        long long m_durationsTotal;         /**< Time unit is the DurationType of the ScopeBenchmarker. */
+        long long m_iterations;             /**< Number of entering the scope during the frame. */
+        intmax_t m_ratioDenominator;        /**< Same as BmData::m_ratioDenominator. */
+    };
+
+    struct FrameData
+    {
+        unsigned long long m_frameIndex = 0;    /**< 0-based index of the frame since the first boundary. */
+        Clock::Duration m_duration{};           /**< Time elapsed between the boundaries of the frame. */
+        std::vector<ScopeInFrame> m_scopes;     /**< Only scopes entered during the frame. */
+    };
+
+    /**
+    * @param nFramesToKeep        Number of last frames whose per-scope data is kept for the worst frames report.
+    * @param histogramBucketWidth Width of a frame-time histogram bucket.
+    * @param nHistogramBuckets    Number of histogram buckets. The last bucket also counts all longer frames.
+    */
+    FrameProfiler(
+        std::size_t nFramesToKeep = 300,
+        const Clock::Duration& histogramBucketWidth = std::chrono::milliseconds(1),
+        std::size_t nHistogramBuckets = 50) :
+        m_frames(nFramesToKeep),
+        m_histogramBucketWidth(histogramBucketWidth),
+        m_histogram(nHistogramBuckets, 0)
+    {
+        if (nFramesToKeep == 0)
+        {
+            throw std::runtime_error("FrameProfiler ctor: nFramesToKeep cannot be 0!");
+        }
+        if (histogramBucketWidth <= Clock::Duration::zero())
+        {
+            throw std::runtime_error("FrameProfiler ctor: histogramBucketWidth must be positive!");
+        }
+        if (nHistogramBuckets == 0)
+        {
+            throw std::runtime_error("FrameProfiler ctor: nHistogramBuckets cannot be 0!");
+        }
+        setBudgets({
+            std::chrono::duration_cast<Clock::Duration>(std::chrono::microseconds(16667)),
+            std::chrono::duration_cast<Clock::Duration>(std::chrono::microseconds(33333)) });
+    }
+
+    FrameProfiler(const FrameProfiler&) = default;
+    FrameProfiler& operator=(const FrameProfiler&) = default;
+    FrameProfiler(FrameProfiler&&) = default;
+    FrameProfiler& operator=(FrameProfiler&&) = default;
+
+    /**
+    * Ends the current frame and begins a new one.
+    * The very first invocation only begins the first frame.
+    */
+    void markFrameBoundary()
+    {
+        const Clock::TimePoint timeNow = Clock::now();
+
+        if (m_bFrameStarted)
+        {
+            FrameData& frame = m_frames[m_nFramesTotal % m_frames.size()];
+            frame.m_frameIndex = m_nFramesTotal;
+            frame.m_duration = timeNow - m_timeFrameStart;
+            frame.m_scopes.clear();
+            snapshotScopes(&frame.m_scopes);
+            addToStatistics(frame.m_duration);
+            ++m_nFramesTotal;
+        }
+        else
+        {
+            snapshotScopes(nullptr);
+            m_bFrameStarted = true;
+        }
+
+        m_timeFrameStart = timeNow;
+    }
+
+    /**
+    * Forgets all frames and statistics. The next markFrameBoundary() will begin the first frame again.
+    */
+    void reset()
+    {
+        for (auto& frame : m_frames)
+        {
+            frame = FrameData();
+        }
+        std::fill(m_histogram.begin(), m_histogram.end(), 0);
+        std::fill(m_framesOverBudget.begin(), m_framesOverBudget.end(), 0);
+        m_lastTotals.clear();
+        m_nFramesTotal = 0;
+        m_durationFramesTotal = Clock::Duration::zero();
+        m_durationFrameMin = Clock::Duration::max();
+        m_durationFrameMax = Clock::Duration::zero();
+        m_bFrameStarted = false;
+    }
+
+    /**
+    * Sets the frame time budgets. Resets the counters of frames over budget.
+    */
+    void setBudgets(const std::vector<Clock::Duration>& budgets)
+    {
+        m_budgets = budgets;
+        std::sort(m_budgets.begin(), m_budgets.end());
+        m_framesOverBudget.assign(m_budgets.size(), 0);
+    }
+
+    const std::vector<Clock::Duration>& getBudgets() const
+    {
+        return m_budgets;
+    }
+
+    /**
+    * @return Number of frames longer than the budget of the given index in getBudgets().
+    */
+    unsigned long long getFramesOverBudget(std::size_t iBudget) const
+    {
+        return m_framesOverBudget.at(iBudget);
+    }
+
+    /**
+    * @return Number of finished frames since the first boundary, including the ones not kept anymore.
+    */
+    unsigned long long getFrameCount() const
+    {
+        return m_nFramesTotal;
+    }
+
+    /**
+    * @return Duration of the last finished frame, or 0 if there is no finished frame yet.
+    */
+    Clock::Duration getLastFrameDuration() const
+    {
+        return m_nFramesTotal == 0 ? Clock::Duration::zero() : m_frames[(m_nFramesTotal - 1) % m_frames.size()].m_duration;
+    }
+
+    /**
+    * @return Number of frames currently kept with per-scope data, at most the nFramesToKeep ctor parameter.
+    */
+    std::size_t getKeptFrameCount() const
+    {
+        return static_cast<std::size_t>(std::min<unsigned long long>(m_nFramesTotal, m_frames.size()));
+    }
+
+    /**
+    * @param i Index in range [0, getKeptFrameCount()), 0 being the oldest kept frame.
+    */
+    const FrameData& getKeptFrame(std::size_t i) const
+    {
+        if (i >= getKeptFrameCount())
+        {
+            throw std::runtime_error("FrameProfiler::getKeptFrame(): index out of range!");
+        }
+        return m_frames[(m_nFramesTotal - getKeptFrameCount() + i) % m_frames.size()];
+    }
+
+    /**
+    * @return The kept frames with the longest durations, in descending order of duration.
+    */
+    std::vector<const FrameData*> getWorstFrames(std::size_t nFrames) const
+    {
+        std::vector<const FrameData*> frames;
+        for (std::size_t i = 0; i < getKeptFrameCount(); i++)
+        {
+            frames.push_back(&getKeptFrame(i));
+        }
+        nFrames = std::min(nFrames, frames.size());
+        std::partial_sort(frames.begin(), frames.begin() + nFrames, frames.end(),
+            [](const FrameData* a, const FrameData* b) { return a->m_duration > b->m_duration; });
+        frames.resize(nFrames);
+        return frames;
+    }
+
+    /**
+    * @return Frame count per histogram bucket. Bucket i counts frames with duration in [i * width, (i+1) * width),
+    *         the last bucket also counts all longer frames.
+    */
+    const std::vector<unsigned long long>& getHistogram() const
+    {
+        return m_histogram;
+    }
+
+    const Clock::Duration& getHistogramBucketWidth() const
+    {
+        return m_histogramBucketWidth;
+    }
+
+    Clock::Duration getFrameDurationMin() const
+    {
+        return m_nFramesTotal == 0 ? Clock::Duration::zero() : m_durationFrameMin;
+    }
+
+    Clock::Duration getFrameDurationMax() const
+    {
+        return m_durationFrameMax;
+    }
+
+    Clock::Duration getFrameDurationAverage() const
+    {
+        return m_nFramesTotal == 0 ?
+            Clock::Duration::zero() :
+            Clock::Duration(m_durationFramesTotal.count() / static_cast<Clock::Duration::rep>(m_nFramesTotal));
+    }
+
+    /**
+    * @return Name of the scope benchmarker with the given name hash, as seen by the last boundary.
+    */
+    std::string getScopeName(const PFL::StringHash& nameHash) const
+    {
+        const auto it = m_lastTotals.find(nameHash);
+        return it == m_lastTotals.end() ? std::string() : it->second.m_name;
+    }
+
+    /**
+    * @param nWorstFrames Number of worst frames to be listed with per-scope breakdown.
+    * @return Human-readable lines of frame statistics, histogram with budget lines and worst frames.
+    */
+    std::vector<std::string> getReport(std::size_t nWorstFrames = 5) const
+    {
+        std::vector<std::string> lines;
+        lines.push_back("  Frames: " + std::to_string(m_nFramesTotal) +
+            ", Frame Time Min/Max/Avg: " + formatMs(getFrameDurationMin()) + "/" + formatMs(getFrameDurationMax()) + "/" +
+            formatMs(getFrameDurationAverage()) + " ms");
+        if (m_nFramesTotal == 0)
+        {
+            return lines;
+        }
+
+        for (std::size_t iBudget = 0; iBudget < m_budgets.size(); iBudget++)
+        {
+            lines.push_back("  Frames over " + formatMs(m_budgets[iBudget]) + " ms budget: " +
+                std::to_string(m_framesOverBudget[iBudget]) + " (" +
+                formatPercent(m_framesOverBudget[iBudget], m_nFramesTotal) + "%)");
+        }
+
+        addHistogramLines(lines);
+
+        lines.push_back("  Worst frames of the last " + std::to_string(getKeptFrameCount()) + ":");
+        for (const FrameData* pFrame : getWorstFrames(nWorstFrames))
+        {
+            lines.push_back("    Frame " + std::to_string(pFrame->m_frameIndex) + ": " + formatMs(pFrame->m_duration) + " ms");
+
+            std::vector<const ScopeInFrame*> scopes;
+            for (const auto& scope : pFrame->m_scopes)
+            {
+                scopes.push_back(&scope);
+            }
+            // mixing units is fine here, they are sorted only for convenience of reading
+            std::sort(scopes.begin(), scopes.end(),
+                [](const ScopeInFrame* a, const ScopeInFrame* b) { return a->m_durationsTotal > b->m_durationsTotal; });
+            for (const ScopeInFrame* pScope : scopes)
+            {
+                lines.push_back("      " + getScopeName(pScope->m_nameHash) +
+                    ": " + std::to_string(pScope->m_durationsTotal) + " " +
+                    ScopeBenchmarkerDataStore::BmData::getUnitString(pScope->m_ratioDenominator) +
+                    ", Iterations: " + std::to_string(pScope->m_iterations));
+            }
+        }
+
+        return lines;
+    }
+
+private:
+
+    struct LastTotals
+    {
+        std::string m_name;
+        long long m_durationsTotal;
+        long long m_iterations;
+    };
+
+    std::vector<FrameData> m_frames;                            /**< Ring of the last frames. */
+    unsigned long long m_nFramesTotal = 0;
+    bool m_bFrameStarted = false;
+    Clock::TimePoint m_timeFrameStart;
+    std::map<PFL::StringHash, LastTotals> m_lastTotals;         /**< Scope benchmarker data as seen by the last boundary. */
+    unsigned long long m_lastTotalsGeneration = 0;              /**< ScopeBenchmarkerDataStore::getGeneration() at the last boundary. */
+
+    Clock::Duration m_histogramBucketWidth;
+    std::vector<unsigned long long> m_histogram;
+    std::vector<Clock::Duration> m_budgets;                     /**< Ascending order. */
+    std::vector<unsigned long long> m_framesOverBudget;         /**< Same indexing as m_budgets. */
+    Clock::Duration m_durationFramesTotal = Clock::Duration::zero();
+    Clock::Duration m_durationFrameMin = Clock::Duration::max();
+    Clock::Duration m_durationFrameMax = Clock::Duration::zero();
+
+    static std::string formatMs(const Clock::Duration& duration)
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1) << std::chrono::duration<double, std::milli>(duration).count();
+        return ss.str();
+    }
+
+    static std::string formatPercent(unsigned long long nPart, unsigned long long nTotal)
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1) << (nTotal == 0 ? 0.0 : 100.0 * nPart / nTotal);
+        return ss.str();
+    }
+
+    /**
+    * Updates m_lastTotals from the scope benchmarker data store, and if pScopes is not null, saves the growth of the
+    * scopes entered since the previous snapshot.
+    */
+    void snapshotScopes(std::vector<ScopeInFrame>* pScopes)
+    {
+        // the data store might have been cleared (e.g. by Benchmark) since the previous boundary, then the new entries
+        // might have grown past the old totals already, so those cannot be compared; names are kept for the reports
+        const unsigned long long generation = ScopeBenchmarkerDataStore::getGeneration();
+        if (generation != m_lastTotalsGeneration)
+        {
+            for (auto& lastTotals : m_lastTotals)
+            {
+                lastTotals.second.m_durationsTotal = 0;
+                lastTotals.second.m_iterations = 0;
+            }
+            m_lastTotalsGeneration = generation;
+        }
+
+        for (const auto& bmDataPair : ScopeBenchmarkerDataStore::getAllData())
+        {
+            const ScopeBenchmarkerDataStore::BmData& bmData = bmDataPair.second;
+            auto it = m_lastTotals.find(bmDataPair.first);
+            if (it == m_lastTotals.end())
+            {
+                it = m_lastTotals.insert(std::make_pair(bmDataPair.first, LastTotals{ bmData.m_name, 0, 0 })).first;
+            }
+            LastTotals& lastTotals = it->second;
+
+            // the entry might have been reset since the previous boundary
+            if (bmData.m_iterations < lastTotals.m_iterations)
+            {
+                lastTotals.m_durationsTotal = 0;
+                lastTotals.m_iterations = 0;
+            }
+
+            if (pScopes && (bmData.m_iterations > lastTotals.m_iterations))
+            {
+                pScopes->push_back(ScopeInFrame{
+                    bmDataPair.first,
+                    bmData.m_durationsTotal - lastTotals.m_durationsTotal,
+                    bmData.m_iterations - lastTotals.m_iterations,
+                    bmData.m_ratioDenominator });
+            }
+
+            lastTotals.m_durationsTotal = bmData.m_durationsTotal;
+            lastTotals.m_iterations = bmData.m_iterations;
+        }
+    }
+
+    void addToStatistics(const Clock::Duration& duration)
+    {
+        const std::size_t iBucket = static_cast<std::size_t>(std::min<Clock::Duration::rep>(
+            duration.count() / m_histogramBucketWidth.count(),
+            static_cast<Clock::Duration::rep>(m_histogram.size() - 1)));
+        ++m_histogram[iBucket];
+
+        for (std::size_t iBudget = 0; iBudget < m_budgets.size(); iBudget++)
+        {
+            if (duration > m_budgets[iBudget])
+            {
+                ++m_framesOverBudget[iBudget];
+            }
+        }
+
+        m_durationFramesTotal += duration;
+        m_durationFrameMin = std::min(m_durationFrameMin, duration);
+        m_durationFrameMax = std::max(m_durationFrameMax, duration);
+    }
+
+    /**
+    * Adds histogram lines with bars proportional to the frame count, empty buckets are omitted.
+    * Budget lines are placed before the first bucket beginning at or above the budget.
+    */
+    void addHistogramLines(std::vector<std::string>& lines) const
+    {
+        static constexpr std::size_t nMaxBarLength = 40;
+
+        std::size_t nLastUsedBucket = 0;
+        unsigned long long nMaxCount = 0;
+        for (std::size_t i = 0; i < m_histogram.size(); i++)
+        {
+            if (m_histogram[i] > 0)
+            {
+                nLastUsedBucket = i;
+                nMaxCount = std::max(nMaxCount, m_histogram[i]);
+            }
+        }
+
+        lines.push_back("  Frame Time Histogram:");
+        std::size_t iBudget = 0;
+        for (std::size_t i = 0; i <= nLastUsedBucket; i++)
+        {
+            const Clock::Duration bucketBegin = m_histogramBucketWidth * static_cast<Clock::Duration::rep>(i);
+            for (; (iBudget < m_budgets.size()) && (m_budgets[iBudget] <= bucketBegin); iBudget++)
+            {
+                lines.push_back("    ------------ " + formatMs(m_budgets[iBudget]) + " ms budget ------------");
+            }
+
+            if (m_histogram[i] == 0)
+            {
+                continue;
+            }
+
+            const bool bLastBucket = (i + 1 == m_histogram.size());
+            const std::size_t nBarLength =
+                static_cast<std::size_t>((m_histogram[i] * nMaxBarLength + nMaxCount - 1) / nMaxCount);
+            lines.push_back("    " + formatMs(bucketBegin) +
+                (bLastBucket ? std::string(" ms -      ") : " - " + formatMs(bucketBegin + m_histogramBucketWidth) + " ms: ") +
+                std::string(nBarLength, '#') + " " + std::to_string(m_histogram[i]));
+        }
+        for (; iBudget < m_budgets.size(); iBudget++)
+        {
+            lines.push_back("    ------------ " + formatMs(m_budgets[iBudget]) + " ms budget ------------");
+        }
+    }
+};
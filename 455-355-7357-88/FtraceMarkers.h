@@ -0,0 +1,282 @@
+#pragma once
+
+/*
+    ###################################################################################
+    FtraceMarkers.h
+    Basic header-only writer of ScopeBenchmarker events to the ftrace trace_marker file.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <atomic>              // requires cpp11
+#include <chrono>              // requires cpp11
+#include <condition_variable>  // requires cpp11
+#include <cstdio>              // snprintf
+#include <mutex>               // requires cpp11
+#include <stdexcept>
+#include <string>
+#include <thread>              // requires cpp11
+#include <unordered_map>
+
+#ifdef __linux__
+#include <fcntl.h>             // open
+#include <unistd.h>            // write, close, getpid
+#endif
+
+#include "PFL.h"  // for PFL::StringHash
+
+#include "Clock.h"
+#include "ScopeBenchmarker.h"
+
+/**
+* Writes every scope entered and left by any ScopeBenchmarker to the ftrace trace_marker file, in the begin/end format
+* of systrace ("B|<pid>|<name>" and "E|<pid>"), so the scopes show up as slices in trace-cmd, perf and Perfetto traces
+* of the kernel, next to scheduling and other kernel events. The kernel records the writing thread and the timestamp.
+*
+* Alternative to the USDT probes of UsdtProbes.h when those cannot be used, e.g. the binary is not built with them.
+* Markers are written only while ftrace is recording (tracing_on is 1), checked periodically by a background thread,
+* otherwise an event costs only a relaxed atomic load. While recording, an event costs a write() system call.
+*
+* Supported on Linux only, elsewhere start() returns false.
+* Writing trace_marker usually requires root, or access rights given to the tracefs files.
+*
+* Example:
+*
+*     FtraceMarkers ftraceMarkers;
+*     ftraceMarkers.start();
+*     // then record: trace-cmd record -e sched_switch ./app
+*/
+class FtraceMarkers : public ScopeBenchmarkerListener
+{
+public:
+
+    /**
+    * @param sTracingDir  Directory of tracefs, empty means trying /sys/kernel/tracing then /sys/kernel/debug/tracing.
+    * @param pollInterval Interval of checking if ftrace is recording.
+    */
+    FtraceMarkers(const std::string& sTracingDir = "", const std::chrono::milliseconds& pollInterval = std::chrono::milliseconds(500)) :
+        m_sTracingDir(sTracingDir),
+        m_pollInterval(pollInterval)
+    {
+        if (pollInterval <= std::chrono::milliseconds::zero())
+        {
+            throw std::runtime_error("FtraceMarkers ctor: pollInterval must be positive!");
+        }
+    }
+
+    /**
+    * Closes trace_marker, after waiting for the other threads still writing markers, see ScopeBenchmarkerDataStore::removeListener().
+    */
+    virtual ~FtraceMarkers()
+    {
+        stop();
+#ifdef __linux__
+        if (m_fdMarker >= 0)
+        {
+            close(m_fdMarker);
+        }
+#endif
+    }
+
+    FtraceMarkers(const FtraceMarkers&) = delete;
+    FtraceMarkers& operator=(const FtraceMarkers&) = delete;
+    FtraceMarkers(FtraceMarkers&&) = delete;
+    FtraceMarkers& operator=(FtraceMarkers&&) = delete;
+
+    /**
+    * Opens trace_marker and starts listening to ScopeBenchmarkers.
+    * Throws std::runtime_error if the writer cannot be added as listener to ScopeBenchmarkerDataStore.
+    *
+    * @return False if not supported on this platform or trace_marker cannot be opened, true otherwise.
+    */
+    bool start()
+    {
+#ifdef __linux__
+        if (m_bStarted)
+        {
+            return true;
+        }
+
+        // trace_marker stays open after a stop(), so it is opened only once
+        const std::string candidateDirs[] = { m_sTracingDir, "/sys/kernel/tracing", "/sys/kernel/debug/tracing" };
+        for (const auto& sDir : candidateDirs)
+        {
+            if ((m_fdMarker >= 0) || sDir.empty())
+            {
+                continue;
+            }
+            m_fdMarker = open((sDir + "/trace_marker").c_str(), O_WRONLY | O_CLOEXEC);
+            if (m_fdMarker >= 0)
+            {
+                m_sTracingOnPath = sDir + "/tracing_on";
+                break;
+            }
+            if (!m_sTracingDir.empty())
+            {
+                break;  // only the given directory is tried
+            }
+        }
+        if (m_fdMarker < 0)
+        {
+            return false;
+        }
+
+        if (!ScopeBenchmarkerDataStore::addListener(this))
+        {
+            throw std::runtime_error("FtraceMarkers::start(): too many ScopeBenchmarker listeners!");
+        }
+
+        m_pid = static_cast<long>(getpid());
+        pollTracingOn();
+        {
+            std::lock_guard<std::mutex> lock(m_threadMutex);
+            m_bStopRequested = false;
+        }
+        m_thread = std::thread([this]() {
+            std::unique_lock<std::mutex> lock(m_threadMutex);
+            while (!m_threadCv.wait_for(lock, m_pollInterval, [this]() { return m_bStopRequested; }))
+            {
+                pollTracingOn();
+            }
+        });
+        m_bStarted = true;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+    * Stops writing markers, after waiting for the other threads still writing a marker.
+    * trace_marker is closed only by the dtor, so writing can be started again.
+    */
+    void stop()
+    {
+#ifdef __linux__
+        if (!m_bStarted)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_threadMutex);
+            m_bStopRequested = true;
+        }
+        m_threadCv.notify_all();
+        m_thread.join();
+        // the polling thread cannot turn it back on anymore
+        m_bTracingOn = false;
+        ScopeBenchmarkerDataStore::removeListener(this);
+        m_bStarted = false;
+#endif
+    }
+
+    /**
+    * @return True if ftrace was recording at the last check, so markers are being written.
+    */
+    bool isTracingOn() const
+    {
+        return m_bTracingOn.load(std::memory_order_relaxed);
+    }
+
+    virtual void onScopeEnter(const PFL::StringHash& nameHash, const Clock::TimePoint& /*timeStart*/) override
+    {
+        if (!m_bTracingOn.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        const std::string& sName = getCachedName(nameHash);
+        char szMarker[256];
+        const int nLength = sName.empty() ?
+            snprintf(szMarker, sizeof(szMarker), "B|%ld|scope#%llu", m_pid, static_cast<unsigned long long>(nameHash)) :
+            snprintf(szMarker, sizeof(szMarker), "B|%ld|%s", m_pid, sName.c_str());
+        writeMarker(szMarker, nLength, sizeof(szMarker));
+    }
+
+    virtual void onScopeExit(const PFL::StringHash& /*nameHash*/, const Clock::TimePoint& /*timeStart*/, const Clock::TimePoint& /*timeEnd*/) override
+    {
+        if (!m_bTracingOn.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        char szMarker[32];
+        writeMarker(szMarker, snprintf(szMarker, sizeof(szMarker), "E|%ld", m_pid), sizeof(szMarker));
+    }
+
+private:
+
+    const std::string m_sTracingDir;
+    const std::chrono::milliseconds m_pollInterval;
+    std::string m_sTracingOnPath;
+    int m_fdMarker = -1;                /**< Kept open from the first successful start() until destruction. */
+    bool m_bStarted = false;
+    long m_pid = 0;
+    std::atomic<bool> m_bTracingOn{ false };
+
+    std::mutex m_threadMutex;
+    std::condition_variable m_threadCv;
+    bool m_bStopRequested = false;
+    std::thread m_thread;               /**< Polls tracing_on, see pollTracingOn(). */
+
+    /**
+    * @return Name of the scope of the given name hash, empty if it is unknown.
+    *         Names are looked up under the registry lock only once per thread, since the name of a hash never changes.
+    */
+    static const std::string& getCachedName(const PFL::StringHash& nameHash)
+    {
+        static thread_local std::unordered_map<PFL::StringHash, std::string> s_names;
+        auto it = s_names.find(nameHash);
+        if (it == s_names.end())
+        {
+            const std::string sName = ScopeBenchmarkerDataStore::getNameByHash(nameHash);
+            if (sName.empty())
+            {
+                // not cached, the scope might get its name later
+                static const std::string s_sEmpty;
+                return s_sEmpty;
+            }
+            it = s_names.insert(std::make_pair(nameHash, sName)).first;
+        }
+        return it->second;
+    }
+
+    void pollTracingOn()
+    {
+#ifdef __linux__
+        bool bTracingOn = false;
+        const int fd = open(m_sTracingOnPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            char c = '0';
+            bTracingOn = (read(fd, &c, 1) == 1) && (c == '1');
+            close(fd);
+        }
+        m_bTracingOn.store(bTracingOn, std::memory_order_relaxed);
+#endif
+    }
+
+    /**
+    * @param nLength     Return value of snprintf(), that is the untruncated length.
+    * @param nBufferSize Size of the buffer given to snprintf().
+    */
+    void writeMarker(const char* szMarker, int nLength, size_t nBufferSize)
+    {
+#ifdef __linux__
+        if (nLength <= 0)
+        {
+            return;
+        }
+        const size_t nBytes = (static_cast<size_t>(nLength) < nBufferSize) ? static_cast<size_t>(nLength) : nBufferSize - 1;
+        // failing to write a marker is not an error for the measured code, so the result is ignored
+        const ssize_t nWritten = write(m_fdMarker, szMarker, nBytes);
+        (void)nWritten;
+#else
+        (void)szMarker;
+        (void)nLength;
+        (void)nBufferSize;
+#endif
+    }
+};
@@ -0,0 +1,487 @@
+/*
+    ###################################################################################
+    FunctionInstrumentation.cpp
+    Optional implementation of the -finstrument-functions hooks, to be used only if FUNCTION_INSTRUMENTATION is defined
+    for this file. Otherwise, or with compilers not supporting -finstrument-functions, this file compiles to nothing,
+    so it is harmless to keep it in the project.
+    Must not be compiled with -finstrument-functions itself.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#if defined(FUNCTION_INSTRUMENTATION) && defined(__GNUC__)
+
+#include <algorithm>   // std::find
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>      // snprintf
+#include <cstdlib>     // free
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <cxxabi.h>    // abi::__cxa_demangle
+#include <dlfcn.h>     // dladdr
+
+#include "FunctionInstrumentation.h"
+#include "Clock.h"
+#include "ScopeBenchmarker.h"
+
+#define FUNCTION_INSTRUMENTATION_NO_INSTRUMENT __attribute__((no_instrument_function))
+
+namespace
+{
+
+    struct FunctionCounters
+    {
+        std::atomic<uintptr_t> m_fn{ 0 };                 /**< Function address, 0 is an empty slot. Published last by the owner thread. */
+        bool m_bRecorded = true;                           /**< False if excluded by the filters. */
+        std::atomic<uint64_t> m_nCalls{ 0 };
+        std::atomic<uint64_t> m_durationsTotal{ 0 };       /**< In nanoseconds. */
+        std::atomic<uint64_t> m_durationsMin{ UINT64_MAX };
+        std::atomic<uint64_t> m_durationsMax{ 0 };
+    };
+
+    struct Frame
+    {
+        uintptr_t m_fn;
+        FunctionCounters* m_pCounters;                     /**< nullptr if the function is not recorded. */
+        Clock::TimePoint m_timeStart;
+    };
+
+    /**
+    * Written only by the owner thread, counters are atomics only so that collect() can read them from another thread.
+    * When the owner thread finishes, its counters are merged into Globals::m_finishedCounters and the table is
+    * recycled for the next new thread, see releaseThreadTable().
+    */
+    struct ThreadTable
+    {
+        FunctionCounters m_counters[FunctionInstrumentation::MaxFunctionsPerThread];   /**< Open addressing, linear probing. */
+        Frame m_stack[FunctionInstrumentation::MaxCallDepth];
+        unsigned int m_nDepth = 0;                         /**< Can be larger than MaxCallDepth, the frames beyond that are not stored. */
+        std::atomic<unsigned long long> m_nDroppedCalls{ 0 };
+    };
+
+    struct MergedCounters
+    {
+        uint64_t m_nCalls = 0;
+        uint64_t m_durationsTotal = 0;
+        uint64_t m_durationsMin = UINT64_MAX;
+        uint64_t m_durationsMax = 0;
+    };
+
+    struct Globals
+    {
+        std::atomic<bool> m_bRunning{ false };
+        std::mutex m_mutex;                                /**< Guards the fields below. */
+        std::vector<ThreadTable*> m_tables;                /**< Tables of the running threads. */
+        std::vector<ThreadTable*> m_freeTables;            /**< Zeroed tables of finished threads, to be reused. */
+        std::map<uintptr_t, MergedCounters> m_finishedCounters;   /**< Counters of the finished threads. */
+        unsigned long long m_nFinishedDroppedCalls = 0;
+        std::vector<std::string> m_includeFilters;
+        std::vector<std::string> m_excludeFilters;
+        std::map<uintptr_t, bool> m_filterDecisions;       /**< Cache of isRecordedByFilters() so dladdr() runs once per function. */
+    };
+
+    FUNCTION_INSTRUMENTATION_NO_INSTRUMENT Globals& getGlobals()
+    {
+        // never destroyed since instrumented functions might still run during static destruction
+        static Globals* const s_pGlobals = new Globals();
+        return *s_pGlobals;
+    }
+
+    thread_local ThreadTable* t_pTable = nullptr;
+    thread_local bool t_bInHook = false;                   /**< Protects against recursion if the slow path calls instrumented code. */
+    thread_local bool t_bTableReleased = false;            /**< Calls during the rest of thread exit are not recorded. */
+
+    FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void releaseThreadTable();
+
+    /**
+    * Releases the table of the thread when the thread finishes, by its thread_local dtor.
+    */
+    struct ThreadTableReleaser
+    {
+        FUNCTION_INSTRUMENTATION_NO_INSTRUMENT ~ThreadTableReleaser()
+        {
+            releaseThreadTable();
+        }
+    };
+
+    thread_local ThreadTableReleaser t_tableReleaser;
+
+    FUNCTION_INSTRUMENTATION_NO_INSTRUMENT std::string getFunctionName(uintptr_t fn)
+    {
+        Dl_info info;
+        if ((dladdr(reinterpret_cast<void*>(fn), &info) != 0) && info.dli_sname)
+        {
+            int status = 0;
+            char* const szDemangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            if (szDemangled)
+            {
+                const std::string sName(szDemangled);
+                free(szDemangled);
+                return sName;
+            }
+            return info.dli_sname;
+        }
+
+        char szAddress[32];
+        snprintf(szAddress, sizeof(szAddress), "0x%llx", static_cast<unsigned long long>(fn));
+        return szAddress;
+    }
+
+    /**
+    * Expects Globals::m_mutex to be locked.
+    */
+    FUNCTION_INSTRUMENTATION_NO_INSTRUMENT bool isRecordedByFilters(Globals& globals, uintptr_t fn)
+    {
+        if (globals.m_includeFilters.empty() && globals.m_excludeFilters.empty())
+        {
+            return true;
+        }
+
+        const auto it = globals.m_filterDecisions.find(fn);
+        if (it != globals.m_filterDecisions.end())
+        {
+            return it->second;
+        }
+
+        const std::string sName = getFunctionName(fn);
+        bool bRecorded = globals.m_includeFilters.empty();
+        for (const auto& sFilter : globals.m_includeFilters)
+        {
+            if (sName.find(sFilter) != std::string::npos)
+            {
+                bRecorded = true;
+                break;
+            }
+        }
+        for (const auto& sFilter : globals.m_excludeFilters)
+        {
+            if (sName.find(sFilter) != std::string::npos)
+            {
+                bRecorded = false;
+                break;
+            }
+        }
+        globals.m_filterDecisions[fn] = bRecorded;
+        return bRecorded;
+    }
+
+    /**
+    * Expects Globals::m_mutex to be locked.
+    */
+    FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void mergeCounters(std::map<uintptr_t, MergedCounters>& merged, const ThreadTable& table)
+    {
+        for (const FunctionCounters& counters : table.m_counters)
+        {
+            const uintptr_t fn = counters.m_fn.load(std::memory_order_acquire);
+            const uint64_t nCalls = counters.m_nCalls.load(std::memory_order_relaxed);
+            if ((fn == 0) || !counters.m_bRecorded || (nCalls == 0))
+            {
+                continue;
+            }
+            MergedCounters& m = merged[fn];
+            m.m_nCalls += nCalls;
+            m.m_durationsTotal += counters.m_durationsTotal.load(std::memory_order_relaxed);
+            const uint64_t durationsMin = counters.m_durationsMin.load(std::memory_order_relaxed);
+            const uint64_t durationsMax = counters.m_durationsMax.load(std::memory_order_relaxed);
+            m.m_durationsMin = durationsMin < m.m_durationsMin ? durationsMin : m.m_durationsMin;
+            m.m_durationsMax = durationsMax > m.m_durationsMax ? durationsMax : m.m_durationsMax;
+        }
+    }
+
+    FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void resetCounters(FunctionCounters& counters)
+    {
+        counters.m_nCalls.store(0, std::memory_order_relaxed);
+        counters.m_durationsTotal.store(0, std::memory_order_relaxed);
+        counters.m_durationsMin.store(UINT64_MAX, std::memory_order_relaxed);
+        counters.m_durationsMax.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+    * @return Table of the current thread, nullptr if the thread is already finishing.
+    */
+    FUNCTION_INSTRUMENTATION_NO_INSTRUMENT ThreadTable* getThreadTable()
+    {
+        if (!t_pTable && !t_bTableReleased)
+        {
+            Globals& globals = getGlobals();
+            std::lock_guard<std::mutex> lock(globals.m_mutex);
+            if (globals.m_freeTables.empty())
+            {
+                t_pTable = new ThreadTable();
+            }
+            else
+            {
+                t_pTable = globals.m_freeTables.back();
+                globals.m_freeTables.pop_back();
+            }
+            globals.m_tables.push_back(t_pTable);
+            (void)&t_tableReleaser;  // first use of the thread_local registers its dtor for the thread exit
+        }
+        return t_pTable;
+    }
+
+    /**
+    * Merges the counters of the current thread into Globals::m_finishedCounters, then zeroes its table and keeps it
+    * for the next new thread, so the memory of the tables is bounded by the peak number of instrumented threads.
+    */
+    FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void releaseThreadTable()
+    {
+        t_bTableReleased = true;
+        ThreadTable* const pTable = t_pTable;
+        if (!pTable)
+        {
+            return;
+        }
+        t_pTable = nullptr;
+
+        Globals& globals = getGlobals();
+        std::lock_guard<std::mutex> lock(globals.m_mutex);
+        mergeCounters(globals.m_finishedCounters, *pTable);
+        globals.m_nFinishedDroppedCalls += pTable->m_nDroppedCalls.load(std::memory_order_relaxed);
+
+        for (FunctionCounters& counters : pTable->m_counters)
+        {
+            counters.m_fn.store(0, std::memory_order_relaxed);
+            counters.m_bRecorded = true;
+            resetCounters(counters);
+        }
+        pTable->m_nDepth = 0;
+        pTable->m_nDroppedCalls.store(0, std::memory_order_relaxed);
+
+        globals.m_tables.erase(std::find(globals.m_tables.begin(), globals.m_tables.end(), pTable));
+        globals.m_freeTables.push_back(pTable);
+    }
+
+    /**
+    * @return Counters of the given function in the given table, nullptr if the table is full or the function is excluded.
+    */
+    FUNCTION_INSTRUMENTATION_NO_INSTRUMENT FunctionCounters* findCounters(ThreadTable& table, uintptr_t fn)
+    {
+        const unsigned int nMask = FunctionInstrumentation::MaxFunctionsPerThread - 1;
+        unsigned int iSlot = static_cast<unsigned int>((static_cast<uint64_t>(fn) * 0x9E3779B97F4A7C15ull) >> 40) & nMask;
+        for (unsigned int nProbes = 0; nProbes < FunctionInstrumentation::MaxFunctionsPerThread; nProbes++)
+        {
+            FunctionCounters& counters = table.m_counters[iSlot];
+            const uintptr_t slotFn = counters.m_fn.load(std::memory_order_relaxed);
+            if (slotFn == fn)
+            {
+                return counters.m_bRecorded ? &counters : nullptr;
+            }
+            if (slotFn == 0)
+            {
+                // slow path: first call of the function in this thread
+                Globals& globals = getGlobals();
+                {
+                    std::lock_guard<std::mutex> lock(globals.m_mutex);
+                    counters.m_bRecorded = isRecordedByFilters(globals, fn);
+                }
+                counters.m_fn.store(fn, std::memory_order_release);
+                return counters.m_bRecorded ? &counters : nullptr;
+            }
+            iSlot = (iSlot + 1) & nMask;
+        }
+        table.m_nDroppedCalls.fetch_add(1, std::memory_order_relaxed);  // table is full
+        return nullptr;
+    }
+
+    FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void incrementRelaxed(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        // only the owner thread writes, so no need for atomic read-modify-write
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+} // namespace
+
+
+extern "C" FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void __cyg_profile_func_enter(void* pFn, void* /*pCallSite*/)
+{
+    if (t_bInHook || !getGlobals().m_bRunning.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    t_bInHook = true;
+
+    ThreadTable* const pTable = getThreadTable();
+    if (!pTable)
+    {
+        t_bInHook = false;
+        return;
+    }
+    ThreadTable& table = *pTable;
+    if (table.m_nDepth < FunctionInstrumentation::MaxCallDepth)
+    {
+        const uintptr_t fn = reinterpret_cast<uintptr_t>(pFn);
+        Frame& frame = table.m_stack[table.m_nDepth];
+        frame.m_fn = fn;
+        frame.m_pCounters = findCounters(table, fn);
+        frame.m_timeStart = Clock::now();
+    }
+    else
+    {
+        table.m_nDroppedCalls.fetch_add(1, std::memory_order_relaxed);
+    }
+    ++table.m_nDepth;
+
+    t_bInHook = false;
+}
+
+extern "C" FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void __cyg_profile_func_exit(void* pFn, void* /*pCallSite*/)
+{
+    if (t_bInHook || !t_pTable)
+    {
+        return;
+    }
+    t_bInHook = true;
+
+    const Clock::TimePoint timeEnd = Clock::now();
+    ThreadTable& table = *t_pTable;
+    const uintptr_t fn = reinterpret_cast<uintptr_t>(pFn);
+
+    if (table.m_nDepth > FunctionInstrumentation::MaxCallDepth)
+    {
+        --table.m_nDepth;  // frame was not stored
+        t_bInHook = false;
+        return;
+    }
+
+    // Normally the matching frame is on the top. It is deeper if frames were skipped by longjmp(), and it is missing
+    // if the function was entered while not running, such exits are ignored.
+    unsigned int iFrame = table.m_nDepth;
+    while ((iFrame > 0) && (table.m_stack[iFrame - 1].m_fn != fn))
+    {
+        --iFrame;
+    }
+
+    if (iFrame > 0)
+    {
+        table.m_nDepth = iFrame - 1;
+        const Frame& frame = table.m_stack[table.m_nDepth];
+        if (frame.m_pCounters)
+        {
+            FunctionCounters& counters = *frame.m_pCounters;
+            const uint64_t duration = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(timeEnd - frame.m_timeStart).count());
+            incrementRelaxed(counters.m_nCalls, 1);
+            incrementRelaxed(counters.m_durationsTotal, duration);
+            if (duration < counters.m_durationsMin.load(std::memory_order_relaxed))
+            {
+                counters.m_durationsMin.store(duration, std::memory_order_relaxed);
+            }
+            if (duration > counters.m_durationsMax.load(std::memory_order_relaxed))
+            {
+                counters.m_durationsMax.store(duration, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    t_bInHook = false;
+}
+
+
+FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void FunctionInstrumentation::start()
+{
+    getGlobals().m_bRunning.store(true, std::memory_order_relaxed);
+}
+
+FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void FunctionInstrumentation::stop()
+{
+    getGlobals().m_bRunning.store(false, std::memory_order_relaxed);
+}
+
+FUNCTION_INSTRUMENTATION_NO_INSTRUMENT bool FunctionInstrumentation::isRunning()
+{
+    return getGlobals().m_bRunning.load(std::memory_order_relaxed);
+}
+
+FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void FunctionInstrumentation::addIncludeFilter(const std::string& sSubstring)
+{
+    Globals& globals = getGlobals();
+    std::lock_guard<std::mutex> lock(globals.m_mutex);
+    globals.m_includeFilters.push_back(sSubstring);
+    globals.m_filterDecisions.clear();
+}
+
+FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void FunctionInstrumentation::addExcludeFilter(const std::string& sSubstring)
+{
+    Globals& globals = getGlobals();
+    std::lock_guard<std::mutex> lock(globals.m_mutex);
+    globals.m_excludeFilters.push_back(sSubstring);
+    globals.m_filterDecisions.clear();
+}
+
+FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void FunctionInstrumentation::clearFilters()
+{
+    Globals& globals = getGlobals();
+    std::lock_guard<std::mutex> lock(globals.m_mutex);
+    globals.m_includeFilters.clear();
+    globals.m_excludeFilters.clear();
+    globals.m_filterDecisions.clear();
+}
+
+FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void FunctionInstrumentation::collect()
+{
+    const bool bInHookPrev = t_bInHook;
+    t_bInHook = true;  // the data store and the name resolution below might call instrumented code
+    std::map<uintptr_t, MergedCounters> merged;
+    {
+        Globals& globals = getGlobals();
+        std::lock_guard<std::mutex> lock(globals.m_mutex);
+        merged = globals.m_finishedCounters;
+        for (const ThreadTable* const pTable : globals.m_tables)
+        {
+            mergeCounters(merged, *pTable);
+        }
+    }
+
+    for (const auto& function : merged)
+    {
+        const std::string sName = getFunctionName(function.first);
+        auto& bmData = ScopeBenchmarkerDataStore::getDataByName(sName);
+        bmData.beginWrite();
+        bmData.m_ratioDenominator = std::chrono::nanoseconds::period::den;
+        bmData.m_iterations = static_cast<long long>(function.second.m_nCalls);
+        bmData.m_durationsTotal = static_cast<long long>(function.second.m_durationsTotal);
+        bmData.m_durationsMin = static_cast<long long>(function.second.m_durationsMin);
+        bmData.m_durationsMax = static_cast<long long>(function.second.m_durationsMax);
+        bmData.endWrite();
+    }
+    t_bInHook = bInHookPrev;
+}
+
+FUNCTION_INSTRUMENTATION_NO_INSTRUMENT void FunctionInstrumentation::reset()
+{
+    Globals& globals = getGlobals();
+    std::lock_guard<std::mutex> lock(globals.m_mutex);
+    for (ThreadTable* const pTable : globals.m_tables)
+    {
+        for (FunctionCounters& counters : pTable->m_counters)
+        {
+            resetCounters(counters);
+        }
+        pTable->m_nDroppedCalls.store(0, std::memory_order_relaxed);
+    }
+    globals.m_finishedCounters.clear();
+    globals.m_nFinishedDroppedCalls = 0;
+}
+
+FUNCTION_INSTRUMENTATION_NO_INSTRUMENT unsigned long long FunctionInstrumentation::getDroppedCallCount()
+{
+    Globals& globals = getGlobals();
+    std::lock_guard<std::mutex> lock(globals.m_mutex);
+    unsigned long long nDropped = globals.m_nFinishedDroppedCalls;
+    for (const ThreadTable* const pTable : globals.m_tables)
+    {
+        nDropped += pTable->m_nDroppedCalls.load(std::memory_order_relaxed);
+    }
+    return nDropped;
+}
+
+#endif // FUNCTION_INSTRUMENTATION && __GNUC__
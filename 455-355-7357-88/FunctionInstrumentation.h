@@ -0,0 +1,93 @@
+#pragma once
+
+/*
+    ###################################################################################
+    FunctionInstrumentation.h
+    Automatic function-level timing of code compiled with -finstrument-functions.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <string>
+
+/**
+* Records the timing of every function of the instrumented code, without manually placing ScopeBenchmarkers, e.g. for
+* exploring an unfamiliar hot path.
+*
+* Usage with GCC or Clang:
+*  - compile the code to be explored with -finstrument-functions, and exclude the framework headers from the
+*    instrumentation, e.g. -finstrument-functions-exclude-file-list=455-355-7357-88/;
+*  - compile FunctionInstrumentation.cpp with FUNCTION_INSTRUMENTATION defined and WITHOUT -finstrument-functions,
+*    since it implements the __cyg_profile_func_enter() and __cyg_profile_func_exit() hooks invoked by the compiler;
+*  - link with -rdynamic (and -ldl with older glibc) so the function names can be resolved by dladdr();
+*  - call start() before and collect() after the code to be explored, then print the ScopeBenchmarkerDataStore as
+*    usual, e.g. by Benchmark.
+*
+* Without FUNCTION_INSTRUMENTATION, and with compilers not supporting -finstrument-functions (e.g. MSVC),
+* FunctionInstrumentation.cpp compiles to nothing, so it is harmless to keep it in the project, but then the functions
+* below are not defined either.
+*
+* The hooks use a per-thread fast path: every thread has its own shadow call stack and its own open addressing table
+* of per-function counters, so recording a call takes 2 Clock::now() calls and a few thread-local memory accesses,
+* without locks and without shared cache lines. Function names are resolved only by collect(), unless filters are
+* set: then each function is resolved once, on its first call, to decide if it is to be recorded.
+* Durations are inclusive (they contain the callees), so recursive functions are counted multiple times.
+* Each thread can record at most MaxFunctionsPerThread different functions and MaxCallDepth nested calls, calls beyond
+* these limits are not recorded but counted by getDroppedCallCount().
+* When a thread finishes, its counters are kept for collect() and its table is reused by the next new thread, so memory
+* use is bounded by the peak number of concurrently instrumented threads, not by the number of threads ever started.
+*/
+class FunctionInstrumentation
+{
+public:
+
+    static constexpr unsigned int MaxFunctionsPerThread = 4096;
+    static constexpr unsigned int MaxCallDepth = 256;
+
+    /**
+    * Starts recording calls in all threads.
+    */
+    static void start();
+
+    /**
+    * Stops recording calls. Recorded counters are kept.
+    */
+    static void stop();
+
+    static bool isRunning();
+
+    /**
+    * Only functions whose demangled name contains at least 1 of the include filters are recorded.
+    * No include filter means all functions are recorded, except the excluded ones.
+    * Filters should be set while not running, since already seen functions are not evaluated again.
+    */
+    static void addIncludeFilter(const std::string& sSubstring);
+
+    /**
+    * Functions whose demangled name contains any of the exclude filters are not recorded.
+    * Filters should be set while not running, since already seen functions are not evaluated again.
+    */
+    static void addExcludeFilter(const std::string& sSubstring);
+
+    static void clearFilters();
+
+    /**
+    * Merges the counters of all threads and writes them into ScopeBenchmarkerDataStore, in BmData named after the
+    * demangled function name (or its address if it cannot be resolved), with nanosecond unit.
+    * The BmData are overwritten, not added to, so collect() can be invoked multiple times.
+    * Since ScopeBenchmarkerDataStore is not thread-safe, it should be invoked when other threads are not in measured scopes.
+    */
+    static void collect();
+
+    /**
+    * Zeroes the counters of all threads. Should be invoked while not running.
+    */
+    static void reset();
+
+    /**
+    * @return Number of calls not recorded due to per-thread limits.
+    */
+    static unsigned long long getDroppedCallCount();
+};
@@ -0,0 +1,572 @@
+#pragma once
+
+/*
+    ###################################################################################
+    HostCharacterization.h
+    Basic header-only host characterization: cache and memory latencies, memory bandwidth.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>
+#include <atomic>    // requires cpp11
+#include <chrono>    // requires cpp11
+#include <cstddef>   // size_t
+#include <cstdint>   // uintptr_t
+#include <cstdio>    // snprintf
+#include <cstdlib>   // strtoull
+#include <cstring>   // memcpy
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>    // requires cpp11
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#endif
+
+#include "BenchmarkMerge.h"
+#include "Benchmarks.h"
+
+/**
+* Measures the memory hierarchy of the host, so benchmark results of different hosts can be interpreted:
+* - latency of dependent loads (pointer chasing in random order, defeating the prefetchers) across working set sizes,
+*   from which the cache levels are detected as plateaus of the latency;
+* - read, write and copy bandwidth of a large buffer (STREAM-like), by a single thread and by multiple threads.
+*
+* Results can be stored as host metadata by Result::storeAsHostMetadata(), then they are written into every export by
+* BenchmarkMerge::writeDataStore(), and listed per source by BenchmarkMerge::getReport().
+*
+* Time is measured by std::chrono::steady_clock, not Clock, since it is about the real host.
+* See HostCharacterizationBenchmark for running it as part of a benchmark suite.
+*/
+class HostCharacterization
+{
+public:
+
+    static constexpr size_t LineSize = 64;   /**< Assumed cache line size, working sets are chased by this stride. */
+
+    struct Options
+    {
+        size_t m_nMinWorkingSetBytes = 4 * 1024;             /**< Smallest working set of the latency measurement. */
+        size_t m_nMaxWorkingSetBytes = 128 * 1024 * 1024;    /**< Largest working set of the latency measurement, should be well
+                                                                  above the last level cache, since the last plateau is taken as memory. */
+        size_t m_nChaseLoads = 1 << 21;                      /**< Number of dependent loads measured per working set. */
+        size_t m_nBandwidthBytes = 64 * 1024 * 1024;         /**< Buffer size of the bandwidth measurement, should be well above the last level cache. */
+        unsigned int m_nThreads = 0;                         /**< Threads of the multi-threaded bandwidth measurement, 0 means the number of hardware threads. */
+        size_t m_nRepeats = 3;                               /**< Bandwidth measurements are repeated this many times, the best is kept. */
+    };
+
+    struct LatencyPoint
+    {
+        size_t m_nWorkingSetBytes;
+        double m_fLatencyNs;                                 /**< Average latency of a dependent load. */
+    };
+
+    struct CacheLevel
+    {
+        size_t m_nSizeBytes;                                 /**< Largest measured working set still on the plateau of this level. */
+        double m_fLatencyNs;                                 /**< Median latency of the plateau. */
+    };
+
+    enum class StreamKind
+    {
+        Read,
+        Write,
+        Copy
+    };
+
+    struct Bandwidth
+    {
+        double m_fReadGBps = 0.0;
+        double m_fWriteGBps = 0.0;
+        double m_fCopyGBps = 0.0;                            /**< Counting both read and written bytes, as STREAM does. */
+    };
+
+    struct Result
+    {
+        std::vector<LatencyPoint> m_latencies;               /**< By ascending working set size. */
+        std::vector<CacheLevel> m_cacheLevels;               /**< Detected cache levels, L1 first. */
+        double m_fMemoryLatencyNs = 0.0;                     /**< Median latency of the last plateau. */
+        std::vector<size_t> m_reportedCacheSizes;            /**< See getReportedCacheSizes(), to cross-check m_cacheLevels. */
+        Bandwidth m_singleThread;
+        Bandwidth m_multiThread;
+        unsigned int m_nThreads = 0;                         /**< Threads of m_multiThread. */
+
+        /**
+        * @return The results as key/value pairs, e.g. "cache.L1.latency_ns" = "1.2", "bandwidth.read.multi_thread_gbps" = "35.1".
+        */
+        std::vector<std::pair<std::string, std::string>> toMetadata() const
+        {
+            std::vector<std::pair<std::string, std::string>> metadata;
+            for (size_t i = 0; i < m_cacheLevels.size(); i++)
+            {
+                const std::string sLevel = "cache.L" + std::to_string(i + 1);
+                metadata.emplace_back(sLevel + ".size_bytes", std::to_string(m_cacheLevels[i].m_nSizeBytes));
+                metadata.emplace_back(sLevel + ".latency_ns", formatNumber(m_cacheLevels[i].m_fLatencyNs));
+            }
+            for (size_t i = 0; i < m_reportedCacheSizes.size(); i++)
+            {
+                metadata.emplace_back("cache.L" + std::to_string(i + 1) + ".reported_size_bytes", std::to_string(m_reportedCacheSizes[i]));
+            }
+            metadata.emplace_back("memory.latency_ns", formatNumber(m_fMemoryLatencyNs));
+            metadata.emplace_back("bandwidth.read.single_thread_gbps", formatNumber(m_singleThread.m_fReadGBps));
+            metadata.emplace_back("bandwidth.write.single_thread_gbps", formatNumber(m_singleThread.m_fWriteGBps));
+            metadata.emplace_back("bandwidth.copy.single_thread_gbps", formatNumber(m_singleThread.m_fCopyGBps));
+            metadata.emplace_back("bandwidth.read.multi_thread_gbps", formatNumber(m_multiThread.m_fReadGBps));
+            metadata.emplace_back("bandwidth.write.multi_thread_gbps", formatNumber(m_multiThread.m_fWriteGBps));
+            metadata.emplace_back("bandwidth.copy.multi_thread_gbps", formatNumber(m_multiThread.m_fCopyGBps));
+            metadata.emplace_back("bandwidth.threads", std::to_string(m_nThreads));
+            return metadata;
+        }
+
+        /**
+        * Stores toMetadata() by BenchmarkMerge::setHostMetadata() with "host." key prefix, so it is written into exports.
+        */
+        void storeAsHostMetadata() const
+        {
+            for (const auto& metadata : toMetadata())
+            {
+                BenchmarkMerge::setHostMetadata("host." + metadata.first, metadata.second);
+            }
+        }
+
+        /**
+        * @return Report lines: latency of every working set, detected cache levels, bandwidths.
+        */
+        std::vector<std::string> getReport() const
+        {
+            std::vector<std::string> lines;
+            lines.push_back("  Load latency by working set:");
+            for (const auto& latency : m_latencies)
+            {
+                lines.push_back("    " + formatBytes(latency.m_nWorkingSetBytes) + ": " + formatNumber(latency.m_fLatencyNs) + " ns");
+            }
+            for (size_t i = 0; i < m_cacheLevels.size(); i++)
+            {
+                lines.push_back("  L" + std::to_string(i + 1) + ": up to " + formatBytes(m_cacheLevels[i].m_nSizeBytes) +
+                    (i < m_reportedCacheSizes.size() ? " (reported: " + formatBytes(m_reportedCacheSizes[i]) + ")" : std::string()) +
+                    ", Latency: " + formatNumber(m_cacheLevels[i].m_fLatencyNs) + " ns");
+            }
+            lines.push_back("  Memory Latency: " + formatNumber(m_fMemoryLatencyNs) + " ns");
+            lines.push_back("  Bandwidth Read/Write/Copy: 1 thread: " + formatNumber(m_singleThread.m_fReadGBps) + "/" +
+                formatNumber(m_singleThread.m_fWriteGBps) + "/" + formatNumber(m_singleThread.m_fCopyGBps) + " GB/s, " +
+                std::to_string(m_nThreads) + " threads: " + formatNumber(m_multiThread.m_fReadGBps) + "/" +
+                formatNumber(m_multiThread.m_fWriteGBps) + "/" + formatNumber(m_multiThread.m_fCopyGBps) + " GB/s");
+            return lines;
+        }
+    };
+
+    /**
+    * Runs all measurements. Takes a few seconds with the default options.
+    */
+    static Result run(const Options& options)
+    {
+        Result result;
+        result.m_latencies = measureLatencies(options);
+        detectCacheLevels(result);
+        result.m_reportedCacheSizes = getReportedCacheSizes();
+        result.m_nThreads = getThreadCount(options);
+        result.m_singleThread = measureBandwidths(options.m_nBandwidthBytes, 1, options.m_nRepeats);
+        result.m_multiThread = measureBandwidths(options.m_nBandwidthBytes, result.m_nThreads, options.m_nRepeats);
+        return result;
+    }
+
+    static Result run()
+    {
+        return run(Options());
+    }
+
+    /**
+    * @return Latency of every working set size given by getWorkingSetSizes() of the options, see measureLatency().
+    */
+    static std::vector<LatencyPoint> measureLatencies(const Options& options)
+    {
+        std::vector<LatencyPoint> latencies;
+        for (const size_t nWorkingSetBytes : getWorkingSetSizes(options.m_nMinWorkingSetBytes, options.m_nMaxWorkingSetBytes))
+        {
+            latencies.push_back(LatencyPoint{ nWorkingSetBytes, measureLatency(nWorkingSetBytes, options.m_nChaseLoads) });
+        }
+        return latencies;
+    }
+
+    /**
+    * Detects the cache levels as plateaus of the latency: a plateau lasts while the latency stays within JumpRatio of
+    * its first point, then the transition to the next plateau lasts while the latency keeps rising by more than
+    * TransitionRatio per point. The last plateau is taken as memory.
+    * Fills m_cacheLevels and m_fMemoryLatencyNs from m_latencies.
+    */
+    static void detectCacheLevels(Result& result)
+    {
+        result.m_cacheLevels.clear();
+        result.m_fMemoryLatencyNs = 0.0;
+        const std::vector<LatencyPoint>& points = result.m_latencies;
+        size_t iPlateauStart = 0;
+        while (iPlateauStart < points.size())
+        {
+            size_t iPlateauEnd = iPlateauStart;
+            while ((iPlateauEnd + 1 < points.size()) && (points[iPlateauEnd + 1].m_fLatencyNs <= points[iPlateauStart].m_fLatencyNs * JumpRatio))
+            {
+                iPlateauEnd++;
+            }
+
+            std::vector<double> plateau;
+            for (size_t i = iPlateauStart; i <= iPlateauEnd; i++)
+            {
+                plateau.push_back(points[i].m_fLatencyNs);
+            }
+            std::sort(plateau.begin(), plateau.end());
+            const double fPlateauLatencyNs = plateau[plateau.size() / 2];
+
+            if (iPlateauEnd + 1 == points.size())
+            {
+                result.m_fMemoryLatencyNs = fPlateauLatencyNs;
+                break;
+            }
+            result.m_cacheLevels.push_back(CacheLevel{ points[iPlateauEnd].m_nWorkingSetBytes, fPlateauLatencyNs });
+
+            iPlateauStart = iPlateauEnd + 1;
+            while ((iPlateauStart + 1 < points.size()) && (points[iPlateauStart + 1].m_fLatencyNs > points[iPlateauStart].m_fLatencyNs * TransitionRatio))
+            {
+                iPlateauStart++;
+            }
+        }
+    }
+
+    /**
+    * @return Powers of 2 between the given sizes and the midpoints (1.5x) between them, ascending.
+    */
+    static std::vector<size_t> getWorkingSetSizes(size_t nMinBytes, size_t nMaxBytes)
+    {
+        std::vector<size_t> sizes;
+        for (size_t nBytes = std::max(nMinBytes, LineSize * 2); nBytes <= nMaxBytes; nBytes *= 2)
+        {
+            sizes.push_back(nBytes);
+            if (nBytes / 2 * 3 <= nMaxBytes)
+            {
+                sizes.push_back(nBytes / 2 * 3);
+            }
+        }
+        return sizes;
+    }
+
+    /**
+    * @return Average latency of a dependent load in nanoseconds, chasing pointers stored 1 per cache line in a
+    *         working set of the given size, in a random cyclic order, so neither the prefetchers nor out-of-order
+    *         execution can hide the latency.
+    */
+    static double measureLatency(size_t nWorkingSetBytes, size_t nLoads)
+    {
+        const size_t nLines = std::max(nWorkingSetBytes / LineSize, static_cast<size_t>(2));
+        std::vector<char> buffer(nLines * LineSize + LineSize);
+        char* const pLines = buffer.data() + (LineSize - reinterpret_cast<uintptr_t>(buffer.data()) % LineSize) % LineSize;
+
+        // Sattolo's algorithm gives a random permutation being a single cycle, so every line is visited
+        std::vector<size_t> order(nLines);
+        for (size_t i = 0; i < nLines; i++)
+        {
+            order[i] = i;
+        }
+        std::mt19937_64 rng(88);
+        for (size_t i = nLines - 1; i > 0; i--)
+        {
+            std::swap(order[i], order[std::uniform_int_distribution<size_t>(0, i - 1)(rng)]);
+        }
+        for (size_t i = 0; i < nLines; i++)
+        {
+            char* const pNext = pLines + order[(i + 1) % nLines] * LineSize;
+            memcpy(pLines + order[i] * LineSize, &pNext, sizeof(pNext));
+        }
+
+        char* p = chase(pLines, std::min(nLines, nLoads));   // warm-up
+        const auto timeStart = std::chrono::steady_clock::now();
+        p = chase(p, nLoads);
+        const auto duration = std::chrono::steady_clock::now() - timeStart;
+        getSink().store(reinterpret_cast<uintptr_t>(p), std::memory_order_relaxed);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / static_cast<double>(nLoads);
+    }
+
+    /**
+    * @return Best bandwidth of the given kind in GB/s out of nRepeats measurements, with the buffer of the given size
+    *         split evenly among the given number of threads.
+    */
+    static double measureBandwidth(StreamKind kind, size_t nBytes, unsigned int nThreads, size_t nRepeats)
+    {
+        nThreads = std::max(nThreads, 1u);
+        const size_t nElements = std::max(nBytes / sizeof(double), static_cast<size_t>(nThreads));
+        std::vector<double> source(nElements);
+        std::vector<double> target(nElements);
+        const size_t nBytesMoved = nElements * sizeof(double) * (kind == StreamKind::Copy ? 2 : 1);
+
+        double fBestGBps = 0.0;
+        for (size_t iRepeat = 0; iRepeat < std::max(nRepeats, static_cast<size_t>(1)) + 1; iRepeat++)
+        {
+            std::atomic<bool> bStart{ false };
+            std::atomic<unsigned int> nReady{ 0 };
+            std::vector<std::thread> threads;
+            for (unsigned int iThread = 0; iThread < nThreads; iThread++)
+            {
+                threads.emplace_back([&, iThread]()
+                    {
+                        double* const pSource = source.data() + nElements * iThread / nThreads;
+                        double* const pTarget = target.data() + nElements * iThread / nThreads;
+                        const size_t nChunk = nElements * (iThread + 1) / nThreads - nElements * iThread / nThreads;
+                        nReady++;
+                        while (!bStart.load(std::memory_order_acquire))
+                        {
+                            std::this_thread::yield();
+                        }
+                        stream(kind, pSource, pTarget, nChunk);
+                    });
+            }
+            while (nReady.load() < nThreads)
+            {
+                std::this_thread::yield();
+            }
+            const auto timeStart = std::chrono::steady_clock::now();
+            bStart.store(true, std::memory_order_release);
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+            const long long nDurationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timeStart).count();
+            // the first run is warm-up, also faulting in the pages
+            if ((iRepeat > 0) && (nDurationNs > 0))
+            {
+                fBestGBps = std::max(fBestGBps, nBytesMoved / static_cast<double>(nDurationNs));
+            }
+        }
+        return fBestGBps;
+    }
+
+    /**
+    * @return Read, write and copy bandwidth with the given number of threads, see measureBandwidth().
+    */
+    static Bandwidth measureBandwidths(size_t nBytes, unsigned int nThreads, size_t nRepeats)
+    {
+        Bandwidth bandwidth;
+        bandwidth.m_fReadGBps = measureBandwidth(StreamKind::Read, nBytes, nThreads, nRepeats);
+        bandwidth.m_fWriteGBps = measureBandwidth(StreamKind::Write, nBytes, nThreads, nRepeats);
+        bandwidth.m_fCopyGBps = measureBandwidth(StreamKind::Copy, nBytes, nThreads, nRepeats);
+        return bandwidth;
+    }
+
+    /**
+    * @return Threads of the multi-threaded bandwidth measurement by the given options.
+    */
+    static unsigned int getThreadCount(const Options& options)
+    {
+        return (options.m_nThreads == 0) ? std::max(std::thread::hardware_concurrency(), 1u) : options.m_nThreads;
+    }
+
+    /**
+    * @return Sizes of the data and unified caches as reported by the operating system, L1 first, empty if unknown.
+    */
+    static std::vector<size_t> getReportedCacheSizes()
+    {
+        std::map<unsigned int, size_t> sizesByLevel;
+#ifdef _WIN32
+        DWORD nBufferSize = 0;
+        GetLogicalProcessorInformation(nullptr, &nBufferSize);
+        std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(nBufferSize / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+        if (!infos.empty() && GetLogicalProcessorInformation(infos.data(), &nBufferSize))
+        {
+            for (const auto& info : infos)
+            {
+                if ((info.Relationship == RelationCache) && (info.Cache.Type != CacheInstruction))
+                {
+                    sizesByLevel[info.Cache.Level] = info.Cache.Size;
+                }
+            }
+        }
+#else
+        for (unsigned int iIndex = 0; iIndex < 16; iIndex++)
+        {
+            const std::string sDir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(iIndex) + "/";
+            std::ifstream fLevel(sDir + "level");
+            std::ifstream fType(sDir + "type");
+            std::ifstream fSize(sDir + "size");
+            unsigned int nLevel = 0;
+            std::string sType;
+            std::string sSize;
+            if (!(fLevel >> nLevel) || !(fType >> sType) || !(fSize >> sSize))
+            {
+                break;
+            }
+            if (sType == "Instruction")
+            {
+                continue;
+            }
+            char* pEnd = nullptr;
+            size_t nSize = static_cast<size_t>(strtoull(sSize.c_str(), &pEnd, 10));
+            nSize *= (*pEnd == 'K') ? 1024 : (*pEnd == 'M') ? 1024 * 1024 : 1;
+            sizesByLevel[nLevel] = nSize;
+        }
+#endif
+        std::vector<size_t> sizes;
+        for (const auto& sizeByLevel : sizesByLevel)
+        {
+            sizes.push_back(sizeByLevel.second);
+        }
+        return sizes;
+    }
+
+private:
+
+    static constexpr double JumpRatio = 1.3;         /**< Latency rise ending a plateau, see detectCacheLevels(). */
+    static constexpr double TransitionRatio = 1.1;   /**< Latency rise per point continuing a transition, see detectCacheLevels(). */
+
+    static char* chase(char* p, size_t nLoads)
+    {
+        for (size_t i = 0; i < nLoads; i++)
+        {
+            memcpy(&p, p, sizeof(p));
+        }
+        return p;
+    }
+
+    static void stream(StreamKind kind, double* pSource, double* pTarget, size_t nElements)
+    {
+        switch (kind)
+        {
+        case StreamKind::Read:
+        {
+            double fSum = 0.0;
+            for (size_t i = 0; i < nElements; i++)
+            {
+                fSum += pSource[i];
+            }
+            getSink().fetch_add(static_cast<uintptr_t>(fSum), std::memory_order_relaxed);
+            break;
+        }
+        case StreamKind::Write:
+            for (size_t i = 0; i < nElements; i++)
+            {
+                pTarget[i] = 1.0;
+            }
+            break;
+        case StreamKind::Copy:
+            for (size_t i = 0; i < nElements; i++)
+            {
+                pTarget[i] = pSource[i];
+            }
+            break;
+        }
+    }
+
+    /**
+    * Results of the measured loops are stored here, so the compiler cannot optimize the loops away.
+    */
+    static std::atomic<uintptr_t>& getSink()
+    {
+        static std::atomic<uintptr_t> s_sink{ 0 };
+        return s_sink;
+    }
+
+    static std::string formatNumber(double fValue)
+    {
+        char szValue[32];
+        snprintf(szValue, sizeof(szValue), "%.2f", fValue);
+        return szValue;
+    }
+
+    static std::string formatBytes(size_t nBytes)
+    {
+        if ((nBytes >= 1024 * 1024) && (nBytes % (1024 * 1024) == 0))
+        {
+            return std::to_string(nBytes / (1024 * 1024)) + " MiB";
+        }
+        if ((nBytes >= 1024) && (nBytes % 1024 == 0))
+        {
+            return std::to_string(nBytes / 1024) + " KiB";
+        }
+        return std::to_string(nBytes) + " B";
+    }
+};
+
+
+/**
+* Built-in benchmark suite characterizing the host by HostCharacterization, to be added to the tests passed to
+* Test::runTests(), so the results of the other benchmarks can be interpreted across different hosts.
+* Results are added to the info messages and stored as host metadata, see HostCharacterization::Result::storeAsHostMetadata().
+*/
+class HostCharacterizationBenchmark : public Benchmark
+{
+public:
+
+    HostCharacterizationBenchmark(const HostCharacterization::Options& options = HostCharacterization::Options()) :
+        Benchmark(__FILE__),
+        m_options(options)
+    {
+        addSubTest("test_load_latency_and_cache_levels", (PFNUNITSUBTEST)&HostCharacterizationBenchmark::test_load_latency_and_cache_levels);
+        addSubTest("test_single_thread_bandwidth", (PFNUNITSUBTEST)&HostCharacterizationBenchmark::test_single_thread_bandwidth);
+        addSubTest("test_multi_thread_bandwidth", (PFNUNITSUBTEST)&HostCharacterizationBenchmark::test_multi_thread_bandwidth);
+    }
+
+    HostCharacterizationBenchmark(const HostCharacterizationBenchmark&) = delete;
+    HostCharacterizationBenchmark& operator=(const HostCharacterizationBenchmark&) = delete;
+    HostCharacterizationBenchmark(HostCharacterizationBenchmark&&) = delete;
+    HostCharacterizationBenchmark& operator=(HostCharacterizationBenchmark&&) = delete;
+
+    /**
+    * @return Results of the last run.
+    */
+    const HostCharacterization::Result& getResult() const
+    {
+        return m_result;
+    }
+
+protected:
+
+    virtual void finalize() override
+    {
+        m_result.storeAsHostMetadata();
+        for (const auto& sLine : m_result.getReport())
+        {
+            addToInfoMessages(sLine.c_str());
+        }
+        addToInfoMessages("");
+    }
+
+private:
+
+    HostCharacterization::Options m_options;
+    HostCharacterization::Result m_result;
+
+    bool test_load_latency_and_cache_levels()
+    {
+        m_result.m_latencies = HostCharacterization::measureLatencies(m_options);
+        HostCharacterization::detectCacheLevels(m_result);
+        m_result.m_reportedCacheSizes = HostCharacterization::getReportedCacheSizes();
+
+        bool bLatenciesValid = true;
+        for (const auto& latency : m_result.m_latencies)
+        {
+            bLatenciesValid &= latency.m_fLatencyNs > 0.0;
+        }
+        return (assertFalse(m_result.m_latencies.empty(), "latencies") &
+            assertTrue(bLatenciesValid, "latencies valid") &
+            assertLess(0.0, m_result.m_fMemoryLatencyNs, "memory latency")) != 0;
+    }
+
+    bool test_single_thread_bandwidth()
+    {
+        m_result.m_singleThread = HostCharacterization::measureBandwidths(m_options.m_nBandwidthBytes, 1, m_options.m_nRepeats);
+        return assertLess(0.0, m_result.m_singleThread.m_fReadGBps, "read");
+    }
+
+    bool test_multi_thread_bandwidth()
+    {
+        m_result.m_nThreads = HostCharacterization::getThreadCount(m_options);
+        m_result.m_multiThread = HostCharacterization::measureBandwidths(m_options.m_nBandwidthBytes, m_result.m_nThreads, m_options.m_nRepeats);
+        return assertLess(0.0, m_result.m_multiThread.m_fReadGBps, "read");
+    }
+};
@@ -0,0 +1,599 @@
+#pragma once
+
+/*
+    ###################################################################################
+    InstrumentedMutex.h
+    Basic header-only mutex wrappers measuring lock wait time and hold time.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>
+#include <atomic>    // requires cpp11
+#include <chrono>    // requires cpp11
+#include <iterator>  // std::next
+#include <mutex>     // requires cpp11
+#include <shared_mutex>  // std::shared_timed_mutex requires cpp14, std::shared_mutex requires cpp17
+#include <stdexcept>
+#include <string>
+#include <thread>    // requires cpp11
+#include <utility>
+#include <vector>
+
+#include "PFL.h"  // for PFL::StringHash
+
+#include "Clock.h"
+#include "ScopeBenchmarker.h"
+
+/**
+* Simple spinlock satisfying the Lockable requirements, so it can be used with std::lock_guard, std::unique_lock, etc.
+* Yields the thread after spinning a while, to avoid burning the CPU when the lock is held for long.
+*/
+class SpinLock
+{
+public:
+
+    SpinLock() = default;
+
+    SpinLock(const SpinLock&) = delete;
+    SpinLock& operator=(const SpinLock&) = delete;
+    SpinLock(SpinLock&&) = delete;
+    SpinLock& operator=(SpinLock&&) = delete;
+
+    void lock()
+    {
+        int nSpins = 0;
+        while (m_flag.test_and_set(std::memory_order_acquire))
+        {
+            if (++nSpins >= 64)
+            {
+                std::this_thread::yield();
+                nSpins = 0;
+            }
+        }
+    }
+
+    bool try_lock()
+    {
+        return !m_flag.test_and_set(std::memory_order_acquire);
+    }
+
+    void unlock()
+    {
+        m_flag.clear(std::memory_order_release);
+    }
+
+private:
+
+    std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+};
+
+
+/**
+* Lock statistics shared by the instrumented lock wrappers.
+*
+* Wait and hold durations are recorded in nanoseconds into ScopeBenchmarkerDataStore with the following names, so they
+* are printed together with the scope benchmarkers (e.g. by Benchmark):
+*  - <name>.wait and <name>.hold for exclusive locking;
+*  - <name>.shared_wait and <name>.shared_hold for shared locking.
+* Every acquisition is counted in .wait, also the uncontended ones with near-zero wait time.
+*
+* Additionally, contended acquisitions are counted, and the longest waits are kept together with the scope of the
+* waiting thread and the scope holding the lock when the wait started (see ScopeBenchmarkerDataStore::getCurrentScope()).
+*
+* Durations are measured by Clock like the scopes, so they are in virtual time when a VirtualClock is installed.
+*
+* Exclusive statistics are recorded while still holding the measured lock, so they are serialized by the measured lock
+* itself. Shared statistics are recorded by multiple threads at the same time, so they are recorded by a
+* ScopeBenchmarkerDataStore::ConcurrentRecorder, without making any thread wait.
+* BmData references are cached by prepare() before acquiring the measured lock, so a failing lookup cannot leave the
+* lock acquired. They are looked up again after ScopeBenchmarkerDataStore::clear(), however the data store should not
+* be cleared while the lock is in use by other threads.
+*/
+class LockProfile
+{
+public:
+
+    typedef Clock::TimePoint TimePoint;
+
+    static constexpr size_t MaxLongestWaits = 5;
+
+    struct LongWait
+    {
+        long long m_waitNanosecs;
+        PFL::StringHash m_waiterScopeHash;      /**< Scope of the waiting thread, 0 if none. */
+        PFL::StringHash m_holderScopeHash;      /**< Scope of the holder thread when the wait started, 0 if none or unknown. */
+        bool m_bShared;
+    };
+
+    LockProfile(const std::string& sName) :
+        m_sName(sName)
+    {
+        if (sName.empty())
+        {
+            throw std::runtime_error("LockProfile ctor: name cannot be empty!");
+        }
+        // inserting a long wait must not throw while the measured lock is held
+        m_longestWaits.reserve(MaxLongestWaits + 1);
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
+        getRegistry().push_back(this);
+    }
+
+    ~LockProfile()
+    {
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
+        auto& registry = getRegistry();
+        registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+    }
+
+    LockProfile(const LockProfile&) = delete;
+    LockProfile& operator=(const LockProfile&) = delete;
+    LockProfile(LockProfile&&) = delete;
+    LockProfile& operator=(LockProfile&&) = delete;
+
+    const std::string& getName() const
+    {
+        return m_sName;
+    }
+
+    long long getAcquisitionCount() const
+    {
+        return m_nAcquisitions.load(std::memory_order_relaxed);
+    }
+
+    long long getContendedCount() const
+    {
+        return m_nContended.load(std::memory_order_relaxed);
+    }
+
+    /**
+    * @return The longest waits in descending order, at most MaxLongestWaits.
+    */
+    std::vector<LongWait> getLongestWaits() const
+    {
+        std::lock_guard<std::mutex> lock(m_longestWaitsMutex);
+        return m_longestWaits;
+    }
+
+    /**
+    * Resets the counters and the longest waits. BmData in ScopeBenchmarkerDataStore are not reset.
+    */
+    void reset()
+    {
+        m_nAcquisitions = 0;
+        m_nContended = 0;
+        std::lock_guard<std::mutex> lock(m_longestWaitsMutex);
+        m_longestWaits.clear();
+    }
+
+    /**
+    * @return Human-readable lines of contention statistics of all existing instrumented locks, in descending order of
+    *         contended acquisitions. Scope names are resolved from ScopeBenchmarkerDataStore.
+    */
+    static std::vector<std::string> getReport()
+    {
+        std::vector<const LockProfile*> profiles;
+        {
+            std::lock_guard<std::mutex> lock(getRegistryMutex());
+            profiles = getRegistry();
+        }
+        std::sort(profiles.begin(), profiles.end(),
+            [](const LockProfile* a, const LockProfile* b) { return a->getContendedCount() > b->getContendedCount(); });
+
+        std::vector<std::string> lines;
+        for (const LockProfile* pProfile : profiles)
+        {
+            const long long nAcquisitions = pProfile->getAcquisitionCount();
+            const long long nContended = pProfile->getContendedCount();
+            lines.push_back("  Lock " + pProfile->getName() + ": Acquisitions: " + std::to_string(nAcquisitions) +
+                ", Contended: " + std::to_string(nContended) +
+                " (" + std::to_string(nAcquisitions == 0 ? 0 : nContended * 100 / nAcquisitions) + "%)");
+            for (const auto& longWait : pProfile->getLongestWaits())
+            {
+                lines.push_back("    " + std::to_string(longWait.m_waitNanosecs / 1000) + " us" +
+                    (longWait.m_bShared ? " shared" : "") +
+                    " wait in " + getScopeName(longWait.m_waiterScopeHash) +
+                    " while held by " + getScopeName(longWait.m_holderScopeHash));
+            }
+        }
+        return lines;
+    }
+
+    /**
+    * To be invoked by the lock wrapper before trying to acquire the lock, while not holding it yet.
+    * @return Scope of the current holder of the lock, as far as known.
+    */
+    PFL::StringHash getHolderScope() const
+    {
+        return m_holderScopeHash.load(std::memory_order_relaxed);
+    }
+
+    /**
+    * To be invoked by the lock wrapper before acquiring the lock: looks up the BmData references if the data store
+    * was cleared since the last lookup. Might throw, e.g. by ExclusiveResources::require(), so it cannot be invoked
+    * while holding the lock.
+    */
+    void prepare()
+    {
+        const unsigned long long generation = ScopeBenchmarkerDataStore::getGeneration();
+        if (m_bmDataGeneration.load(std::memory_order_acquire) == generation)
+        {
+            return;
+        }
+
+        // multiple threads might prepare at the same time, e.g. for shared locking, serialize the lookup
+        std::lock_guard<std::mutex> lock(m_longestWaitsMutex);
+        if (m_bmDataGeneration.load(std::memory_order_relaxed) == generation)
+        {
+            return;
+        }
+        m_pWaitBmData = &ScopeBenchmarkerDataStore::getDataByName(m_sName + ".wait");
+        m_pHoldBmData = &ScopeBenchmarkerDataStore::getDataByName(m_sName + ".hold");
+        m_pSharedWaitBmData = &ScopeBenchmarkerDataStore::getDataByName(m_sName + ".shared_wait");
+        m_pSharedHoldBmData = &ScopeBenchmarkerDataStore::getDataByName(m_sName + ".shared_hold");
+        m_bmDataGeneration.store(generation, std::memory_order_release);
+    }
+
+    /**
+    * To be invoked by the lock wrapper right after acquiring the lock exclusively.
+    */
+    void onAcquired(const TimePoint& timeWaitStart, const TimePoint& timeAcquired, bool bContended, const PFL::StringHash& holderScopeHash)
+    {
+        const PFL::StringHash currentScopeHash = ScopeBenchmarkerDataStore::getCurrentScope();
+        m_holderScopeHash.store(currentScopeHash, std::memory_order_relaxed);
+        const long long waitNanosecs = toNanosecs(timeAcquired - timeWaitStart);
+        if (isBmDataCurrent())
+        {
+            m_pWaitBmData->record(waitNanosecs);
+        }
+        onAcquiredCommon(waitNanosecs, bContended, currentScopeHash, holderScopeHash, false);
+    }
+
+    /**
+    * To be invoked by the lock wrapper right before releasing the exclusively held lock.
+    */
+    void onReleasing(const TimePoint& timeAcquired)
+    {
+        m_holderScopeHash.store(0, std::memory_order_relaxed);
+        if (isBmDataCurrent())
+        {
+            m_pHoldBmData->record(toNanosecs(Clock::now() - timeAcquired));
+        }
+    }
+
+    /**
+    * To be invoked by the lock wrapper right after acquiring the lock in shared mode.
+    */
+    void onSharedAcquired(const TimePoint& timeWaitStart, const TimePoint& timeAcquired, bool bContended, const PFL::StringHash& holderScopeHash)
+    {
+        const long long waitNanosecs = toNanosecs(timeAcquired - timeWaitStart);
+        if (isBmDataCurrent())
+        {
+            m_sharedWaitRecorder.record(*m_pSharedWaitBmData, waitNanosecs);
+        }
+        onAcquiredCommon(waitNanosecs, bContended, ScopeBenchmarkerDataStore::getCurrentScope(), holderScopeHash, true);
+    }
+
+    /**
+    * To be invoked by the lock wrapper right before releasing the lock held in shared mode.
+    */
+    void onSharedReleasing(const TimePoint& timeAcquired)
+    {
+        if (isBmDataCurrent())
+        {
+            m_sharedHoldRecorder.record(*m_pSharedHoldBmData, toNanosecs(Clock::now() - timeAcquired));
+        }
+    }
+
+private:
+
+    const std::string m_sName;
+    std::atomic<long long> m_nAcquisitions{ 0 };
+    std::atomic<long long> m_nContended{ 0 };
+    std::atomic<PFL::StringHash> m_holderScopeHash{ 0 };  /**< Scope of the exclusive holder, 0 if not held or unknown. */
+
+    mutable std::mutex m_longestWaitsMutex;
+    std::vector<LongWait> m_longestWaits;                  /**< Descending order of wait. */
+
+    ScopeBenchmarkerDataStore::ConcurrentRecorder m_sharedWaitRecorder;
+    ScopeBenchmarkerDataStore::ConcurrentRecorder m_sharedHoldRecorder;
+
+    // cached references to ScopeBenchmarkerDataStore
+    std::atomic<unsigned long long> m_bmDataGeneration{ ~0ull };
+    ScopeBenchmarkerDataStore::BmData* m_pWaitBmData = nullptr;
+    ScopeBenchmarkerDataStore::BmData* m_pHoldBmData = nullptr;
+    ScopeBenchmarkerDataStore::BmData* m_pSharedWaitBmData = nullptr;
+    ScopeBenchmarkerDataStore::BmData* m_pSharedHoldBmData = nullptr;
+
+    static std::mutex& getRegistryMutex()
+    {
+        static std::mutex s_registryMutex;
+        return s_registryMutex;
+    }
+
+    static std::vector<const LockProfile*>& getRegistry()
+    {
+        static std::vector<const LockProfile*> s_registry;
+        return s_registry;
+    }
+
+    static std::string getScopeName(const PFL::StringHash& scopeHash)
+    {
+        if (scopeHash == 0)
+        {
+            return "(no scope)";
+        }
+        const std::string sName = ScopeBenchmarkerDataStore::getNameByHash(scopeHash);
+        return sName.empty() ? "scope#" + std::to_string(scopeHash) : sName;
+    }
+
+    static long long toNanosecs(const Clock::Duration& duration)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    }
+
+    /**
+    * @return False if the data store was cleared since prepare(), then durations are not recorded into the deleted BmData.
+    */
+    bool isBmDataCurrent() const
+    {
+        return m_bmDataGeneration.load(std::memory_order_acquire) == ScopeBenchmarkerDataStore::getGeneration();
+    }
+
+    void onAcquiredCommon(
+        long long waitNanosecs,
+        bool bContended,
+        const PFL::StringHash& waiterScopeHash,
+        const PFL::StringHash& holderScopeHash,
+        bool bShared)
+    {
+        m_nAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (!bContended)
+        {
+            return;
+        }
+
+        m_nContended.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_longestWaitsMutex);
+        if ((m_longestWaits.size() == MaxLongestWaits) && (m_longestWaits.back().m_waitNanosecs >= waitNanosecs))
+        {
+            return;
+        }
+        const LongWait longWait = { waitNanosecs, waiterScopeHash, holderScopeHash, bShared };
+        m_longestWaits.insert(
+            std::upper_bound(m_longestWaits.begin(), m_longestWaits.end(), longWait,
+                [](const LongWait& a, const LongWait& b) { return a.m_waitNanosecs > b.m_waitNanosecs; }),
+            longWait);
+        if (m_longestWaits.size() > MaxLongestWaits)
+        {
+            m_longestWaits.pop_back();
+        }
+    }
+};
+
+
+/**
+* Drop-in replacement of a Lockable type (e.g. std::mutex or SpinLock) measuring wait time and hold time, see LockProfile.
+* Satisfies the Lockable requirements, so it can be used with std::lock_guard, std::unique_lock, etc.
+*/
+template <typename LockType>
+class InstrumentedLock
+{
+public:
+
+    InstrumentedLock(const std::string& sName) :
+        m_profile(sName)
+    {}
+
+    InstrumentedLock(const InstrumentedLock&) = delete;
+    InstrumentedLock& operator=(const InstrumentedLock&) = delete;
+    InstrumentedLock(InstrumentedLock&&) = delete;
+    InstrumentedLock& operator=(InstrumentedLock&&) = delete;
+
+    void lock()
+    {
+        m_profile.prepare();
+        const LockProfile::TimePoint timeWaitStart = Clock::now();
+        bool bContended = false;
+        PFL::StringHash holderScopeHash = 0;
+        if (!m_lock.try_lock())
+        {
+            bContended = true;
+            holderScopeHash = m_profile.getHolderScope();
+            m_lock.lock();
+        }
+        m_timeAcquired = Clock::now();
+        m_profile.onAcquired(timeWaitStart, m_timeAcquired, bContended, holderScopeHash);
+    }
+
+    bool try_lock()
+    {
+        m_profile.prepare();
+        const LockProfile::TimePoint timeWaitStart = Clock::now();
+        if (!m_lock.try_lock())
+        {
+            return false;
+        }
+        m_timeAcquired = Clock::now();
+        m_profile.onAcquired(timeWaitStart, m_timeAcquired, false, 0);
+        return true;
+    }
+
+    void unlock()
+    {
+        m_profile.onReleasing(m_timeAcquired);
+        m_lock.unlock();
+    }
+
+    const LockProfile& getProfile() const
+    {
+        return m_profile;
+    }
+
+    LockProfile& getProfile()
+    {
+        return m_profile;
+    }
+
+private:
+
+    LockType m_lock;
+    LockProfile m_profile;
+    LockProfile::TimePoint m_timeAcquired;      /**< Only accessed by the holder. */
+};
+
+typedef InstrumentedLock<std::mutex> InstrumentedMutex;
+typedef InstrumentedLock<SpinLock> InstrumentedSpinLock;
+
+
+/**
+* Drop-in replacement of std::shared_mutex measuring wait time and hold time, see LockProfile.
+* Satisfies the SharedMutex requirements, so it can be used with std::shared_lock as well as std::unique_lock, etc.
+* Wraps std::shared_mutex when compiled as C++17, otherwise std::shared_timed_mutex, so it is also available in the
+* default C++14 build. MSVC reports the language version in _MSVC_LANG, since __cplusplus is 199711L without /Zc:__cplusplus.
+*/
+class InstrumentedSharedMutex
+{
+public:
+
+    InstrumentedSharedMutex(const std::string& sName) :
+        m_profile(sName)
+    {}
+
+    InstrumentedSharedMutex(const InstrumentedSharedMutex&) = delete;
+    InstrumentedSharedMutex& operator=(const InstrumentedSharedMutex&) = delete;
+    InstrumentedSharedMutex(InstrumentedSharedMutex&&) = delete;
+    InstrumentedSharedMutex& operator=(InstrumentedSharedMutex&&) = delete;
+
+    void lock()
+    {
+        m_profile.prepare();
+        const LockProfile::TimePoint timeWaitStart = Clock::now();
+        bool bContended = false;
+        PFL::StringHash holderScopeHash = 0;
+        if (!m_mutex.try_lock())
+        {
+            bContended = true;
+            holderScopeHash = m_profile.getHolderScope();
+            m_mutex.lock();
+        }
+        m_timeAcquired = Clock::now();
+        m_profile.onAcquired(timeWaitStart, m_timeAcquired, bContended, holderScopeHash);
+    }
+
+    bool try_lock()
+    {
+        m_profile.prepare();
+        const LockProfile::TimePoint timeWaitStart = Clock::now();
+        if (!m_mutex.try_lock())
+        {
+            return false;
+        }
+        m_timeAcquired = Clock::now();
+        m_profile.onAcquired(timeWaitStart, m_timeAcquired, false, 0);
+        return true;
+    }
+
+    void unlock()
+    {
+        m_profile.onReleasing(m_timeAcquired);
+        m_mutex.unlock();
+    }
+
+    void lock_shared()
+    {
+        m_profile.prepare();
+        // pushed before acquiring, since it might throw
+        pushSharedAcquisition();
+        const LockProfile::TimePoint timeWaitStart = Clock::now();
+        bool bContended = false;
+        PFL::StringHash holderScopeHash = 0;
+        if (!m_mutex.try_lock_shared())
+        {
+            bContended = true;
+            holderScopeHash = m_profile.getHolderScope();
+            m_mutex.lock_shared();
+        }
+        const LockProfile::TimePoint timeAcquired = Clock::now();
+        getSharedAcquisitions().back().second = timeAcquired;
+        m_profile.onSharedAcquired(timeWaitStart, timeAcquired, bContended, holderScopeHash);
+    }
+
+    bool try_lock_shared()
+    {
+        m_profile.prepare();
+        pushSharedAcquisition();
+        const LockProfile::TimePoint timeWaitStart = Clock::now();
+        if (!m_mutex.try_lock_shared())
+        {
+            getSharedAcquisitions().pop_back();
+            return false;
+        }
+        const LockProfile::TimePoint timeAcquired = Clock::now();
+        getSharedAcquisitions().back().second = timeAcquired;
+        m_profile.onSharedAcquired(timeWaitStart, timeAcquired, false, 0);
+        return true;
+    }
+
+    void unlock_shared()
+    {
+        m_profile.onSharedReleasing(popSharedAcquisition());
+        m_mutex.unlock_shared();
+    }
+
+    const LockProfile& getProfile() const
+    {
+        return m_profile;
+    }
+
+    LockProfile& getProfile()
+    {
+        return m_profile;
+    }
+
+private:
+
+#if (__cplusplus >= 201703L) || (defined(_MSVC_LANG) && (_MSVC_LANG >= 201703L))
+    std::shared_mutex m_mutex;
+#else
+    std::shared_timed_mutex m_mutex;
+#endif
+    LockProfile m_profile;
+    LockProfile::TimePoint m_timeAcquired;      /**< Only accessed by the exclusive holder. */
+
+    /**
+    * Shared acquisition times of the current thread: multiple threads can hold the lock in shared mode, so the
+    * acquisition time for measuring the hold time is kept per thread, per lock.
+    */
+    static std::vector<std::pair<const InstrumentedSharedMutex*, LockProfile::TimePoint>>& getSharedAcquisitions()
+    {
+        static thread_local std::vector<std::pair<const InstrumentedSharedMutex*, LockProfile::TimePoint>> s_sharedAcquisitions;
+        return s_sharedAcquisitions;
+    }
+
+    /**
+    * Adds the entry of the current acquisition, its time is set once the lock is acquired.
+    */
+    void pushSharedAcquisition()
+    {
+        getSharedAcquisitions().push_back(std::make_pair(this, LockProfile::TimePoint()));
+    }
+
+    LockProfile::TimePoint popSharedAcquisition()
+    {
+        auto& sharedAcquisitions = getSharedAcquisitions();
+        // usually the last one, unless shared locks of different mutexes are released in non-reverse order
+        for (auto it = sharedAcquisitions.rbegin(); it != sharedAcquisitions.rend(); ++it)
+        {
+            if (it->first == this)
+            {
+                const LockProfile::TimePoint timeAcquired = it->second;
+                sharedAcquisitions.erase(std::next(it).base());
+                return timeAcquired;
+            }
+        }
+        return Clock::now();  // unlock_shared() without lock_shared() in this thread
+    }
+};
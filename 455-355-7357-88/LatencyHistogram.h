@@ -0,0 +1,219 @@
+#pragma once
+
+/*
+    ###################################################################################
+    LatencyHistogram.h
+    Basic header-only thread-safe log-linear latency histogram.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <array>
+#include <atomic>    // requires cpp11
+#include <cstddef>   // std::size_t
+#include <cstdint>   // uint64_t
+
+/**
+* Histogram of non-negative values (typically latencies in nanoseconds) with log-linear buckets: every power of 2
+* range is divided into SubBuckets equal-width buckets, so the relative error of a reported value is at most
+* 1 / SubBuckets (about 6%), over the whole uint64_t range, with fixed memory.
+*
+* Recording is lock-free: every bucket is an atomic counter, so any thread can record at any time.
+* Readers get a consistent-enough view for reporting: counts recorded during reading might or might not be included.
+*/
+class LatencyHistogram
+{
+public:
+
+    static constexpr std::size_t SubBucketBits = 4;
+    static constexpr std::size_t SubBuckets = 1 << SubBucketBits;
+    static constexpr std::size_t BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+
+    LatencyHistogram()
+    {
+        reset();
+    }
+
+    // atomics are not copyable, use merge() to copy the content
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+    LatencyHistogram(LatencyHistogram&&) = delete;
+    LatencyHistogram& operator=(LatencyHistogram&&) = delete;
+
+    /**
+    * @return Index of the bucket counting the given value.
+    */
+    static std::size_t getBucketIndex(uint64_t value)
+    {
+        if (value < SubBuckets)
+        {
+            return static_cast<std::size_t>(value);
+        }
+        const std::size_t nMsb = getMostSignificantBit(value);
+        const std::size_t iSubBucket = static_cast<std::size_t>(value >> (nMsb - SubBucketBits)) & (SubBuckets - 1);
+        return (nMsb - SubBucketBits + 1) * SubBuckets + iSubBucket;
+    }
+
+    /**
+    * @return The smallest value counted by the bucket of the given index.
+    */
+    static uint64_t getBucketLowerBound(std::size_t iBucket)
+    {
+        if (iBucket < SubBuckets)
+        {
+            return iBucket;
+        }
+        const std::size_t nMsb = iBucket / SubBuckets + SubBucketBits - 1;
+        const uint64_t iSubBucket = iBucket % SubBuckets;
+        return (uint64_t(1) << nMsb) | (iSubBucket << (nMsb - SubBucketBits));
+    }
+
+    /**
+    * @return The largest value counted by the bucket of the given index.
+    */
+    static uint64_t getBucketUpperBound(std::size_t iBucket)
+    {
+        return (iBucket + 1 < BucketCount) ? getBucketLowerBound(iBucket + 1) - 1 : UINT64_MAX;
+    }
+
+    void record(uint64_t value)
+    {
+        m_buckets[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        updateMinMax(value, value);
+    }
+
+    /**
+    * Adds the counts of the other histogram to this histogram.
+    */
+    void merge(const LatencyHistogram& other)
+    {
+        for (std::size_t i = 0; i < BucketCount; i++)
+        {
+            const uint64_t nCount = other.m_buckets[i].load(std::memory_order_relaxed);
+            if (nCount > 0)
+            {
+                m_buckets[i].fetch_add(nCount, std::memory_order_relaxed);
+            }
+        }
+        const uint64_t nOtherCount = other.getCount();
+        if (nOtherCount > 0)
+        {
+            m_count.fetch_add(nOtherCount, std::memory_order_relaxed);
+            updateMinMax(other.getMin(), other.getMax());
+        }
+    }
+
+    /**
+    * Adds the given count to the given bucket, as if nCount values between minValue and maxValue were recorded, e.g.
+    * when restoring a histogram from its bucket counts. minValue and maxValue should be within the bucket.
+    */
+    void addToBucket(std::size_t iBucket, uint64_t nCount, uint64_t minValue, uint64_t maxValue)
+    {
+        if ((iBucket >= BucketCount) || (nCount == 0))
+        {
+            return;
+        }
+        m_buckets[iBucket].fetch_add(nCount, std::memory_order_relaxed);
+        m_count.fetch_add(nCount, std::memory_order_relaxed);
+        updateMinMax(minValue, maxValue);
+    }
+
+    void reset()
+    {
+        for (auto& bucket : m_buckets)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        m_count.store(0, std::memory_order_relaxed);
+        m_min.store(UINT64_MAX, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t getCount() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getBucketValue(std::size_t iBucket) const
+    {
+        return m_buckets[iBucket].load(std::memory_order_relaxed);
+    }
+
+    /**
+    * @return The smallest recorded value, or 0 if nothing was recorded.
+    */
+    uint64_t getMin() const
+    {
+        return getCount() == 0 ? 0 : m_min.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getMax() const
+    {
+        return m_max.load(std::memory_order_relaxed);
+    }
+
+    /**
+    * @param percentile Value in range [0, 100].
+    * @return Upper bound of the bucket containing the given percentile, clamped to the recorded maximum,
+    *         or 0 if nothing was recorded.
+    */
+    uint64_t getPercentile(double percentile) const
+    {
+        const uint64_t nCount = getCount();
+        if (nCount == 0)
+        {
+            return 0;
+        }
+
+        const double fTarget = (percentile <= 0.0) ? 1.0 : (percentile >= 100.0 ? nCount : nCount * percentile / 100.0);
+        uint64_t nTarget = static_cast<uint64_t>(fTarget);
+        if (static_cast<double>(nTarget) < fTarget)
+        {
+            ++nTarget;  // ceil
+        }
+
+        uint64_t nCumulative = 0;
+        for (std::size_t i = 0; i < BucketCount; i++)
+        {
+            nCumulative += getBucketValue(i);
+            if (nCumulative >= nTarget)
+            {
+                const uint64_t upperBound = getBucketUpperBound(i);
+                return upperBound < getMax() ? upperBound : getMax();
+            }
+        }
+        return getMax();
+    }
+
+private:
+
+    std::array<std::atomic<uint64_t>, BucketCount> m_buckets;
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_min;
+    std::atomic<uint64_t> m_max;
+
+    void updateMinMax(uint64_t minCandidate, uint64_t maxCandidate)
+    {
+        uint64_t minValue = m_min.load(std::memory_order_relaxed);
+        while ((minCandidate < minValue) && !m_min.compare_exchange_weak(minValue, minCandidate, std::memory_order_relaxed))
+        {
+        }
+        uint64_t maxValue = m_max.load(std::memory_order_relaxed);
+        while ((maxCandidate > maxValue) && !m_max.compare_exchange_weak(maxValue, maxCandidate, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    static std::size_t getMostSignificantBit(uint64_t value)
+    {
+        std::size_t nMsb = 0;
+        while (value >>= 1)
+        {
+            ++nMsb;
+        }
+        return nMsb;
+    }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+/*
+    ###################################################################################
+    MappedFile.h
+    Basic header-only read-only memory-mapped file class.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <cstddef>   // std::size_t
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>     // open()
+#include <sys/mman.h>  // mmap(), munmap()
+#include <sys/stat.h>  // fstat()
+#include <unistd.h>    // close()
+#endif
+
+/**
+* Read-only view of a whole file mapped into memory.
+* The operating system pages in the file content on demand, so even huge files are "opened" instantly and
+* only the actually touched parts will be read from disk.
+*
+* Throws std::runtime_error if the file cannot be opened or mapped.
+* An empty file is valid: getData() returns nullptr and getSize() returns 0 in that case.
+*/
+class MappedFile
+{
+public:
+
+    MappedFile(const std::string& filename)
+    {
+        if (filename.empty())
+        {
+            throw std::runtime_error("MappedFile ctor: filename cannot be empty!");
+        }
+
+#ifdef _WIN32
+        m_hFile = CreateFileA(
+            filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (m_hFile == INVALID_HANDLE_VALUE)
+        {
+            throw std::runtime_error("MappedFile ctor: failed to open file: " + filename);
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(m_hFile, &fileSize))
+        {
+            CloseHandle(m_hFile);
+            throw std::runtime_error("MappedFile ctor: failed to get size of file: " + filename);
+        }
+        m_size = static_cast<std::size_t>(fileSize.QuadPart);
+        if (m_size == 0)
+        {
+            return;
+        }
+
+        m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_hMapping == NULL)
+        {
+            CloseHandle(m_hFile);
+            throw std::runtime_error("MappedFile ctor: failed to create mapping of file: " + filename);
+        }
+
+        m_pData = static_cast<const char*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+        if (m_pData == nullptr)
+        {
+            CloseHandle(m_hMapping);
+            CloseHandle(m_hFile);
+            throw std::runtime_error("MappedFile ctor: failed to map view of file: " + filename);
+        }
+#else
+        const int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("MappedFile ctor: failed to open file: " + filename);
+        }
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("MappedFile ctor: failed to get size of file: " + filename);
+        }
+        m_size = static_cast<std::size_t>(fileStat.st_size);
+        if (m_size == 0)
+        {
+            close(fd);
+            return;
+        }
+
+        void* const pMapped = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);  // the mapping keeps its own reference to the file
+        if (pMapped == MAP_FAILED)
+        {
+            throw std::runtime_error("MappedFile ctor: failed to map file: " + filename);
+        }
+        m_pData = static_cast<const char*>(pMapped);
+        // we are mostly streaming through such files from beginning to end
+        madvise(pMapped, m_size, MADV_SEQUENTIAL);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (m_pData)
+        {
+            UnmapViewOfFile(m_pData);
+        }
+        if (m_hMapping != NULL)
+        {
+            CloseHandle(m_hMapping);
+        }
+        if (m_hFile != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_hFile);
+        }
+#else
+        if (m_pData)
+        {
+            munmap(const_cast<char*>(m_pData), m_size);
+        }
+#endif
+    }
+
+    // owner of OS resources, copying would lead to double unmapping
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    /**
+    * @return Pointer to the first byte of the mapped file content, or nullptr if the file is empty.
+    */
+    const char* getData() const
+    {
+        return m_pData;
+    }
+
+    /**
+    * @return Size of the mapped file in bytes.
+    */
+    std::size_t getSize() const
+    {
+        return m_size;
+    }
+
+private:
+
+    const char* m_pData = nullptr;    /**< Beginning of the mapped view. */
+    std::size_t m_size = 0;           /**< Size of the mapped view in bytes. */
+#ifdef _WIN32
+    HANDLE m_hFile = INVALID_HANDLE_VALUE;
+    HANDLE m_hMapping = NULL;
+#endif
+};
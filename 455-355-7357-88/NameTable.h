@@ -0,0 +1,401 @@
+#pragma once
+
+/*
+    ###################################################################################
+    NameTable.h
+    Basic header-only interned name table and allocation-free name builder for ScopeBenchmarker names.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <array>
+#include <atomic>    // requires cpp11
+#include <cstddef>   // size_t
+#include <cstdint>   // uint32_t, uint64_t
+#include <cstring>   // memcmp, memcpy, strlen
+#include <memory>    // requires cpp11
+#include <mutex>     // requires cpp11
+#include <stdexcept>
+#include <string>
+
+#include "PFL.h"  // for PFL::StringHash
+
+/**
+* Global table of interned names: every distinct name is stored once, and is identified by an integer handle.
+* Looking up an already interned name is lock-free and does not allocate: it hashes the characters and probes an open
+* addressing table of atomic pointers. Only interning a new name takes a lock and allocates.
+*
+* ScopeBenchmarker can be constructed with a handle instead of a string, then it needs neither hashing nor copying the
+* name, and its BmData is found through a pointer cached in the table instead of a map lookup.
+* Use NameBuilder to build dynamic names (like "system/<id>") on the stack and intern them.
+*
+* Names are never removed, so the number of different names is limited by Capacity.
+*/
+class NameTable
+{
+public:
+
+    typedef uint32_t Handle;
+
+    static constexpr size_t Capacity = 65536;   /**< Power of 2, the probing table is twice as large to keep probes short. */
+
+    /**
+    * @return Handle of the given name, interning the name if it is not yet in the table.
+    *         Throws std::runtime_error if the name is empty or the table is full.
+    */
+    static Handle intern(const char* szName, size_t nLength)
+    {
+        if (nLength == 0)
+        {
+            throw std::runtime_error("NameTable::intern(): name cannot be empty!");
+        }
+
+        Table& table = getTable();
+        const uint64_t hash = calcNameHash(szName, nLength);
+        const Entry* const pFound = find(table, szName, nLength, hash);
+        if (pFound)
+        {
+            return pFound->m_handle;
+        }
+
+        // slow path: insert under lock, after checking again if another thread inserted it meanwhile
+        std::lock_guard<std::mutex> lock(table.m_insertMutex);
+        size_t iSlot = static_cast<size_t>(hash) & (ProbeTableSize - 1);
+        while (true)
+        {
+            const Entry* const pEntry = table.m_slots[iSlot].load(std::memory_order_acquire);
+            if (!pEntry)
+            {
+                break;
+            }
+            if (pEntry->equals(szName, nLength, hash))
+            {
+                return pEntry->m_handle;
+            }
+            iSlot = (iSlot + 1) & (ProbeTableSize - 1);
+        }
+
+        const size_t nSize = table.m_nSize.load(std::memory_order_relaxed);
+        if (nSize >= Capacity)
+        {
+            throw std::runtime_error("NameTable::intern(): table is full!");
+        }
+
+        Entry* const pEntry = new Entry();
+        pEntry->m_sName.assign(szName, nLength);
+        pEntry->m_hash = hash;
+        pEntry->m_nameHash = PFL::calcHash(pEntry->m_sName);
+        pEntry->m_handle = static_cast<Handle>(nSize);
+        table.m_entries[nSize].store(pEntry, std::memory_order_release);
+        table.m_slots[iSlot].store(pEntry, std::memory_order_release);
+        table.m_nSize.store(nSize + 1, std::memory_order_release);
+        return pEntry->m_handle;
+    }
+
+    static Handle intern(const std::string& sName)
+    {
+        return intern(sName.c_str(), sName.length());
+    }
+
+    /**
+    * Looks up the given name without interning it, lock-free.
+    *
+    * @return True and the handle of the name if the name is already interned, false otherwise.
+    */
+    static bool findHandle(const char* szName, size_t nLength, Handle& handle)
+    {
+        const Entry* const pFound = find(getTable(), szName, nLength, calcNameHash(szName, nLength));
+        if (!pFound)
+        {
+            return false;
+        }
+        handle = pFound->m_handle;
+        return true;
+    }
+
+    static const std::string& getName(const Handle& handle)
+    {
+        return getEntry(handle).m_sName;
+    }
+
+    /**
+    * @return Same hash as PFL::calcHash() of the name, so it is the key of the name in ScopeBenchmarkerDataStore.
+    */
+    static const PFL::StringHash& getNameHash(const Handle& handle)
+    {
+        return getEntry(handle).m_nameHash;
+    }
+
+    /**
+    * @return Number of interned names.
+    */
+    static size_t size()
+    {
+        return getTable().m_nSize.load(std::memory_order_acquire);
+    }
+
+    /**
+    * @return Data cached for the given handle by setCachedData() with the same generation, nullptr otherwise.
+    *         Used by ScopeBenchmarkerDataStore to find the BmData of the name without map lookup.
+    */
+    static void* getCachedData(const Handle& handle, const unsigned long long& generation)
+    {
+        const Entry& entry = getEntry(handle);
+        if (entry.m_cachedGeneration.load(std::memory_order_acquire) != generation)
+        {
+            return nullptr;
+        }
+        return entry.m_pCachedData.load(std::memory_order_relaxed);
+    }
+
+    static void setCachedData(const Handle& handle, void* pData, const unsigned long long& generation)
+    {
+        Entry& entry = getEntry(handle);
+        entry.m_pCachedData.store(pData, std::memory_order_relaxed);
+        entry.m_cachedGeneration.store(generation, std::memory_order_release);
+    }
+
+private:
+
+    static constexpr size_t ProbeTableSize = Capacity * 2;
+
+    struct Entry
+    {
+        std::string m_sName;
+        uint64_t m_hash;                                    /**< calcNameHash() of the name, for the probing table. */
+        PFL::StringHash m_nameHash;                         /**< Key in ScopeBenchmarkerDataStore. */
+        Handle m_handle;
+        std::atomic<void*> m_pCachedData{ nullptr };
+        std::atomic<unsigned long long> m_cachedGeneration{ ~0ull };
+
+        bool equals(const char* szName, size_t nLength, uint64_t hash) const
+        {
+            return (m_hash == hash) && (m_sName.length() == nLength) && (memcmp(m_sName.data(), szName, nLength) == 0);
+        }
+    };
+
+    struct Table
+    {
+        std::array<std::atomic<Entry*>, ProbeTableSize> m_slots;   /**< Open addressing by hash, linear probing. */
+        std::array<std::atomic<Entry*>, Capacity> m_entries;       /**< Index is the handle. */
+        std::atomic<size_t> m_nSize{ 0 };
+        std::mutex m_insertMutex;
+
+        Table()
+        {
+            for (auto& slot : m_slots)
+            {
+                slot.store(nullptr, std::memory_order_relaxed);
+            }
+            for (auto& entry : m_entries)
+            {
+                entry.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    static Table& getTable()
+    {
+        // allocated since it is large, and never freed since names might be used during static destruction
+        static Table* const s_pTable = new Table();
+        return *s_pTable;
+    }
+
+    static Entry& getEntry(const Handle& handle)
+    {
+        Entry* const pEntry = (handle < Capacity) ? getTable().m_entries[handle].load(std::memory_order_acquire) : nullptr;
+        if (!pEntry)
+        {
+            throw std::runtime_error("NameTable: invalid handle: " + std::to_string(handle));
+        }
+        return *pEntry;
+    }
+
+    /**
+    * MurmurHash64A, processing 8 characters at a time, since this is the main cost of looking up a name.
+    */
+    static uint64_t calcNameHash(const char* szName, size_t nLength)
+    {
+        const uint64_t m = 0xc6a4a7935bd1e995ull;
+        const int r = 47;
+        uint64_t hash = 0x8445d61a4e774912ull ^ (nLength * m);
+
+        size_t i = 0;
+        for (; i + 8 <= nLength; i += 8)
+        {
+            uint64_t k;
+            memcpy(&k, szName + i, 8);  // compiles to a single unaligned load
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            hash ^= k;
+            hash *= m;
+        }
+
+        if (i < nLength)
+        {
+            uint64_t k = 0;
+            memcpy(&k, szName + i, nLength - i);
+            hash ^= k;
+            hash *= m;
+        }
+
+        hash ^= hash >> r;
+        hash *= m;
+        hash ^= hash >> r;
+        return hash;
+    }
+
+    static const Entry* find(Table& table, const char* szName, size_t nLength, uint64_t hash)
+    {
+        size_t iSlot = static_cast<size_t>(hash) & (ProbeTableSize - 1);
+        while (true)
+        {
+            const Entry* const pEntry = table.m_slots[iSlot].load(std::memory_order_acquire);
+            if (!pEntry || pEntry->equals(szName, nLength, hash))
+            {
+                return pEntry;
+            }
+            iSlot = (iSlot + 1) & (ProbeTableSize - 1);
+        }
+    }
+};
+
+
+/**
+* Builds a name in a fixed-size buffer on the stack, without heap allocation, to be interned into NameTable.
+*
+* Example:
+*
+*     const NameTable::Handle nameHandle = (NameBuilder() << "system/" << systemId).intern();
+*     ScopeBenchmarker<std::chrono::microseconds> bm(nameHandle);
+*/
+class NameBuilder
+{
+public:
+
+    static constexpr size_t MaxBaseLength = 127;   /**< Longest benchmarker name accepted with labels, see ScopeBenchmarkerDataStore::getSeriesHandle(). */
+
+    /**
+    * Room for a name of MaxBaseLength characters followed by the longest labels, see BenchmarkLabels::MaxAppendedLength.
+    */
+    static constexpr size_t MaxLength = MaxBaseLength + 4 * (31 + 31 + 2) + 2;
+
+    NameBuilder()
+    {
+        // only the terminating zero, the buffer is large
+        m_szBuffer[0] = '\0';
+    }
+
+    NameBuilder(const NameBuilder&) = default;
+    NameBuilder& operator=(const NameBuilder&) = default;
+    NameBuilder(NameBuilder&&) = default;
+    NameBuilder& operator=(NameBuilder&&) = default;
+
+    NameBuilder& append(const char* szText, size_t nLength)
+    {
+        if (m_nLength + nLength > MaxLength)
+        {
+            m_bOverflow = true;
+            nLength = MaxLength - m_nLength;
+        }
+        memcpy(m_szBuffer + m_nLength, szText, nLength);
+        m_nLength += nLength;
+        m_szBuffer[m_nLength] = '\0';
+        return *this;
+    }
+
+    NameBuilder& operator<<(const char* szText)
+    {
+        return append(szText, strlen(szText));
+    }
+
+    NameBuilder& operator<<(const std::string& sText)
+    {
+        return append(sText.c_str(), sText.length());
+    }
+
+    NameBuilder& operator<<(char c)
+    {
+        return append(&c, 1);
+    }
+
+    NameBuilder& operator<<(long long value)
+    {
+        if (value < 0)
+        {
+            append("-", 1);
+            // unsigned negation is fine also for LLONG_MIN
+            return appendUnsigned(0ull - static_cast<unsigned long long>(value));
+        }
+        return appendUnsigned(static_cast<unsigned long long>(value));
+    }
+
+    NameBuilder& operator<<(unsigned long long value)
+    {
+        return appendUnsigned(value);
+    }
+
+    NameBuilder& operator<<(int value)
+    {
+        return *this << static_cast<long long>(value);
+    }
+
+    NameBuilder& operator<<(unsigned int value)
+    {
+        return appendUnsigned(value);
+    }
+
+    NameBuilder& operator<<(long value)
+    {
+        return *this << static_cast<long long>(value);
+    }
+
+    NameBuilder& operator<<(unsigned long value)
+    {
+        return appendUnsigned(value);
+    }
+
+    const char* c_str() const
+    {
+        return m_szBuffer;
+    }
+
+    size_t length() const
+    {
+        return m_nLength;
+    }
+
+    /**
+    * Interns the built name into NameTable.
+    * Throws std::runtime_error if the name was longer than MaxLength, so different names are never mixed by truncation.
+    */
+    NameTable::Handle intern() const
+    {
+        if (m_bOverflow)
+        {
+            throw std::runtime_error("NameBuilder::intern(): name is longer than " + std::to_string(MaxLength) + " characters!");
+        }
+        return NameTable::intern(m_szBuffer, m_nLength);
+    }
+
+private:
+
+    char m_szBuffer[MaxLength + 1];
+    size_t m_nLength = 0;
+    bool m_bOverflow = false;
+
+    NameBuilder& appendUnsigned(unsigned long long value)
+    {
+        char szDigits[20];
+        size_t nDigits = 0;
+        do
+        {
+            szDigits[sizeof(szDigits) - 1 - nDigits++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        return append(szDigits + sizeof(szDigits) - nDigits, nDigits);
+    }
+};
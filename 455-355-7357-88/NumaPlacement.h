@@ -0,0 +1,495 @@
+#pragma once
+
+/*
+    ###################################################################################
+    NumaPlacement.h
+    Basic header-only NUMA thread and memory placement, and local vs. remote node benchmark matrix.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>
+#include <array>
+#include <cstddef>   // size_t
+#include <cstdlib>   // strtol
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>         // sched_getaffinity, sched_setaffinity
+#include <sys/mman.h>      // mmap, munmap
+#include <sys/syscall.h>   // SYS_get_mempolicy, SYS_set_mempolicy, SYS_mbind, SYS_getcpu
+#include <unistd.h>        // syscall
+#endif
+
+#include "ScopeBenchmarker.h"
+
+/**
+* Binds threads and memory to NUMA nodes, by the Linux system calls directly, so libnuma is not needed.
+* Node topology is read from /sys/devices/system/node.
+*
+* On other platforms, and on machines with a single NUMA node, there is nothing to bind: getNodeCount() returns 1,
+* ThreadBinding does nothing and bindMemory() returns false, so callers need no special handling.
+*/
+class NumaPlacement
+{
+public:
+
+    /**
+    * Maximum number of NUMA nodes supported, size of the node masks passed to the kernel.
+    */
+    static constexpr int MaxNodes = 1024;
+
+private:
+
+    // from <linux/mempolicy.h>, not included since it is not always installed
+    static constexpr int MPOL_DEFAULT = 0;
+    static constexpr int MPOL_BIND = 2;
+    static constexpr unsigned long MPOL_F_NODE = 1ul << 0;
+    static constexpr unsigned long MPOL_F_ADDR = 1ul << 1;
+    static constexpr unsigned int MPOL_MF_MOVE = 1u << 1;
+
+    static constexpr size_t BitsPerWord = sizeof(unsigned long) * 8;
+    typedef std::array<unsigned long, MaxNodes / (sizeof(unsigned long) * 8)> NodeMask;
+
+    static void setNode(NodeMask& nodeMask, int node)
+    {
+        nodeMask[static_cast<size_t>(node) / BitsPerWord] |= 1ul << (static_cast<size_t>(node) % BitsPerWord);
+    }
+
+public:
+
+    /**
+    * @return Ids of the online NUMA nodes, {0} if the topology cannot be read.
+    */
+    static std::vector<int> getNodes()
+    {
+        std::vector<int> nodes = parseList(readFile("/sys/devices/system/node/online"));
+        if (nodes.empty())
+        {
+            nodes.push_back(0);
+        }
+        return nodes;
+    }
+
+    static size_t getNodeCount()
+    {
+        return getNodes().size();
+    }
+
+    /**
+    * @return Ids of the CPUs of the given node, empty if unknown.
+    */
+    static std::vector<int> getNodeCpus(int node)
+    {
+        return parseList(readFile("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    }
+
+    /**
+    * @return Node of the CPU running the current thread, -1 if unknown.
+    */
+    static int getCurrentNode()
+    {
+#if defined(__linux__) && defined(SYS_getcpu)
+        unsigned int cpu = 0;
+        unsigned int node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+        {
+            return static_cast<int>(node);
+        }
+#endif
+        return -1;
+    }
+
+    /**
+    * @return Node of the physical memory of the page of the given address, -1 if unknown, e.g. the page is not yet
+    *         touched so it has no physical memory yet.
+    */
+    static int getNodeOfAddress(const void* p)
+    {
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+        int node = -1;
+        if (syscall(SYS_get_mempolicy, &node, nullptr, 0ul, p, MPOL_F_NODE | MPOL_F_ADDR) == 0)
+        {
+            return node;
+        }
+#else
+        (void)p;
+#endif
+        return -1;
+    }
+
+    /**
+    * Binds the physical memory of the given range to the given node, moving already touched pages there.
+    * The range should be page-aligned, e.g. allocated by mmap().
+    *
+    * @return True on success, false if not supported or failed.
+    */
+    static bool bindMemory(void* p, size_t nSize, int node)
+    {
+#if defined(__linux__) && defined(SYS_mbind)
+        if ((node < 0) || (node >= MaxNodes))
+        {
+            return false;
+        }
+        NodeMask nodeMask = {};
+        setNode(nodeMask, node);
+        return syscall(SYS_mbind, p, static_cast<unsigned long>(nSize), MPOL_BIND, nodeMask.data(),
+            static_cast<unsigned long>(MaxNodes + 1), MPOL_MF_MOVE) == 0;
+#else
+        (void)p;
+        (void)nSize;
+        (void)node;
+        return false;
+#endif
+    }
+
+    /**
+    * Binds the current thread to the CPUs of a node and its future allocations to the memory of a node, until
+    * destroyed, then the previous CPU affinity and memory policy are restored.
+    * Threads created by the bound thread inherit both, so worker threads of a benchmark are bound too.
+    * Does nothing if there is only a single node.
+    */
+    class ThreadBinding
+    {
+    public:
+
+        /**
+        * Throws std::runtime_error if a node is not an online node.
+        */
+        ThreadBinding(int cpuNode, int memoryNode)
+        {
+            if (getNodeCount() < 2)
+            {
+                return;
+            }
+            const std::vector<int> nodes = getNodes();
+            for (const int node : { cpuNode, memoryNode })
+            {
+                if (std::find(nodes.begin(), nodes.end(), node) == nodes.end())
+                {
+                    throw std::runtime_error("NumaPlacement::ThreadBinding ctor: node " + std::to_string(node) + " is not online!");
+                }
+            }
+#ifdef __linux__
+            m_bAffinitySaved = sched_getaffinity(0, sizeof(m_savedAffinity), &m_savedAffinity) == 0;
+            cpu_set_t affinity;
+            CPU_ZERO(&affinity);
+            for (const int cpu : getNodeCpus(cpuNode))
+            {
+                if ((cpu >= 0) && (cpu < CPU_SETSIZE))
+                {
+                    CPU_SET(cpu, &affinity);
+                }
+            }
+            m_bCpuBound = (CPU_COUNT(&affinity) > 0) && (sched_setaffinity(0, sizeof(affinity), &affinity) == 0);
+
+            m_bMemoryPolicySaved = syscall(SYS_get_mempolicy, &m_savedMemoryPolicyMode, m_savedMemoryPolicyNodes.data(),
+                static_cast<unsigned long>(MaxNodes + 1), nullptr, 0ul) == 0;
+            NodeMask nodeMask = {};
+            setNode(nodeMask, memoryNode);
+            m_bMemoryBound = syscall(SYS_set_mempolicy, MPOL_BIND, nodeMask.data(), static_cast<unsigned long>(MaxNodes + 1)) == 0;
+#endif
+        }
+
+        ~ThreadBinding()
+        {
+#ifdef __linux__
+            if (m_bMemoryBound && m_bMemoryPolicySaved)
+            {
+                syscall(SYS_set_mempolicy, m_savedMemoryPolicyMode,
+                    m_savedMemoryPolicyMode == MPOL_DEFAULT ? nullptr : m_savedMemoryPolicyNodes.data(),
+                    static_cast<unsigned long>(MaxNodes + 1));
+            }
+            if (m_bCpuBound && m_bAffinitySaved)
+            {
+                sched_setaffinity(0, sizeof(m_savedAffinity), &m_savedAffinity);
+            }
+#endif
+        }
+
+        ThreadBinding(const ThreadBinding&) = delete;
+        ThreadBinding& operator=(const ThreadBinding&) = delete;
+        ThreadBinding(ThreadBinding&&) = delete;
+        ThreadBinding& operator=(ThreadBinding&&) = delete;
+
+        /**
+        * @return True if the thread is bound to the CPUs of the requested node.
+        */
+        bool isCpuBound() const
+        {
+            return m_bCpuBound;
+        }
+
+        /**
+        * @return True if the memory policy of the thread is bound to the requested node.
+        */
+        bool isMemoryBound() const
+        {
+            return m_bMemoryBound;
+        }
+
+    private:
+
+        bool m_bCpuBound = false;
+        bool m_bMemoryBound = false;
+#ifdef __linux__
+        bool m_bAffinitySaved = false;
+        cpu_set_t m_savedAffinity;
+        bool m_bMemoryPolicySaved = false;
+        int m_savedMemoryPolicyMode = 0;
+        NodeMask m_savedMemoryPolicyNodes = {};
+#endif
+    };
+
+    /**
+    * @return Node where memory allocated by the current thread actually lands: touches a fresh page and queries its
+    *         node, so it reflects the memory policy of the thread. -1 if unknown.
+    */
+    static int probeAllocationNode()
+    {
+#ifdef __linux__
+        const size_t nPageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        void* const p = mmap(nullptr, nPageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            return -1;
+        }
+        *static_cast<volatile char*>(p) = 1;
+        const int node = getNodeOfAddress(p);
+        munmap(p, nPageSize);
+        return node;
+#else
+        return -1;
+#endif
+    }
+
+private:
+
+    static std::string readFile(const std::string& sFilename)
+    {
+        std::ifstream f(sFilename);
+        std::string sContent;
+        std::getline(f, sContent);
+        return sContent;
+    }
+
+    /**
+    * @return Numbers of a list like "0-3,8,10-11", as used by sysfs.
+    */
+    static std::vector<int> parseList(const std::string& sList)
+    {
+        std::vector<int> numbers;
+        std::stringstream ssList(sList);
+        std::string sRange;
+        while (std::getline(ssList, sRange, ','))
+        {
+            char* pEnd = nullptr;
+            const long first = strtol(sRange.c_str(), &pEnd, 10);
+            if (pEnd == sRange.c_str())
+            {
+                continue;
+            }
+            const long last = (*pEnd == '-') ? strtol(pEnd + 1, nullptr, 10) : first;
+            for (long i = first; i <= last; i++)
+            {
+                numbers.push_back(static_cast<int>(i));
+            }
+        }
+        return numbers;
+    }
+};
+
+
+/**
+* Runs a workload with every combination of CPU node and memory node, and compares the benchmarkers measured by the
+* workload when memory is local (same node as the CPU) and remote, to show the cross-node penalty of the workload.
+*
+* Results of a combination are the difference of the benchmarkers of ScopeBenchmarkerDataStore before and after
+* running the workload with that combination, so the workload should measure its hot scopes by ScopeBenchmarkers.
+* On a single node machine the workload runs once without binding, and there is no penalty to report.
+*
+* Example:
+*
+*     NumaMatrix numaMatrix;
+*     numaMatrix.run([]() { ScopeBenchmarker<std::chrono::microseconds> bm("traverse"); traverseLargeGraph(); });
+*     addNumaMatrixReport(numaMatrix);   // in a Benchmark
+*/
+class NumaMatrix
+{
+public:
+
+    /**
+    * Results of running the workload with a combination of CPU and memory nodes.
+    */
+    struct Cell
+    {
+        int m_cpuNode = -1;                 /**< -1 if not bound, e.g. single node. */
+        int m_memoryNode = -1;              /**< -1 if not bound, e.g. single node. */
+        int m_actualMemoryNode = -1;        /**< Node where allocations actually landed, see NumaPlacement::probeAllocationNode(). */
+        std::map<std::string, ScopeBenchmarkerDataStore::BmData> m_results;   /**< Iterations and total of the benchmarkers
+                                                                                   during this run, by name. */
+
+        bool isLocal() const
+        {
+            return m_cpuNode == m_memoryNode;
+        }
+    };
+
+    NumaMatrix() = default;
+
+    NumaMatrix(const NumaMatrix&) = default;
+    NumaMatrix& operator=(const NumaMatrix&) = default;
+    NumaMatrix(NumaMatrix&&) = default;
+    NumaMatrix& operator=(NumaMatrix&&) = default;
+
+    /**
+    * Runs the workload once for every combination of online CPU node and memory node, on the current thread bound by
+    * NumaPlacement::ThreadBinding. Threads created by the workload inherit the binding.
+    * Results of previous run() are discarded.
+    */
+    void run(const std::function<void()>& workload)
+    {
+        m_cells.clear();
+        const std::vector<int> nodes = NumaPlacement::getNodes();
+        if (nodes.size() < 2)
+        {
+            runCell(Cell(), workload);
+            return;
+        }
+
+        for (const int cpuNode : nodes)
+        {
+            for (const int memoryNode : nodes)
+            {
+                NumaPlacement::ThreadBinding binding(cpuNode, memoryNode);
+                Cell cell;
+                cell.m_cpuNode = cpuNode;
+                cell.m_memoryNode = memoryNode;
+                cell.m_actualMemoryNode = NumaPlacement::probeAllocationNode();
+                runCell(std::move(cell), workload);
+            }
+        }
+    }
+
+    const std::vector<Cell>& getCells() const
+    {
+        return m_cells;
+    }
+
+    /**
+    * @return Average duration of the given benchmarker over the remote cells divided by the same over the local
+    *         cells, minus 1, e.g. 0.3 means remote memory makes it 30% slower. 0 if there are no remote cells.
+    */
+    double getCrossNodePenalty(const std::string& sName) const
+    {
+        double fLocalSum = 0.0;
+        double fRemoteSum = 0.0;
+        size_t nLocal = 0;
+        size_t nRemote = 0;
+        for (const auto& cell : m_cells)
+        {
+            const auto it = cell.m_results.find(sName);
+            if ((it == cell.m_results.end()) || (it->second.m_iterations == 0) || (cell.m_cpuNode < 0))
+            {
+                continue;
+            }
+            if (cell.isLocal())
+            {
+                fLocalSum += it->second.getAverageDuration();
+                nLocal++;
+            }
+            else
+            {
+                fRemoteSum += it->second.getAverageDuration();
+                nRemote++;
+            }
+        }
+        if ((nLocal == 0) || (nRemote == 0) || (fLocalSum <= 0.0))
+        {
+            return 0.0;
+        }
+        return (fRemoteSum / nRemote) / (fLocalSum / nLocal) - 1.0;
+    }
+
+    /**
+    * @return Report lines: node placement of each combination, then average duration of every benchmarker in each
+    *         combination with its cross-node penalty.
+    */
+    std::vector<std::string> getReport() const
+    {
+        std::vector<std::string> lines;
+        if (m_cells.empty())
+        {
+            return lines;
+        }
+        if (m_cells.front().m_cpuNode < 0)
+        {
+            lines.push_back("  NUMA Matrix: single node, placement skipped");
+            return lines;
+        }
+
+        lines.push_back("  NUMA Matrix (cpu node/memory node):");
+        std::map<std::string, std::string> benchmarkerLines;
+        for (const auto& cell : m_cells)
+        {
+            const std::string sCell = std::to_string(cell.m_cpuNode) + "/" + std::to_string(cell.m_memoryNode);
+            lines.push_back("    " + sCell + (cell.isLocal() ? " local" : " remote") + ", allocations landed on node " +
+                (cell.m_actualMemoryNode < 0 ? std::string("?") : std::to_string(cell.m_actualMemoryNode)));
+            for (const auto& result : cell.m_results)
+            {
+                std::stringstream ssAverage;
+                ssAverage << result.second.getAverageDuration();
+                std::string& sLine = benchmarkerLines[result.first];
+                sLine += (sLine.empty() ? "" : ", ") + sCell + ": " + ssAverage.str() + " " + result.second.getUnitString();
+            }
+        }
+        for (const auto& benchmarkerLine : benchmarkerLines)
+        {
+            std::stringstream ssPenalty;
+            ssPenalty.precision(1);
+            ssPenalty << std::fixed << getCrossNodePenalty(benchmarkerLine.first) * 100.0;
+            lines.push_back("    " + benchmarkerLine.first + " Avg: " + benchmarkerLine.second + ", Cross-node penalty: " + ssPenalty.str() + "%");
+        }
+        return lines;
+    }
+
+private:
+
+    std::vector<Cell> m_cells;
+
+    void runCell(Cell cell, const std::function<void()>& workload)
+    {
+        std::map<std::string, ScopeBenchmarkerDataStore::BmData> before;
+        for (auto& bmData : ScopeBenchmarkerDataStore::getSnapshot().m_data)
+        {
+            before[bmData.m_name] = std::move(bmData);
+        }
+
+        workload();
+
+        for (const auto& bmData : ScopeBenchmarkerDataStore::getSnapshot().m_data)
+        {
+            const auto itBefore = before.find(bmData.m_name);
+            const bool bExistedBefore = itBefore != before.end();
+            const long long nIterationsBefore = bExistedBefore ? itBefore->second.m_iterations : 0;
+            if (bmData.m_iterations == nIterationsBefore)
+            {
+                continue;
+            }
+            ScopeBenchmarkerDataStore::BmData& result = cell.m_results[bmData.m_name];
+            result.m_name = bmData.m_name;
+            result.m_ratioDenominator = bmData.m_ratioDenominator;
+            result.m_iterations = bmData.m_iterations - nIterationsBefore;
+            result.m_durationsTotal = bmData.m_durationsTotal - (bExistedBefore ? itBefore->second.m_durationsTotal : 0);
+        }
+        m_cells.push_back(std::move(cell));
+    }
+};
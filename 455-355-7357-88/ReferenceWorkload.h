@@ -0,0 +1,201 @@
+#pragma once
+
+/*
+    ###################################################################################
+    ReferenceWorkload.h
+    Basic header-only fixed reference workload for normalizing benchmark results across machines.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>
+#include <chrono>    // requires cpp11
+#include <cmath>     // std::abs
+#include <cstddef>   // size_t
+#include <cstdint>   // uint32_t, uint64_t
+#include <string>
+#include <vector>
+
+/**
+* Short, fixed, deterministic workload (integer arithmetic, data-dependent branches and random accesses of a table
+* fitting into L2 cache) whose duration is the score of the machine, so results measured on different machines
+* (e.g. different CI runners) can be compared after normalizing them by the score.
+*
+* Benchmark measures it once per process before its first test, see Benchmark::preSetUp(), then normalized results are
+* printed next to the measured ones, and the score is stored as host metadata "reference.*", see BenchmarkMerge::setHostMetadata(),
+* so BenchmarkMerge can also print normalized results of each source. BenchmarkBaseline can compare normalized values,
+* see BenchmarkBaseline::normalize().
+*
+* Normalizing is a linear scaling, so it is only as good as the workload resembles the measured code: it compensates
+* differences of clock speed well, differences of memory hierarchy less so.
+*/
+class ReferenceWorkload
+{
+public:
+
+    /**
+    * Score of an arbitrary nominal machine: normalized values are the values the nominal machine would measure,
+    * so they stay in the same magnitude and unit as the measured values.
+    */
+    static constexpr double NominalScoreNs = 5000000.0;
+
+    /**
+    * Maximum relative spread of the rounds for a stable score, see Score::isStable().
+    */
+    static constexpr double MaxStableSpread = 0.05;
+
+    struct Score
+    {
+        double m_fNs = 0.0;       /**< Median duration of a round, 0 if not measured. */
+        double m_fSpread = 0.0;   /**< Median absolute deviation of the rounds relative to m_fNs. */
+        size_t m_nRounds = 0;
+
+        /**
+        * @return False if the rounds deviated so much that the machine was probably busy or throttling during the
+        *         measurement, so normalized results are unreliable.
+        */
+        bool isStable() const
+        {
+            return (m_fNs > 0.0) && (m_fSpread <= MaxStableSpread);
+        }
+    };
+
+    /**
+    * Runs the workload nRounds times after a warm-up round.
+    * Real time is used, not Clock::now(), since an installed virtual clock would hide the costs.
+    */
+    static Score run(size_t nRounds = 15)
+    {
+        std::vector<uint32_t> table(TableSize);
+        std::vector<double> durations;
+        for (size_t iRound = 0; iRound <= std::max(nRounds, static_cast<size_t>(1)); iRound++)
+        {
+            const auto timeStart = std::chrono::steady_clock::now();
+            getSink() = getSink() + runRound(table);  // compound assignment to volatile is deprecated since C++20
+            const double fNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - timeStart).count();
+            if (iRound > 0)
+            {
+                durations.push_back(fNs);
+            }
+        }
+
+        Score score;
+        score.m_nRounds = durations.size();
+        score.m_fNs = getMedian(durations);
+        std::vector<double> deviations;
+        for (const double fNs : durations)
+        {
+            deviations.push_back(std::abs(fNs - score.m_fNs));
+        }
+        score.m_fSpread = (score.m_fNs > 0.0) ? getMedian(deviations) / score.m_fNs : 0.0;
+        return score;
+    }
+
+    /**
+    * Runs the workload by run() if there is no score of this process yet, then stores it by setScore().
+    *
+    * @return True if the workload was run now, false if there was a score already.
+    */
+    static bool measure()
+    {
+        if (getScore().m_fNs > 0.0)
+        {
+            return false;
+        }
+        setScore(run());
+        return true;
+    }
+
+    /**
+    * @return Score of this process stored by measure() or setScore(), m_fNs is 0 if there is none.
+    */
+    static const Score& getScore()
+    {
+        return getStoredScore();
+    }
+
+    /**
+    * Stores the given score as the score of this process.
+    * Not thread-safe, should be invoked before measuring anything.
+    */
+    static void setScore(const Score& score)
+    {
+        getStoredScore() = score;
+    }
+
+    /**
+    * @return The given duration or cost normalized to the nominal machine, see NominalScoreNs, or unchanged if there is no score.
+    */
+    static double normalize(double fValue)
+    {
+        return normalize(fValue, getScore().m_fNs);
+    }
+
+    /**
+    * @return The given duration or cost measured on a machine with the given score normalized to the nominal machine,
+    *         or unchanged if the score is not positive.
+    */
+    static double normalize(double fValue, double fScoreNs)
+    {
+        return (fScoreNs > 0.0) ? fValue * NominalScoreNs / fScoreNs : fValue;
+    }
+
+private:
+
+    static constexpr size_t TableSize = 64 * 1024;   /**< 256 KiB, fits into L2 cache of most machines. */
+    static constexpr uint32_t StepCount = 1 << 19;
+
+    /**
+    * Same work every time, independent of the previous rounds: the table is reinitialized.
+    */
+    static uint64_t runRound(std::vector<uint32_t>& table)
+    {
+        for (size_t i = 0; i < table.size(); i++)
+        {
+            table[i] = static_cast<uint32_t>(i * 2654435761u);
+        }
+
+        uint64_t x = 88;
+        for (uint32_t iStep = 0; iStep < StepCount; iStep++)
+        {
+            // xorshift64 for cheap pseudo-random indices
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            const size_t iEntry = static_cast<size_t>(x) & (TableSize - 1);
+            table[iEntry] += static_cast<uint32_t>(x >> 32);
+            if (table[iEntry] & 1u)
+            {
+                x += table[(iEntry * 7) & (TableSize - 1)];
+            }
+        }
+        return x;
+    }
+
+    static double getMedian(std::vector<double> values)
+    {
+        if (values.empty())
+        {
+            return 0.0;
+        }
+        std::sort(values.begin(), values.end());
+        return (values.size() % 2 == 1) ? values[values.size() / 2] : (values[values.size() / 2 - 1] + values[values.size() / 2]) / 2.0;
+    }
+
+    static Score& getStoredScore()
+    {
+        static Score s_score;
+        return s_score;
+    }
+
+    /**
+    * Results of the rounds are accumulated here, so the compiler cannot optimize the workload away.
+    */
+    static volatile uint64_t& getSink()
+    {
+        static volatile uint64_t s_sink = 0;
+        return s_sink;
+    }
+};
@@ -0,0 +1,498 @@
+#pragma once
+
+/*
+    ###################################################################################
+    ReplayHarness.h
+    Basic header-only trace-driven replay benchmark harness for recorded event traces.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>
+#include <cstddef>   // size_t
+#include <cstdint>   // uint32_t, uint64_t
+#include <cstring>   // memcmp, memcpy
+#include <fstream>
+#include <map>
+#include <memory>    // requires cpp11
+#include <stdexcept>
+#include <string>
+
+#include "PFL.h"  // for PFL::StringHash
+
+#include "Clock.h"
+#include "LatencyHistogram.h"
+#include "MappedFile.h"
+#include "ScopeBenchmarker.h"
+
+/**
+* Event trace file format shared by ReplayTrace and ReplayTraceWriter, all integers in the byte order of the writer:
+* - header: 8 bytes magic "455TRACE", 4 bytes version, 4 bytes reserved;
+* - then 1 frame per event: 4 bytes payload size, 4 bytes event type, 8 bytes timestamp in nanoseconds since the
+*   beginning of the recording, then the payload.
+* Frames of type TypeNameEventType are not events: their payload is a 4 bytes event type followed by the name of that
+* event type, so traces can describe themselves.
+*/
+struct ReplayTraceFormat
+{
+    static constexpr size_t HeaderSize = 16;
+    static constexpr size_t FrameHeaderSize = 16;
+    static constexpr uint32_t Version = 1;
+    static constexpr uint32_t TypeNameEventType = 0xFFFFFFFFu;
+
+    static const char* getMagic()
+    {
+        return "455TRACE";
+    }
+};
+
+
+/**
+* A single event of a ReplayTrace, pointing into the memory-mapped trace file.
+*/
+struct ReplayEvent
+{
+    size_t m_iEvent = 0;                  /**< 0-based index of the event within the trace, type name frames not counted. */
+    uint32_t m_type = 0;
+    uint64_t m_timestampNs = 0;           /**< Nanoseconds since the beginning of the recording. */
+    const char* m_pPayload = nullptr;
+    size_t m_nPayloadSize = 0;
+
+    /**
+    * Throws std::out_of_range if the requested value does not fit into the payload.
+    *
+    * @return Value of type T copied from the given offset of the payload, in the byte order of the trace file.
+    */
+    template <typename T>
+    T getAs(size_t offset) const
+    {
+        if (offset + sizeof(T) > m_nPayloadSize)
+        {
+            throw std::out_of_range("ReplayEvent::getAs(): offset out of payload bounds!");
+        }
+        T value;
+        // memcpy since there is no guarantee about alignment of values within payloads
+        std::memcpy(&value, m_pPayload + offset, sizeof(T));
+        return value;
+    }
+};
+
+
+/**
+* Read-only view of a recorded event trace, see ReplayTraceFormat.
+* The file is memory-mapped, and validated frame by frame in the ctor without touching the payloads, so replaying
+* cannot fail midway due to a corrupt file.
+*
+* Throws std::runtime_error if the file cannot be mapped, has invalid header or truncated frame.
+*/
+class ReplayTrace
+{
+public:
+
+    ReplayTrace(const std::string& sFilename) :
+        m_file(sFilename)
+    {
+        if ((m_file.getSize() < ReplayTraceFormat::HeaderSize) ||
+            (memcmp(m_file.getData(), ReplayTraceFormat::getMagic(), 8) != 0))
+        {
+            throw std::runtime_error("ReplayTrace ctor: not a trace file: " + sFilename);
+        }
+        uint32_t version;
+        memcpy(&version, m_file.getData() + 8, sizeof(version));
+        if (version != ReplayTraceFormat::Version)
+        {
+            throw std::runtime_error("ReplayTrace ctor: unsupported version " + std::to_string(version) + " of trace file: " + sFilename);
+        }
+
+        const char* pCursor = m_file.getData() + ReplayTraceFormat::HeaderSize;
+        const char* const pEnd = m_file.getData() + m_file.getSize();
+        ReplayEvent event;
+        while (pCursor != pEnd)
+        {
+            if (!readFrame(pCursor, pEnd, event))
+            {
+                throw std::runtime_error("ReplayTrace ctor: truncated frame at offset " +
+                    std::to_string(pCursor - m_file.getData()) + " of trace file: " + sFilename);
+            }
+            if (event.m_type == ReplayTraceFormat::TypeNameEventType)
+            {
+                if (event.m_nPayloadSize > sizeof(uint32_t))
+                {
+                    m_typeNames[event.getAs<uint32_t>(0)].assign(event.m_pPayload + sizeof(uint32_t), event.m_nPayloadSize - sizeof(uint32_t));
+                }
+                continue;
+            }
+            m_nEvents++;
+            m_durationNs = std::max(m_durationNs, event.m_timestampNs);
+            m_types[event.m_type]++;
+        }
+    }
+
+    ReplayTrace(const ReplayTrace&) = delete;
+    ReplayTrace& operator=(const ReplayTrace&) = delete;
+    ReplayTrace(ReplayTrace&&) = delete;
+    ReplayTrace& operator=(ReplayTrace&&) = delete;
+
+    size_t getEventCount() const
+    {
+        return m_nEvents;
+    }
+
+    /**
+    * @return Largest timestamp of the events.
+    */
+    uint64_t getDurationNs() const
+    {
+        return m_durationNs;
+    }
+
+    /**
+    * @return Number of events by event type.
+    */
+    const std::map<uint32_t, size_t>& getEventTypes() const
+    {
+        return m_types;
+    }
+
+    /**
+    * @return Event type names recorded in the trace, by event type.
+    */
+    const std::map<uint32_t, std::string>& getTypeNames() const
+    {
+        return m_typeNames;
+    }
+
+    /**
+    * Invokes func(const ReplayEvent&) for every event in recorded order, type name frames skipped.
+    */
+    template <typename Func>
+    void forEach(Func&& func) const
+    {
+        const char* pCursor = m_file.getData() + ReplayTraceFormat::HeaderSize;
+        const char* const pEnd = m_file.getData() + m_file.getSize();
+        ReplayEvent event;
+        size_t iEvent = 0;
+        // frames are validated in ctor
+        while ((pCursor != pEnd) && readFrame(pCursor, pEnd, event))
+        {
+            if (event.m_type != ReplayTraceFormat::TypeNameEventType)
+            {
+                event.m_iEvent = iEvent++;
+                func(static_cast<const ReplayEvent&>(event));
+            }
+        }
+    }
+
+private:
+
+    MappedFile m_file;
+    size_t m_nEvents = 0;
+    uint64_t m_durationNs = 0;
+    std::map<uint32_t, size_t> m_types;
+    std::map<uint32_t, std::string> m_typeNames;
+
+    /**
+    * @return False if the frame at pCursor is truncated, otherwise the event is filled and pCursor is advanced past the frame.
+    */
+    static bool readFrame(const char*& pCursor, const char* pEnd, ReplayEvent& event)
+    {
+        if (static_cast<size_t>(pEnd - pCursor) < ReplayTraceFormat::FrameHeaderSize)
+        {
+            return false;
+        }
+        uint32_t nPayloadSize;
+        memcpy(&nPayloadSize, pCursor, sizeof(nPayloadSize));
+        memcpy(&event.m_type, pCursor + 4, sizeof(event.m_type));
+        memcpy(&event.m_timestampNs, pCursor + 8, sizeof(event.m_timestampNs));
+        if (static_cast<size_t>(pEnd - pCursor) - ReplayTraceFormat::FrameHeaderSize < nPayloadSize)
+        {
+            return false;
+        }
+        event.m_pPayload = pCursor + ReplayTraceFormat::FrameHeaderSize;
+        event.m_nPayloadSize = nPayloadSize;
+        pCursor += ReplayTraceFormat::FrameHeaderSize + nPayloadSize;
+        return true;
+    }
+};
+
+
+/**
+* Records events (e.g. network packets, player inputs) into a trace file to be replayed by ReplayHarness.
+* Timestamps are taken by Clock::now() relative to the first recorded event, or given explicitly.
+*
+* Throws std::runtime_error if the file cannot be written.
+*/
+class ReplayTraceWriter
+{
+public:
+
+    ReplayTraceWriter(const std::string& sFilename) :
+        m_sFilename(sFilename),
+        m_file(sFilename, std::ios::binary | std::ios::trunc)
+    {
+        char header[ReplayTraceFormat::HeaderSize] = {};
+        const uint32_t version = ReplayTraceFormat::Version;
+        memcpy(header, ReplayTraceFormat::getMagic(), 8);
+        memcpy(header + 8, &version, sizeof(version));
+        m_file.write(header, sizeof(header));
+        check("ReplayTraceWriter ctor");
+    }
+
+    ReplayTraceWriter(const ReplayTraceWriter&) = delete;
+    ReplayTraceWriter& operator=(const ReplayTraceWriter&) = delete;
+    ReplayTraceWriter(ReplayTraceWriter&&) = delete;
+    ReplayTraceWriter& operator=(ReplayTraceWriter&&) = delete;
+
+    /**
+    * Writes the name of the given event type into the trace, used by ReplayHarness for naming the benchmarker of the type.
+    */
+    void setTypeName(uint32_t type, const std::string& sName)
+    {
+        if (type == ReplayTraceFormat::TypeNameEventType)
+        {
+            throw std::runtime_error("ReplayTraceWriter::setTypeName(): reserved event type!");
+        }
+        std::string sPayload(sizeof(type), '\0');
+        memcpy(&sPayload[0], &type, sizeof(type));
+        sPayload += sName;
+        writeFrame(ReplayTraceFormat::TypeNameEventType, 0, sPayload.data(), sPayload.size());
+    }
+
+    /**
+    * Records an event happening now according to Clock::now().
+    */
+    void record(uint32_t type, const void* pPayload, size_t nPayloadSize)
+    {
+        const Clock::TimePoint timeNow = Clock::now();
+        if (!m_bStarted)
+        {
+            m_timeStart = timeNow;
+            m_bStarted = true;
+        }
+        write(type, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(timeNow - m_timeStart).count()), pPayload, nPayloadSize);
+    }
+
+    /**
+    * Records an event with the given timestamp, e.g. when converting an existing recording.
+    */
+    void write(uint32_t type, uint64_t timestampNs, const void* pPayload, size_t nPayloadSize)
+    {
+        if (type == ReplayTraceFormat::TypeNameEventType)
+        {
+            throw std::runtime_error("ReplayTraceWriter::write(): reserved event type!");
+        }
+        writeFrame(type, timestampNs, pPayload, nPayloadSize);
+    }
+
+    void flush()
+    {
+        m_file.flush();
+        check("ReplayTraceWriter::flush()");
+    }
+
+private:
+
+    std::string m_sFilename;
+    std::ofstream m_file;
+    bool m_bStarted = false;
+    Clock::TimePoint m_timeStart;
+
+    void writeFrame(uint32_t type, uint64_t timestampNs, const void* pPayload, size_t nPayloadSize)
+    {
+        if (nPayloadSize > 0xFFFFFFFFu)
+        {
+            throw std::runtime_error("ReplayTraceWriter: payload is too large!");
+        }
+        const uint32_t nPayloadSize32 = static_cast<uint32_t>(nPayloadSize);
+        char frameHeader[ReplayTraceFormat::FrameHeaderSize];
+        memcpy(frameHeader, &nPayloadSize32, sizeof(nPayloadSize32));
+        memcpy(frameHeader + 4, &type, sizeof(type));
+        memcpy(frameHeader + 8, &timestampNs, sizeof(timestampNs));
+        m_file.write(frameHeader, sizeof(frameHeader));
+        m_file.write(static_cast<const char*>(pPayload), static_cast<std::streamsize>(nPayloadSize));
+        check("ReplayTraceWriter");
+    }
+
+    void check(const char* szWhere)
+    {
+        if (!m_file)
+        {
+            throw std::runtime_error(std::string(szWhere) + ": failed to write " + m_sFilename);
+        }
+    }
+};
+
+
+/**
+* Replays a recorded event trace (see ReplayTraceWriter), feeding the events to a callback, e.g. a recorded match fed
+* to the game server, and measures the callback per event type.
+*
+* The duration of each callback invocation is recorded into the BmData named "<prefix>.<event type name>" of
+* ScopeBenchmarkerDataStore in nanoseconds, with a LatencyHistogram for percentiles, same as FlowTracker does.
+* Event type names are taken from setTypeName(), then from the trace, otherwise "type<number>" is used.
+*
+* Events can be replayed as fast as possible, measuring throughput, or at the original pacing (optionally sped up),
+* waiting by Clock::sleepUntil() until the recorded time of each event: then the lag of dispatching each event after
+* its scheduled time is also recorded into "<prefix>.lag", showing if the callback keeps up with the recorded rate.
+* Time is taken by Clock::now(), so with a VirtualClock installed even paced replays run instantly.
+*
+* Example:
+*
+*     ReplayHarness replay("match_dust.trace", "replay");
+*     replay.setTypeName(1, "packet");
+*     replay.run([&server](const ReplayEvent& event) { server.onPacket(event.m_pPayload, event.m_nPayloadSize); },
+*         ReplayHarness::Pacing::Original);
+*/
+class ReplayHarness
+{
+public:
+
+    enum class Pacing
+    {
+        AsFastAsPossible,
+        Original
+    };
+
+    struct Result
+    {
+        size_t m_nEvents = 0;
+        Clock::Duration m_duration = Clock::Duration::zero();   /**< Duration of the whole replay. */
+        Clock::Duration m_maxLag = Clock::Duration::zero();     /**< Largest dispatch lag, only with Pacing::Original. */
+    };
+
+    /**
+    * Throws std::runtime_error if the trace cannot be read, see ReplayTrace, or the prefix is empty.
+    */
+    ReplayHarness(const std::string& sTraceFilename, const std::string& sBenchmarkerPrefix = "replay") :
+        m_trace(sTraceFilename),
+        m_sPrefix(sBenchmarkerPrefix)
+    {
+        if (sBenchmarkerPrefix.empty())
+        {
+            throw std::runtime_error("ReplayHarness ctor: sBenchmarkerPrefix cannot be empty!");
+        }
+    }
+
+    ReplayHarness(const ReplayHarness&) = delete;
+    ReplayHarness& operator=(const ReplayHarness&) = delete;
+    ReplayHarness(ReplayHarness&&) = delete;
+    ReplayHarness& operator=(ReplayHarness&&) = delete;
+
+    const ReplayTrace& getTrace() const
+    {
+        return m_trace;
+    }
+
+    /**
+    * Overrides the name of the given event type used in benchmarker names.
+    */
+    void setTypeName(uint32_t type, const std::string& sName)
+    {
+        if (sName.empty())
+        {
+            throw std::runtime_error("ReplayHarness::setTypeName(): sName cannot be empty!");
+        }
+        m_typeNames[type] = sName;
+    }
+
+    /**
+    * Replays all events of the trace in recorded order on the current thread.
+    *
+    * @param callback Callable with signature: void callback(const ReplayEvent& event).
+    * @param pacing   Whether to wait for the recorded time of each event.
+    * @param fSpeed   With Pacing::Original, recorded time is divided by this, e.g. 2 replays twice as fast as recorded.
+    */
+    template <typename Callback>
+    Result run(Callback&& callback, const Pacing& pacing = Pacing::AsFastAsPossible, double fSpeed = 1.0)
+    {
+        if (!(fSpeed > 0.0))
+        {
+            throw std::runtime_error("ReplayHarness::run(): fSpeed must be positive!");
+        }
+
+        // BmData of all types are looked up in advance, so replaying does not look up ScopeBenchmarkerDataStore,
+        // only again if the callback cleared the data store
+        std::map<uint32_t, ScopeBenchmarkerDataStore::BmData*> bmDataByType;
+        ScopeBenchmarkerDataStore::BmData* pLagBmData = nullptr;
+        unsigned long long bmDataGeneration = 0;
+        const auto lookUpBmData = [&]()
+            {
+                bmDataGeneration = ScopeBenchmarkerDataStore::getGeneration();
+                for (const auto& type : m_trace.getEventTypes())
+                {
+                    bmDataByType[type.first] = &getBmData(m_sPrefix + "." + getTypeName(type.first));
+                }
+                pLagBmData = (pacing == Pacing::Original) ? &getBmData(m_sPrefix + ".lag") : nullptr;
+            };
+        lookUpBmData();
+
+        Result result;
+        const Clock::TimePoint timeStart = Clock::now();
+        m_trace.forEach([&](const ReplayEvent& event)
+            {
+                if (ScopeBenchmarkerDataStore::getGeneration() != bmDataGeneration)
+                {
+                    lookUpBmData();
+                }
+                if (pLagBmData)
+                {
+                    const Clock::TimePoint timeScheduled = timeStart +
+                        std::chrono::duration_cast<Clock::Duration>(std::chrono::duration<double, std::nano>(event.m_timestampNs / fSpeed));
+                    Clock::sleepUntil(timeScheduled);
+                    const Clock::Duration lag = Clock::now() - timeScheduled;
+                    recordDuration(*pLagBmData, lag);
+                    result.m_maxLag = std::max(result.m_maxLag, lag);
+                }
+
+                const Clock::TimePoint timeEventStart = Clock::now();
+                callback(event);
+                const Clock::TimePoint timeEventEnd = Clock::now();
+                if (ScopeBenchmarkerDataStore::getGeneration() != bmDataGeneration)
+                {
+                    lookUpBmData();
+                }
+                recordDuration(*bmDataByType[event.m_type], timeEventEnd - timeEventStart);
+                result.m_nEvents++;
+            });
+        result.m_duration = Clock::now() - timeStart;
+        return result;
+    }
+
+private:
+
+    ReplayTrace m_trace;
+    const std::string m_sPrefix;
+    std::map<uint32_t, std::string> m_typeNames;   /**< Set by setTypeName(). */
+
+    std::string getTypeName(uint32_t type) const
+    {
+        auto it = m_typeNames.find(type);
+        if (it != m_typeNames.end())
+        {
+            return it->second;
+        }
+        it = m_trace.getTypeNames().find(type);
+        return (it != m_trace.getTypeNames().end()) ? it->second : "type" + std::to_string(type);
+    }
+
+    /**
+    * @return The BmData of the given name, initialized for nanoseconds with a histogram.
+    */
+    static ScopeBenchmarkerDataStore::BmData& getBmData(const std::string& sName)
+    {
+        ScopeBenchmarkerDataStore::BmData& bmData = ScopeBenchmarkerDataStore::getDataByName(sName);
+        if (!bmData.m_pHistogram)
+        {
+            bmData.m_ratioDenominator = std::chrono::nanoseconds::period::den;
+            bmData.m_pHistogram = std::make_shared<LatencyHistogram>();
+        }
+        return bmData;
+    }
+
+    static void recordDuration(ScopeBenchmarkerDataStore::BmData& bmData, const Clock::Duration& duration)
+    {
+        bmData.record(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+};
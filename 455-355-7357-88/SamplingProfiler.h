@@ -0,0 +1,527 @@
+#pragma once
+
+/*
+    ###################################################################################
+    SamplingProfiler.h
+    Basic header-only timer-based sampling profiler correlated with ScopeBenchmarkers.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>
+#include <atomic>    // requires cpp11
+#include <cstddef>   // size_t
+#include <cstdint>   // uintptr_t
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <cstdio>    // snprintf
+#include <cstdlib>   // free
+#include <cstring>   // memset
+#include <cxxabi.h>  // abi::__cxa_demangle
+#include <dlfcn.h>   // dladdr
+#include <pthread.h> // pthread_getattr_np
+#include <signal.h>
+#include <time.h>    // timer_create
+#include <ucontext.h>
+#endif
+
+#include "PFL.h"  // for PFL::StringHash
+
+#include "ScopeBenchmarker.h"
+
+/**
+* Sampling profiler showing which functions take the time within the measured scopes, where ScopeBenchmarker can only
+* tell that a scope is slow.
+*
+* While running, a timer ticking on the CPU time of the process (timer_create() with CLOCK_PROCESS_CPUTIME_ID) sends
+* SIGPROF to the process, and the signal handler captures the call stack of the interrupted thread together with its
+* current ScopeBenchmarker (see ScopeBenchmarkerDataStore::getCurrentScope()) into a preallocated sample buffer.
+* The handler does not allocate, lock or resolve names: unwinding follows the frame pointers, so the profiled code
+* should be compiled with -fno-omit-frame-pointer, otherwise stacks are truncated (the interrupted function is always
+* captured). Names are resolved by dladdr() only when reporting, so link with -rdynamic to see non-exported functions.
+* Frame pointers are followed only within the stack of the interrupted thread, which the handler cannot query, so
+* threads must invoke registerThread() to have their stacks unwound: start() registers the calling thread, other
+* threads (e.g. workers started by a benchmark) should register themselves once.
+*
+* Reports (see getReport()) list the top functions per ScopeBenchmarker by self samples (the function was running)
+* and total samples (the function was on the stack), and getFoldedStacks() outputs the samples in the folded stack
+* format of flamegraph.pl and speedscope, with the ScopeBenchmarker name as the root frame.
+*
+* Supported on Linux x86-64 and AArch64 only, elsewhere start() returns false and nothing is sampled.
+* Only 1 SamplingProfiler can run at the same time. Reports should be made when not running.
+* Benchmark can run it automatically during each subtest, see Benchmark::enableSamplingProfiler().
+*/
+class SamplingProfiler
+{
+public:
+
+    static constexpr unsigned int MaxFrames = 32;
+
+    struct Sample
+    {
+        PFL::StringHash m_scopeHash;        /**< Innermost ScopeBenchmarker of the interrupted thread, 0 if none. */
+        unsigned int m_nFrames;
+        uintptr_t m_frames[MaxFrames];      /**< m_frames[0] is the interrupted instruction, then the return addresses. */
+    };
+
+    struct FunctionStats
+    {
+        std::string m_sName;
+        size_t m_nSelfSamples;
+        size_t m_nTotalSamples;
+    };
+
+    /**
+    * @param nMaxSamples Capacity of the preallocated sample buffer. Samples beyond this are dropped and counted.
+    */
+    SamplingProfiler(size_t nMaxSamples = 16384) :
+        m_samples(nMaxSamples)
+    {
+        if (nMaxSamples == 0)
+        {
+            throw std::runtime_error("SamplingProfiler ctor: nMaxSamples must be positive!");
+        }
+    }
+
+    virtual ~SamplingProfiler()
+    {
+        stop();
+    }
+
+    SamplingProfiler(const SamplingProfiler&) = delete;
+    SamplingProfiler& operator=(const SamplingProfiler&) = delete;
+    SamplingProfiler(SamplingProfiler&&) = delete;
+    SamplingProfiler& operator=(SamplingProfiler&&) = delete;
+
+    static bool isSupported()
+    {
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+    * Starts sampling, keeping the already captured samples.
+    * Throws std::runtime_error if another SamplingProfiler is running or the timer cannot be created.
+    *
+    * @param nFrequencyHz Samples per second of process CPU time.
+    * @return False if sampling is not supported on this platform, true otherwise.
+    */
+    bool start(unsigned int nFrequencyHz = 1000)
+    {
+        if (nFrequencyHz == 0)
+        {
+            throw std::runtime_error("SamplingProfiler::start(): nFrequencyHz must be positive!");
+        }
+        if (!isSupported())
+        {
+            return false;
+        }
+        if (m_bRunning)
+        {
+            return true;
+        }
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+        registerThread();
+        SamplingProfiler* pExpected = nullptr;
+        if (!getActiveProfiler().compare_exchange_strong(pExpected, this))
+        {
+            throw std::runtime_error("SamplingProfiler::start(): another SamplingProfiler is already running!");
+        }
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = &SamplingProfiler::handleSignal;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &m_prevAction);
+
+        struct sigevent sev;
+        memset(&sev, 0, sizeof(sev));
+        sev.sigev_notify = SIGEV_SIGNAL;
+        sev.sigev_signo = SIGPROF;
+        if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &sev, &m_timer) != 0)
+        {
+            sigaction(SIGPROF, &m_prevAction, nullptr);
+            getActiveProfiler().store(nullptr);
+            throw std::runtime_error("SamplingProfiler::start(): timer_create() failed!");
+        }
+
+        const long nIntervalNs = static_cast<long>(1000000000ull / nFrequencyHz);
+        struct itimerspec spec;
+        spec.it_interval.tv_sec = nIntervalNs / 1000000000l;
+        spec.it_interval.tv_nsec = nIntervalNs % 1000000000l;
+        spec.it_value = spec.it_interval;
+        timer_settime(m_timer, 0, &spec, nullptr);
+        m_bRunning = true;
+#endif
+        return true;
+    }
+
+    /**
+    * Stops sampling. Captured samples are kept until clear().
+    */
+    void stop()
+    {
+        if (!m_bRunning)
+        {
+            return;
+        }
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+        timer_delete(m_timer);
+        getActiveProfiler().store(nullptr);
+        // An already pending SIGPROF might still be delivered, so the default action (terminating the process) must
+        // not be restored, the inactive handler simply ignores it. Any other previous handler is restored.
+        if ((m_prevAction.sa_flags & SA_SIGINFO) || ((m_prevAction.sa_handler != SIG_DFL) && (m_prevAction.sa_handler != SIG_IGN)))
+        {
+            sigaction(SIGPROF, &m_prevAction, nullptr);
+        }
+#endif
+        m_bRunning = false;
+    }
+
+    bool isRunning() const
+    {
+        return m_bRunning;
+    }
+
+    /**
+    * Caches the stack bounds of the current thread for the signal handler, so call stacks of the thread are unwound
+    * in addition to the interrupted function. Can be invoked any time, repeated invocations do nothing.
+    *
+    * @return False if the stack bounds cannot be queried or the platform is not supported, true otherwise.
+    */
+    static bool registerThread()
+    {
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+        StackBounds& bounds = getThreadStackBoundsRef();
+        if (bounds.m_high != 0)
+        {
+            return true;
+        }
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) != 0)
+        {
+            return false;
+        }
+        void* pStackLow = nullptr;
+        size_t nStackSize = 0;
+        const bool bSuccess = (pthread_attr_getstack(&attr, &pStackLow, &nStackSize) == 0) && pStackLow && (nStackSize > 0);
+        pthread_attr_destroy(&attr);
+        if (bSuccess)
+        {
+            bounds.m_low = reinterpret_cast<uintptr_t>(pStackLow);
+            bounds.m_high = bounds.m_low + nStackSize;
+        }
+        return bSuccess;
+#else
+        return false;
+#endif
+    }
+
+    /**
+    * Deletes the captured samples. Should be invoked when not running.
+    */
+    void clear()
+    {
+        m_nSamples.store(0);
+        m_nDroppedSamples.store(0);
+    }
+
+    size_t getSampleCount() const
+    {
+        return std::min(m_nSamples.load(), m_samples.size());
+    }
+
+    const Sample& getSample(size_t i) const
+    {
+        return m_samples.at(i);
+    }
+
+    unsigned long long getDroppedSampleCount() const
+    {
+        return m_nDroppedSamples.load();
+    }
+
+    /**
+    * @return Functions sampled within the given ScopeBenchmarker (0 for samples outside any), ordered by self samples.
+    */
+    std::vector<FunctionStats> getTopFunctions(const PFL::StringHash& scopeHash, size_t nTop) const
+    {
+        std::map<std::string, FunctionStats> statsByName;
+        std::map<uintptr_t, std::string> nameCache;
+        for (size_t i = 0; i < getSampleCount(); i++)
+        {
+            const Sample& sample = m_samples[i];
+            if ((sample.m_scopeHash != scopeHash) || (sample.m_nFrames == 0))
+            {
+                continue;
+            }
+
+            std::set<std::string> countedNames;  // recursive functions count once per sample in total
+            for (unsigned int iFrame = 0; iFrame < sample.m_nFrames; iFrame++)
+            {
+                const std::string& sName = getFunctionName(sample.m_frames[iFrame], iFrame == 0, nameCache);
+                FunctionStats& stats = statsByName.insert(std::make_pair(sName, FunctionStats{ sName, 0, 0 })).first->second;
+                if (iFrame == 0)
+                {
+                    ++stats.m_nSelfSamples;
+                }
+                if (countedNames.insert(sName).second)
+                {
+                    ++stats.m_nTotalSamples;
+                }
+            }
+        }
+
+        std::vector<FunctionStats> topFunctions;
+        for (const auto& stats : statsByName)
+        {
+            topFunctions.push_back(stats.second);
+        }
+        std::sort(topFunctions.begin(), topFunctions.end(), [](const FunctionStats& a, const FunctionStats& b) {
+            return (a.m_nSelfSamples != b.m_nSelfSamples) ? (a.m_nSelfSamples > b.m_nSelfSamples) : (a.m_nTotalSamples > b.m_nTotalSamples);
+        });
+        if (topFunctions.size() > nTop)
+        {
+            topFunctions.resize(nTop);
+        }
+        return topFunctions;
+    }
+
+    /**
+    * @return Lines of "<ScopeBenchmarker>;<outermost function>;...;<innermost function> <sample count>".
+    *         ScopeBenchmarker names are taken from ScopeBenchmarkerDataStore, so this should be invoked before clearing it.
+    */
+    std::vector<std::string> getFoldedStacks() const
+    {
+        std::map<std::string, size_t> stackCounts;
+        std::map<uintptr_t, std::string> nameCache;
+        for (size_t i = 0; i < getSampleCount(); i++)
+        {
+            const Sample& sample = m_samples[i];
+            std::string sStack = getScopeName(sample.m_scopeHash);
+            for (unsigned int iFrame = sample.m_nFrames; iFrame > 0; iFrame--)
+            {
+                sStack += ";" + getFunctionName(sample.m_frames[iFrame - 1], iFrame == 1, nameCache);
+            }
+            ++stackCounts[sStack];
+        }
+
+        std::vector<std::string> lines;
+        for (const auto& stackCount : stackCounts)
+        {
+            lines.push_back(stackCount.first + " " + std::to_string(stackCount.second));
+        }
+        return lines;
+    }
+
+    /**
+    * Writes getFoldedStacks() to the given file.
+    *
+    * @return False if the file cannot be written, true otherwise.
+    */
+    bool writeFoldedStacks(const std::string& sFilename) const
+    {
+        std::ofstream f(sFilename, std::ios::trunc);
+        if (!f)
+        {
+            return false;
+        }
+        for (const auto& sLine : getFoldedStacks())
+        {
+            f << sLine << std::endl;
+        }
+        return static_cast<bool>(f);
+    }
+
+    /**
+    * @return Report lines with the top functions of each ScopeBenchmarker having samples.
+    *         ScopeBenchmarker names are taken from ScopeBenchmarkerDataStore, so this should be invoked before clearing it.
+    */
+    std::vector<std::string> getReport(size_t nTopFunctions = 5) const
+    {
+        std::map<PFL::StringHash, size_t> sampleCountsByScope;
+        for (size_t i = 0; i < getSampleCount(); i++)
+        {
+            ++sampleCountsByScope[m_samples[i].m_scopeHash];
+        }
+
+        std::vector<std::string> lines;
+        lines.push_back("Sampling Profiler: " + std::to_string(getSampleCount()) + " samples, dropped: " +
+            std::to_string(getDroppedSampleCount()));
+        for (const auto& sampleCount : sampleCountsByScope)
+        {
+            lines.push_back("  " + getScopeName(sampleCount.first) + ": " + std::to_string(sampleCount.second) + " samples, top functions (self/total):");
+            for (const auto& stats : getTopFunctions(sampleCount.first, nTopFunctions))
+            {
+                lines.push_back("    " + std::to_string(stats.m_nSelfSamples) + "/" + std::to_string(stats.m_nTotalSamples) + " " + stats.m_sName);
+            }
+        }
+        return lines;
+    }
+
+private:
+
+    /**
+    * Maximum distance of consecutive frame pointers, a larger step is taken as garbage ending the unwinding.
+    */
+    static constexpr uintptr_t MaxFrameSize = 256 * 1024;
+
+    struct StackBounds
+    {
+        uintptr_t m_low;    /**< Lowest address of the stack, 0 if the thread is not registered. */
+        uintptr_t m_high;   /**< One past the highest address of the stack. */
+    };
+
+    std::vector<Sample> m_samples;                      /**< Preallocated, so the signal handler does not allocate. */
+    std::atomic<size_t> m_nSamples{ 0 };                /**< Reserved slots, can be larger than the capacity. */
+    std::atomic<unsigned long long> m_nDroppedSamples{ 0 };
+    bool m_bRunning = false;
+#ifdef __linux__
+    timer_t m_timer{};
+    struct sigaction m_prevAction {};
+#endif
+
+    static std::atomic<SamplingProfiler*>& getActiveProfiler()
+    {
+        // constant-initialized so the signal handler can use it without a guard
+        static std::atomic<SamplingProfiler*> s_pActiveProfiler(nullptr);
+        return s_pActiveProfiler;
+    }
+
+    static StackBounds& getThreadStackBoundsRef()
+    {
+        // constant-initialized and first accessed by registerThread(), so the signal handler can use it
+        static thread_local StackBounds s_stackBounds{ 0, 0 };
+        return s_stackBounds;
+    }
+
+    static std::string getScopeName(const PFL::StringHash& scopeHash)
+    {
+        if (scopeHash == 0)
+        {
+            return "(no scope)";
+        }
+        const std::string sName = ScopeBenchmarkerDataStore::getNameByHash(scopeHash);
+        return sName.empty() ? "scope#" + std::to_string(scopeHash) : sName;
+    }
+
+    /**
+    * @param bInterrupted True if the address is the interrupted instruction, false if it is a return address.
+    */
+    static const std::string& getFunctionName(uintptr_t address, bool bInterrupted, std::map<uintptr_t, std::string>& nameCache)
+    {
+        // return address points after the call instruction, which might be the beginning of the next function
+        const uintptr_t lookupAddress = bInterrupted ? address : address - 1;
+        const auto it = nameCache.find(lookupAddress);
+        if (it != nameCache.end())
+        {
+            return it->second;
+        }
+
+        std::string sName;
+#ifdef __linux__
+        Dl_info info;
+        if ((dladdr(reinterpret_cast<void*>(lookupAddress), &info) != 0) && info.dli_sname)
+        {
+            int status = 0;
+            char* const szDemangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            sName = szDemangled ? szDemangled : info.dli_sname;
+            free(szDemangled);
+        }
+        else
+        {
+            // not exported, or not in any loaded module: show module and offset, so it can be resolved by addr2line
+            const bool bModuleKnown = (dladdr(reinterpret_cast<void*>(lookupAddress), &info) != 0) && info.dli_fname;
+            char szAddress[32];
+            snprintf(szAddress, sizeof(szAddress), "0x%llx", static_cast<unsigned long long>(
+                bModuleKnown ? lookupAddress - reinterpret_cast<uintptr_t>(info.dli_fbase) : lookupAddress));
+            if (bModuleKnown)
+            {
+                const std::string sModule(info.dli_fname);
+                sName = sModule.substr(sModule.find_last_of('/') + 1) + "+";
+            }
+            sName += szAddress;
+        }
+#endif
+        // ';' separates the frames in the folded stack format
+        std::replace(sName.begin(), sName.end(), ';', ',');
+        return nameCache.insert(std::make_pair(lookupAddress, sName)).first->second;
+    }
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+    static void handleSignal(int /*signal*/, siginfo_t* /*pInfo*/, void* pContext)
+    {
+        SamplingProfiler* const pProfiler = getActiveProfiler().load(std::memory_order_acquire);
+        if (!pProfiler || !pContext)
+        {
+            return;
+        }
+
+        const size_t iSample = pProfiler->m_nSamples.fetch_add(1, std::memory_order_relaxed);
+        if (iSample >= pProfiler->m_samples.size())
+        {
+            pProfiler->m_nDroppedSamples.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Sample& sample = pProfiler->m_samples[iSample];
+        sample.m_scopeHash = ScopeBenchmarkerDataStore::getCurrentScope();
+        sample.m_nFrames = 0;
+
+        const ucontext_t* const pUContext = static_cast<const ucontext_t*>(pContext);
+#if defined(__x86_64__)
+        const uintptr_t pc = static_cast<uintptr_t>(pUContext->uc_mcontext.gregs[REG_RIP]);
+        uintptr_t fp = static_cast<uintptr_t>(pUContext->uc_mcontext.gregs[REG_RBP]);
+        const uintptr_t sp = static_cast<uintptr_t>(pUContext->uc_mcontext.gregs[REG_RSP]);
+#else
+        const uintptr_t pc = static_cast<uintptr_t>(pUContext->uc_mcontext.pc);
+        uintptr_t fp = static_cast<uintptr_t>(pUContext->uc_mcontext.regs[29]);
+        const uintptr_t sp = static_cast<uintptr_t>(pUContext->uc_mcontext.sp);
+#endif
+        sample.m_frames[sample.m_nFrames++] = pc;
+
+        // Frame pointer chain: [fp] is the caller's fp, [fp + 1 word] is the return address. Frame pointers are
+        // accepted only between the stack pointer and the top of the registered stack of the thread, and only
+        // strictly growing by at most MaxFrameSize, so garbage in a frame pointer register (code compiled without
+        // frame pointers) cannot lead outside of the stack. Unregistered threads and threads interrupted on another
+        // stack (e.g. alternate signal stack, fiber) are not unwound.
+        const StackBounds& bounds = getThreadStackBoundsRef();
+        if ((bounds.m_high == 0) || (sp < bounds.m_low) || (sp >= bounds.m_high))
+        {
+            return;
+        }
+        while ((sample.m_nFrames < MaxFrames) && (fp >= sp) && (fp <= bounds.m_high - 2 * sizeof(uintptr_t)) &&
+            ((fp & (sizeof(uintptr_t) - 1)) == 0))
+        {
+            const uintptr_t* const pFrame = reinterpret_cast<const uintptr_t*>(fp);
+            const uintptr_t returnAddress = pFrame[1];
+            if (returnAddress == 0)
+            {
+                break;
+            }
+            sample.m_frames[sample.m_nFrames++] = returnAddress;
+            const uintptr_t nextFp = pFrame[0];
+            if ((nextFp <= fp) || (nextFp - fp > MaxFrameSize))
+            {
+                break;
+            }
+            fp = nextFp;
+        }
+    }
+#endif
+};
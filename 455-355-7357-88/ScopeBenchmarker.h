@@ -10,27 +10,135 @@
     ###################################################################################
 */
 
-#include <chrono>    // seconds, milliseconds, now(), etc.; requires cpp11
+#include <algorithm>
+#include <array>
+#include <atomic>    // requires cpp11
+#include <cassert>
+#include <chrono>    // seconds, milliseconds, etc.; requires cpp11
+#include <climits>   // LLONG_MAX
 #include <cstdint>   // intmax_t
-#include <limits>    // LLONG_MAX
+#include <limits>
 #include <map>
+#include <memory>    // requires cpp11
+#include <mutex>     // requires cpp11
+#include <ostream>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <thread>    // requires cpp11
+#include <utility>
+#include <vector>
 
 #include "PFL.h"  // for PFL::StringHash
 
+#include "BenchmarkLabels.h"
+#include "Clock.h"
+#include "ExclusiveResources.h"
+#include "LatencyHistogram.h"
+#include "NameTable.h"
+#include "UsdtProbes.h"
+
+/**
+* Interface for getting notified about every scope entered and left by any ScopeBenchmarker, e.g. for recording events.
+* Listeners are invoked on the thread running the scope, so implementations must be thread-safe and fast.
+* Time points are taken by Clock::now(). Listeners are notified outside of the measured period, so their cost is not
+* included in the measured durations: timeStart of onScopeEnter() is taken right before the ScopeBenchmarker takes its
+* own start time, while onScopeExit() gets the start and end times of the measured period.
+*/
+class ScopeBenchmarkerListener
+{
+public:
+
+    virtual ~ScopeBenchmarkerListener() = default;
+
+    virtual void onScopeEnter(const PFL::StringHash& nameHash, const Clock::TimePoint& timeStart) = 0;
+
+    virtual void onScopeExit(const PFL::StringHash& nameHash, const Clock::TimePoint& timeStart, const Clock::TimePoint& timeEnd) = 0;
+
+    enum class FlowEventType : unsigned char
+    {
+        Begin,
+        Stage,
+        End
+    };
+
+    /**
+    * Invoked by FlowTracker when a flow begins, reaches a stage or ends, on the thread doing so.
+    * Default implementation ignores flows.
+    *
+    * @param nameHash Name hash of the BmData of the flow (Begin) or of the stage (Stage, End).
+    * @param flowId   Unique id of the flow, same for all events of the flow.
+    */
+    virtual void onFlowEvent(
+        const PFL::StringHash& /*nameHash*/, unsigned long long /*flowId*/, FlowEventType /*type*/, const Clock::TimePoint& /*time*/)
+    {
+    }
+};
+
+
 /**
 * Class for handling the global container of scope benchmarkers.
 * The actual class is derived from this.
 * With this code segregation, Benchmark class can use these static functions without specifying template argument
 * that is requred for the derived ScopeBenchmarker class.
+* Looking up and creating benchmarkers is thread-safe: the container is guarded by a registry mutex, and since std::map
+* never moves its elements, a found BmData can be used without the lock until clear(). Frequent users (e.g.
+* ScopeBenchmarker, FlowTracker) cache the BmData pointer with getGeneration() instead of looking it up again.
+* Iterating getAllData(), resetAll() and clear() are not thread-safe, they need that no other thread is measuring.
+* Tests run concurrently by Test::runTests() must have exclusive resource ExclusiveResources::BENCHMARKERS to look
+* up, reset or clear benchmarkers, otherwise std::runtime_error is thrown.
 */
 class ScopeBenchmarkerDataStore
 {
 public:
 
+    /**
+    * Maximum number of different direct child scopes kept in the breakdown of an exemplar.
+    * Further child scopes are summed into an additional entry with name hash 0.
+    */
+    static constexpr size_t MaxExemplarChildren = 8;
+
+    /**
+    * One of the slowest iterations of a scope, see setExemplarCapacity().
+    */
+    struct Exemplar
+    {
+        Clock::Duration m_duration;
+        Clock::TimePoint m_timeStart;
+        std::thread::id m_threadId;
+        bool m_bTagged = false;
+        long long m_tag = 0;                   /** User-supplied value, see ScopeBenchmarker::setTag(). */
+        std::vector<std::pair<PFL::StringHash, Clock::Duration>> m_children;   /** Total time in the direct child scopes
+                                                                                   during the iteration, slowest first. */
+    };
+
+    /**
+    * Sequence counter of the seqlock of BmData, see BmData::beginWrite().
+    * Copyable so BmData stays copyable, a copy starts with the same sequence.
+    */
+    struct SequenceCounter
+    {
+        std::atomic<unsigned long long> m_value{ 0 };
+
+        SequenceCounter() = default;
+
+        SequenceCounter(const SequenceCounter& other) :
+            m_value(other.m_value.load(std::memory_order_relaxed))
+        {
+        }
+
+        SequenceCounter& operator=(const SequenceCounter& other)
+        {
+            m_value.store(other.m_value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+    };
+
     struct BmData
     {
-        std::string m_name;
+        std::string m_name;                    /** Name of the series, including its labels if any, e.g. "tick{map=dust,players=16}". */
+        std::string m_baseName;                /** Name without labels, empty if the benchmarker has no labels, see getBaseName(). */
+        std::vector<std::pair<std::string, std::string>> m_labels;  /** Labels of the series ordered by key, see BenchmarkLabels. */
         long long m_durationsTotal = 0;        /** Time unit (sec, millisec, etc.) is the actual template parameter DurationType when instantiating ScopeBenchmarker. */
         long long m_durationsMin = LLONG_MAX;  /** Time unit (sec, millisec, etc.) is the actual template parameter DurationType when instantiating ScopeBenchmarker. */
         long long m_durationsMax = 0;          /** Time unit (sec, millisec, etc.) is the actual template parameter DurationType when instantiating ScopeBenchmarker. */
@@ -39,6 +147,14 @@ public:
         intmax_t m_ratioDenominator = 0;       /** Denominator of the std::ratio of DurationType passed to ScopeBenchmarker.
                                                    We need this for printing unit of measure.
                                                    0 is obviously invalid value, only non-0 values can be formatted to valid string. */
+        Clock::Duration m_budget = Clock::Duration::zero();  /** Latency budget of the scope, zero means no budget. See ScopeBudgetMonitor. */
+        long long m_budgetExceededCount = 0;                 /** Number of entering the scope that took longer than m_budget. */
+        std::shared_ptr<std::atomic<long long>> m_pBudgetExceededCounter;  /** Same as m_budgetExceededCount but shared with
+                                                                               ScopeBudgetMonitor so it can read it from its own thread. */
+        std::shared_ptr<LatencyHistogram> m_pHistogram;      /** Optional distribution of the durations in nanoseconds, e.g. set by FlowTracker. */
+        std::vector<Exemplar> m_exemplars;                   /** Slowest iterations, slowest first, see setExemplarCapacity(). */
+        SequenceCounter m_sequence;                          /** Odd while the measurement fields are being written, see beginWrite(). */
+        bool m_bIndexed = false;                             /** Added to the registry index read by getSnapshot(), by the first endWrite(). */
 
         static const char* getUnitString(const intmax_t& ratioDenominator)
         {
@@ -57,6 +173,29 @@ public:
             return getUnitString(m_ratioDenominator);
         }
 
+        /**
+        * @return Name of the benchmarker without labels, same for all series of the benchmarker.
+        */
+        const std::string& getBaseName() const
+        {
+            return m_baseName.empty() ? m_name : m_baseName;
+        }
+
+        /**
+        * @return Value of the label with the given key, empty string if the series has no such label.
+        */
+        std::string getLabel(const std::string& sKey) const
+        {
+            for (const auto& label : m_labels)
+            {
+                if (label.first == sKey)
+                {
+                    return label.second;
+                }
+            }
+            return std::string();
+        }
+
         /**
         * @return Simply the total duration divided by the number of iterations (entering the measured scope).
         *         Time unit (sec, millisec, etc.) is the actual template parameter DurationType when instantiating ScopeBenchmarker.
@@ -68,13 +207,262 @@ public:
                 m_durationsTotal / static_cast<float>(m_iterations);
         }
 
+        /**
+        * @return The given duration in the time unit of the durations of this benchmarker, or in nanoseconds if unit is not yet known.
+        */
+        long long toDurationCount(const Clock::Duration& duration) const
+        {
+            const long long nanosecs = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+            return m_ratioDenominator == 0 ? nanosecs : nanosecs / (std::nano::den / m_ratioDenominator);
+        }
+
+        /**
+        * Adds the measurements of the other BmData to this one: totals, iterations and budget exceeded counts are summed,
+        * min and max are taken over both, histograms are merged, exemplars are merged keeping the slowest.
+        * Name and labels are not changed.
+        * Throws std::runtime_error if the two were measured in different DurationType.
+        */
+        void merge(const BmData& other)
+        {
+            if ((other.m_ratioDenominator != 0) && (m_ratioDenominator != other.m_ratioDenominator))
+            {
+                if (m_ratioDenominator != 0)
+                {
+                    throw std::runtime_error("BmData::merge(): " + getBaseName() + " is measured in different units!");
+                }
+                m_ratioDenominator = other.m_ratioDenominator;
+            }
+
+            m_durationsTotal += other.m_durationsTotal;
+            m_durationsMin = std::min(m_durationsMin, other.m_durationsMin);
+            m_durationsMax = std::max(m_durationsMax, other.m_durationsMax);
+            m_iterations += other.m_iterations;
+            m_budgetExceededCount += other.m_budgetExceededCount;
+            if (other.m_pHistogram)
+            {
+                if (!m_pHistogram)
+                {
+                    m_pHistogram = std::make_shared<LatencyHistogram>();
+                }
+                m_pHistogram->merge(*other.m_pHistogram);
+            }
+
+            if (!other.m_exemplars.empty())
+            {
+                const size_t nCapacity = std::max(m_exemplars.size(), other.m_exemplars.size());
+                m_exemplars.insert(m_exemplars.end(), other.m_exemplars.begin(), other.m_exemplars.end());
+                std::stable_sort(m_exemplars.begin(), m_exemplars.end(),
+                    [](const Exemplar& a, const Exemplar& b) { return a.m_duration > b.m_duration; });
+                m_exemplars.resize(nCapacity);
+            }
+        }
+
+        /**
+        * Writers of the measurement fields (durations, iterations, budget exceeded count) enclose their updates
+        * between beginWrite() and endWrite(), so readConsistent() can copy them from the same instant in another
+        * thread without locking the writer. Name and labels must be set before the first endWrite(), and must not
+        * change afterwards.
+        *
+        * A BmData has a single writer: the fields are plain integers updated by read-modify-write, and even an atomic
+        * increment of the sequence could not stop 2 overlapping writers from losing updates and publishing a torn state
+        * as consistent. So ScopeBenchmarkers of the same name must not run in multiple threads at the same time, use
+        * a different name or label per thread instead, see aggregateByLabels(). Debug builds assert this.
+        * The single writer needs no RMW instructions, see scope_benchmarker/seqlock_write in SelfBenchmarks for the cost.
+        */
+        void beginWrite()
+        {
+#ifdef NDEBUG
+            m_sequence.m_value.store(m_sequence.m_value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+#else
+            // an odd sequence means another thread is between its beginWrite() and endWrite()
+            const unsigned long long sequenceBefore = m_sequence.m_value.fetch_add(1, std::memory_order_relaxed);
+            assert(((sequenceBefore & 1) == 0) && "BmData is written by multiple threads at the same time!");
+            (void)sequenceBefore;
+#endif
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        void endWrite()
+        {
+            m_sequence.m_value.store(m_sequence.m_value.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            if (!m_bIndexed)
+            {
+                m_bIndexed = true;
+                addToRegistryIndex(*this);
+            }
+        }
+
+        /**
+        * Records 1 iteration of the given duration in nanoseconds, also into the histogram if there is any.
+        * For code measuring durations on its own instead of by a ScopeBenchmarker, e.g. LockProfile and ReplayHarness.
+        * The single writer rule of beginWrite() applies, see ConcurrentRecorder for multiple writers.
+        */
+        void record(long long durationNs)
+        {
+            record(1, durationNs, durationNs, durationNs);
+            if (m_pHistogram)
+            {
+                m_pHistogram->record(durationNs < 0 ? 0 : static_cast<uint64_t>(durationNs));
+            }
+        }
+
+        /**
+        * Records the given number of iterations in nanoseconds, given by their total, min and max duration.
+        * The histogram is not updated.
+        */
+        void record(long long nIterations, long long durationsTotalNs, long long durationsMinNs, long long durationsMaxNs)
+        {
+            beginWrite();
+            m_ratioDenominator = std::nano::den;
+            m_iterations += nIterations;
+            m_durationsTotal += durationsTotalNs;
+            if (durationsMinNs < m_durationsMin)
+            {
+                m_durationsMin = durationsMinNs;
+            }
+            if (durationsMaxNs > m_durationsMax)
+            {
+                m_durationsMax = durationsMaxNs;
+            }
+            endWrite();
+        }
+
+        /**
+        * Copies name, labels and the measurement fields into the given BmData, retrying if a writer was active during
+        * the copy. Histogram and exemplars are not copied since they are not covered by the sequence counter.
+        *
+        * The fields are plain integers, so strictly speaking the reads race with the writer, but a torn or
+        * half-updated copy is always detected by the sequence counter and thrown away.
+        *
+        * @return True if a consistent copy was made within nMaxRetries retries, false otherwise.
+        */
+        bool readConsistent(BmData& copy, size_t nMaxRetries) const
+        {
+            copy.m_name = m_name;
+            copy.m_baseName = m_baseName;
+            copy.m_labels = m_labels;
+            copy.m_budget = m_budget;
+            for (size_t iTry = 0; iTry <= nMaxRetries; iTry++)
+            {
+                const unsigned long long sequenceBefore = m_sequence.m_value.load(std::memory_order_acquire);
+                if ((sequenceBefore & 1) != 0)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                copy.m_durationsTotal = m_durationsTotal;
+                copy.m_durationsMin = m_durationsMin;
+                copy.m_durationsMax = m_durationsMax;
+                copy.m_iterations = m_iterations;
+                copy.m_ratioDenominator = m_ratioDenominator;
+                copy.m_budgetExceededCount = m_budgetExceededCount;
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m_sequence.m_value.load(std::memory_order_relaxed) == sequenceBefore)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
         void reset()
         {
+            beginWrite();
             m_durationsTotal = 0;
             m_durationsMin = LLONG_MAX;
             m_durationsMax = 0;
             m_iterations = 0;
+            m_budgetExceededCount = 0;
+            m_exemplars.clear();
+            if (m_pHistogram)
+            {
+                m_pHistogram->reset();
+            }
+            // not endWrite(): resetting does not make the BmData worth adding to the registry index
+            m_sequence.m_value.store(m_sequence.m_value.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    };
+
+    /**
+    * Records nanosecond durations into a BmData from multiple threads at the same time, e.g. the stages of a FlowTracker
+    * marked by any worker thread, or shared lock hold times in LockProfile.
+    * Durations are accumulated in atomics, and moved into the BmData by whichever thread finds no other thread moving
+    * them, so no thread waits for another and the BmData still has a single writer, see BmData::beginWrite().
+    * A duration recorded during a move might be moved without its iteration, then the iteration is moved by the next one.
+    */
+    class ConcurrentRecorder
+    {
+    public:
+
+        ConcurrentRecorder() = default;
+
+        ConcurrentRecorder(const ConcurrentRecorder&) = delete;
+        ConcurrentRecorder& operator=(const ConcurrentRecorder&) = delete;
+        ConcurrentRecorder(ConcurrentRecorder&&) = delete;
+        ConcurrentRecorder& operator=(ConcurrentRecorder&&) = delete;
+
+        /**
+        * Records 1 iteration of the given duration into the given BmData, also into its histogram if there is any.
+        * The same BmData must always be passed, until it is deleted by clear().
+        */
+        void record(BmData& bmData, long long durationNs)
+        {
+            m_total.fetch_add(durationNs, std::memory_order_relaxed);
+            long long min = m_min.load(std::memory_order_relaxed);
+            while ((durationNs < min) && !m_min.compare_exchange_weak(min, durationNs, std::memory_order_relaxed))
+            {
+            }
+            long long max = m_max.load(std::memory_order_relaxed);
+            while ((durationNs > max) && !m_max.compare_exchange_weak(max, durationNs, std::memory_order_relaxed))
+            {
+            }
+            // counted last, so a move taking the iteration also takes its duration
+            m_nIterations.fetch_add(1);
+            if (bmData.m_pHistogram)
+            {
+                bmData.m_pHistogram->record(durationNs < 0 ? 0 : static_cast<uint64_t>(durationNs));
+            }
+
+            // the moving thread checks for new iterations after finishing, so no iteration is left behind
+            while (!m_bMoving.exchange(true))
+            {
+                const long long nIterations = m_nIterations.exchange(0);
+                if (nIterations > 0)
+                {
+                    bmData.record(
+                        nIterations,
+                        m_total.exchange(0, std::memory_order_relaxed),
+                        m_min.exchange(LLONG_MAX, std::memory_order_relaxed),
+                        m_max.exchange(0, std::memory_order_relaxed));
+                }
+                m_bMoving.store(false);
+                if (m_nIterations.load() == 0)
+                {
+                    return;
+                }
+            }
         }
+
+    private:
+
+        std::atomic<long long> m_nIterations{ 0 };   /**< Not yet moved into the BmData, same for the other fields. */
+        std::atomic<long long> m_total{ 0 };
+        std::atomic<long long> m_min{ LLONG_MAX };
+        std::atomic<long long> m_max{ 0 };
+        std::atomic<bool> m_bMoving{ false };        /**< A thread is moving the fields into the BmData. */
+    };
+
+    /**
+    * Consistent copy of the stored benchmarkers, taken while ScopeBenchmarkers may be running in other threads,
+    * see getSnapshot().
+    */
+    struct Snapshot
+    {
+        unsigned long long m_generation = 0;   /** getGeneration() when the snapshot was taken. */
+        std::vector<BmData> m_data;            /** Copies without histogram and exemplars, in order of first measurement. */
+        size_t m_nSkipped = 0;                 /** Number of benchmarkers left out since they were being written during all retries. */
     };
 
     /**
@@ -84,6 +472,7 @@ public:
     {
         // originally s_scopeBenchmarkersData was static member, but that way you cannot create header-only stuff, so
         // there are different tricks for that and this local static variable is the most convenient!
+        // All other process-wide state of the framework is kept in function-local statics like this.
         static std::map<PFL::StringHash, BmData> s_scopeBenchmarkersData;
         return s_scopeBenchmarkersData;
     }
@@ -91,10 +480,12 @@ public:
     /**
     * @param  hash Benchmarker name hash to search for.
     * @return Returns measurement-specific data by the given benchmarker name hash.
-    *         If such does not exist yet, a new entry with given name will be created and returned with default values.
+    *         If such does not exist yet, a new entry without name will be created and returned with default values.
     */
     static BmData& getDataByNameHash(const PFL::StringHash& hash)
     {
+        ExclusiveResources::require(ExclusiveResources::BENCHMARKERS, "ScopeBenchmarkerDataStore::getDataByNameHash()");
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
         return getAllData()[hash];
     }
 
@@ -105,108 +496,1000 @@ public:
     */
     static BmData& getDataByName(const std::string& name)
     {
-        return getDataByNameHash(PFL::calcHash(name));
+        return findOrCreate(PFL::calcHash(name), name);
     }
 
     /**
-    * Resets all measurement-specific data in stored benchmarkers.
-    * Does not delete any of the stored benchmarkers.
+    * @return Name of the benchmarker with the given name hash, empty string if there is no such benchmarker.
+    *         Can be invoked from any thread, e.g. by listeners to resolve the hash passed to them.
     */
-    static void resetAll()
+    static std::string getNameByHash(const PFL::StringHash& hash)
     {
-        for (auto& bmData : getAllData())
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
+        const auto it = getAllData().find(hash);
+        return (it == getAllData().end()) ? std::string() : it->second.m_name;
+    }
+
+    /**
+    * @param  nameHandle Benchmarker name interned into NameTable.
+    * @return Returns measurement-specific data by the given benchmarker name handle, without map lookup if it was
+    *         already looked up since the last clear().
+    *         If such does not exist yet, a new entry with given name will be created and returned with default values.
+    */
+    static BmData& getDataByNameHandle(const NameTable::Handle& nameHandle)
+    {
+        const unsigned long long generation = getGeneration();
+        void* const pCachedData = NameTable::getCachedData(nameHandle, generation);
+        if (pCachedData)
         {
-            bmData.second.reset();
+            return *static_cast<BmData*>(pCachedData);
         }
+
+        // std::map never moves its elements, so the pointer stays valid until clear()
+        BmData& bmData = findOrCreate(NameTable::getNameHash(nameHandle), NameTable::getName(nameHandle));
+        NameTable::setCachedData(nameHandle, &bmData, generation);
+        return bmData;
     }
 
     /**
-    * Deletes all stored benchmarkers.
+    * Label key of the overflow series of a benchmarker name, see setMaxSeriesPerName().
     */
-    static void clear()
+    static const char* getOverflowLabelKey()
     {
-        getAllData().clear();
+        return "__overflow__";
     }
-};
 
+    /**
+    * Sets the maximum number of different label sets (series) stored for a benchmarker name, 256 by default.
+    * Further label sets of the name are all measured in a single overflow series with label __overflow__=true, so a
+    * label with unexpectedly many values (e.g. an id) cannot make the registry and NameTable grow without bound.
+    * Not cleared by clear(). Should be set when no scope is being measured.
+    */
+    static void setMaxSeriesPerName(size_t nMaxSeries)
+    {
+        if (nMaxSeries == 0)
+        {
+            throw std::runtime_error("ScopeBenchmarkerDataStore::setMaxSeriesPerName(): nMaxSeries must be positive!");
+        }
+        getMaxSeriesPerNameRef().store(nMaxSeries, std::memory_order_relaxed);
+    }
 
-/**
-* Basic header-only scope benchmarker class to conveniently stopwatch a scope (code block).
-*
-* The template parameter DurationType should be the time measurement unit, e.g. std::chrono::milliseconds.
-* Note that DurationType shall be fine-grained enough to properly measure min/max/avg/total values.
-* For example, if you specify std::chrono::seconds, but your measured code always finishes within milliseconds,
-* it won't be properly measured, so you should use std::chrono::milliseconds or std::chrono::macroseconds.
-* 
-* Improvement idea: durations should be always measured in macro- or nanoseconds, and then those values should be
-* converted to DurationType upon evaluating the results, this way the user could specify arbitrary DurationType, the
-* measurements would stay precise.
-* 
-* For example usage, see Benchmarks.cpp.
-*/
-template <typename DurationType>
-class ScopeBenchmarker : public ScopeBenchmarkerDataStore
-{
-public:
+    static size_t getMaxSeriesPerName()
+    {
+        return getMaxSeriesPerNameRef().load(std::memory_order_relaxed);
+    }
 
-    static_assert(std::chrono::_Is_duration_v<DurationType>, "DurationType template argument must be of std::duration!");
-    ScopeBenchmarker(const std::string& name)
+    /**
+    * @param  baseName Benchmarker name without labels.
+    * @param  labels   Labels of the series, empty means the series is the benchmarker name itself.
+    * @return Handle of the interned series name, e.g. "tick{map=dust,players=16}", to be passed to getDataByNameHandle().
+    *         Also creates the BmData of the series with its labels if it does not exist yet, or returns the handle of
+    *         the overflow series if the name already has getMaxSeriesPerName() series.
+    *         For an existing series, only the series name is built and looked up, without lock or heap allocation.
+    *         Throws std::runtime_error if baseName is empty, or has labels and is longer than NameBuilder::MaxBaseLength.
+    */
+    static NameTable::Handle getSeriesHandle(const std::string& baseName, const BenchmarkLabels& labels)
     {
-        if (name.empty())
+        if (baseName.empty())
         {
-            throw std::runtime_error("ScopeBenchmarker ctor: name cannot be empty!");
+            throw std::runtime_error("ScopeBenchmarkerDataStore::getSeriesHandle(): baseName cannot be empty!");
+        }
+        if (!labels.empty() && (baseName.length() > NameBuilder::MaxBaseLength))
+        {
+            throw std::runtime_error("ScopeBenchmarkerDataStore::getSeriesHandle(): baseName is longer than " +
+                std::to_string(NameBuilder::MaxBaseLength) + " characters: " + baseName);
         }
 
-        m_nameHash = PFL::calcHash(name);
-        auto& bmData = getDataByNameHash(m_nameHash);
+        NameBuilder seriesName;
+        seriesName << baseName;
+        labels.appendTo(seriesName);
 
-        bmData.m_iterations++;
-        assert(bmData.m_iterations > 0);
-        if (bmData.m_iterations <= 0)
+        NameTable::Handle seriesHandle;
+        if (NameTable::findHandle(seriesName.c_str(), seriesName.length(), seriesHandle) &&
+            NameTable::getCachedData(seriesHandle, getGeneration()))
         {
-            throw std::runtime_error("ScopeBenchmarker ctor: m_iterations overflew!");
+            return seriesHandle;
+        }
+
+        if (labels.empty())
+        {
+            return NameTable::intern(baseName);
+        }
+
+        // new series, or existing but not yet looked up by handle since the last clear()
+        const std::string sSeriesName(seriesName.c_str(), seriesName.length());
+        if (!createSeries(PFL::calcHash(sSeriesName), sSeriesName, baseName, labels.toVector()))
+        {
+            return getOverflowSeriesHandle(baseName);
         }
 
-        // We could debate what is faster from performance perspective:
-        // - copy string everytime there (brute-force)
-        // - copy string only if target is empty (hash already provides uniqueness so we are sure if target is non-empty, it already equals to our input name)
-        // I should profile this but not now!
-        bmData.m_name = name;
-        bmData.m_ratioDenominator = DurationType::period::den;
-        m_timeStartScope = std::chrono::steady_clock::now();
+        seriesHandle = seriesName.intern();
+        getDataByNameHandle(seriesHandle);
+        return seriesHandle;
     }
 
-    ~ScopeBenchmarker()
+    static NameTable::Handle getSeriesHandle(const NameTable::Handle& baseNameHandle, const BenchmarkLabels& labels)
     {
-        const auto thisDurationCount = std::chrono::duration_cast<DurationType>(std::chrono::steady_clock::now() - m_timeStartScope).count();
-        auto& bmData = getDataByNameHash(m_nameHash);
+        return getSeriesHandle(NameTable::getName(baseNameHandle), labels);
+    }
 
-        bmData.m_durationsTotal += thisDurationCount;
-        assert(bmData.m_durationsTotal > 0);
-        
-        // dtor cannot throw
-        //if (bmData.m_durationsTotal <= 0)
-        //{
-        //    throw std::runtime_error("ScopeBenchmarker dtor: m_durationsTotal overflew!");
-        //}
+    /**
+    * Aggregates all series of the given benchmarker name by the values of the given label keys, e.g. with groupByKeys
+    * { "map" } all series of "tick" with map=dust are merged into series "tick{map=dust}", whatever their other labels are.
+    * Series without any of the given keys are grouped under empty value, with empty groupByKeys all series are merged.
+    * Totals, iterations and budget exceeded counts are summed, min and max are taken over the series,
+    * histograms are merged, exemplars are merged keeping the slowest.
+    * Throws std::runtime_error if the series were measured in different DurationType.
+    *
+    * @return Aggregated data by name of the group, e.g. "tick{map=dust}", with m_labels holding the grouped labels.
+    */
+    static std::map<std::string, BmData> aggregateByLabels(const std::string& baseName, const std::vector<std::string>& groupByKeys)
+    {
+        std::map<std::string, BmData> groups;
+        for (const auto& bmDataPair : getAllData())
+        {
+            const BmData& series = bmDataPair.second;
+            if (series.getBaseName() != baseName)
+            {
+                continue;
+            }
 
-        if (thisDurationCount < bmData.m_durationsMin)
+            std::vector<std::pair<std::string, std::string>> groupLabels;
+            for (const auto& sKey : groupByKeys)
+            {
+                groupLabels.emplace_back(sKey, series.getLabel(sKey));
+            }
+            std::sort(groupLabels.begin(), groupLabels.end());
+            const std::string sGroupName = baseName + BenchmarkLabels::toString(groupLabels);
+
+            BmData& group = groups[sGroupName];
+            if (group.m_name.empty())
+            {
+                group.m_name = sGroupName;
+                group.m_baseName = baseName;
+                group.m_labels = groupLabels;
+                group.m_ratioDenominator = series.m_ratioDenominator;
+            }
+            group.merge(series);
+        }
+        return groups;
+    }
+
+    /**
+    * Writes all stored benchmarkers in CSV format: 1 line per series, with 1 column per label key used by any series,
+    * empty where a series has no such label. Durations are in the unit given in the unit column.
+    */
+    static void writeCsv(std::ostream& os)
+    {
+        std::set<std::string> labelKeys;
+        for (const auto& bmDataPair : getAllData())
         {
-            bmData.m_durationsMin = thisDurationCount;
+            for (const auto& label : bmDataPair.second.m_labels)
+            {
+                labelKeys.insert(label.first);
+            }
         }
-        if (thisDurationCount > bmData.m_durationsMax)
+
+        os << "name";
+        for (const auto& sKey : labelKeys)
         {
-            bmData.m_durationsMax = thisDurationCount;
+            os << "," << sKey;
+        }
+        os << ",iterations,min,max,avg,total,unit" << std::endl;
+
+        for (const auto& bmDataPair : getAllData())
+        {
+            const BmData& bmData = bmDataPair.second;
+            os << escapeCsv(bmData.getBaseName());
+            for (const auto& sKey : labelKeys)
+            {
+                os << "," << escapeCsv(bmData.getLabel(sKey));
+            }
+            os << "," << bmData.m_iterations
+                << "," << (bmData.m_iterations == 0 ? 0 : bmData.m_durationsMin)
+                << "," << bmData.m_durationsMax
+                << "," << bmData.getAverageDuration()
+                << "," << bmData.m_durationsTotal
+                << "," << bmData.getUnitString() << std::endl;
         }
     }
 
-    ScopeBenchmarker(const ScopeBenchmarker&) = default;
-    ScopeBenchmarker& operator=(const ScopeBenchmarker&) = default;
-    ScopeBenchmarker(ScopeBenchmarker&&) = default;
-    ScopeBenchmarker& operator=(ScopeBenchmarker&&) = default;
+    /**
+    * Takes a snapshot of all benchmarkers measured so far, for monitoring them from another thread while they are
+    * being measured, without locking or stopping the measuring threads.
+    * The set of benchmarkers is read from a copy-on-write index published by the measuring threads, and the
+    * measurement fields of each benchmarker are read by its seqlock, see BmData::readConsistent(), so total, min, max
+    * and iterations are from the same instant. Iterations include the currently running iteration of the scope.
+    * Benchmarkers that are never measured (e.g. only looked up) are not in the snapshot.
+    *
+    * Can be invoked from any thread, except while clear() is running, since that deletes the benchmarkers.
+    *
+    * @param nMaxRetries Number of retries of reading a benchmarker being written, before leaving it out of the snapshot.
+    */
+    static Snapshot getSnapshot(size_t nMaxRetries = 100)
+    {
+        const std::shared_ptr<const RegistryIndex> pIndex = std::atomic_load(&getRegistryIndexRef());
+        Snapshot snapshot;
+        snapshot.m_generation = pIndex->m_generation;
+        for (const auto& pChunk : pIndex->m_chunks)
+        {
+            for (const BmData* const pBmData : *pChunk)
+            {
+                BmData copy;
+                if (pBmData->readConsistent(copy, nMaxRetries))
+                {
+                    snapshot.m_data.push_back(std::move(copy));
+                }
+                else
+                {
+                    snapshot.m_nSkipped++;
+                }
+            }
+        }
+        return snapshot;
+    }
 
-private:
+    /**
+    * Resets all measurement-specific data in stored benchmarkers.
+    * Does not delete any of the stored benchmarkers.
+    */
+    static void resetAll()
+    {
+        ExclusiveResources::require(ExclusiveResources::BENCHMARKERS, "ScopeBenchmarkerDataStore::resetAll()");
+        for (auto& bmData : getAllData())
+        {
+            bmData.second.reset();
+        }
+    }
+
+    /**
+    * Deletes all stored benchmarkers.
+    */
+    static void clear()
+    {
+        ExclusiveResources::require(ExclusiveResources::BENCHMARKERS, "ScopeBenchmarkerDataStore::clear()");
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
+        std::lock_guard<std::mutex> indexLock(getRegistryIndexMutex());
+        getAllData().clear();
+        getSeriesCounts().clear();
+        getGenerationRef()++;
+        auto pEmptyIndex = std::make_shared<RegistryIndex>();
+        pEmptyIndex->m_generation = getGeneration();
+        std::atomic_store(&getRegistryIndexRef(), std::shared_ptr<const RegistryIndex>(std::move(pEmptyIndex)));
+    }
+
+    /**
+    * @return Number of clear() invocations so far. Code caching references to BmData can use this to detect that the
+    *         cached references became invalid.
+    */
+    static unsigned long long getGeneration()
+    {
+        return getGenerationRef().load(std::memory_order_acquire);
+    }
+
+    /**
+    * @return Name hash of the innermost ScopeBenchmarker running in the current thread, 0 if there is none.
+    */
+    static PFL::StringHash getCurrentScope()
+    {
+        return getCurrentScopeRef();
+    }
+
+    /**
+    * Sets the number of slowest iterations (exemplars) kept for each benchmarker with context: start time, thread,
+    * tag and time spent in the direct child scopes. 0 (the default) disables exemplars.
+    * Exemplars are not included in getSnapshot(), see updateExemplars().
+    * Not cleared by clear(). Should be set when no scope is being measured.
+    */
+    static void setExemplarCapacity(size_t nExemplars)
+    {
+        getExemplarCapacityRef().store(nExemplars, std::memory_order_relaxed);
+    }
+
+    static size_t getExemplarCapacity()
+    {
+        return getExemplarCapacityRef().load(std::memory_order_relaxed);
+    }
+
+    /**
+    * Maximum number of listeners that can be added at the same time.
+    */
+    static constexpr size_t MaxListeners = 4;
+
+    /**
+    * Adds a listener to be notified by every ScopeBenchmarker about entering and leaving its scope.
+    * The caller keeps ownership of the listener.
+    *
+    * @return False if the listener cannot be added because there are already MaxListeners listeners, true otherwise.
+    */
+    static bool addListener(ScopeBenchmarkerListener* pListener)
+    {
+        for (auto& listener : getListeners())
+        {
+            ScopeBenchmarkerListener* pExpected = nullptr;
+            if (listener.compare_exchange_strong(pExpected, pListener))
+            {
+                getListenerCountRef()++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+    * Removes the given listener, then waits until the notifications already in progress in other threads finish,
+    * so the listener object can be destroyed right after.
+    * Must not be invoked from a listener callback, since that notification would be waited for.
+    */
+    static void removeListener(ScopeBenchmarkerListener* pListener)
+    {
+        // serialized, so removers don't flip the epoch for each other while waiting
+        static std::mutex s_mutex;
+        std::lock_guard<std::mutex> lock(s_mutex);
+
+        bool bRemoved = false;
+        for (auto& listener : getListeners())
+        {
+            ScopeBenchmarkerListener* pExpected = pListener;
+            if (listener.compare_exchange_strong(pExpected, nullptr))
+            {
+                getListenerCountRef()--;
+                bRemoved = true;
+            }
+        }
+        if (!bRemoved)
+        {
+            return;
+        }
+
+        // threads which might have loaded the listener are counted by the counter of the current epoch, while
+        // notifications started after the flip are counted by the other counter, so the wait is bounded
+        const size_t iEpoch = getNotifyingEpochRef().fetch_add(1) & 1;
+        while (getNotifyingCounts()[iEpoch].load() != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+protected:
+
+    /**
+    * Per-iteration state of a running ScopeBenchmarker needed for its exemplar, linked to the enclosing scope in the
+    * same thread, so child scopes can add their durations to it.
+    * Trivially constructible, so it costs nothing when exemplars are disabled: initialized by init() only when the
+    * ScopeBenchmarker keeps exemplars.
+    */
+    struct ScopeFrame
+    {
+        struct ChildDuration
+        {
+            PFL::StringHash m_nameHash;
+            Clock::Duration m_duration;
+        };
+
+        ScopeFrame* m_pParent;
+        bool m_bTagged;
+        long long m_tag;
+        size_t m_nChildren;
+        ChildDuration m_children[MaxExemplarChildren];   /**< Only the first m_nChildren are initialized. */
+        Clock::Duration m_otherChildrenDuration;        /**< Children not fitting into m_children. */
+
+        void init(ScopeFrame* pParent)
+        {
+            m_pParent = pParent;
+            m_bTagged = false;
+            m_tag = 0;
+            m_nChildren = 0;
+            m_otherChildrenDuration = Clock::Duration::zero();
+        }
+
+        void addChildDuration(const PFL::StringHash& nameHash, const Clock::Duration& duration)
+        {
+            for (size_t i = 0; i < m_nChildren; i++)
+            {
+                if (m_children[i].m_nameHash == nameHash)
+                {
+                    m_children[i].m_duration += duration;
+                    return;
+                }
+            }
+            if (m_nChildren < MaxExemplarChildren)
+            {
+                m_children[m_nChildren++] = ChildDuration{ nameHash, duration };
+            }
+            else
+            {
+                m_otherChildrenDuration += duration;
+            }
+        }
+    };
+
+    static std::atomic<size_t>& getExemplarCapacityRef()
+    {
+        static std::atomic<size_t> s_nExemplarCapacity(0);
+        return s_nExemplarCapacity;
+    }
+
+    static ScopeFrame*& getCurrentFrameRef()
+    {
+        static thread_local ScopeFrame* s_pCurrentFrame = nullptr;
+        return s_pCurrentFrame;
+    }
+
+    /**
+    * Keeps the given iteration in bmData.m_exemplars if it is one of the slowest.
+    * Invoked after BmData::endWrite() of the iteration, since exemplars are not covered by the seqlock: they are not
+    * part of getSnapshot(), and can be read only when no thread is measuring the benchmarker.
+    */
+    static void updateExemplars(
+        BmData& bmData, const size_t& nCapacity, const ScopeFrame& frame, const Clock::TimePoint& timeStart, const Clock::Duration& duration)
+    {
+        if ((bmData.m_exemplars.size() >= nCapacity) && (duration <= bmData.m_exemplars.back().m_duration))
+        {
+            return;
+        }
+
+        Exemplar exemplar;
+        exemplar.m_duration = duration;
+        exemplar.m_timeStart = timeStart;
+        exemplar.m_threadId = std::this_thread::get_id();
+        exemplar.m_bTagged = frame.m_bTagged;
+        exemplar.m_tag = frame.m_tag;
+        for (size_t i = 0; i < frame.m_nChildren; i++)
+        {
+            exemplar.m_children.emplace_back(frame.m_children[i].m_nameHash, frame.m_children[i].m_duration);
+        }
+        if (frame.m_otherChildrenDuration > Clock::Duration::zero())
+        {
+            exemplar.m_children.emplace_back(0, frame.m_otherChildrenDuration);
+        }
+        std::sort(exemplar.m_children.begin(), exemplar.m_children.end(),
+            [](const std::pair<PFL::StringHash, Clock::Duration>& a, const std::pair<PFL::StringHash, Clock::Duration>& b) {
+                return a.second > b.second;
+            });
+
+        auto it = bmData.m_exemplars.begin();
+        while ((it != bmData.m_exemplars.end()) && (it->m_duration >= duration))
+        {
+            ++it;
+        }
+        bmData.m_exemplars.insert(it, std::move(exemplar));
+        while (bmData.m_exemplars.size() > nCapacity)
+        {
+            bmData.m_exemplars.pop_back();
+        }
+    }
+
+    /**
+    * Registry index entries are stored in chunks of this size, so publishing a new entry copies at most 1 chunk.
+    */
+    static constexpr size_t RegistryIndexChunkSize = 256;
+
+    /**
+    * Immutable list of the measured benchmarkers, replaced by a modified copy whenever a benchmarker is added, so
+    * readers can iterate it while new benchmarkers are being added. Only the last chunk is copied, the others are shared.
+    */
+    struct RegistryIndex
+    {
+        unsigned long long m_generation = 0;
+        std::vector<std::shared_ptr<const std::vector<const BmData*>>> m_chunks;
+    };
+
+    /**
+    * Guards getAllData() and getSeriesCounts() for lookups and insertions. Taken before getRegistryIndexMutex() when
+    * both are needed.
+    */
+    static std::mutex& getRegistryMutex()
+    {
+        static std::mutex s_registryMutex;
+        return s_registryMutex;
+    }
+
+    /**
+    * @return Data of the given benchmarker, created with the given name if it does not exist yet. The name is set
+    *         under the registry mutex before the BmData is published to any thread, so it never changes later.
+    */
+    static BmData& findOrCreate(const PFL::StringHash& hash, const std::string& name)
+    {
+        ExclusiveResources::require(ExclusiveResources::BENCHMARKERS, "ScopeBenchmarkerDataStore::getDataByName()");
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
+        BmData& bmData = getAllData()[hash];
+        if (bmData.m_name.empty())
+        {
+            bmData.m_name = name;
+        }
+        return bmData;
+    }
+
+    /**
+    * Creates the BmData of the given labeled series with its name, base name and labels, if it does not exist yet.
+    *
+    * @return False if the series does not exist and the base name already has getMaxSeriesPerName() series, true otherwise.
+    */
+    static bool createSeries(
+        const PFL::StringHash& seriesHash,
+        const std::string& sSeriesName,
+        const std::string& baseName,
+        std::vector<std::pair<std::string, std::string>> labels)
+    {
+        ExclusiveResources::require(ExclusiveResources::BENCHMARKERS, "ScopeBenchmarkerDataStore::getSeriesHandle()");
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
+        if (getAllData().find(seriesHash) != getAllData().end())
+        {
+            return true;
+        }
+
+        size_t& nSeries = getSeriesCounts()[PFL::calcHash(baseName)];
+        if (nSeries >= getMaxSeriesPerName())
+        {
+            return false;
+        }
+        ++nSeries;
+
+        BmData& bmData = getAllData()[seriesHash];
+        bmData.m_name = sSeriesName;
+        bmData.m_baseName = baseName;
+        bmData.m_labels = std::move(labels);
+        return true;
+    }
+
+    /**
+    * Entry of the per-thread cache of getDataByNameCached(), an empty entry has nullptr m_pBmData.
+    */
+    struct ThreadCacheEntry
+    {
+        PFL::StringHash m_hash;
+        BmData* m_pBmData;
+        unsigned long long m_generation;
+    };
+
+    static constexpr size_t ThreadCacheSize = 64;   /**< Must be power of 2. */
+
+    static ThreadCacheEntry* getThreadCache()
+    {
+        // trivial type, so the thread_local is zero-initialized without any per-thread initialization code
+        static thread_local ThreadCacheEntry s_threadCache[ThreadCacheSize];
+        return s_threadCache;
+    }
+
+    /**
+    * Same as findOrCreate(), but takes the registry mutex only if the BmData is not in the direct-mapped cache of the
+    * current thread, i.e. on the first use of the name in the thread since the last clear(), or on hash collision.
+    */
+    static BmData& getDataByNameCached(const PFL::StringHash& hash, const std::string& name)
+    {
+        const unsigned long long generation = getGeneration();
+        ThreadCacheEntry& entry = getThreadCache()[hash & (ThreadCacheSize - 1)];
+        if (entry.m_pBmData && (entry.m_hash == hash) && (entry.m_generation == generation))
+        {
+            return *entry.m_pBmData;
+        }
+
+        // a clear() since reading the generation is detected by the next lookup, since the entry has the older generation
+        BmData& bmData = findOrCreate(hash, name);
+        entry.m_hash = hash;
+        entry.m_pBmData = &bmData;
+        entry.m_generation = generation;
+        return bmData;
+    }
+
+    static std::shared_ptr<const RegistryIndex>& getRegistryIndexRef()
+    {
+        // accessed only by std::atomic_load() and std::atomic_store()
+        static std::shared_ptr<const RegistryIndex> s_pRegistryIndex = std::make_shared<RegistryIndex>();
+        return s_pRegistryIndex;
+    }
+
+    /**
+    * Serializes writers of the registry index, readers do not lock it.
+    */
+    static std::mutex& getRegistryIndexMutex()
+    {
+        static std::mutex s_registryIndexMutex;
+        return s_registryIndexMutex;
+    }
+
+    /**
+    * Invoked by the first BmData::endWrite() of the given BmData, so at most once per benchmarker.
+    */
+    static void addToRegistryIndex(const BmData& bmData)
+    {
+        std::lock_guard<std::mutex> lock(getRegistryIndexMutex());
+        auto pIndex = std::make_shared<RegistryIndex>(*std::atomic_load(&getRegistryIndexRef()));
+        if (pIndex->m_chunks.empty() || (pIndex->m_chunks.back()->size() == RegistryIndexChunkSize))
+        {
+            auto pChunk = std::make_shared<std::vector<const BmData*>>();
+            pChunk->reserve(RegistryIndexChunkSize);
+            pChunk->push_back(&bmData);
+            pIndex->m_chunks.push_back(std::move(pChunk));
+        }
+        else
+        {
+            auto pChunk = std::make_shared<std::vector<const BmData*>>(*pIndex->m_chunks.back());
+            pChunk->push_back(&bmData);
+            pIndex->m_chunks.back() = std::move(pChunk);
+        }
+        std::atomic_store(&getRegistryIndexRef(), std::shared_ptr<const RegistryIndex>(std::move(pIndex)));
+    }
+
+    static std::atomic<size_t>& getMaxSeriesPerNameRef()
+    {
+        static std::atomic<size_t> s_nMaxSeriesPerName(256);
+        return s_nMaxSeriesPerName;
+    }
+
+    /**
+    * @return Number of labeled series by hash of benchmarker name, for bounding cardinality in getSeriesHandle().
+    */
+    static std::map<PFL::StringHash, size_t>& getSeriesCounts()
+    {
+        static std::map<PFL::StringHash, size_t> s_seriesCounts;
+        return s_seriesCounts;
+    }
+
+    static NameTable::Handle getOverflowSeriesHandle(const std::string& baseName)
+    {
+        NameBuilder overflowName;
+        overflowName << baseName << '{' << getOverflowLabelKey() << "=true}";
+        const NameTable::Handle overflowHandle = overflowName.intern();
+        {
+            ExclusiveResources::require(ExclusiveResources::BENCHMARKERS, "ScopeBenchmarkerDataStore::getSeriesHandle()");
+            std::lock_guard<std::mutex> lock(getRegistryMutex());
+            BmData& bmData = getAllData()[NameTable::getNameHash(overflowHandle)];
+            if (bmData.m_name.empty())
+            {
+                bmData.m_name = NameTable::getName(overflowHandle);
+                bmData.m_baseName = baseName;
+                bmData.m_labels = { std::make_pair(std::string(getOverflowLabelKey()), std::string("true")) };
+            }
+        }
+        getDataByNameHandle(overflowHandle);
+        return overflowHandle;
+    }
+
+    static std::string escapeCsv(const std::string& s)
+    {
+        if (s.find_first_of(",\"\n") == std::string::npos)
+        {
+            return s;
+        }
+        std::string sEscaped = "\"";
+        for (const char c : s)
+        {
+            sEscaped += (c == '"') ? std::string("\"\"") : std::string(1, c);
+        }
+        return sEscaped + "\"";
+    }
+
+    static std::atomic<unsigned long long>& getGenerationRef()
+    {
+        static std::atomic<unsigned long long> s_generation(0);
+        return s_generation;
+    }
+
+    static PFL::StringHash& getCurrentScopeRef()
+    {
+        static thread_local PFL::StringHash s_currentScope = 0;
+        return s_currentScope;
+    }
+
+    /**
+    * @return Slots of listeners, nullptr is an empty slot.
+    */
+    static std::array<std::atomic<ScopeBenchmarkerListener*>, MaxListeners>& getListeners()
+    {
+        // zero-initialized since it has static storage duration
+        static std::array<std::atomic<ScopeBenchmarkerListener*>, MaxListeners> s_listeners;
+        return s_listeners;
+    }
+
+    /**
+    * Number of non-empty slots of getListeners(), so notifying costs a single load when there is no listener.
+    */
+    static std::atomic<size_t>& getListenerCountRef()
+    {
+        static std::atomic<size_t> s_nListeners(0);
+        return s_nListeners;
+    }
+
+    /**
+    * Counters of the threads notifying listeners, indexed by the epoch flipped by removeListener().
+    */
+    static std::array<std::atomic<size_t>, 2>& getNotifyingCounts()
+    {
+        // zero-initialized since it has static storage duration
+        static std::array<std::atomic<size_t>, 2> s_nNotifying;
+        return s_nNotifying;
+    }
+
+    static std::atomic<size_t>& getNotifyingEpochRef()
+    {
+        static std::atomic<size_t> s_iEpoch(0);
+        return s_iEpoch;
+    }
+
+    /**
+    * Counts the current thread as notifying listeners during its lifetime, see removeListener().
+    * Listener slots must be loaded with sequentially consistent ordering after construction.
+    */
+    class NotifyingGuard
+    {
+    public:
+
+        NotifyingGuard() :
+            m_nNotifying(getNotifyingCounts()[getNotifyingEpochRef().load() & 1])
+        {
+            m_nNotifying.fetch_add(1);
+        }
+
+        ~NotifyingGuard()
+        {
+            m_nNotifying.fetch_sub(1, std::memory_order_release);
+        }
+
+        NotifyingGuard(const NotifyingGuard&) = delete;
+        NotifyingGuard& operator=(const NotifyingGuard&) = delete;
+
+    private:
+
+        std::atomic<size_t>& m_nNotifying;
+    };
+
+    /**
+    * Invoked before the start time of the scope is taken, so the time passed to the listeners is taken here, only if
+    * there is any listener.
+    */
+    static void notifyScopeEnter(const PFL::StringHash& nameHash)
+    {
+        if (getListenerCountRef().load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+
+        const NotifyingGuard notifying;
+        bool bTimeTaken = false;
+        Clock::TimePoint timeStart;
+        for (auto& listener : getListeners())
+        {
+            ScopeBenchmarkerListener* const pListener = listener.load();
+            if (pListener)
+            {
+                if (!bTimeTaken)
+                {
+                    timeStart = Clock::now();
+                    bTimeTaken = true;
+                }
+                pListener->onScopeEnter(nameHash, timeStart);
+            }
+        }
+    }
+
+    static void notifyScopeExit(const PFL::StringHash& nameHash, const Clock::TimePoint& timeStart, const Clock::TimePoint& timeEnd)
+    {
+        if (getListenerCountRef().load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+
+        const NotifyingGuard notifying;
+        for (auto& listener : getListeners())
+        {
+            ScopeBenchmarkerListener* const pListener = listener.load();
+            if (pListener)
+            {
+                pListener->onScopeExit(nameHash, timeStart, timeEnd);
+            }
+        }
+    }
+
+    static void notifyFlowEvent(
+        const PFL::StringHash& nameHash, unsigned long long flowId, ScopeBenchmarkerListener::FlowEventType type, const Clock::TimePoint& time)
+    {
+        if (getListenerCountRef().load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+
+        const NotifyingGuard notifying;
+        for (auto& listener : getListeners())
+        {
+            ScopeBenchmarkerListener* const pListener = listener.load();
+            if (pListener)
+            {
+                pListener->onFlowEvent(nameHash, flowId, type, time);
+            }
+        }
+    }
+};
+
+
+/**
+* Basic header-only scope benchmarker class to conveniently stopwatch a scope (code block).
+*
+* The template parameter DurationType should be the time measurement unit, e.g. std::chrono::milliseconds.
+* Note that DurationType shall be fine-grained enough to properly measure min/max/avg/total values.
+* For example, if you specify std::chrono::seconds, but your measured code always finishes within milliseconds,
+* it won't be properly measured, so you should use std::chrono::milliseconds or std::chrono::macroseconds.
+* 
+* Time is taken by Clock::now(), so scopes are measured in virtual time when a VirtualClock is installed.
+* Benchmarkers of the same name must not run in multiple threads at the same time, see BmData::beginWrite().
+* Entering and leaving the scope is also reported to the listeners added by addListener(), e.g. to a FlightRecorder,
+* and optionally to external tracing tools by USDT probes, see UsdtProbes.h.
+*
+* Improvement idea: durations should be always measured in macro- or nanoseconds, and then those values should be
+* converted to DurationType upon evaluating the results, this way the user could specify arbitrary DurationType, the
+* measurements would stay precise.
+* 
+* For example usage, see Benchmarks.cpp.
+*/
+template <typename DurationType>
+class ScopeBenchmarker : public ScopeBenchmarkerDataStore
+{
+public:
+
+    static_assert(std::chrono::_Is_duration_v<DurationType>, "DurationType template argument must be of std::duration!");
+    ScopeBenchmarker(const std::string& name)
+    {
+        if (name.empty())
+        {
+            throw std::runtime_error("ScopeBenchmarker ctor: name cannot be empty!");
+        }
+
+        m_nameHash = PFL::calcHash(name);
+        // string is copied only when the BmData is created: hash already provides uniqueness so an existing BmData
+        // already has our input name (SelfBenchmarks name_length results dropped by this)
+        m_pBmData = &getDataByNameCached(m_nameHash, name);
+        enterScope();
+    }
+
+    /**
+    * Constructs a benchmarker measuring the series of the given name with the given labels, see BenchmarkLabels.
+    * Once the series exists, the series name is built and looked up without heap allocation.
+    */
+    ScopeBenchmarker(const std::string& name, const BenchmarkLabels& labels) :
+        ScopeBenchmarker(getSeriesHandle(name, labels))
+    {
+    }
+
+    ScopeBenchmarker(const NameTable::Handle& nameHandle, const BenchmarkLabels& labels) :
+        ScopeBenchmarker(getSeriesHandle(nameHandle, labels))
+    {
+    }
+
+    /**
+    * Constructs a benchmarker with a name interned into NameTable, e.g. by NameBuilder, so the name is neither hashed
+    * nor copied and its BmData is usually found without map lookup: no heap traffic after the first use of the name.
+    */
+    ScopeBenchmarker(const NameTable::Handle& nameHandle)
+    {
+        m_nameHash = NameTable::getNameHash(nameHandle);
+        m_pBmData = &getDataByNameHandle(nameHandle);
+        enterScope();
+    }
+
+    ~ScopeBenchmarker()
+    {
+        const auto timeEndScope = Clock::now();
+        const auto thisDurationCount = std::chrono::duration_cast<DurationType>(timeEndScope - m_timeStartScope).count();
+        // clear() during the scope (e.g. by Benchmark::preSetUp() of a nested test) deleted the cached BmData, and the
+        // iteration counted by ctor was deleted with it, so this measurement is dropped
+        const bool bDataValid = getGeneration() == m_generation;
+        if (bDataValid)
+        {
+            recordDuration(*m_pBmData, timeEndScope, thisDurationCount);
+        }
+
+        notifyScopeExit(m_nameHash, m_timeStartScope, timeEndScope);
+        SCOPEBENCHMARKER_PROBE_EXIT(m_nameHash, bDataValid ? m_pBmData->m_name.c_str() : "",
+            std::chrono::duration_cast<std::chrono::nanoseconds>(timeEndScope - m_timeStartScope).count());
+        getCurrentScopeRef() = m_parentScopeHash;
+        if (m_nExemplarCapacity > 0)
+        {
+            if (m_frame.m_pParent)
+            {
+                m_frame.m_pParent->addChildDuration(m_nameHash, timeEndScope - m_timeStartScope);
+            }
+            getCurrentFrameRef() = m_frame.m_pParent;
+        }
+    }
+
+    // the current frame of the thread points to m_frame, so a copied or moved benchmarker would leave it dangling
+    ScopeBenchmarker(const ScopeBenchmarker&) = delete;
+    ScopeBenchmarker& operator=(const ScopeBenchmarker&) = delete;
+    ScopeBenchmarker(ScopeBenchmarker&&) = delete;
+    ScopeBenchmarker& operator=(ScopeBenchmarker&&) = delete;
+
+    /**
+    * Attaches a value describing this iteration (e.g. entity count, packet size) to its exemplar, see setExemplarCapacity().
+    */
+    void setTag(long long tag)
+    {
+        if (m_nExemplarCapacity > 0)
+        {
+            m_frame.m_bTagged = true;
+            m_frame.m_tag = tag;
+        }
+    }
+
+private:
+
+    /**
+    * Adds the duration of the finished iteration to the given BmData and its exemplars.
+    */
+    void recordDuration(BmData& bmData, const Clock::TimePoint& timeEndScope, const typename DurationType::rep& thisDurationCount)
+    {
+        bmData.beginWrite();
+        bmData.m_durationsTotal += thisDurationCount;
+        assert(bmData.m_durationsTotal >= 0);
+        
+        // dtor cannot throw
+        //if (bmData.m_durationsTotal <= 0)
+        //{
+        //    throw std::runtime_error("ScopeBenchmarker dtor: m_durationsTotal overflew!");
+        //}
+
+        if (thisDurationCount < bmData.m_durationsMin)
+        {
+            bmData.m_durationsMin = thisDurationCount;
+        }
+        if (thisDurationCount > bmData.m_durationsMax)
+        {
+            bmData.m_durationsMax = thisDurationCount;
+        }
+
+        if ((bmData.m_budget > Clock::Duration::zero()) && (timeEndScope - m_timeStartScope > bmData.m_budget))
+        {
+            ++bmData.m_budgetExceededCount;
+            if (bmData.m_pBudgetExceededCounter)
+            {
+                bmData.m_pBudgetExceededCounter->fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        bmData.endWrite();
+
+        if (m_nExemplarCapacity > 0)
+        {
+            updateExemplars(bmData, m_nExemplarCapacity, m_frame, m_timeStartScope, timeEndScope - m_timeStartScope);
+        }
+    }
+
+    /**
+    * Common part of the ctors, after m_nameHash and m_pBmData are set.
+    */
+    void enterScope()
+    {
+        m_generation = getGeneration();
+        m_pBmData->beginWrite();
+        m_pBmData->m_iterations++;
+        m_pBmData->m_ratioDenominator = DurationType::period::den;
+        m_pBmData->endWrite();
+        assert(m_pBmData->m_iterations > 0);
+        if (m_pBmData->m_iterations <= 0)
+        {
+            throw std::runtime_error("ScopeBenchmarker ctor: m_iterations overflew!");
+        }
+
+        m_parentScopeHash = getCurrentScopeRef();
+        getCurrentScopeRef() = m_nameHash;
+        // the frame is touched only if exemplars are kept
+        m_nExemplarCapacity = getExemplarCapacity();
+        if (m_nExemplarCapacity > 0)
+        {
+            m_frame.init(getCurrentFrameRef());
+            getCurrentFrameRef() = &m_frame;
+        }
+        // listeners are notified before taking the start time, so their cost is not measured
+        notifyScopeEnter(m_nameHash);
+        SCOPEBENCHMARKER_PROBE_ENTER(m_nameHash, m_pBmData->m_name.c_str());
+        m_timeStartScope = Clock::now();
+    }
 
     PFL::StringHash m_nameHash;                                              /**< Key to ScopeBenchmarkerDataStore::getAllData(). */
+    BmData* m_pBmData;                                                       /**< Found in ctor, so dtor does not look it up again. Valid until
+                                                                                  ScopeBenchmarkerDataStore::clear(). */
+    unsigned long long m_generation;                                         /**< ScopeBenchmarkerDataStore::getGeneration() when m_pBmData was found. */
+    PFL::StringHash m_parentScopeHash;                                       /**< Enclosing scope in the same thread, restored as current scope by dtor. */
+    size_t m_nExemplarCapacity;                                              /**< getExemplarCapacity() when entering the scope, m_frame is used only if non-0. */
+    ScopeFrame m_frame;                                                      /**< Collects tag and child scope durations for exemplars. */
     std::chrono::time_point<std::chrono::steady_clock> m_timeStartScope;     /**< Timestamp of scope beginning. */
 };
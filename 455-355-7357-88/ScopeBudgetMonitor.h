@@ -0,0 +1,330 @@
+#pragma once
+
+/*
+    ###################################################################################
+    ScopeBudgetMonitor.h
+    Basic header-only monitor of ScopeBenchmarker latency budgets with alarm callbacks.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <atomic>              // requires cpp11
+#include <chrono>              // requires cpp11
+#include <condition_variable>  // requires cpp11
+#include <deque>
+#include <functional>          // requires cpp11
+#include <memory>              // requires cpp11
+#include <mutex>               // requires cpp11
+#include <stdexcept>
+#include <string>
+#include <thread>              // requires cpp11
+#include <utility>
+#include <vector>
+
+#include "Clock.h"
+#include "ScopeBenchmarker.h"
+
+/**
+* Latency budgets attached to ScopeBenchmarker names, with alarm callbacks invoked when a budget is exceeded
+* k times within a time window, so the application can react (log, shed load, downgrade quality, etc.).
+*
+* The hot path stays cheap: the ScopeBenchmarker dtor only compares the scope duration to BmData::m_budget and on
+* exceeding it increments BmData::m_budgetExceededCount and an atomic counter shared with the monitor.
+* Counting exceedances within the window and invoking the callbacks is deferred to the monitor thread (see start()),
+* which polls the counters, so the time of exceedances is known with the precision of the poll interval.
+* Alternatively, poll() can be invoked manually, e.g. once per frame, without starting the monitor thread.
+*
+* Time is taken by Clock::now() so windows are evaluated in virtual time when a VirtualClock is installed.
+*
+* Budgets are stored in the BmData of ScopeBenchmarkerDataStore, so they are lost when the data store is cleared,
+* e.g. by Benchmark before each test: use applyBudgets() after clearing the data store to attach the budgets again.
+* Same as ScopeBenchmarkerDataStore, setBudget() and applyBudgets() are not thread-safe.
+*
+* Example:
+*
+*     ScopeBudgetMonitor budgetMonitor;
+*     budgetMonitor.setBudget("handleRequest", std::chrono::milliseconds(20), 5, std::chrono::seconds(10),
+*         [](const ScopeBudgetMonitor::Alarm& alarm) { shedLoad(); });
+*     budgetMonitor.start();
+*/
+class ScopeBudgetMonitor
+{
+public:
+
+    /**
+    * Passed to the callback when a budget was exceeded at least k times within the window.
+    */
+    struct Alarm
+    {
+        std::string m_sName;                    /**< Name of the ScopeBenchmarker. */
+        Clock::Duration m_budget;
+        Clock::Duration m_window;
+        unsigned int m_nExceededInWindow;       /**< At least k. */
+        long long m_nExceededTotal;             /**< Since the budget was set. */
+        Clock::TimePoint m_time;                /**< Time of detection by the monitor. */
+    };
+
+    typedef std::function<void(const Alarm&)> AlarmCallback;
+
+    /**
+    * @param pollInterval Interval of the monitor thread checking the counters.
+    */
+    ScopeBudgetMonitor(const std::chrono::milliseconds& pollInterval = std::chrono::milliseconds(100)) :
+        m_pollInterval(pollInterval)
+    {
+        if (pollInterval <= std::chrono::milliseconds::zero())
+        {
+            throw std::runtime_error("ScopeBudgetMonitor ctor: pollInterval must be positive!");
+        }
+    }
+
+    virtual ~ScopeBudgetMonitor()
+    {
+        stop();
+    }
+
+    ScopeBudgetMonitor(const ScopeBudgetMonitor&) = delete;
+    ScopeBudgetMonitor& operator=(const ScopeBudgetMonitor&) = delete;
+    ScopeBudgetMonitor(ScopeBudgetMonitor&&) = delete;
+    ScopeBudgetMonitor& operator=(ScopeBudgetMonitor&&) = delete;
+
+    /**
+    * Attaches a latency budget to the given ScopeBenchmarker name, replacing its previous budget if any.
+    *
+    * @param sName     Name of the ScopeBenchmarker.
+    * @param budget    Scopes taking longer than this exceed the budget. Must be positive.
+    * @param k         Number of exceedances within the window for invoking the callback. Must be positive.
+    * @param window    Length of the sliding window.
+    * @param callback  Invoked by the monitor thread or by poll(). After invoking, the window starts again empty, so
+    *                  the callback is invoked again only after another k exceedances.
+    */
+    void setBudget(
+        const std::string& sName, const Clock::Duration& budget, unsigned int k, const Clock::Duration& window, AlarmCallback callback)
+    {
+        if (sName.empty())
+        {
+            throw std::runtime_error("ScopeBudgetMonitor::setBudget(): name cannot be empty!");
+        }
+        if ((budget <= Clock::Duration::zero()) || (k == 0))
+        {
+            throw std::runtime_error("ScopeBudgetMonitor::setBudget(): budget and k must be positive!");
+        }
+
+        std::shared_ptr<Budget> pBudget(new Budget());
+        pBudget->m_sName = sName;
+        pBudget->m_budget = budget;
+        pBudget->m_k = k;
+        pBudget->m_window = window;
+        pBudget->m_callback = std::move(callback);
+        pBudget->m_pExceededCounter = std::make_shared<std::atomic<long long>>(0);
+
+        {
+            std::lock_guard<std::mutex> lock(m_budgetsMutex);
+            bool bReplaced = false;
+            for (auto& pExistingBudget : m_budgets)
+            {
+                if (pExistingBudget->m_sName == sName)
+                {
+                    pExistingBudget = pBudget;
+                    bReplaced = true;
+                }
+            }
+            if (!bReplaced)
+            {
+                m_budgets.push_back(pBudget);
+            }
+        }
+
+        applyBudget(*pBudget);
+    }
+
+    /**
+    * Detaches the budget from the given ScopeBenchmarker name.
+    */
+    void removeBudget(const std::string& sName)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_budgetsMutex);
+            for (auto it = m_budgets.begin(); it != m_budgets.end(); ++it)
+            {
+                if ((*it)->m_sName == sName)
+                {
+                    m_budgets.erase(it);
+                    break;
+                }
+            }
+        }
+
+        auto& bmData = ScopeBenchmarkerDataStore::getDataByName(sName);
+        bmData.m_budget = Clock::Duration::zero();
+        bmData.m_pBudgetExceededCounter.reset();
+    }
+
+    /**
+    * Attaches all budgets again to the BmData in ScopeBenchmarkerDataStore, e.g. after the data store was cleared.
+    */
+    void applyBudgets()
+    {
+        std::lock_guard<std::mutex> lock(m_budgetsMutex);
+        for (const auto& pBudget : m_budgets)
+        {
+            applyBudget(*pBudget);
+        }
+    }
+
+    /**
+    * Starts the monitor thread invoking poll() periodically.
+    */
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        if (m_thread.joinable())
+        {
+            return;
+        }
+        m_bStopRequested = false;
+        m_thread = std::thread([this]() {
+            std::unique_lock<std::mutex> lock(m_threadMutex);
+            while (!m_threadCv.wait_for(lock, m_pollInterval, [this]() { return m_bStopRequested; }))
+            {
+                lock.unlock();
+                poll();
+                lock.lock();
+            }
+        });
+    }
+
+    /**
+    * Stops the monitor thread. Callbacks are not invoked after this returns, unless poll() is invoked manually.
+    */
+    void stop()
+    {
+        std::thread thread;
+        {
+            std::lock_guard<std::mutex> lock(m_threadMutex);
+            m_bStopRequested = true;
+            thread = std::move(m_thread);
+        }
+        m_threadCv.notify_all();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    /**
+    * Checks the counters of the budgets and invokes the callbacks of the budgets exceeded k times within their window.
+    * Invoked periodically by the monitor thread, but can be invoked manually too.
+    */
+    void poll()
+    {
+        const Clock::TimePoint timeNow = Clock::now();
+
+        std::vector<std::pair<std::shared_ptr<Budget>, Alarm>> alarms;
+        {
+            std::lock_guard<std::mutex> lock(m_budgetsMutex);
+            for (const auto& pBudget : m_budgets)
+            {
+                Budget& budget = *pBudget;
+                const long long nExceededTotal = budget.m_pExceededCounter->load(std::memory_order_relaxed);
+                if (nExceededTotal > budget.m_nLastSeenExceeded)
+                {
+                    budget.m_history.push_back(std::make_pair(timeNow, nExceededTotal - budget.m_nLastSeenExceeded));
+                    budget.m_nExceededInWindow += nExceededTotal - budget.m_nLastSeenExceeded;
+                    budget.m_nLastSeenExceeded = nExceededTotal;
+                }
+                while (!budget.m_history.empty() && (budget.m_history.front().first < timeNow - budget.m_window))
+                {
+                    budget.m_nExceededInWindow -= budget.m_history.front().second;
+                    budget.m_history.pop_front();
+                }
+
+                if (budget.m_nExceededInWindow >= budget.m_k)
+                {
+                    alarms.push_back(std::make_pair(pBudget, Alarm{
+                        budget.m_sName, budget.m_budget, budget.m_window,
+                        static_cast<unsigned int>(budget.m_nExceededInWindow), nExceededTotal, timeNow }));
+                    budget.m_history.clear();
+                    budget.m_nExceededInWindow = 0;
+                    ++budget.m_nAlarms;
+                }
+            }
+        }
+
+        // callbacks are invoked without holding the lock, so they can use this monitor
+        for (const auto& alarm : alarms)
+        {
+            if (alarm.first->m_callback)
+            {
+                alarm.first->m_callback(alarm.second);
+            }
+        }
+    }
+
+    /**
+    * @return Number of exceedances of the budget of the given name since the budget was set, 0 if there is no such budget.
+    */
+    long long getExceededCount(const std::string& sName) const
+    {
+        std::lock_guard<std::mutex> lock(m_budgetsMutex);
+        const Budget* const pBudget = findBudget(sName);
+        return pBudget ? pBudget->m_pExceededCounter->load(std::memory_order_relaxed) : 0;
+    }
+
+    /**
+    * @return Number of alarms raised for the budget of the given name, 0 if there is no such budget.
+    */
+    unsigned int getAlarmCount(const std::string& sName) const
+    {
+        std::lock_guard<std::mutex> lock(m_budgetsMutex);
+        const Budget* const pBudget = findBudget(sName);
+        return pBudget ? pBudget->m_nAlarms : 0;
+    }
+
+private:
+
+    struct Budget
+    {
+        std::string m_sName;
+        Clock::Duration m_budget;
+        unsigned int m_k;
+        Clock::Duration m_window;
+        AlarmCallback m_callback;
+        std::shared_ptr<std::atomic<long long>> m_pExceededCounter;    /**< Shared with BmData::m_pBudgetExceededCounter. */
+        long long m_nLastSeenExceeded = 0;
+        long long m_nExceededInWindow = 0;
+        std::deque<std::pair<Clock::TimePoint, long long>> m_history;   /**< Poll time and number of new exceedances. */
+        unsigned int m_nAlarms = 0;
+    };
+
+    const std::chrono::milliseconds m_pollInterval;
+
+    mutable std::mutex m_budgetsMutex;
+    std::vector<std::shared_ptr<Budget>> m_budgets;
+
+    std::mutex m_threadMutex;
+    std::condition_variable m_threadCv;
+    bool m_bStopRequested = false;
+    std::thread m_thread;
+
+    static void applyBudget(const Budget& budget)
+    {
+        auto& bmData = ScopeBenchmarkerDataStore::getDataByName(budget.m_sName);
+        bmData.m_budget = budget.m_budget;
+        bmData.m_pBudgetExceededCounter = budget.m_pExceededCounter;
+    }
+
+    const Budget* findBudget(const std::string& sName) const
+    {
+        for (const auto& pBudget : m_budgets)
+        {
+            if (pBudget->m_sName == sName)
+            {
+                return pBudget.get();
+            }
+        }
+        return nullptr;
+    }
+};
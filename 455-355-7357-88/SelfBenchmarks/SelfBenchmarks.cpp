@@ -0,0 +1,466 @@
+/*
+    ###############################################
+    SelfBenchmarks.cpp
+    Benchmarks of the framework's own hot paths: ScopeBenchmarker enter/exit and its seqlock, passing assertions, Test::run().
+    Results are compared to the baseline committed next to this file (SelfBenchmarks_Release.baseline, SelfBenchmarks_Debug.baseline)
+    so framework changes cannot regress instrumentation overhead unnoticed: a result slower than the tolerance fails the benchmark.
+    Results are normalized by the reference workload score stored in the baseline, so the baseline can be shared by different machines.
+    Command line:
+     --update-baseline                 overwrite the baseline file with the current results;
+     --baseline-tolerance-percent=N    allowed slowdown compared to the baseline, default 25.
+    Made by PR00F88
+    2024
+    ################################################
+*/
+
+// need to define this macro so we can use Test::runTests() with Console lib
+#ifndef TEST_WITH_CCONSOLE
+#define TEST_WITH_CCONSOLE
+#endif
+#include "Benchmarks.h"
+#include "BenchmarkBaseline.h"
+#include "ReferenceWorkload.h"
+
+#include <algorithm>
+#include <atomic>    // requires cpp11
+#include <cmath>
+#include <cstdlib>   // atof()
+#include <memory>    // for std::unique_ptr; requires cpp11
+#include <thread>    // requires cpp11
+
+#include "UnitTest.h"
+#include "winproof88.h"  // part of PFL lib: https://github.com/proof88/PFL
+
+static CConsole& getConsole()
+{
+    return CConsole::getConsoleInstance();
+}
+
+/**
+* Minimal unit tests for measuring the per-test overhead of Test::run().
+*/
+class EmptyUnitTest :
+    public UnitTest
+{
+public:
+
+    EmptyUnitTest(int nSubTests) : UnitTest(__FILE__)
+    {
+        for (int i = 0; i < nSubTests; i++)
+        {
+            addSubTest("test_empty", (PFNUNITSUBTEST)&EmptyUnitTest::test_empty);
+        }
+    }
+
+private:
+
+    bool test_empty()
+    {
+        return true;
+    }
+}; // class EmptyUnitTest
+
+
+class FrameworkSelfBenchmark :
+    public Benchmark
+{
+public:
+
+    FrameworkSelfBenchmark(bool bUpdateBaseline, double baselineTolerance) :
+        Benchmark(__FILE__, ""),
+        m_baseline(getBaselineFilename(), baselineTolerance),
+        m_bUpdateBaseline(bUpdateBaseline)
+    {
+        // results are rounded to 0.1 ns and the cheapest operations take about 1 ns, so their relative noise is huge
+        m_baseline.setMinDelta(1.0);
+    }
+
+    FrameworkSelfBenchmark(const FrameworkSelfBenchmark&) = delete;
+    FrameworkSelfBenchmark& operator=(const FrameworkSelfBenchmark&) = delete;
+    FrameworkSelfBenchmark(FrameworkSelfBenchmark&&) = delete;
+    FrameworkSelfBenchmark& operator=(FrameworkSelfBenchmark&&) = delete;
+
+protected:
+
+    virtual void initialize() override
+    {
+        m_bBaselineChanged = false;
+        m_bWarnedNoReferenceScore = false;
+        if (m_baseline.load())
+        {
+            addToInfoMessages(("  Baseline: " + m_baseline.getFilename()).c_str());
+        }
+        else
+        {
+            addToInfoMessages(("  Baseline " + m_baseline.getFilename() + " not found, it will be created.").c_str());
+        }
+
+        addSubTest("bench_scope_benchmarker_name_length", (PFNUNITSUBTEST)&FrameworkSelfBenchmark::bench_scope_benchmarker_name_length);
+        addSubTest("bench_scope_benchmarker_registry_size", (PFNUNITSUBTEST)&FrameworkSelfBenchmark::bench_scope_benchmarker_registry_size);
+        addSubTest("bench_scope_benchmarker_dynamic_names", (PFNUNITSUBTEST)&FrameworkSelfBenchmark::bench_scope_benchmarker_dynamic_names);
+        addSubTest("bench_scope_benchmarker_threads", (PFNUNITSUBTEST)&FrameworkSelfBenchmark::bench_scope_benchmarker_threads);
+        addSubTest("bench_scope_benchmarker_seqlock", (PFNUNITSUBTEST)&FrameworkSelfBenchmark::bench_scope_benchmarker_seqlock);
+        addSubTest("bench_passing_assertions", (PFNUNITSUBTEST)&FrameworkSelfBenchmark::bench_passing_assertions);
+        addSubTest("bench_test_run", (PFNUNITSUBTEST)&FrameworkSelfBenchmark::bench_test_run);
+    }
+
+    virtual void tearDown() override
+    {
+        // we are measuring ScopeBenchmarker itself, Benchmark::postTearDown() should not print the thousands of benchmarkers
+        ScopeBenchmarkerDataStore::clear();
+    }
+
+    virtual void finalize() override
+    {
+        if (m_bBaselineChanged)
+        {
+            m_baseline.save();
+            addToInfoMessages(("  Baseline saved: " + m_baseline.getFilename()).c_str());
+        }
+    }
+
+private:
+
+    static constexpr int nMeasurementRounds = 15;
+
+    BenchmarkBaseline m_baseline;
+    bool m_bUpdateBaseline;
+    bool m_bBaselineChanged = false;
+    bool m_bWarnedNoReferenceScore = false;
+
+    /**
+    * The baselines are committed next to this source file, so they are found regardless of the working directory,
+    * and --update-baseline overwrites the committed file.
+    */
+    static std::string getBaselineFilename()
+    {
+        const std::string sSourcePath = __FILE__;
+        const size_t iSeparator = sSourcePath.find_last_of("/\\");
+        const std::string sDir = (iSeparator == std::string::npos) ? "" : sSourcePath.substr(0, iSeparator + 1);
+        // Debug and Release builds perform very differently, so they need separate baselines
+#ifdef NDEBUG
+        return sDir + "SelfBenchmarks_Release.baseline";
+#else
+        return sDir + "SelfBenchmarks_Debug.baseline";
+#endif
+    }
+
+    /**
+    * Runs func(i) for i in [0, nIterations) in multiple rounds and returns the per-iteration duration of the fastest round.
+    * Real time is used here on purpose instead of Clock::now(), since an installed virtual clock would hide the costs.
+    */
+    template <typename Func>
+    static double measureNsPerOp(long long nIterations, Func func)
+    {
+        double minNsPerOp = -1.0;
+        for (int iRound = 0; iRound < nMeasurementRounds; iRound++)
+        {
+            const auto timeStart = std::chrono::steady_clock::now();
+            for (long long i = 0; i < nIterations; i++)
+            {
+                func(i);
+            }
+            const double nsPerOp =
+                std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - timeStart).count() / nIterations;
+            if ((minNsPerOp < 0.0) || (nsPerOp < minNsPerOp))
+            {
+                minNsPerOp = nsPerOp;
+            }
+        }
+        return minNsPerOp;
+    }
+
+    /**
+    * Prints the result and compares it to the baseline, after scaling it by the reference workload scores of this
+    * machine and the baseline machine, so the baseline can be shared by different machines.
+    * The reference score of an existing baseline is only set with --update-baseline, without a score there is no scaling.
+    * @return False if the result regressed compared to the baseline, true otherwise.
+    */
+    bool reportResult(const std::string& name, double nsPerOp)
+    {
+        const ReferenceWorkload::Score& referenceScore = ReferenceWorkload::getScore();
+        if (m_bUpdateBaseline || m_baseline.getValues().empty())
+        {
+            // values of a new or updated baseline are measured on this machine, so they belong to its reference score
+            m_baseline.setReferenceScore(referenceScore.m_fNs);
+            m_bBaselineChanged = true;
+        }
+        else if ((m_baseline.getReferenceScore() == 0.0) && !m_bWarnedNoReferenceScore)
+        {
+            // the machine of an older baseline is unknown, stamping the current score into it would normalize wrong forever
+            addToInfoMessages(("  WARNING: baseline " + m_baseline.getFilename() + " has no reference score, results are compared " +
+                "without normalization, rerun with --update-baseline on the baseline machine to add it.").c_str());
+            m_bWarnedNoReferenceScore = true;
+        }
+
+        const double nsPerOpRounded = std::round(nsPerOp * 10.0) / 10.0;
+        const double nsPerOpNormalized = std::round(m_baseline.normalize(nsPerOp, referenceScore.m_fNs) * 10.0) / 10.0;
+        const BenchmarkBaseline::Result result = m_baseline.compare(name, nsPerOpNormalized);
+
+        std::string sLine = "    " + name + ": " + toString(nsPerOpRounded) + " ns/op";
+        if (nsPerOpNormalized != nsPerOpRounded)
+        {
+            sLine += ", normalized to baseline machine: " + toString(nsPerOpNormalized) + " ns/op";
+        }
+        if (result != BenchmarkBaseline::Result::New)
+        {
+            sLine += " (baseline: " + toString(m_baseline.get(name)) + " ns/op, " + BenchmarkBaseline::getResultString(result) + ")";
+        }
+        addToInfoMessages(sLine.c_str());
+
+        if (m_bUpdateBaseline || (result == BenchmarkBaseline::Result::New))
+        {
+            m_baseline.set(name, nsPerOpNormalized);
+            m_bBaselineChanged = true;
+            return true;
+        }
+
+        if (result == BenchmarkBaseline::Result::Regressed)
+        {
+            addToErrorMessages(("  " + name + " regressed: " + toString(nsPerOpNormalized) + " ns/op, baseline: " +
+                toString(m_baseline.get(name)) + " ns/op" +
+                (referenceScore.isStable() ? "" : ", reference workload was unstable, so this might be noise")).c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool bench_scope_benchmarker_name_length()
+    {
+        // name is hashed by ScopeBenchmarker ctor every time (but copied only on first use), so cost is expected to grow with name length
+        bool b = true;
+        for (const size_t nameLength : { 8u, 64u, 256u })
+        {
+            const std::string sName(nameLength, 'x');
+            b &= reportResult(
+                "scope_benchmarker/name_length_" + std::to_string(nameLength),
+                measureNsPerOp(200000, [&sName](long long) { ScopeBenchmarker<std::chrono::microseconds> bm(sName); }));
+            ScopeBenchmarkerDataStore::clear();
+        }
+        return b;
+    }
+
+    bool bench_scope_benchmarker_registry_size()
+    {
+        bool b = true;
+        const std::string sName("registry-bm-16ch");
+        for (const int nRegistrySize : { 10, 1000, 100000 })
+        {
+            for (int i = 0; i < nRegistrySize - 1; i++)
+            {
+                ScopeBenchmarkerDataStore::getDataByName("registry-filler-" + std::to_string(i));
+            }
+            b &= reportResult(
+                "scope_benchmarker/registry_size_" + std::to_string(nRegistrySize),
+                measureNsPerOp(200000, [&sName](long long) { ScopeBenchmarker<std::chrono::microseconds> bm(sName); }));
+            ScopeBenchmarkerDataStore::clear();
+        }
+        return b;
+    }
+
+    bool bench_scope_benchmarker_dynamic_names()
+    {
+        // names like "physics-system/<id>" generated in the hot loop: std::string allocates (longer than SSO), NameBuilder formats on the stack
+        // and interns, and a handle interned in advance skips even that
+        bool b = true;
+        b &= reportResult(
+            "scope_benchmarker/dynamic_name_string",
+            measureNsPerOp(200000, [](long long i) {
+                ScopeBenchmarker<std::chrono::microseconds> bm("physics-system/" + std::to_string(i % 64)); }));
+        ScopeBenchmarkerDataStore::clear();
+
+        b &= reportResult(
+            "scope_benchmarker/dynamic_name_builder",
+            measureNsPerOp(200000, [](long long i) {
+                ScopeBenchmarker<std::chrono::microseconds> bm((NameBuilder() << "physics-system/" << (i % 64)).intern()); }));
+        ScopeBenchmarkerDataStore::clear();
+
+        const NameTable::Handle nameHandle = NameTable::intern("physics-system/0");
+        b &= reportResult(
+            "scope_benchmarker/name_handle",
+            measureNsPerOp(200000, [nameHandle](long long) { ScopeBenchmarker<std::chrono::microseconds> bm(nameHandle); }));
+        ScopeBenchmarkerDataStore::clear();
+
+        // same 64 series, as labels of a single benchmarker name
+        const NameTable::Handle baseNameHandle = NameTable::intern("physics-system");
+        b &= reportResult(
+            "scope_benchmarker/labeled_series",
+            measureNsPerOp(200000, [baseNameHandle](long long i) {
+                ScopeBenchmarker<std::chrono::microseconds> bm(baseNameHandle, BenchmarkLabels().add("id", i % 64)); }));
+        ScopeBenchmarkerDataStore::clear();
+        return b;
+    }
+
+    bool bench_scope_benchmarker_threads()
+    {
+        // ScopeBenchmarkerDataStore is not thread-safe: every thread must use its own benchmarker, registered before
+        // starting the threads, so the threads only look up and update existing entries, never insert.
+        // The result is the per-thread cost of enter/exit while the given number of threads are doing the same.
+        bool b = true;
+        const unsigned int nHwThreads = std::max(1u, std::thread::hardware_concurrency());
+        for (const unsigned int nThreads : { 1u, 2u, 4u, 8u })
+        {
+            if ((nThreads > 1) && (nThreads > nHwThreads))
+            {
+                addToInfoMessages(("    scope_benchmarker/threads_" + std::to_string(nThreads) + ": skipped, not enough hardware threads").c_str());
+                continue;
+            }
+
+            std::vector<std::string> names;
+            for (unsigned int i = 0; i < nThreads; i++)
+            {
+                names.push_back("thread-bm-" + std::to_string(i));
+                ScopeBenchmarkerDataStore::getDataByName(names.back());
+            }
+
+            std::vector<double> nsPerOpPerThread(nThreads, 0.0);
+            std::atomic<unsigned int> nThreadsReady(0);
+            std::vector<std::thread> threads;
+            for (unsigned int i = 0; i < nThreads; i++)
+            {
+                threads.emplace_back([&, i]() {
+                    // start measuring at the same time so the threads really run concurrently
+                    nThreadsReady++;
+                    while (nThreadsReady.load() < nThreads)
+                    {
+                        std::this_thread::yield();
+                    }
+                    const std::string& sName = names[i];
+                    nsPerOpPerThread[i] = measureNsPerOp(100000, [&sName](long long) { ScopeBenchmarker<std::chrono::microseconds> bm(sName); });
+                });
+            }
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+
+            double nsPerOpSum = 0.0;
+            for (const double nsPerOp : nsPerOpPerThread)
+            {
+                nsPerOpSum += nsPerOp;
+            }
+            b &= reportResult("scope_benchmarker/threads_" + std::to_string(nThreads), nsPerOpSum / nThreads);
+            ScopeBenchmarkerDataStore::clear();
+        }
+        return b;
+    }
+
+    bool bench_scope_benchmarker_seqlock()
+    {
+        // cost of the seqlock around updating a BmData, compared to updating it without any synchronization, and to
+        // incrementing the sequence by atomic RMW instructions as multiple writers would need (Debug builds do that anyway);
+        // the signal fence only keeps the compiler from merging the updates of the iterations
+        auto& bmData = ScopeBenchmarkerDataStore::getDataByName("seqlock-bm");
+        bmData.m_name = "seqlock-bm";
+
+        bool b = true;
+        b &= reportResult(
+            "scope_benchmarker/unsynchronized_write",
+            measureNsPerOp(2000000, [&bmData](long long i) {
+                bmData.m_iterations++;
+                bmData.m_durationsTotal += i;
+                std::atomic_signal_fence(std::memory_order_seq_cst); }));
+        b &= reportResult(
+            "scope_benchmarker/seqlock_write",
+            measureNsPerOp(2000000, [&bmData](long long i) {
+                bmData.beginWrite();
+                bmData.m_iterations++;
+                bmData.m_durationsTotal += i;
+                bmData.endWrite();
+                std::atomic_signal_fence(std::memory_order_seq_cst); }));
+        b &= reportResult(
+            "scope_benchmarker/seqlock_write_rmw",
+            measureNsPerOp(2000000, [&bmData](long long i) {
+                bmData.m_sequence.m_value.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                bmData.m_iterations++;
+                bmData.m_durationsTotal += i;
+                bmData.m_sequence.m_value.fetch_add(1, std::memory_order_release);
+                std::atomic_signal_fence(std::memory_order_seq_cst); }));
+
+        ScopeBenchmarkerDataStore::BmData copy;
+        b &= reportResult(
+            "scope_benchmarker/seqlock_read",
+            measureNsPerOp(2000000, [&bmData, &copy](long long) { bmData.readConsistent(copy, 0); }));
+        return b;
+    }
+
+    bool bench_passing_assertions()
+    {
+        // volatile so the compiler cannot evaluate the assertions at compile-time
+        volatile int nValue = 42;
+        volatile float fValue = 4.2f;
+        const std::string sValue("passing assertion");
+        const std::string sValueCopy(sValue);
+
+        bool bAllPassed = true;
+        bool b = true;
+        b &= reportResult(
+            "assert_equals_pass/int",
+            measureNsPerOp(1000000, [&](long long) { bAllPassed &= assertEquals(42, static_cast<int>(nValue)); }));
+        b &= reportResult(
+            "assert_equals_pass/float",
+            measureNsPerOp(1000000, [&](long long) { bAllPassed &= assertEquals(4.2f, static_cast<float>(fValue), 0.001f); }));
+        b &= reportResult(
+            "assert_equals_pass/string",
+            measureNsPerOp(1000000, [&](long long) { bAllPassed &= assertEquals(sValue, sValueCopy); }));
+        b &= reportResult(
+            "assert_equals_pass/int_with_message",
+            measureNsPerOp(1000000, [&](long long) { bAllPassed &= assertEquals(42, static_cast<int>(nValue), "value"); }));
+        return assertTrue(bAllPassed, "assertions should have passed") & b;
+    }
+
+    bool bench_test_run()
+    {
+        // this is the per-test work of runTests() apart from printing the results
+        bool b = true;
+        for (const int nSubTests : { 0, 1, 10 })
+        {
+            EmptyUnitTest test(nSubTests);
+            b &= reportResult(
+                "test_run/subtests_" + std::to_string(nSubTests),
+                measureNsPerOp(20000, [&test](long long) { test.run(); }));
+        }
+        return b;
+    }
+
+}; // class FrameworkSelfBenchmark
+
+
+int WINAPI WinMain(_In_ HINSTANCE /*hInstance*/, _In_opt_ HINSTANCE /*hPrevInstance*/, _In_ LPSTR lpCmdLine, _In_ int /*nCmdShow*/)
+{
+    constexpr const char* const CON_TITLE = "455-355-7357-88 self-benchmarks";
+
+    getConsole().Initialize(CON_TITLE, true);
+    getConsole().SetErrorsAlwaysOn(false);
+
+    getConsole().OLn("");
+    // Expecting NDEBUG to be reliable: https://man7.org/linux/man-pages/man3/assert.3.html
+#ifdef NDEBUG
+    const char* const szBuildType = "Release";
+#else
+    const char* const szBuildType = "Debug";
+#endif
+    getConsole().OLn("%s. Build Type: %s, Timestamp: %s @ %s", CON_TITLE, szBuildType, __DATE__, __TIME__);
+
+    const std::string sCmdLine(lpCmdLine ? lpCmdLine : "");
+    const bool bUpdateBaseline = sCmdLine.find("--update-baseline") != std::string::npos;
+    double baselineTolerancePercent = 25.0;
+    const std::string sTolerancePrefix = "--baseline-tolerance-percent=";
+    const size_t nTolerancePos = sCmdLine.find(sTolerancePrefix);
+    if (nTolerancePos != std::string::npos)
+    {
+        baselineTolerancePercent = std::atof(sCmdLine.c_str() + nTolerancePos + sTolerancePrefix.length());
+    }
+
+    std::vector<std::unique_ptr<Test>> tests;
+    tests.push_back(std::unique_ptr<Test>(new FrameworkSelfBenchmark(bUpdateBaseline, baselineTolerancePercent / 100.0)));
+
+    Test::runTests(tests, getConsole(), "Running Framework Self-Benchmarks ...");
+    system("pause");
+
+    getConsole().Deinitialize();
+
+    return 0;
+
+} // WinMain()
@@ -0,0 +1,22 @@
+/*
+    ###################################################################################
+    Test.cpp
+    Optional single implementation file of Test, to be used only if TEST_SEPARATE_COMPILATION is defined for the whole project.
+    In header-only mode (the default) this file compiles to nothing, so it is harmless to keep it in the project.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#ifdef TEST_SEPARATE_COMPILATION
+
+#include "Test.h"
+#include "TestImpl.h"
+#include "TestToString.h"
+
+// explicit instantiation definitions for the extern template declarations in Test.h
+#define TEST_INSTANTIATE_COMMON_TYPE_TEMPLATES(T) TEST_COMMON_TYPE_TEMPLATES(, T)
+TEST_FOR_EACH_COMMON_TYPE(TEST_INSTANTIATE_COMMON_TYPE_TEMPLATES)
+
+#endif // TEST_SEPARATE_COMPILATION
@@ -10,10 +10,8 @@
     ###################################################################################
 */
 
-#include <cassert>
-#include <cmath>
+#include <chrono>   // for measuring test durations; requires cpp11
 #include <memory>   // for std::unique_ptr; requires cpp11
-#include <sstream>
 #include <string>
 #include <vector>
 #include <utility>  // std::size_t, etc.
@@ -22,11 +20,68 @@
 #include "CConsole.h"  // CConsole lib: https://github.com/proof88/Console
 #endif
 
+#include "ExclusiveResources.h"
+
+/**
+    Options for Test::run() and Test::runTests() to select tests and subtests by their tags.
+*/
+struct TestRunOptions
+{
+    std::vector<std::string> m_includeTags;                         /**< If not empty, only tests and subtests having at least one of these tags are run. */
+    std::vector<std::string> m_excludeTags;                         /**< Tests and subtests having any of these tags are not run, even if they have an included tag. */
+    std::chrono::milliseconds m_fastTestDurationLimit{ 100 };       /**< A warning is added to info messages if a test or subtest tagged "fast" runs longer than this.
+                                                                         0 disables the warning. */
+    unsigned int m_nJobs = 1;                                       /**< Maximum number of tests run concurrently by Test::runTests(), 0 means the number of
+                                                                         hardware threads. See Test::addExclusiveResource() for tests not to be run concurrently. */
+
+    /**
+        Convenience function for filling the options from a command line, e.g. the lpCmdLine argument of WinMain().
+        Recognized arguments, separated by whitespace:
+         --tags=tag1,tag2,...          to fill m_includeTags,
+         --exclude-tags=tag1,tag2,...  to fill m_excludeTags,
+         --fast-limit-ms=N             to set m_fastTestDurationLimit,
+         --jobs=N                      to set m_nJobs.
+        Other arguments are ignored.
+    */
+    static TestRunOptions fromCommandLine(const std::string& cmdLine);
+
+    /**
+        @return True if the given tags are selected by these options.
+    */
+    bool isSelected(const std::vector<std::string>& tags) const;
+
+private:
+
+    static std::vector<std::string> splitTagList(const std::string& tagList);
+}; // struct TestRunOptions
+
+
 class Test
 {
 public:
 
-    static constexpr char* frameworkVersion = "1.2";
+    static constexpr char* frameworkVersion = "1.3";
+
+    /**
+        Predefined tags for tests and subtests, see addTag() and addSubTest().
+        Any other string can be used as custom tag.
+    */
+    static constexpr const char* const TAG_FAST = "fast";             /**< Expected to finish within TestRunOptions::m_fastTestDurationLimit. */
+    static constexpr const char* const TAG_SLOW = "slow";             /**< E.g. touching filesystem or network, so it is run only on-demand. */
+    static constexpr const char* const TAG_BENCHMARK = "benchmark";   /**< Automatically added to every Benchmark. */
+    static constexpr const char* const TAG_IO = "io";                 /**< Doing file or network I/O. */
+
+    /**
+        Predefined exclusive resources, see addExclusiveResource() and ExclusiveResources.
+        When tests run concurrently, using the process-wide state of the framework without having its resource throws.
+    */
+    static constexpr const char* const RESOURCE_MACHINE = ExclusiveResources::MACHINE;             /**< The test runs alone, no other test runs concurrently.
+                                                                                                        Automatically added to every Benchmark, since tests running
+                                                                                                        concurrently would distort its measurements. */
+    static constexpr const char* const RESOURCE_CLOCK = ExclusiveResources::CLOCK;                 /**< Installing a Clock, e.g. by ClockInstaller. Tests reading
+                                                                                                        Clock::now() while another test installs a VirtualClock would
+                                                                                                        also read virtual time, so they should have it too. */
+    static constexpr const char* const RESOURCE_BENCHMARKERS = ExclusiveResources::BENCHMARKERS;   /**< Using ScopeBenchmarker or ScopeBenchmarkerDataStore. */
 
     /**
         Convenience function for running all test cases and summarizing the results.
@@ -45,124 +100,28 @@ public:
         The Console lib is this: https://github.com/proof88/Console .
 
         If you want to use your own test runner and summarizer implementation, then don't define the TEST_WITH_CCONSOLE macro before including Test.h.
+
+        The given options are passed to every test's run(), so tests and subtests can be selected by their tags.
+        Tests not having any selected part are skipped and are not counted in the pass/fail statistics.
+
+        If TestRunOptions::m_nJobs is not 1, up to that many tests are run concurrently, each on its own thread, still
+        started in the order of the vector, and results are still summarized in the order of the vector.
+        Tests having the same exclusive resource (see addExclusiveResource()) never run concurrently, and a test having
+        RESOURCE_MACHINE runs alone: tests after it in the vector are not started until it finishes.
+        An exception escaping a test run concurrently is rethrown by this function after all started tests finished.
     */
 #ifdef TEST_WITH_CCONSOLE
-    static void runTests(std::vector<std::unique_ptr<Test>>& tests, CConsole& console, const char* title = "")
-    {
-        if (tests.empty())
-        {
-            console.OLn("Not Running Any %s This Time (tests vector empty).", title);
-            console.OLn("");
-            return;
-        }
-
-        console.OLn("%s", title);
-        console.OLn("Powered by: 455-355-7357-88 (ASS-ESS-TEST-88) Test Framework by PR00F88, version: %s", frameworkVersion);
-
-        size_t nSucceededTests = 0;
-        size_t nTotalSubTests = 0;
-        size_t nTotalPassedSubTests = 0;
-        for (size_t i = 0; i < tests.size(); ++i)
-        {
-            console.OLn("Running test %d / %d ... ", i + 1, tests.size());
-            tests[i]->run();
-        }
-
-        // summarizing
-        console.OLn("");
-        for (size_t i = 0; i < tests.size(); ++i)
-        {
-            for (const auto& infoMsg : tests[i]->getInfoMessages())
-            {
-                console.OLn("%s", infoMsg.c_str());
-            }
-
-            if (tests[i]->isPassed())
-            {
-                ++nSucceededTests;
-                console.SOn();
-                if (tests[i]->getName().empty())
-                {
-                    console.OLn("Test passed: %s(%d)!", tests[i]->getFile().c_str(), tests[i]->getSubTestCount());
-                }
-                else if (tests[i]->getFile().empty())
-                {
-                    console.OLn("Test passed: %s(%d)!", tests[i]->getName().c_str(), tests[i]->getSubTestCount());
-                }
-                else
-                {
-                    console.OLn("Test passed: %s(%d) in %s!", tests[i]->getName().c_str(), tests[i]->getSubTestCount(), tests[i]->getFile().c_str());
-                }
-                console.SOff();
-            }
-            else
-            {
-                console.EOn();
-                if (tests[i]->getName().empty())
-                {
-                    console.OLn("Test failed: %s", tests[i]->getFile().c_str());
-                }
-                else if (tests[i]->getFile().empty())
-                {
-                    console.OLn("Test failed: %s", tests[i]->getName().c_str());
-                }
-                else
-                {
-                    console.OLn("Test failed: %s in %s", tests[i]->getName().c_str(), tests[i]->getFile().c_str());
-                }
-                console.Indent();
-                for (size_t j = 0; j < tests[i]->getErrorMessages().size(); ++j)
-                {
-                    console.OLn("%s", tests[i]->getErrorMessages()[j].c_str());
-                }
-                console.Outdent();
-                console.EOff();
-            }
-            nTotalSubTests += tests[i]->getSubTestCount();
-            nTotalPassedSubTests += tests[i]->getPassedSubTestCount();
-        }
-
-        console.OLn("");
-        console.OLn("========================================================");
-        if (nSucceededTests == tests.size())
-        {
-            console.SOn();
-        }
-        else
-        {
-            console.EOn();
-        }
-        console.OLn("Passed tests: %d / %d (SubTests: %d / %d)", nSucceededTests, tests.size(), nTotalPassedSubTests, nTotalSubTests);
-        console.NOn();
-        console.OLn("========================================================");
-        console.OLn("");
-    } // runTests()
+    static void runTests(std::vector<std::unique_ptr<Test>>& tests, CConsole& console, const char* title = "", const TestRunOptions& options = TestRunOptions());
 #endif
 
     /**
         @param testFile The file where the test is defined.
         @param testName The name of the test. If empty, itt will be "Unnamed Test".
     */
-    Test(const std::string& testFile = "", const std::string& testName = "")
-    {
-        reset();
-        if (testName.empty() && testFile.empty())
-            sTestName = "Unnamed Test";
-        else
-            sTestName = testName;
-
-        if (!testFile.empty())
-            sTestFile = getFilename(testFile);
-    }
+    Test(const std::string& testFile = "", const std::string& testName = "");
 
 
-    virtual ~Test()
-    {
-        // TODO: these are not needed
-        sInfoMessages.clear();
-        sErrorMessages.clear();
-        tSubTests.clear();
-    }
+    virtual ~Test();
 
     Test(const Test&) = default;
     Test& operator=(const Test&) = default;
@@ -182,6 +141,44 @@ public:
     }
 
 
+    /**
+        @return Tags of the test, added by addTag(). Subtests also inherit these tags.
+    */
+    const std::vector<std::string>& getTags() const
+    {
+        return tTags;
+    }
+
+
+    /**
+        @return True if the test has the given tag, false otherwise.
+    */
+    bool hasTag(const std::string& tag) const;
+
+
+    /**
+        @return Exclusive resources of the test, added by addExclusiveResource().
+    */
+    const std::vector<std::string>& getExclusiveResources() const
+    {
+        return tExclusiveResources;
+    }
+
+
+    /**
+        @return True if the test has the given exclusive resource, false otherwise.
+    */
+    bool hasExclusiveResource(const std::string& resource) const;
+
+
+    /**
+        @return True if the given options select either testMethod() or any of the subtests, false otherwise.
+                Subtests added by initialize() are not known before run(), so a test not selected yet might still be
+                selected after its initialize().
+    */
+    bool isSelected(const TestRunOptions& options) const;
+
+
     /**
         @return Informational messages after run().
     */
@@ -226,21 +223,7 @@ public:
 
         @return          The value of the given statement.
     */
-    bool assertTrue(bool statement, const char* msg = NULL)
-    {
-        if (!statement)
-        {
-            if (msg == NULL)
-            {
-                addToErrorMessages("Assertion failed!");
-            }
-            else
-            {
-                addToErrorMessages(std::string("Assertion failed: ").append(msg).c_str());
-            }
-        }
-        return statement;
-    }
+    bool assertTrue(bool statement, const char* msg = NULL);
 
 
     /**
@@ -269,14 +252,7 @@ public:
     template <class T, class S>
     bool assertEquals(const T& expected, const S& checked, const char* msg = NULL)
     {
-        std::string asdasd;
-        if (msg != NULL)
-            asdasd = toString(checked).append(" should be ").append(toString(expected)).append(", ").append(msg);
-
-        return msg == NULL ?
-            assertTrue(expected == checked,
-                toString(checked).append(" should be ").append(toString(expected)).append("!").c_str()) :
-            assertTrue(expected == checked, asdasd.c_str());
+        return (expected == checked) || addAssertionFailure(toString(checked), " should be ", toString(expected), msg);
     }
 
 
@@ -289,25 +265,13 @@ public:
 
         @return         True if checked equals to expected, false otherwise.
     */
-    bool assertEquals(unsigned char expected, unsigned char checked, const char* msg = NULL)
-    {
-        return assertEquals(static_cast<int>(expected), static_cast<int>(checked), msg);
-    }
+    bool assertEquals(unsigned char expected, unsigned char checked, const char* msg = NULL);
 
-    bool assertEquals(char expected, unsigned char checked, const char* msg = NULL)
-    {
-        return assertEquals(static_cast<int>(expected), static_cast<int>(checked), msg);
-    }
+    bool assertEquals(char expected, unsigned char checked, const char* msg = NULL);
 
-    bool assertEquals(unsigned char expected, char checked, const char* msg = NULL)
-    {
-        return assertEquals(static_cast<int>(expected), static_cast<int>(checked), msg);
-    }
+    bool assertEquals(unsigned char expected, char checked, const char* msg = NULL);
 
-    bool assertEquals(char expected, char checked, const char* msg = NULL)
-    {
-        return assertEquals(static_cast<int>(expected), static_cast<int>(checked), msg);
-    }
+    bool assertEquals(char expected, char checked, const char* msg = NULL);
 
 
     /**
@@ -320,14 +284,7 @@ public:
 
         @return         True if checked value is not farther from expected value than epsilon, false otherwise.
     */
-    bool assertEquals(float expected, float checked, float epsilon, const char* msg = NULL)
-    {
-        return msg == NULL ?
-            assertTrue(std::abs(expected - checked) <= epsilon,
-                toString(checked).append(" should be ").append(toString(expected)).append("!").c_str()) :
-            assertTrue(std::abs(expected - checked) <= epsilon,
-                toString(checked).append(" should be ").append(toString(expected)).append(", ").append(msg).c_str());
-    }
+    bool assertEquals(float expected, float checked, float epsilon, const char* msg = NULL);
 
 
     /**
@@ -342,11 +299,7 @@ public:
     template <class T, class S>
     bool assertNotEquals(const T& comparedTo, const S& checked, const char* msg = NULL)
     {
-        return msg == NULL ?
-            assertTrue(comparedTo != checked,
-                toString(checked).append(" should NOT be ").append(toString(comparedTo)).append("!").c_str()) :
-            assertTrue(comparedTo != checked,
-                toString(checked).append(" should NOT be ").append(toString(comparedTo)).append(", ").append(msg).c_str());
+        return (comparedTo != checked) || addAssertionFailure(toString(checked), " should NOT be ", toString(comparedTo), msg);
     }
 
 
@@ -359,10 +312,7 @@ public:
 
         @return           True if checked doesn't equal to the other value, false otherwise.
     */
-    bool assertNotEquals(unsigned char comparedTo, unsigned char checked, const char* msg = NULL)
-    {
-        return assertNotEquals((int)comparedTo, (int)checked, msg);
-    }
+    bool assertNotEquals(unsigned char comparedTo, unsigned char checked, const char* msg = NULL);
 
 
     /**
@@ -375,14 +325,7 @@ public:
 
         @return           True if checked value is farther from the other value than epsilon, false otherwise.
     */
-    bool assertNotEquals(float comparedTo, float checked, float epsilon, const char* msg = NULL)
-    {
-        return msg == NULL ?
-            assertTrue(std::abs(comparedTo - checked) > epsilon,
-                toString(checked).append(" should NOT be ").append(toString(comparedTo)).append("!").c_str()) :
-            assertTrue(std::abs(comparedTo - checked) > epsilon,
-                toString(checked).append(" should NOT be ").append(toString(comparedTo)).append(", ").append(msg).c_str());
-    }
+    bool assertNotEquals(float comparedTo, float checked, float epsilon, const char* msg = NULL);
 
 
     /**
@@ -398,13 +341,7 @@ public:
     template <class T, class S>
     bool assertBetween(const T& minVal, const T& maxVal, const S& checked, const char* msg = NULL)
     {
-        return msg == NULL ?
-            assertTrue(minVal <= checked && maxVal >= checked,
-                std::string("out of range: ").append(toString(minVal)).append(" <= ").append(
-                    toString(checked)).append(" <= ").append(toString(maxVal)).append(" !").c_str()) :
-            assertTrue(minVal <= checked && maxVal >= checked,
-                std::string("out of range: ").append(toString(minVal)).append(" <= ").append(
-                    toString(checked)).append(" <= ").append(toString(maxVal)).append(", ").append(msg).c_str());
+        return (minVal <= checked && maxVal >= checked) || addRangeAssertionFailure(toString(minVal), toString(checked), toString(maxVal), msg);
     }
 
 
@@ -420,19 +357,7 @@ public:
 
         @return True if the given value is inside the given interval, false otherwise.
     */
-    bool assertBetween(float minVal, float maxVal, float checked, float epsilon, const char* msg = NULL)
-    {
-        bool b = ((minVal < checked) || (std::abs(minVal - checked) <= epsilon)) &&
-            ((maxVal > checked) || (std::abs(maxVal - checked) <= epsilon));
-
-        return msg == NULL ?
-            assertTrue(b,
-                std::string("out of range: ").append(toString(minVal)).append(" <= ").append(
-                    toString(checked)).append(" <= ").append(toString(maxVal)).append(" !").c_str()) :
-            assertTrue(b,
-                std::string("out of range: ").append(toString(minVal)).append(" <= ").append(
-                    toString(checked)).append(" <= ").append(toString(maxVal)).append(", ").append(msg).c_str());
-    }
+    bool assertBetween(float minVal, float maxVal, float checked, float epsilon, const char* msg = NULL);
 
 
     /**
@@ -447,14 +372,7 @@ public:
     template <class T, class S>
     bool assertLess(const T& checked, const S& comparedTo, const char* msg = NULL)
     {
-        std::string asdasd;
-        if (msg != NULL)
-            asdasd = toString(checked).append(" should be < ").append(toString(comparedTo)).append(", ").append(msg);
-
-        return msg == NULL ?
-            assertTrue(checked < comparedTo,
-                toString(checked).append(" should be < ").append(toString(comparedTo)).append("!").c_str()) :
-            assertTrue(checked < comparedTo, asdasd.c_str());
+        return (checked < comparedTo) || addAssertionFailure(toString(checked), " should be < ", toString(comparedTo), msg);
     }
 
 
@@ -467,10 +385,7 @@ public:
 
         @return            True if checked value is less than the other value.
     */
-    bool assertLess(unsigned char checked, unsigned char comparedTo, const char* msg = NULL)
-    {
-        return assertLess((int)checked, (int)comparedTo, msg);
-    }
+    bool assertLess(unsigned char checked, unsigned char comparedTo, const char* msg = NULL);
 
 
     /**
@@ -483,16 +398,7 @@ public:
 
         @return            True if checked value is less than the other value.
     */
-    bool assertLess(float checked, float comparedTo, const char* msg = NULL)
-    {
-        // TODO: currently this is same as the template function, as for some reason we do not use any epsilon in this specialization,
-        // probably we can delete this specialization in the future ...
-        return msg == NULL ?
-            assertTrue(checked < comparedTo,
-                toString(checked).append(" should be < ").append(toString(comparedTo)).append("!").c_str()) :
-            assertTrue(checked < comparedTo,
-                toString(checked).append(" should be < ").append(toString(comparedTo)).append(", ").append(msg).c_str());
-    }
+    bool assertLess(float checked, float comparedTo, const char* msg = NULL);
 
 
     /**
@@ -507,14 +413,7 @@ public:
     template <class T, class S>
     bool assertLequals(const T& checked, const S& comparedTo, const char* msg = NULL)
     {
-        std::string asdasd;
-        if (msg != NULL)
-            asdasd = toString(checked).append(" should be <= ").append(toString(comparedTo)).append(", ").append(msg);
-
-        return msg == NULL ?
-            assertTrue(checked <= comparedTo,
-                toString(checked).append(" should be <= ").append(toString(comparedTo)).append("!").c_str()) :
-            assertTrue(checked <= comparedTo, asdasd.c_str());
+        return (checked <= comparedTo) || addAssertionFailure(toString(checked), " should be <= ", toString(comparedTo), msg);
     }
 
 
@@ -527,10 +426,7 @@ public:
 
         @return            True if checked value is less than or equal to the other value.
     */
-    bool assertLequals(unsigned char checked, unsigned char comparedTo, const char* msg = NULL)
-    {
-        return assertLequals((int)checked, (int)comparedTo, msg);
-    }
+    bool assertLequals(unsigned char checked, unsigned char comparedTo, const char* msg = NULL);
 
 
     /**
@@ -544,14 +440,7 @@ public:
 
         @return            True if checked value is less than or equal to the other value.
     */
-    bool assertLequals(float checked, float comparedTo, float epsilon, const char* msg = NULL)
-    {
-        return msg == NULL ?
-            assertTrue((checked < comparedTo) || (std::abs(comparedTo - checked) <= epsilon),
-                toString(checked).append(" should be <= ").append(toString(comparedTo)).append("!").c_str()) :
-            assertTrue((checked < comparedTo) || (std::abs(comparedTo - checked) <= epsilon),
-                toString(checked).append(" should be <= ").append(toString(comparedTo)).append(", ").append(msg).c_str());
-    }
+    bool assertLequals(float checked, float comparedTo, float epsilon, const char* msg = NULL);
 
 
     /**
@@ -566,14 +455,7 @@ public:
     template <class T, class S>
     bool assertGreater(const T& checked, const S& comparedTo, const char* msg = NULL)
     {
-        std::string asdasd;
-        if (msg != NULL)
-            asdasd = toString(checked).append(" should be > ").append(toString(comparedTo)).append(", ").append(msg);
-
-        return msg == NULL ?
-            assertTrue(checked > comparedTo,
-                toString(checked).append(" should be > ").append(toString(comparedTo)).append("!").c_str()) :
-            assertTrue(checked > comparedTo, asdasd.c_str());
+        return (checked > comparedTo) || addAssertionFailure(toString(checked), " should be > ", toString(comparedTo), msg);
     }
 
 
@@ -586,10 +468,7 @@ public:
 
         @return            True if checked value is greater than the other value.
     */
-    bool assertGreater(unsigned char checked, unsigned char comparedTo, const char* msg = NULL)
-    {
-        return assertGreater((int)checked, (int)comparedTo, msg);
-    }
+    bool assertGreater(unsigned char checked, unsigned char comparedTo, const char* msg = NULL);
 
 
     /**
@@ -602,16 +481,7 @@ public:
 
         @return            True if checked value is greater than the other value.
     */
-    bool assertGreater(float checked, float comparedTo, const char* msg = NULL)
-    {
-        // TODO: currently this is same as the template function, as for some reason we do not use any epsilon in this specialization,
-        // probably we can delete this specialization in the future ...
-        return msg == NULL ?
-            assertTrue(checked > comparedTo,
-                toString(checked).append(" should be > ").append(toString(comparedTo)).append("!").c_str()) :
-            assertTrue(checked > comparedTo,
-                toString(checked).append(" should be > ").append(toString(comparedTo)).append(", ").append(msg).c_str());
-    }
+    bool assertGreater(float checked, float comparedTo, const char* msg = NULL);
 
 
     /**
@@ -626,14 +496,7 @@ public:
     template <class T, class S>
     bool assertGequals(const T& checked, const S& comparedTo, const char* msg = NULL)
     {
-        std::string asdasd;
-        if (msg != NULL)
-            asdasd = toString(checked).append(" should be >= ").append(toString(comparedTo)).append(", ").append(msg);
-
-        return msg == NULL ?
-            assertTrue(checked >= comparedTo,
-                toString(checked).append(" should be >= ").append(toString(comparedTo)).append("!").c_str()) :
-            assertTrue(checked >= comparedTo, asdasd.c_str());
+        return (checked >= comparedTo) || addAssertionFailure(toString(checked), " should be >= ", toString(comparedTo), msg);
     }
 
 
@@ -646,10 +509,7 @@ public:
 
         @return            True if checked value is greater than or equal to the other value.
     */
-    bool assertGequals(unsigned char checked, unsigned char comparedTo, const char* msg = NULL)
-    {
-        return assertGequals((int)checked, (int)comparedTo, msg);
-    }
+    bool assertGequals(unsigned char checked, unsigned char comparedTo, const char* msg = NULL);
 
 
     /**
@@ -663,14 +523,7 @@ public:
 
         @return            True if checked value is greater than or equal to the other value.
     */
-    bool assertGequals(float checked, float comparedTo, float epsilon, const char* msg = NULL)
-    {
-        return msg == NULL ?
-            assertTrue((checked > comparedTo) || (std::abs(comparedTo - checked) <= epsilon),
-                toString(checked).append(" should be >= ").append(toString(comparedTo)).append("!").c_str()) :
-            assertTrue((checked > comparedTo) || (std::abs(comparedTo - checked) <= epsilon),
-                toString(checked).append(" should be >= ").append(toString(comparedTo)).append(", ").append(msg).c_str());
-    }
+    bool assertGequals(float checked, float comparedTo, float epsilon, const char* msg = NULL);
 
 
     /**
@@ -681,11 +534,7 @@ public:
 
         @return True if the given pointer is null, false otherwise.
     */
-    bool assertNull(const void* checked, const char* msg = NULL)
-    {
-        return msg == NULL ? assertTrue(checked == (void*)0, "pointer should be NULL") :
-            assertTrue(checked == (void*)0, std::string("pointer should be NULL, ").append(msg).c_str());
-    }
+    bool assertNull(const void* checked, const char* msg = NULL);
 
 
     /**
@@ -696,11 +545,7 @@ public:
 
         @return True if the given pointer is not null, false otherwise.
     */
-    bool assertNotNull(const void* checked, const char* msg = NULL)
-    {
-        return msg == NULL ? assertTrue(checked != (void*)0, "pointer is NULL") :
-            assertTrue(checked != (void*)0, std::string("pointer is NULL, ").append(msg).c_str());
-    }
+    bool assertNotNull(const void* checked, const char* msg = NULL);
 
 
     /**
@@ -712,6 +557,15 @@ public:
     }
 
 
+    /**
+        @return True if the last run() did not run anything because nothing was selected by its options, false otherwise.
+    */
+    bool isSkipped() const
+    {
+        return bTestSkipped;
+    }
+
+
     /**
         Executes the test. Runs the overridable testMethod() and every unit-subtests.
         The functions are called in the following order:
@@ -729,59 +583,23 @@ public:
     */
     bool run()
     {
-        reset();
-        bTestRan = true;
-        initialize();
-        bool bSkipAllSubTests;
-        preSetUp();
-        if (setUp())
-        {
-            bSkipAllSubTests = false;
-            if (!testMethod())
-            {
-                addToErrorMessages(std::string("  <").append(sTestFile).append("> failed!").c_str());
-            }
-        }
-        else
-        {
-            bSkipAllSubTests = true;
-            addToErrorMessages(std::string("  <").append(sTestFile).append("> setUp() failed!").c_str());
-        }
-        tearDown();
-        postTearDown();
-
-        // subtests start
-        if (!bSkipAllSubTests)
-        {
-            bWeAreInSubTest = true;
-            for (size_t i = 0; i < tSubTests.size(); ++i)
-            {
-                iCurrentSubTest = i;
-                preSetUp();
-                if (setUp())
-                {
-                    PFNUNITSUBTEST func = tSubTests[i].first;
-                    if ((this->*func)())
-                        ++nSucceededSubTests;
-                    else
-                        addToErrorMessages(std::string("  <").append(tSubTests[i].second).append("> failed!").c_str());
-                }
-                else
-                {
-                    addToErrorMessages(std::string("  <").append(tSubTests[i].second).append("> SKIPPED due to setUp() failed!").c_str());
-                }
-                tearDown();
-                postTearDown();
-            }
-            bWeAreInSubTest = false;
-        }
-        // subtests ended
-
-        finalize();
-        return isPassed();
+        return run(TestRunOptions());
     }
 
 
+    /**
+        Same as run() but testMethod() and the subtests are executed only if their tags are selected by the given options.
+        testMethod() is selected by the tags of the test, subtests are selected by the tags of the test and their own tags.
+        If neither testMethod() nor any subtest is selected, nothing is invoked except initialize() and finalize(), and
+        isSkipped() will return true. initialize() is invoked only if the test is not selected by the tags known before, since it may add
+        further subtests with their own tags.
+        Durations of testMethod() and subtests having the "fast" tag are checked against the limit set in the options.
+
+        @return True if the test including all selected subtests passed or the whole test is skipped, false otherwise.
+    */
+    bool run(const TestRunOptions& options);
+
+
     /**
         @return Returns the number of subtests in the test.
     */
@@ -800,6 +618,15 @@ public:
     }
 
 
+    /**
+        @return Returns the number of subtests not selected by the options of the last run().
+    */
+    int getSkippedSubTestCount() const
+    {
+        return nSkippedSubTests;
+    }
+
+
     /**
         Convenience function for logging/printing, for example, if we want to print the name of the currently running subtest.
         Being called outside from a subtest can cause either assertion failure (debug build) or thrown exception (release build).
@@ -807,11 +634,7 @@ public:
         @return Name of currently running subtest.
                 Valid already in the setUp() and tearDown() phases of the subtest.
     */
-    const std::string& getCurrentSubTestName() const
-    {
-        assert(iCurrentSubTest < tSubTests.size());
-        tSubTests[iCurrentSubTest].second;
-    }
+    const std::string& getCurrentSubTestName() const;
 
 
     /**
@@ -867,16 +690,25 @@ protected:
         Test developer can use it to add defined subtests within the derived test class.
         Such subtests must be member functions of the derived test class.
     */
-    void addSubTest(const char* subTestName, PFNUNITSUBTEST subTestFunc)
-    {
-        if (subTestFunc == nullptr)
-        {
-            return;
-        }
+    void addSubTest(const char* subTestName, PFNUNITSUBTEST subTestFunc);
 
-        TUNITSUBTESTFUNCNAMEPAIR newPair(subTestFunc, std::string(subTestName));
-        tSubTests.push_back(newPair);
-    } // addSubTest()
+    /**
+        Same as above, with additional tags for the subtest. Tags of the test are inherited by the subtest anyway.
+    */
+    void addSubTest(const char* subTestName, PFNUNITSUBTEST subTestFunc, const std::vector<std::string>& subTestTags);
+
+    /**
+        Adds the given tag to the test, so the test can be selected or excluded by TestRunOptions.
+        Use the predefined TAG_XXX tags or any custom string. Usually invoked in the ctor of the derived test class.
+    */
+    void addTag(const std::string& tag);
+
+    /**
+        Adds the given exclusive resource to the test, so runTests() does not run it concurrently with other tests having
+        the same resource, e.g. "port 7777" or "temp dir X". RESOURCE_MACHINE makes the test run alone.
+        Usually invoked in the ctor of the derived test class.
+    */
+    void addExclusiveResource(const std::string& resource);
 
     /**
         Invoked by run() right before any call to setUp().
@@ -904,42 +736,113 @@ protected:
     std::vector<std::string> sErrorMessages;           /**< Error messages. */
     std::vector<std::string> sInfoMessages;            /**< Informational messages. */
     std::vector<TUNITSUBTESTFUNCNAMEPAIR> tSubTests;   /**< Subtests as filled by addSubTest(). */
+    std::vector<std::vector<std::string>> tSubTestTags;/**< Own tags of subtests, same indexing as tSubTests. */
+    std::vector<std::string> tTags;                    /**< Tags of the test as filled by addTag(). */
+    std::vector<std::string> tExclusiveResources;      /**< Exclusive resources of the test as filled by addExclusiveResource(). */
     size_t iCurrentSubTest;                            /**< Index of currently running subtest, valid only if bWeAreInSubTest is true. */
     bool bWeAreInSubTest;                              /**< True only if a subtest is running, valid also in the subtest's corresponding setUp(), tearDown() and printBenchmarkers(). */
     int nSucceededSubTests;                            /**< Number of succeeded subtests. */
+    int nSkippedSubTests;                              /**< Number of subtests not selected by the run options. */
     bool bTestRan;                                     /**< Did the test attempt to run? */
+    bool bTestSkipped;                                 /**< Was the whole test skipped due to run options? */
 
     // ---------------------------------------------------------------------------
 
+    /**
+        Defined in TestToString.h, see the notes about TEST_SEPARATE_COMPILATION at the end of this file.
+    */
     template <class T>
-    static std::string toString(const T& value)
-    {
-        std::stringstream str;
-        str << value;
-        return str.str();
-    }
+    static std::string toString(const T& value);
 
-    static std::string toString(bool value)
-    {
-        return value ? "TRUE" : "FALSE";
-    }
+    static std::string toString(bool value);
 
-    static std::string getFilename(const std::string& path)
-    {
-        return path.substr(path.find_last_of('\\') + 1);
-    }
+    /**
+        Adds "Assertion failed: <checked><relation><comparedTo>!" or "Assertion failed: <checked><relation><comparedTo>, <msg>" to the error messages.
+        Assertion templates call this only on failure, so passing assertions don't build any string, and the
+        message building code is not instantiated for every template argument combination.
+
+        @return Always false.
+    */
+    bool addAssertionFailure(const std::string& checked, const char* relation, const std::string& comparedTo, const char* msg);
+
+    /**
+        Same as addAssertionFailure() but for range assertions: "Assertion failed: out of range: <minVal> <= <checked> <= <maxVal> !".
+
+        @return Always false.
+    */
+    bool addRangeAssertionFailure(const std::string& minVal, const std::string& checked, const std::string& maxVal, const char* msg);
+
+    static std::string getFilename(const std::string& path);
+
+    static std::string joinTags(const std::vector<std::string>& tags);
+
+#ifdef TEST_WITH_CCONSOLE
+    /**
+        Runs the tests for runTests() with up to nJobs tests running concurrently, respecting their exclusive resources.
+    */
+    static void runTestsConcurrently(std::vector<std::unique_ptr<Test>>& tests, CConsole& console, const TestRunOptions& options, size_t nJobs);
+#endif
+
+    /**
+        @return Tags of the test merged with the own tags of the subtest at the given index.
+    */
+    std::vector<std::string> getSubTestTags(size_t iSubTest) const;
+
+    /**
+        Adds a warning to the info messages if a test or subtest having the "fast" tag ran longer than allowed by the options.
+    */
+    void checkFastTestDuration(
+        const std::vector<std::string>& tags,
+        const std::string& name,
+        const std::chrono::steady_clock::duration& duration,
+        const TestRunOptions& options);
 
     /**
         Resets the test so it gets into a rerunnable state.
     */
-    void reset()
-    {
-        bTestRan = false;
-        sErrorMessages.clear();
-        sInfoMessages.clear();
-        iCurrentSubTest = 0;
-        bWeAreInSubTest = false;
-        nSucceededSubTests = 0;
-    }
+    void reset();
 
 }; // class Test
+
+
+/**
+    Test.h is header-only by default: it includes the implementation of the non-template functions (TestImpl.h) and
+    the implementation of Test::toString() (TestToString.h, pulling in <sstream>).
+
+    Big test suites can reduce compile time by defining TEST_SEPARATE_COMPILATION for the whole project and adding Test.cpp to the project:
+     - non-template functions are then compiled only once in Test.cpp;
+     - Test::toString() and the assertion templates are explicitly instantiated in Test.cpp for the common types listed in
+       TEST_FOR_EACH_COMMON_TYPE, and declared extern here, so they are not instantiated in every test file;
+     - <sstream>, <algorithm>, <cmath> etc. are not included by every test file.
+    Test files asserting values of other types (e.g. own classes with operator<<) need to include TestToString.h in that case.
+    Projects using Benchmark need to add Benchmarks.cpp too, see the end of Benchmarks.h.
+    Use CompileTimeBenchmark/compile_time_benchmark.sh to measure the difference for your compiler.
+*/
+#define TEST_FOR_EACH_COMMON_TYPE(X) \
+    X(int) \
+    X(unsigned int) \
+    X(long) \
+    X(unsigned long) \
+    X(long long) \
+    X(unsigned long long) \
+    X(float) \
+    X(double) \
+    X(std::string)
+
+#define TEST_COMMON_TYPE_TEMPLATES(PREFIX, T) \
+    PREFIX template std::string Test::toString<T>(const T&); \
+    PREFIX template bool Test::assertEquals<T, T>(const T&, const T&, const char*); \
+    PREFIX template bool Test::assertNotEquals<T, T>(const T&, const T&, const char*); \
+    PREFIX template bool Test::assertBetween<T, T>(const T&, const T&, const T&, const char*); \
+    PREFIX template bool Test::assertLess<T, T>(const T&, const T&, const char*); \
+    PREFIX template bool Test::assertLequals<T, T>(const T&, const T&, const char*); \
+    PREFIX template bool Test::assertGreater<T, T>(const T&, const T&, const char*); \
+    PREFIX template bool Test::assertGequals<T, T>(const T&, const T&, const char*);
+
+#ifdef TEST_SEPARATE_COMPILATION
+#define TEST_EXTERN_COMMON_TYPE_TEMPLATES(T) TEST_COMMON_TYPE_TEMPLATES(extern, T)
+TEST_FOR_EACH_COMMON_TYPE(TEST_EXTERN_COMMON_TYPE_TEMPLATES)
+#else
+#include "TestImpl.h"
+#include "TestToString.h"
+#endif
@@ -0,0 +1,652 @@
+#pragma once
+
+/*
+    ###################################################################################
+    TestImpl.h
+    Implementation of the non-template functions of Test and TestRunOptions.
+    Included by Test.h in header-only mode, or compiled once in Test.cpp if TEST_SEPARATE_COMPILATION is defined.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>  // std::find()
+#include <cassert>
+#include <cmath>
+#include <cstdlib>    // std::atoll()
+#include <sstream>
+#ifdef TEST_WITH_CCONSOLE
+#include <thread>     // std::thread::hardware_concurrency(); requires cpp11
+#endif
+
+#include "Test.h"
+
+#ifdef TEST_SEPARATE_COMPILATION
+#define TEST_INLINE
+#else
+#define TEST_INLINE inline
+#endif
+
+TEST_INLINE TestRunOptions TestRunOptions::fromCommandLine(const std::string& cmdLine)
+{
+    TestRunOptions options;
+    std::stringstream ssCmdLine(cmdLine);
+    std::string sArg;
+    while (ssCmdLine >> sArg)
+    {
+        if (sArg.find("--tags=") == 0)
+        {
+            options.m_includeTags = splitTagList(sArg.substr(7));
+        }
+        else if (sArg.find("--exclude-tags=") == 0)
+        {
+            options.m_excludeTags = splitTagList(sArg.substr(15));
+        }
+        else if (sArg.find("--fast-limit-ms=") == 0)
+        {
+            options.m_fastTestDurationLimit = std::chrono::milliseconds(std::atoll(sArg.substr(16).c_str()));
+        }
+        else if (sArg.find("--jobs=") == 0)
+        {
+            options.m_nJobs = static_cast<unsigned int>(std::atoll(sArg.substr(7).c_str()));
+        }
+    }
+    return options;
+}
+
+
+TEST_INLINE bool TestRunOptions::isSelected(const std::vector<std::string>& tags) const
+{
+    for (const auto& tag : tags)
+    {
+        if (std::find(m_excludeTags.begin(), m_excludeTags.end(), tag) != m_excludeTags.end())
+        {
+            return false;
+        }
+    }
+
+    if (m_includeTags.empty())
+    {
+        return true;
+    }
+
+    for (const auto& tag : tags)
+    {
+        if (std::find(m_includeTags.begin(), m_includeTags.end(), tag) != m_includeTags.end())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+TEST_INLINE std::vector<std::string> TestRunOptions::splitTagList(const std::string& tagList)
+{
+    std::vector<std::string> tags;
+    std::stringstream ssTagList(tagList);
+    std::string sTag;
+    while (std::getline(ssTagList, sTag, ','))
+    {
+        if (!sTag.empty())
+        {
+            tags.push_back(sTag);
+        }
+    }
+    return tags;
+}
+
+
+#ifdef TEST_WITH_CCONSOLE
+TEST_INLINE void Test::runTests(std::vector<std::unique_ptr<Test>>& tests, CConsole& console, const char* title, const TestRunOptions& options)
+{
+    if (tests.empty())
+    {
+        console.OLn("Not Running Any %s This Time (tests vector empty).", title);
+        console.OLn("");
+        return;
+    }
+
+    console.OLn("%s", title);
+    console.OLn("Powered by: 455-355-7357-88 (ASS-ESS-TEST-88) Test Framework by PR00F88, version: %s", frameworkVersion);
+    if (!options.m_includeTags.empty() || !options.m_excludeTags.empty())
+    {
+        console.OLn("Tags included: %s, excluded: %s", joinTags(options.m_includeTags).c_str(), joinTags(options.m_excludeTags).c_str());
+    }
+
+    size_t nSucceededTests = 0;
+    size_t nSkippedTests = 0;
+    size_t nTotalSubTests = 0;
+    size_t nTotalPassedSubTests = 0;
+    size_t nTotalSkippedSubTests = 0;
+    const size_t nJobs = (options.m_nJobs == 0) ? std::max(1u, std::thread::hardware_concurrency()) : options.m_nJobs;
+    if (nJobs > 1)
+    {
+        runTestsConcurrently(tests, console, options, nJobs);
+    }
+    else
+    {
+        for (size_t i = 0; i < tests.size(); ++i)
+        {
+            // selection is known only after run(), see Test::run()
+            console.OLn("Running test %d / %d ... ", i + 1, tests.size());
+            tests[i]->run(options);
+            if (tests[i]->isSkipped())
+            {
+                console.OLn("Skipped test %d / %d due to tags.", i + 1, tests.size());
+            }
+        }
+    }
+
+    // summarizing
+    console.OLn("");
+    for (size_t i = 0; i < tests.size(); ++i)
+    {
+        if (tests[i]->isSkipped())
+        {
+            ++nSkippedTests;
+            nTotalSkippedSubTests += tests[i]->getSubTestCount();
+            continue;
+        }
+
+        for (const auto& infoMsg : tests[i]->getInfoMessages())
+        {
+            console.OLn("%s", infoMsg.c_str());
+        }
+
+        if (tests[i]->isPassed())
+        {
+            ++nSucceededTests;
+            console.SOn();
+            if (tests[i]->getName().empty())
+            {
+                console.OLn("Test passed: %s(%d)!", tests[i]->getFile().c_str(), tests[i]->getSubTestCount());
+            }
+            else if (tests[i]->getFile().empty())
+            {
+                console.OLn("Test passed: %s(%d)!", tests[i]->getName().c_str(), tests[i]->getSubTestCount());
+            }
+            else
+            {
+                console.OLn("Test passed: %s(%d) in %s!", tests[i]->getName().c_str(), tests[i]->getSubTestCount(), tests[i]->getFile().c_str());
+            }
+            console.SOff();
+        }
+        else
+        {
+            console.EOn();
+            if (tests[i]->getName().empty())
+            {
+                console.OLn("Test failed: %s", tests[i]->getFile().c_str());
+            }
+            else if (tests[i]->getFile().empty())
+            {
+                console.OLn("Test failed: %s", tests[i]->getName().c_str());
+            }
+            else
+            {
+                console.OLn("Test failed: %s in %s", tests[i]->getName().c_str(), tests[i]->getFile().c_str());
+            }
+            console.Indent();
+            for (size_t j = 0; j < tests[i]->getErrorMessages().size(); ++j)
+            {
+                console.OLn("%s", tests[i]->getErrorMessages()[j].c_str());
+            }
+            console.Outdent();
+            console.EOff();
+        }
+        nTotalSubTests += tests[i]->getSubTestCount() - tests[i]->getSkippedSubTestCount();
+        nTotalPassedSubTests += tests[i]->getPassedSubTestCount();
+        nTotalSkippedSubTests += tests[i]->getSkippedSubTestCount();
+    }
+
+    console.OLn("");
+    console.OLn("========================================================");
+    if (nSucceededTests + nSkippedTests == tests.size())
+    {
+        console.SOn();
+    }
+    else
+    {
+        console.EOn();
+    }
+    console.OLn("Passed tests: %d / %d (SubTests: %d / %d)", nSucceededTests, tests.size() - nSkippedTests, nTotalPassedSubTests, nTotalSubTests);
+    if ((nSkippedTests > 0) || (nTotalSkippedSubTests > 0))
+    {
+        console.OLn("Skipped tests: %d (SubTests: %d)", nSkippedTests, nTotalSkippedSubTests);
+    }
+    console.NOn();
+    console.OLn("========================================================");
+    console.OLn("");
+}
+
+
+// the concurrent scheduler is in its own header, so only the file running the tests includes <mutex>, <condition_variable> etc.
+#include "TestScheduler.h"
+#endif
+
+
+TEST_INLINE Test::Test(const std::string& testFile, const std::string& testName)
+{
+    reset();
+    if (testName.empty() && testFile.empty())
+        sTestName = "Unnamed Test";
+    else
+        sTestName = testName;
+
+    if (!testFile.empty())
+        sTestFile = getFilename(testFile);
+}
+
+
+TEST_INLINE Test::~Test()
+{
+    // TODO: these are not needed
+    sInfoMessages.clear();
+    sErrorMessages.clear();
+    tSubTests.clear();
+    tSubTestTags.clear();
+}
+
+
+TEST_INLINE bool Test::hasTag(const std::string& tag) const
+{
+    return std::find(tTags.begin(), tTags.end(), tag) != tTags.end();
+}
+
+
+TEST_INLINE bool Test::hasExclusiveResource(const std::string& resource) const
+{
+    return std::find(tExclusiveResources.begin(), tExclusiveResources.end(), resource) != tExclusiveResources.end();
+}
+
+
+TEST_INLINE bool Test::isSelected(const TestRunOptions& options) const
+{
+    if (options.isSelected(tTags))
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < tSubTests.size(); ++i)
+    {
+        if (options.isSelected(getSubTestTags(i)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+TEST_INLINE bool Test::assertTrue(bool statement, const char* msg)
+{
+    if (!statement)
+    {
+        if (msg == NULL)
+        {
+            addToErrorMessages("Assertion failed!");
+        }
+        else
+        {
+            addToErrorMessages(std::string("Assertion failed: ").append(msg).c_str());
+        }
+    }
+    return statement;
+}
+
+
+TEST_INLINE bool Test::assertEquals(unsigned char expected, unsigned char checked, const char* msg)
+{
+    return assertEquals(static_cast<int>(expected), static_cast<int>(checked), msg);
+}
+
+
+TEST_INLINE bool Test::assertEquals(char expected, unsigned char checked, const char* msg)
+{
+    return assertEquals(static_cast<int>(expected), static_cast<int>(checked), msg);
+}
+
+
+TEST_INLINE bool Test::assertEquals(unsigned char expected, char checked, const char* msg)
+{
+    return assertEquals(static_cast<int>(expected), static_cast<int>(checked), msg);
+}
+
+
+TEST_INLINE bool Test::assertEquals(char expected, char checked, const char* msg)
+{
+    return assertEquals(static_cast<int>(expected), static_cast<int>(checked), msg);
+}
+
+
+TEST_INLINE bool Test::assertEquals(float expected, float checked, float epsilon, const char* msg)
+{
+    return (std::abs(expected - checked) <= epsilon) || addAssertionFailure(toString(checked), " should be ", toString(expected), msg);
+}
+
+
+TEST_INLINE bool Test::assertNotEquals(unsigned char comparedTo, unsigned char checked, const char* msg)
+{
+    return assertNotEquals((int)comparedTo, (int)checked, msg);
+}
+
+
+TEST_INLINE bool Test::assertNotEquals(float comparedTo, float checked, float epsilon, const char* msg)
+{
+    return (std::abs(comparedTo - checked) > epsilon) || addAssertionFailure(toString(checked), " should NOT be ", toString(comparedTo), msg);
+}
+
+
+TEST_INLINE bool Test::assertBetween(float minVal, float maxVal, float checked, float epsilon, const char* msg)
+{
+    bool b = ((minVal < checked) || (std::abs(minVal - checked) <= epsilon)) &&
+        ((maxVal > checked) || (std::abs(maxVal - checked) <= epsilon));
+
+    return b || addRangeAssertionFailure(toString(minVal), toString(checked), toString(maxVal), msg);
+}
+
+
+TEST_INLINE bool Test::assertLess(unsigned char checked, unsigned char comparedTo, const char* msg)
+{
+    return assertLess((int)checked, (int)comparedTo, msg);
+}
+
+
+TEST_INLINE bool Test::assertLess(float checked, float comparedTo, const char* msg)
+{
+    // TODO: currently this is same as the template function, as for some reason we do not use any epsilon in this specialization,
+    // probably we can delete this specialization in the future ...
+    return (checked < comparedTo) || addAssertionFailure(toString(checked), " should be < ", toString(comparedTo), msg);
+}
+
+
+TEST_INLINE bool Test::assertLequals(unsigned char checked, unsigned char comparedTo, const char* msg)
+{
+    return assertLequals((int)checked, (int)comparedTo, msg);
+}
+
+
+TEST_INLINE bool Test::assertLequals(float checked, float comparedTo, float epsilon, const char* msg)
+{
+    return ((checked < comparedTo) || (std::abs(comparedTo - checked) <= epsilon)) || addAssertionFailure(toString(checked), " should be <= ", toString(comparedTo), msg);
+}
+
+
+TEST_INLINE bool Test::assertGreater(unsigned char checked, unsigned char comparedTo, const char* msg)
+{
+    return assertGreater((int)checked, (int)comparedTo, msg);
+}
+
+
+TEST_INLINE bool Test::assertGreater(float checked, float comparedTo, const char* msg)
+{
+    // TODO: currently this is same as the template function, as for some reason we do not use any epsilon in this specialization,
+    // probably we can delete this specialization in the future ...
+    return (checked > comparedTo) || addAssertionFailure(toString(checked), " should be > ", toString(comparedTo), msg);
+}
+
+
+TEST_INLINE bool Test::assertGequals(unsigned char checked, unsigned char comparedTo, const char* msg)
+{
+    return assertGequals((int)checked, (int)comparedTo, msg);
+}
+
+
+TEST_INLINE bool Test::assertGequals(float checked, float comparedTo, float epsilon, const char* msg)
+{
+    return ((checked > comparedTo) || (std::abs(comparedTo - checked) <= epsilon)) || addAssertionFailure(toString(checked), " should be >= ", toString(comparedTo), msg);
+}
+
+
+TEST_INLINE bool Test::assertNull(const void* checked, const char* msg)
+{
+    return msg == NULL ? assertTrue(checked == (void*)0, "pointer should be NULL") :
+        assertTrue(checked == (void*)0, std::string("pointer should be NULL, ").append(msg).c_str());
+}
+
+
+TEST_INLINE bool Test::assertNotNull(const void* checked, const char* msg)
+{
+    return msg == NULL ? assertTrue(checked != (void*)0, "pointer is NULL") :
+        assertTrue(checked != (void*)0, std::string("pointer is NULL, ").append(msg).c_str());
+}
+
+
+TEST_INLINE bool Test::run(const TestRunOptions& options)
+{
+    reset();
+    // subtests added by initialize() might be selected by their tags even if none of the already known parts is selected
+    const bool bSelectedBeforeInitialize = isSelected(options);
+    if (!bSelectedBeforeInitialize)
+    {
+        initialize();
+        if (!isSelected(options))
+        {
+            bTestSkipped = true;
+            nSkippedSubTests = static_cast<int>(tSubTests.size());
+            // initialize() is always paired with finalize(), which releases what it acquired
+            finalize();
+            return true;
+        }
+    }
+
+    bTestRan = true;
+    if (bSelectedBeforeInitialize)
+    {
+        initialize();
+    }
+    bool bSkipAllSubTests = false;
+    if (options.isSelected(tTags))
+    {
+        const auto timeStart = std::chrono::steady_clock::now();
+        preSetUp();
+        if (setUp())
+        {
+            if (!testMethod())
+            {
+                addToErrorMessages(std::string("  <").append(sTestFile).append("> failed!").c_str());
+            }
+        }
+        else
+        {
+            bSkipAllSubTests = true;
+            addToErrorMessages(std::string("  <").append(sTestFile).append("> setUp() failed!").c_str());
+        }
+        tearDown();
+        postTearDown();
+        checkFastTestDuration(tTags, sTestFile, std::chrono::steady_clock::now() - timeStart, options);
+    }
+
+    // subtests start
+    if (!bSkipAllSubTests)
+    {
+        bWeAreInSubTest = true;
+        for (size_t i = 0; i < tSubTests.size(); ++i)
+        {
+            iCurrentSubTest = i;
+            const std::vector<std::string> subTestTags = getSubTestTags(i);
+            if (!options.isSelected(subTestTags))
+            {
+                ++nSkippedSubTests;
+                continue;
+            }
+
+            const auto timeStart = std::chrono::steady_clock::now();
+            preSetUp();
+            if (setUp())
+            {
+                PFNUNITSUBTEST func = tSubTests[i].first;
+                if ((this->*func)())
+                    ++nSucceededSubTests;
+                else
+                    addToErrorMessages(std::string("  <").append(tSubTests[i].second).append("> failed!").c_str());
+            }
+            else
+            {
+                addToErrorMessages(std::string("  <").append(tSubTests[i].second).append("> SKIPPED due to setUp() failed!").c_str());
+            }
+            tearDown();
+            postTearDown();
+            checkFastTestDuration(subTestTags, tSubTests[i].second, std::chrono::steady_clock::now() - timeStart, options);
+        }
+        bWeAreInSubTest = false;
+    }
+    // subtests ended
+
+    finalize();
+    return isPassed();
+}
+
+
+TEST_INLINE const std::string& Test::getCurrentSubTestName() const
+{
+    assert(iCurrentSubTest < tSubTests.size());
+    return tSubTests[iCurrentSubTest].second;
+}
+
+
+TEST_INLINE void Test::addSubTest(const char* subTestName, PFNUNITSUBTEST subTestFunc)
+{
+    if (subTestFunc == nullptr)
+    {
+        return;
+    }
+
+    TUNITSUBTESTFUNCNAMEPAIR newPair(subTestFunc, std::string(subTestName));
+    tSubTests.push_back(newPair);
+    tSubTestTags.push_back(std::vector<std::string>());
+}
+
+
+TEST_INLINE void Test::addSubTest(const char* subTestName, PFNUNITSUBTEST subTestFunc, const std::vector<std::string>& subTestTags)
+{
+    if (subTestFunc == nullptr)
+    {
+        return;
+    }
+
+    addSubTest(subTestName, subTestFunc);
+    tSubTestTags.back() = subTestTags;
+}
+
+
+TEST_INLINE void Test::addTag(const std::string& tag)
+{
+    if (!tag.empty() && !hasTag(tag))
+    {
+        tTags.push_back(tag);
+    }
+}
+
+
+TEST_INLINE void Test::addExclusiveResource(const std::string& resource)
+{
+    if (!resource.empty() && !hasExclusiveResource(resource))
+    {
+        tExclusiveResources.push_back(resource);
+    }
+}
+
+
+TEST_INLINE std::string Test::toString(bool value)
+{
+    return value ? "TRUE" : "FALSE";
+}
+
+
+TEST_INLINE std::string Test::getFilename(const std::string& path)
+{
+    return path.substr(path.find_last_of('\\') + 1);
+}
+
+
+TEST_INLINE std::string Test::joinTags(const std::vector<std::string>& tags)
+{
+    std::string sTags;
+    for (const auto& tag : tags)
+    {
+        sTags.append(sTags.empty() ? "" : ",").append(tag);
+    }
+    return sTags.empty() ? "-" : sTags;
+}
+
+
+TEST_INLINE std::vector<std::string> Test::getSubTestTags(size_t iSubTest) const
+{
+    std::vector<std::string> tags = tTags;
+    for (const auto& tag : tSubTestTags[iSubTest])
+    {
+        if (std::find(tags.begin(), tags.end(), tag) == tags.end())
+        {
+            tags.push_back(tag);
+        }
+    }
+    return tags;
+}
+
+
+TEST_INLINE void Test::checkFastTestDuration(
+    const std::vector<std::string>& tags,
+    const std::string& name,
+    const std::chrono::steady_clock::duration& duration,
+    const TestRunOptions& options)
+{
+    if ((options.m_fastTestDurationLimit.count() == 0) ||
+        (std::find(tags.begin(), tags.end(), std::string(TAG_FAST)) == tags.end()) ||
+        (duration <= options.m_fastTestDurationLimit))
+    {
+        return;
+    }
+
+    addToInfoMessages(
+        (std::string("  WARNING: <").append(name).append("> is tagged fast but took ").append(
+            std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count())).append(" ms, limit is ").append(
+                std::to_string(options.m_fastTestDurationLimit.count())).append(" ms!")).c_str());
+}
+
+
+TEST_INLINE void Test::reset()
+{
+    bTestRan = false;
+    bTestSkipped = false;
+    sErrorMessages.clear();
+    sInfoMessages.clear();
+    iCurrentSubTest = 0;
+    bWeAreInSubTest = false;
+    nSucceededSubTests = 0;
+    nSkippedSubTests = 0;
+}
+
+
+TEST_INLINE bool Test::addAssertionFailure(const std::string& checked, const char* relation, const std::string& comparedTo, const char* msg)
+{
+    std::string sFailure(checked);
+    sFailure.append(relation).append(comparedTo);
+    if (msg == NULL)
+    {
+        sFailure.append("!");
+    }
+    else
+    {
+        sFailure.append(", ").append(msg);
+    }
+    return assertTrue(false, sFailure.c_str());
+}
+
+
+TEST_INLINE bool Test::addRangeAssertionFailure(const std::string& minVal, const std::string& checked, const std::string& maxVal, const char* msg)
+{
+    std::string sFailure("out of range: ");
+    sFailure.append(minVal).append(" <= ").append(checked).append(" <= ").append(maxVal);
+    if (msg == NULL)
+    {
+        sFailure.append(" !");
+    }
+    else
+    {
+        sFailure.append(", ").append(msg);
+    }
+    return assertTrue(false, sFailure.c_str());
+}
@@ -0,0 +1,596 @@
+#pragma once
+
+/*
+    ###################################################################################
+    TestModuleLoader.h
+    Basic header-only loader of tests from dynamically loaded shared libraries.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <atomic>    // requires cpp11
+#include <cstdio>    // std::remove()
+#include <cstdlib>   // std::strtoul()
+#include <fstream>
+#include <memory>    // for std::unique_ptr; requires cpp11
+#include <string>
+#include <vector>
+
+#include "Test.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#define TEST_MODULE_API __declspec(dllexport)
+#else
+#include <cerrno>
+#include <dirent.h>    // opendir(), readdir()
+#include <dlfcn.h>     // dlopen(), dlsym(), dlclose()
+#include <signal.h>    // kill()
+#include <sys/stat.h>  // stat()
+#include <unistd.h>    // getpid()
+#define TEST_MODULE_API __attribute__((visibility("default")))
+#endif
+
+/**
+    Defines the entry points of a test module: a shared library (DLL / .so) containing tests.
+    Put this into exactly one source file of the module, followed by the body of the function filling the given tests vector:
+
+        TEST_MODULE_CREATE_TESTS(tests)
+        {
+            tests.push_back(std::unique_ptr<Test>(new ColorTest));
+            tests.push_back(std::unique_ptr<Test>(new MaterialTest));
+        }
+
+    The module exports the framework version it was compiled with, and the loader refuses modules compiled with different version.
+*/
+#define TEST_MODULE_CREATE_TESTS(tests) \
+    extern "C" TEST_MODULE_API const char* TestModule_getFrameworkVersion() \
+    { \
+        return Test::frameworkVersion; \
+    } \
+    extern "C" TEST_MODULE_API void TestModule_createTests(std::vector<std::unique_ptr<Test>>* pTests); \
+    static void TestModule_createTestsImpl(std::vector<std::unique_ptr<Test>>& tests); \
+    void TestModule_createTests(std::vector<std::unique_ptr<Test>>* pTests) \
+    { \
+        TestModule_createTestsImpl(*pTests); \
+    } \
+    static void TestModule_createTestsImpl(std::vector<std::unique_ptr<Test>>& tests)
+
+
+/**
+    Loads tests from test modules at runtime, so changing a test requires relinking only its own module instead of a monolithic test executable.
+    Modules can be reloaded after rebuild without restarting the test runner process.
+
+    Example test runner:
+
+        TestModuleLoader loader;
+        loader.discoverModules("UnitTests");
+        loader.loadModules();
+        loader.runTests(getConsole(), "Running Unit Tests ...");
+        while (waitForUserInput())
+        {
+            if (loader.reloadChangedModules() > 0)
+            {
+                loader.runTests(getConsole(), "Running Unit Tests ...");
+            }
+        }
+
+    Since Test objects created in a module are used and destroyed by the runner and vice versa, the runner and the modules must be built by the
+    same compiler with the same framework version, and on Windows they must use the DLL version of the C runtime (/MD or /MDd), otherwise
+    memory allocated on one side would be freed on the other side with a different heap.
+    Also note that static data of header-only code, e.g. ScopeBenchmarkerDataStore, is separate per DLL on Windows.
+
+    Modules are not loaded directly from their original path but from a shadow copy, so they can be rebuilt while loaded
+    (on Windows a loaded DLL file cannot be overwritten, and on Linux dlopen() of the same path might return the still cached old library).
+    The shadow copy of e.g. "libx.so.1" is "libx.shadow-<process id>-<n>.so.1" next to it, removed at unloading. Stale copies of
+    processes not running anymore, e.g. crashed runners, are removed at loading, while copies of other running runners are kept.
+*/
+class TestModuleLoader
+{
+public:
+
+    TestModuleLoader() = default;
+
+    ~TestModuleLoader()
+    {
+        unloadModules();
+    }
+
+    TestModuleLoader(const TestModuleLoader&) = delete;
+    TestModuleLoader& operator=(const TestModuleLoader&) = delete;
+    TestModuleLoader(TestModuleLoader&&) = delete;
+    TestModuleLoader& operator=(TestModuleLoader&&) = delete;
+
+    /**
+        Registers the given shared library as test module. It is not loaded until loadModules() is called.
+    */
+    void addModule(const std::string& path)
+    {
+        for (const auto& module : m_modules)
+        {
+            if (module->m_sPath == path)
+            {
+                return;
+            }
+        }
+        std::unique_ptr<Module> module(new Module);
+        module->m_sPath = path;
+        m_modules.push_back(std::move(module));
+    }
+
+    /**
+        Registers every shared library (.dll on Windows, .so otherwise) found in the given directory as test module.
+        Subdirectories are not searched.
+
+        @param directory   The directory to be searched.
+        @param namePrefix  Only files with names starting with this prefix are registered.
+        @return Number of newly registered modules.
+    */
+    size_t discoverModules(const std::string& directory, const std::string& namePrefix = "")
+    {
+        const size_t nModulesBefore = m_modules.size();
+        const std::string sDir = (directory.empty() || (directory.back() == '/') || (directory.back() == '\\')) ? directory : directory + "/";
+#ifdef _WIN32
+        WIN32_FIND_DATAA findData;
+        const HANDLE hFind = FindFirstFileA((sDir + namePrefix + "*" + getModuleExtension()).c_str(), &findData);
+        if (hFind == INVALID_HANDLE_VALUE)
+        {
+            return 0;
+        }
+        do
+        {
+            if (((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) && isModuleFilename(findData.cFileName, namePrefix))
+            {
+                addModule(sDir + findData.cFileName);
+            }
+        } while (FindNextFileA(hFind, &findData));
+        FindClose(hFind);
+#else
+        DIR* const pDir = opendir(sDir.empty() ? "." : sDir.c_str());
+        if (pDir == nullptr)
+        {
+            return 0;
+        }
+        while (const dirent* const pEntry = readdir(pDir))
+        {
+            if (isModuleFilename(pEntry->d_name, namePrefix))
+            {
+                addModule(sDir + pEntry->d_name);
+            }
+        }
+        closedir(pDir);
+#endif
+        return m_modules.size() - nModulesBefore;
+    }
+
+    /**
+        Loads all registered but not yet loaded modules, and creates their tests.
+        Failures are collected into the error messages.
+
+        @return True if all modules are loaded, false otherwise.
+    */
+    bool loadModules()
+    {
+        bool bAllLoaded = true;
+        for (auto& module : m_modules)
+        {
+            if (!module->m_hLib)
+            {
+                bAllLoaded &= load(*module);
+            }
+        }
+        return bAllLoaded;
+    }
+
+    /**
+        Destroys all tests and unloads all modules. Modules stay registered.
+    */
+    void unloadModules()
+    {
+        for (auto& module : m_modules)
+        {
+            unload(*module);
+        }
+    }
+
+    /**
+        Reloads modules whose file has been modified since loading. Their tests are destroyed and recreated.
+        Failures are collected into the error messages.
+
+        @return Number of successfully reloaded modules.
+    */
+    size_t reloadChangedModules()
+    {
+        size_t nReloaded = 0;
+        for (auto& module : m_modules)
+        {
+            if (!module->m_hLib || (getModificationTime(module->m_sPath) == module->m_modificationTime))
+            {
+                continue;
+            }
+
+            unload(*module);
+            if (load(*module))
+            {
+                ++nReloaded;
+            }
+        }
+        return nReloaded;
+    }
+
+    /**
+        @return Number of registered modules.
+    */
+    size_t getModuleCount() const
+    {
+        return m_modules.size();
+    }
+
+    /**
+        @return Total number of tests created by the loaded modules.
+    */
+    size_t getTestCount() const
+    {
+        size_t nTests = 0;
+        for (const auto& module : m_modules)
+        {
+            nTests += module->m_tests.size();
+        }
+        return nTests;
+    }
+
+    /**
+        @return Errors occurred during loading modules.
+    */
+    const std::vector<std::string>& getErrorMessages() const
+    {
+        return m_errorMessages;
+    }
+
+    void clearErrorMessages()
+    {
+        m_errorMessages.clear();
+    }
+
+#ifdef TEST_WITH_CCONSOLE
+    /**
+        Runs the tests of all loaded modules using Test::runTests(), so results are summarized the same way as with statically linked tests.
+        Module loading errors are printed before running the tests.
+    */
+    void runTests(CConsole& console, const char* title = "", const TestRunOptions& options = TestRunOptions())
+    {
+        if (!m_errorMessages.empty())
+        {
+            console.EOn();
+            for (const auto& errorMsg : m_errorMessages)
+            {
+                console.OLn("%s", errorMsg.c_str());
+            }
+            console.EOff();
+        }
+
+        // tests are temporarily moved into a single vector, then given back to their owner modules
+        std::vector<std::unique_ptr<Test>> tests;
+        for (auto& module : m_modules)
+        {
+            for (auto& test : module->m_tests)
+            {
+                tests.push_back(std::move(test));
+            }
+        }
+
+        Test::runTests(tests, console, title, options);
+
+        size_t iTest = 0;
+        for (auto& module : m_modules)
+        {
+            for (auto& test : module->m_tests)
+            {
+                test = std::move(tests[iTest++]);
+            }
+        }
+    }
+#endif
+
+private:
+
+#ifdef _WIN32
+    typedef HMODULE LibHandle;
+#else
+    typedef void* LibHandle;
+#endif
+    typedef const char* (*PFNGETFRAMEWORKVERSION) ();
+    typedef void (*PFNCREATETESTS) (std::vector<std::unique_ptr<Test>>*);
+
+    struct Module
+    {
+        std::string m_sPath;                            /**< Path of the original module file. */
+        std::string m_sShadowPath;                      /**< Path of the copy we actually loaded. */
+        LibHandle m_hLib = nullptr;
+        long long m_modificationTime = 0;               /**< Modification time of the original module file at loading. */
+        std::vector<std::unique_ptr<Test>> m_tests;     /**< Tests created by the module, must be destroyed before unloading the module. */
+    };
+
+    std::vector<std::unique_ptr<Module>> m_modules;
+    std::vector<std::string> m_errorMessages;
+
+    /**
+        @return Unique number for shadow copy names within the process, also across loaders.
+    */
+    static unsigned int getNextShadowCopyIndex()
+    {
+        static std::atomic<unsigned int> s_nShadowCopies(0);
+        return ++s_nShadowCopies;
+    }
+
+    static unsigned long getCurrentProcessId()
+    {
+#ifdef _WIN32
+        return static_cast<unsigned long>(GetCurrentProcessId());
+#else
+        return static_cast<unsigned long>(getpid());
+#endif
+    }
+
+    /**
+        @return False only if the process with the given id surely does not run anymore.
+    */
+    static bool isProcessRunning(unsigned long processId)
+    {
+#ifdef _WIN32
+        const HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(processId));
+        if (!hProcess)
+        {
+            return GetLastError() != ERROR_INVALID_PARAMETER;
+        }
+        DWORD exitCode = 0;
+        const bool bRunning = !GetExitCodeProcess(hProcess, &exitCode) || (exitCode == STILL_ACTIVE);
+        CloseHandle(hProcess);
+        return bRunning;
+#else
+        return (kill(static_cast<pid_t>(processId), 0) == 0) || (errno != ESRCH);
+#endif
+    }
+
+    static const char* getModuleExtension()
+    {
+#ifdef _WIN32
+        return ".dll";
+#else
+        return ".so";
+#endif
+    }
+
+    static bool isModuleFilename(const std::string& filename, const std::string& namePrefix)
+    {
+        const std::string sExt = getModuleExtension();
+        return (filename.size() > sExt.size()) &&
+            (filename.compare(filename.size() - sExt.size(), sExt.size(), sExt) == 0) &&
+            (filename.compare(0, namePrefix.size(), namePrefix) == 0) &&
+            (filename.find(".shadow-") == std::string::npos);
+    }
+
+    static long long getModificationTime(const std::string& path)
+    {
+#ifdef _WIN32
+        WIN32_FILE_ATTRIBUTE_DATA fileData;
+        if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &fileData))
+        {
+            return 0;
+        }
+        return (static_cast<long long>(fileData.ftLastWriteTime.dwHighDateTime) << 32) | fileData.ftLastWriteTime.dwLowDateTime;
+#else
+        struct stat fileStat;
+        if (stat(path.c_str(), &fileStat) != 0)
+        {
+            return 0;
+        }
+        return static_cast<long long>(fileStat.st_mtim.tv_sec) * 1000000000LL + fileStat.st_mtim.tv_nsec;
+#endif
+    }
+
+    /**
+        Splits the given module path into the path without extension and the extension, e.g. "dir/libx.so.1" into "dir/libx" and ".so.1".
+        The extension is the platform module extension with any version suffix if present, otherwise whatever follows the last dot of the file name.
+    */
+    static void splitModulePath(const std::string& path, std::string& sStem, std::string& sExt)
+    {
+        const size_t iSeparator = path.find_last_of("/\\");
+        const size_t iName = (iSeparator == std::string::npos) ? 0 : iSeparator + 1;
+        const std::string sModuleExt = getModuleExtension();
+
+        size_t iExt = std::string::npos;
+        for (size_t iFound = path.rfind(sModuleExt); (iFound != std::string::npos) && (iFound > iName); iFound = path.rfind(sModuleExt, iFound - 1))
+        {
+            const size_t iAfter = iFound + sModuleExt.size();
+            if ((iAfter == path.size()) || (path[iAfter] == '.'))
+            {
+                iExt = iFound;
+                break;
+            }
+        }
+        if (iExt == std::string::npos)
+        {
+            iExt = path.find_last_of('.');
+            if ((iExt == std::string::npos) || (iExt <= iName))
+            {
+                iExt = path.size();
+            }
+        }
+
+        sStem = path.substr(0, iExt);
+        sExt = path.substr(iExt);
+    }
+
+    /**
+        Removes the shadow copies of the module with the given path without extension and extension, created by processes
+        not running anymore, see load(). Copies of this process are removed only by unload(), since they might be loaded
+        by another loader.
+    */
+    static void removeShadowCopies(const std::string& sStem, const std::string& sExt)
+    {
+        const size_t iSeparator = sStem.find_last_of("/\\");
+        const std::string sDir = (iSeparator == std::string::npos) ? "" : sStem.substr(0, iSeparator + 1);
+        const std::string sPrefix = sStem.substr(sDir.size()) + ".shadow-";
+        std::vector<std::string> shadowFilenames;
+#ifdef _WIN32
+        WIN32_FIND_DATAA findData;
+        const HANDLE hFind = FindFirstFileA((sDir + sPrefix + "*" + sExt).c_str(), &findData);
+        if (hFind == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+        do
+        {
+            shadowFilenames.push_back(findData.cFileName);
+        } while (FindNextFileA(hFind, &findData));
+        FindClose(hFind);
+#else
+        DIR* const pDir = opendir(sDir.empty() ? "." : sDir.c_str());
+        if (pDir == nullptr)
+        {
+            return;
+        }
+        while (const dirent* const pEntry = readdir(pDir))
+        {
+            shadowFilenames.push_back(pEntry->d_name);
+        }
+        closedir(pDir);
+#endif
+        for (const auto& filename : shadowFilenames)
+        {
+            // only "<stem>.shadow-<process id>-<number><ext>" is considered, not e.g. files of another module with a longer name
+            if ((filename.size() <= sPrefix.size() + sExt.size()) ||
+                (filename.compare(0, sPrefix.size(), sPrefix) != 0) ||
+                (filename.compare(filename.size() - sExt.size(), sExt.size(), sExt) != 0))
+            {
+                continue;
+            }
+            const std::string sIds = filename.substr(sPrefix.size(), filename.size() - sPrefix.size() - sExt.size());
+            const size_t iDash = sIds.find('-');
+            if ((iDash == 0) || (iDash == std::string::npos) || (iDash + 1 == sIds.size()) ||
+                (sIds.find_first_not_of("0123456789-") != std::string::npos) || (sIds.find('-', iDash + 1) != std::string::npos))
+            {
+                continue;
+            }
+            const unsigned long processId = std::strtoul(sIds.substr(0, iDash).c_str(), nullptr, 10);
+            if ((processId == getCurrentProcessId()) || isProcessRunning(processId))
+            {
+                continue;
+            }
+            std::remove((sDir + filename).c_str());
+        }
+    }
+
+    static bool copyFile(const std::string& from, const std::string& to)
+    {
+        std::ifstream fsFrom(from, std::ios::binary);
+        std::ofstream fsTo(to, std::ios::binary | std::ios::trunc);
+        if (!fsFrom || !fsTo)
+        {
+            return false;
+        }
+        fsTo << fsFrom.rdbuf();
+        return static_cast<bool>(fsTo);
+    }
+
+    static void* getSymbol(LibHandle hLib, const char* name)
+    {
+#ifdef _WIN32
+        return reinterpret_cast<void*>(GetProcAddress(hLib, name));
+#else
+        return dlsym(hLib, name);
+#endif
+    }
+
+    static void closeLib(LibHandle hLib)
+    {
+#ifdef _WIN32
+        FreeLibrary(hLib);
+#else
+        dlclose(hLib);
+#endif
+    }
+
+    bool load(Module& module)
+    {
+        module.m_modificationTime = getModificationTime(module.m_sPath);
+        std::string sStem;
+        std::string sExt;
+        splitModulePath(module.m_sPath, sStem, sExt);
+        // copies left behind by a runner that did not unload its modules, e.g. crashed
+        removeShadowCopies(sStem, sExt);
+        module.m_sShadowPath = sStem + ".shadow-" + std::to_string(getCurrentProcessId()) + "-" + std::to_string(getNextShadowCopyIndex()) + sExt;
+        if (!copyFile(module.m_sPath, module.m_sShadowPath))
+        {
+            m_errorMessages.push_back("Failed to create shadow copy of test module: " + module.m_sPath);
+            std::remove(module.m_sShadowPath.c_str());
+            return false;
+        }
+
+#ifdef _WIN32
+        module.m_hLib = LoadLibraryA(module.m_sShadowPath.c_str());
+        if (!module.m_hLib)
+        {
+            m_errorMessages.push_back("Failed to load test module: " + module.m_sPath + ", error code: " + std::to_string(GetLastError()));
+        }
+#else
+        module.m_hLib = dlopen(module.m_sShadowPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!module.m_hLib)
+        {
+            const char* const szError = dlerror();
+            m_errorMessages.push_back("Failed to load test module: " + module.m_sPath + ", error: " + (szError ? szError : "unknown"));
+        }
+#endif
+        if (!module.m_hLib)
+        {
+            std::remove(module.m_sShadowPath.c_str());
+            return false;
+        }
+
+        const PFNGETFRAMEWORKVERSION pfnGetFrameworkVersion =
+            reinterpret_cast<PFNGETFRAMEWORKVERSION>(getSymbol(module.m_hLib, "TestModule_getFrameworkVersion"));
+        const PFNCREATETESTS pfnCreateTests =
+            reinterpret_cast<PFNCREATETESTS>(getSymbol(module.m_hLib, "TestModule_createTests"));
+        if (!pfnGetFrameworkVersion || !pfnCreateTests)
+        {
+            m_errorMessages.push_back("Not a test module, TEST_MODULE_CREATE_TESTS() is missing: " + module.m_sPath);
+            unload(module);
+            return false;
+        }
+
+        if (std::string(pfnGetFrameworkVersion()) != Test::frameworkVersion)
+        {
+            m_errorMessages.push_back(
+                "Test module " + module.m_sPath + " is built with framework version " + pfnGetFrameworkVersion() +
+                " but the runner is built with version " + Test::frameworkVersion);
+            unload(module);
+            return false;
+        }
+
+        pfnCreateTests(&module.m_tests);
+        return true;
+    }
+
+    void unload(Module& module)
+    {
+        // code of the tests, including their dtors, is in the module, so they must be destroyed first
+        module.m_tests.clear();
+        if (module.m_hLib)
+        {
+            closeLib(module.m_hLib);
+            module.m_hLib = nullptr;
+        }
+        if (!module.m_sShadowPath.empty())
+        {
+            std::remove(module.m_sShadowPath.c_str());
+            module.m_sShadowPath.clear();
+        }
+    }
+
+}; // class TestModuleLoader
@@ -0,0 +1,143 @@
+#pragma once
+
+/*
+    ###################################################################################
+    TestScheduler.h
+    Implementation of Test::runTestsConcurrently(), running tests on multiple threads for Test::runTests().
+    Included by TestImpl.h only if TEST_WITH_CCONSOLE is defined, so only the file running the tests includes the
+    threading headers, or compiled once in Test.cpp if TEST_SEPARATE_COMPILATION is defined.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <algorithm>           // std::find(), std::all_of()
+#include <condition_variable>  // requires cpp11
+#include <exception>           // std::exception_ptr
+#include <mutex>               // requires cpp11
+#include <thread>              // requires cpp11
+
+#include "Test.h"
+
+TEST_INLINE void Test::runTestsConcurrently(std::vector<std::unique_ptr<Test>>& tests, CConsole& console, const TestRunOptions& options, size_t nJobs)
+{
+    console.OLn("Running up to %d tests concurrently ...", nJobs);
+
+    // all tests are scheduled, since a test not selected yet might add selected subtests in its initialize(), see Test::run();
+    // skipped tests are counted in the summary
+    std::vector<size_t> pendingTests;
+    for (size_t i = 0; i < tests.size(); ++i)
+    {
+        pendingTests.push_back(i);
+    }
+
+    std::mutex mutex;
+    std::condition_variable cvTestFinished;
+    std::vector<std::string> heldResources;   // exclusive resources of the running tests
+    size_t nRunningTests = 0;
+    std::vector<std::thread> threads;
+    threads.reserve(tests.size());            // so only creating the thread itself can throw in emplace_back()
+    std::exception_ptr pFirstException;       // first exception escaping a test, rethrown after all threads finished
+    size_t iFirstExceptionTest = 0;
+    bool bStartFailed = false;                // pFirstException is from starting a thread, not from a test
+
+    const auto isResourceFree = [&heldResources](const std::string& resource)
+    {
+        return std::find(heldResources.begin(), heldResources.end(), resource) == heldResources.end();
+    };
+
+    std::unique_lock<std::mutex> lock(mutex);
+    // same as a sequential run, no more tests are started once a test threw
+    while (!pendingTests.empty() && !pFirstException)
+    {
+        bool bStartedAny = false;
+        for (auto it = pendingTests.begin(); (it != pendingTests.end()) && (nRunningTests < nJobs) && isResourceFree(RESOURCE_MACHINE); )
+        {
+            Test& test = *tests[*it];
+            const bool bMachine = test.hasExclusiveResource(RESOURCE_MACHINE);
+            if (bMachine && (nRunningTests > 0))
+            {
+                // barrier: later tests must not start before this one, otherwise it could wait forever
+                break;
+            }
+            if (!std::all_of(test.tExclusiveResources.begin(), test.tExclusiveResources.end(), isResourceFree))
+            {
+                ++it;
+                continue;
+            }
+
+            console.OLn("Running test %d / %d ... ", *it + 1, tests.size());
+            heldResources.insert(heldResources.end(), test.tExclusiveResources.begin(), test.tExclusiveResources.end());
+            ++nRunningTests;
+            bStartedAny = true;
+            try
+            {
+                threads.emplace_back([&test, &options, &mutex, &cvTestFinished, &heldResources, &nRunningTests,
+                    &pFirstException, &iFirstExceptionTest, iTest = *it]()
+                    {
+                        std::exception_ptr pException;
+                        ExclusiveResources::setHeldByThread(&test.tExclusiveResources);
+                        try
+                        {
+                            test.run(options);
+                        }
+                        catch (...)
+                        {
+                            pException = std::current_exception();
+                        }
+                        ExclusiveResources::setHeldByThread(nullptr);
+
+                        std::lock_guard<std::mutex> finishLock(mutex);
+                        if (pException && !pFirstException)
+                        {
+                            pFirstException = pException;
+                            iFirstExceptionTest = iTest;
+                        }
+                        for (const auto& resource : test.tExclusiveResources)
+                        {
+                            heldResources.erase(std::find(heldResources.begin(), heldResources.end(), resource));
+                        }
+                        --nRunningTests;
+                        cvTestFinished.notify_all();
+                    });
+            }
+            catch (...)
+            {
+                // the started threads are still joined below, and the exception is rethrown only after them
+                for (const auto& resource : test.tExclusiveResources)
+                {
+                    heldResources.erase(std::find(heldResources.begin(), heldResources.end(), resource));
+                }
+                --nRunningTests;
+                if (!pFirstException)
+                {
+                    pFirstException = std::current_exception();
+                    iFirstExceptionTest = *it;
+                    bStartFailed = true;
+                }
+                break;
+            }
+            it = pendingTests.erase(it);
+        }
+
+        if (!bStartedAny)
+        {
+            cvTestFinished.wait(lock);
+        }
+    }
+    lock.unlock();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    if (pFirstException)
+    {
+        console.EOn();
+        console.OLn(bStartFailed ? "Failed to start a thread for test %d / %d!" : "Test %d / %d threw an exception!", iFirstExceptionTest + 1, tests.size());
+        console.EOff();
+        std::rethrow_exception(pFirstException);
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+    ###################################################################################
+    TestToString.h
+    Implementation of Test::toString() template used by the assertion templates for building failure messages.
+    Included by Test.h in header-only mode. If TEST_SEPARATE_COMPILATION is defined, include it only in test files
+    asserting values of types not explicitly instantiated in Test.cpp.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+#include <sstream>
+
+#include "Test.h"
+
+template <class T>
+std::string Test::toString(const T& value)
+{
+    std::stringstream str;
+    str << value;
+    return str.str();
+}
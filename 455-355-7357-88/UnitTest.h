@@ -10,6 +10,11 @@
     ###################################################################################
 */
 
+#include <chrono>   // requires cpp11
+#include <cmath>
+#include <cstdio>   // snprintf()
+#include <vector>
+
 #include "Test.h"
 
 /**
@@ -92,6 +97,13 @@
     - a unit-subtest should return true on pass and false on fail;
     - it is ok to use multiple assertions in a single subtest but using the optional message parameters of the assertion methods is highly recommended.
 
+    Tests and subtests can be tagged, e.g. with TAG_SLOW if they touch filesystem or network: use addTag() in the ctor for the whole test,
+    or the tags parameter of addSubTest() for a subtest. The TestRunOptions passed to run() or runTests() then select which ones to run.
+    Tests using a shared resource, e.g. a fixed network port or temp directory, should declare it by addExclusiveResource() in the ctor,
+    so runTests() does not run them concurrently when TestRunOptions::m_nJobs allows running tests in parallel.
+    Tests installing a Clock (e.g. by ClockInstaller) or using ScopeBenchmarker should declare RESOURCE_CLOCK or RESOURCE_BENCHMARKERS,
+    since those are process-wide: without them, a concurrently run test throws when installing the clock or looking up a benchmarker.
+
 
     Example unit test class:
 
@@ -142,4 +154,137 @@ public:
         Test(testFile, testName)
     {} 
 
+    /**
+        Adds an error message if the fast callable is not faster than the slow callable by at least the given factor,
+        with 95% confidence. Useful for guaranteeing e.g. "the cached path is at least 5x faster than the uncached one"
+        without a full benchmark.
+
+        Each callable is first calibrated: its batch size is doubled until a batch takes at least SpeedBatchDurationNs,
+        so even very short callables are measured well above clock resolution. Then SpeedRounds rounds are run, each
+        measuring a batch of both callables, alternating which one goes first, so drifts like CPU frequency changes affect
+        both equally. The speedup of a round is the ratio of the per-call durations of the 2 batches.
+        The assertion passes only if the lower bound of the 95% confidence interval of the geometric mean of the round
+        speedups is above minSpeedup. On failure, the measured speedup and its confidence interval are in the message.
+
+        Real time is measured by std::chrono::steady_clock, not Clock, so an installed VirtualClock does not affect it.
+        Runs for at least 2 * (SpeedRounds + 1) * SpeedBatchDurationNs, longer if a single call is slower than that.
+
+        @param fast        Callable expected to be faster, with signature: void fast().
+        @param slow        Callable expected to be slower, with signature: void slow().
+        @param minSpeedup  Minimum ratio of the per-call duration of slow to the per-call duration of fast.
+        @param msg         Optional error message.
+
+        @return            True if fast is faster than slow by more than minSpeedup with 95% confidence.
+    */
+    template <class FastFunc, class SlowFunc>
+    bool assertFasterBy(FastFunc&& fast, SlowFunc&& slow, double minSpeedup, const char* msg = NULL)
+    {
+        const size_t nFastBatchSize = calibrateBatchSize(fast);
+        const size_t nSlowBatchSize = calibrateBatchSize(slow);
+
+        // speedups are ratios, so their logarithms are averaged, giving the geometric mean and a symmetric interval around it
+        std::vector<double> logSpeedups;
+        logSpeedups.reserve(SpeedRounds);
+        for (size_t iRound = 0; iRound < SpeedRounds; ++iRound)
+        {
+            double fFastNs;
+            double fSlowNs;
+            if (iRound % 2 == 0)
+            {
+                fFastNs = measureBatch(fast, nFastBatchSize);
+                fSlowNs = measureBatch(slow, nSlowBatchSize);
+            }
+            else
+            {
+                fSlowNs = measureBatch(slow, nSlowBatchSize);
+                fFastNs = measureBatch(fast, nFastBatchSize);
+            }
+            logSpeedups.push_back(std::log(fSlowNs / fFastNs));
+        }
+
+        double fMean = 0.0;
+        for (const double fLogSpeedup : logSpeedups)
+        {
+            fMean += fLogSpeedup;
+        }
+        fMean /= logSpeedups.size();
+
+        double fVariance = 0.0;
+        for (const double fLogSpeedup : logSpeedups)
+        {
+            fVariance += (fLogSpeedup - fMean) * (fLogSpeedup - fMean);
+        }
+        fVariance /= (logSpeedups.size() - 1);
+
+        const double fMargin = getStudentT975(logSpeedups.size() - 1) * std::sqrt(fVariance / logSpeedups.size());
+        const double fLower = std::exp(fMean - fMargin);
+        if (fLower > minSpeedup)
+        {
+            return true;
+        }
+
+        return addAssertionFailure(
+            "speedup " + formatSpeedup(std::exp(fMean)) + " (95% CI: " + formatSpeedup(fLower) + " - " + formatSpeedup(std::exp(fMean + fMargin)) + ")",
+            " should be > ",
+            formatSpeedup(minSpeedup),
+            msg);
+    }
+
+protected:
+
+    static constexpr size_t SpeedRounds = 30;                   /**< Number of measured rounds of assertFasterBy(). */
+    static constexpr long long SpeedBatchDurationNs = 1000000;  /**< Minimum duration of a measured batch of assertFasterBy(). */
+
+private:
+
+    /**
+        @return Per-call duration of running the given callable nBatchSize times, in nanoseconds, at least 1.
+    */
+    template <class Func>
+    static double measureBatch(Func& func, size_t nBatchSize)
+    {
+        const auto timeStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < nBatchSize; ++i)
+        {
+            func();
+        }
+        const long long nDurationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timeStart).count();
+        return (nDurationNs > 0 ? nDurationNs : 1) / static_cast<double>(nBatchSize);
+    }
+
+    /**
+        @return Number of calls of the given callable taking at least SpeedBatchDurationNs, also warming up the callable.
+    */
+    template <class Func>
+    static size_t calibrateBatchSize(Func& func)
+    {
+        size_t nBatchSize = 1;
+        while ((measureBatch(func, nBatchSize) * nBatchSize < SpeedBatchDurationNs) && (nBatchSize < (static_cast<size_t>(1) << 30)))
+        {
+            nBatchSize *= 2;
+        }
+        return nBatchSize;
+    }
+
+    /**
+        @return 97.5% quantile of Student's t-distribution with the given degrees of freedom, by Cornish-Fisher expansion
+                around the normal quantile, accurate within 0.1% above 4 degrees of freedom.
+    */
+    static double getStudentT975(size_t nDegreesOfFreedom)
+    {
+        const double z = 1.959964;
+        const double z3 = z * z * z;
+        const double z5 = z3 * z * z;
+        const double z7 = z5 * z * z;
+        const double v = static_cast<double>(nDegreesOfFreedom);
+        return z + (z3 + z) / (4 * v) + (5 * z5 + 16 * z3 + 3 * z) / (96 * v * v) + (3 * z7 + 19 * z5 + 17 * z3 - 15 * z) / (384 * v * v * v);
+    }
+
+    static std::string formatSpeedup(double fSpeedup)
+    {
+        char szSpeedup[32];
+        snprintf(szSpeedup, sizeof(szSpeedup), "%.2fx", fSpeedup);
+        return szSpeedup;
+    }
+
 }; // class UnitTest
@@ -0,0 +1,65 @@
+#pragma once
+
+/*
+    ###################################################################################
+    UsdtProbes.h
+    Optional USDT static probes of ScopeBenchmarker for external tracing tools.
+    Part of the 455-355-7357-88 (ASS-ESS-TEST-88) test framework.
+    Made by PR00F88
+    2024
+    ###################################################################################
+*/
+
+/*
+    If SCOPEBENCHMARKER_USDT is defined on Linux, ScopeBenchmarker fires the following USDT (user statically-defined
+    tracing) probes of provider ass88, which can be traced by bpftrace, perf, SystemTap, etc.:
+     - scope_enter(nameHash, name): arg0 is the name hash (PFL::StringHash), arg1 is the name (const char*);
+     - scope_exit(nameHash, name, durationNs): same as above, arg2 is the duration of the scope in nanoseconds.
+    Requires <sys/sdt.h> (e.g. systemtap-sdt-dev or systemtap-sdt-devel package), no library is needed.
+
+    The probes use semaphores: the arguments are evaluated only if a tracer is attached to the probe, otherwise the
+    cost is a load and a not taken branch, and the probe itself is a nop instruction.
+
+    Example:
+        bpftrace -e 'usdt:./app:ass88:scope_exit { @[str(arg1)] = hist(arg2); }'
+
+    Without SCOPEBENCHMARKER_USDT the macros below expand to nothing.
+*/
+
+#if defined(SCOPEBENCHMARKER_USDT) && defined(__linux__)
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+// Semaphores are incremented by the tracer when attaching to the probe. Weak definitions so they can be defined in
+// this header included by multiple translation units, and the linker keeps only 1 of each.
+extern "C"
+{
+    __attribute__((weak, used, section(".probes"))) volatile unsigned short ass88_scope_enter_semaphore = 0;
+    __attribute__((weak, used, section(".probes"))) volatile unsigned short ass88_scope_exit_semaphore = 0;
+}
+
+#define SCOPEBENCHMARKER_PROBE_ENTER(nameHash, szName) \
+    do \
+    { \
+        if (__builtin_expect(ass88_scope_enter_semaphore != 0, 0)) \
+        { \
+            STAP_PROBE2(ass88, scope_enter, (nameHash), (szName)); \
+        } \
+    } while (0)
+
+#define SCOPEBENCHMARKER_PROBE_EXIT(nameHash, szName, durationNs) \
+    do \
+    { \
+        if (__builtin_expect(ass88_scope_exit_semaphore != 0, 0)) \
+        { \
+            STAP_PROBE3(ass88, scope_exit, (nameHash), (szName), (durationNs)); \
+        } \
+    } while (0)
+
+#else
+
+#define SCOPEBENCHMARKER_PROBE_ENTER(nameHash, szName) do { } while (0)
+#define SCOPEBENCHMARKER_PROBE_EXIT(nameHash, szName, durationNs) do { } while (0)
+
+#endif // SCOPEBENCHMARKER_USDT && __linux__